@@ -14,7 +14,7 @@
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
 //#include <opencv2/ximgproc/slic.hpp>
-#include <map>
+#include <vector>
 using namespace cv;
 
 // main - Generates superpixels for an images using SLIC and displays those superpixels on the image.
@@ -37,6 +37,8 @@ int main(int argc, char* argv[])
 	chdir("../../");
 
 	std::vector<Mat> database_images(input_count);
+	std::vector<Mat> database_labels(input_count);
+	std::vector<int> database_superpixel_counts(input_count);
 	std::string ext = ".jpg";
 	std::string base = "input";
 	const int min_superpixel_size_percent = 4;
@@ -66,22 +68,8 @@ int main(int argc, char* argv[])
 		slic->duperizeWithAverage(25.0f);
 
 		// Gets 2D array of the superpixel each pixel is a part of
-		Mat labels;
-		slic->getLabels(labels);
-		int superpixel_count = slic->getNumberOfSuperpixels();
-
-		// Counts how many pixels are in each superpixel
-		unsigned long* pixel_count = (unsigned long*) calloc(superpixel_count, sizeof(unsigned long));
-		for (int row = 0; row < labels.rows; row += 1)
-		{
-			for (int col = 0; col < labels.cols; col += 1)
-			{
-				pixel_count[labels.at<int>(row, col)] += 1;
-			}
-		}
-
-		// hash superpixels in table
-		hash_table.Hash(database_images[i], labels, superpixel_count, pixel_count);
+		slic->getLabels(database_labels[i]);
+		database_superpixel_counts[i] = slic->getNumberOfSuperpixels();
 
 		// Prints out the pixel count of each superpixel
 		// for (int i = 0; i < superpixel_count; i += 1)
@@ -114,6 +102,11 @@ int main(int argc, char* argv[])
 		// // Write output to an image file
 		// imwrite("output.png", output);
 	}
+	// hash the superpixels of every image in parallel, tagged with the index of their image,
+	// then lay them out bucket by bucket
+	hash_table.HashAll(database_images, database_labels, database_superpixel_counts);
+	hash_table.build();
+
 	std::string qbase = "query";
 	int q_count = 8;
 
@@ -133,69 +126,16 @@ int main(int argc, char* argv[])
 		query_slic->getLabels(query_labels);
 		int query_superpixel_count = query_slic->getNumberOfSuperpixels();
 
-		// count pixels in each query superpixel
-		unsigned long* query_pixel_count = (unsigned long*) calloc(query_superpixel_count, sizeof(unsigned long));
-		for (int row = 0; row < query_labels.rows; row += 1) {
-			for (int col = 0; col < query_labels.cols; col += 1) {
-				query_pixel_count[query_labels.at<int>(row, col)] += 1;
-			}
-		}
-
-		// build HashKey structs for query superpixels
-		HashKey *query_superpixels = (HashKey*) calloc(query_superpixel_count, sizeof(HashKey));
-		for (int row = 0; row < query_labels.rows; row++) {
-			for (int col = 0; col < query_labels.cols; col++) {
-				cv::Vec3b lab_pixel = query_image.at<cv::Vec3b>(row, col); // using BGR as LAB
-				int sp = query_labels.at<int>(row, col);
-				HashKey &curr = query_superpixels[sp];
-
-				// add to total color values
-				curr.l_tot += lab_pixel[0];
-				curr.a_tot += lab_pixel[1];
-				curr.b_tot += lab_pixel[2];
-
-				// set initial params
-				if (curr.pixel_count == 0) {
-					curr.x_range.first = col;
-					curr.x_range.second = col;
-					curr.y_range.first = row;
-					curr.y_range.second = row;
-					curr.original_image = &query_image;
-				// update spatial extent
-				} else {
-					if (curr.x_range.first > col) curr.x_range.first = col;
-					if (curr.x_range.second < col) curr.x_range.second = col;
-					if (curr.y_range.first > row) curr.y_range.first = row;
-					if (curr.y_range.second < row) curr.y_range.second = row;
-				}
-				curr.pixel_count += 1;
-			}
-		}
-
-		// find matches by counting hash collisions
-		std::map<const cv::Mat*, int> match_counts;
-		for (int i = 0; i < query_superpixel_count; i++) {
-			int query_key = hash_table.calculate_hash_key(query_superpixels[i]);
-			if (query_key == -1) continue;
-
-			// check if this hash key exists in the table
-			if (hash_table.hashTable.count(query_key)) {
-				// if so, iterate all superpixels that share this key
-				std::vector<HashKey>& matches = hash_table.hashTable[query_key];
-				for (const HashKey& match : matches) {
-					// increment the count for the image this superpixel belongs to
-					match_counts[match.original_image]++;
-				}
-			}
-		}
+		// count hash collisions per database image, probing neighboring buckets too (using BGR as LAB)
+		std::vector<int> match_counts = hash_table.Query(query_image, query_labels, query_superpixel_count);
 
 		// find the image with the highest match count
-		const cv::Mat* best_match_image_ptr = nullptr;
+		int best_match = -1;
 		int max_matches = 0;
-		for (auto const& pair : match_counts) {
-			if (pair.second > max_matches) {
-				max_matches = pair.second;
-				best_match_image_ptr = pair.first;
+		for (int id = 0; id < (int)match_counts.size(); id++) {
+			if (match_counts[id] > max_matches) {
+				max_matches = match_counts[id];
+				best_match = id;
 			}
 		}
 
@@ -203,17 +143,14 @@ int main(int argc, char* argv[])
 		namedWindow("Query Image");
 		imshow("Query Image", query_image);
 
-		if (best_match_image_ptr != nullptr) {
+		if (best_match != -1) {
 			namedWindow("Best Match");
-			imshow("Best Match", *best_match_image_ptr);
+			imshow("Best Match", database_images[best_match]);
 		} else {
 			std::cout << "No matches found." << std::endl;
 		}
 		
 		waitKey(0);
-
-		free(query_pixel_count);
-		free(query_superpixels);
 	}
 	waitKey(0);
 
@@ -4,22 +4,37 @@
 #define SLICHASHTABLE_HPP
 
 #include <opencv2/core/mat.hpp>
-#include <stdlib.h>
-#include <unordered_map>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
 
-/* a HashKey pointer will point to an array of size superpixel_count (+1 if labels start at 1), 
-in which HashKeys will occupy the indices of the superpixels they represent.
-Each pixel will be looped through and the respective HashKey structs of the superpixels they belong
-to will be dynamically updated.  */
+/* Running totals of one superpixel while its pixels are looped through. A vector of
+superpixel_count HashKeys holds one per superpixel, at the index of its label. */
 typedef struct {
     signed long l_tot, a_tot, b_tot;
     std::pair<int, int> x_range, y_range;
-    const cv::Mat *original_image;
     unsigned long pixel_count;
 } HashKey;
 
-/* Class containing an implementation of a hash map meant to hold copies of structs containing superpixel information 
-   Also contains method for hashing (all) superpixels in a an image and an internal method for calculating hash keys */
+/* What the table stores per superpixel: which image and superpixel it came from, its average
+color and its center. 16 bytes, so a bucket's entries are scanned straight through memory. */
+typedef struct {
+    int32_t image_id;
+    int32_t superpixel_id;
+    uint8_t l, a, b;
+    uint8_t reserved;
+    uint16_t x, y;
+} HashEntry;
+
+static_assert(sizeof(HashEntry) == 16, "HashEntry should stay 16 bytes");
+
+/* Class containing a hash table of superpixels from any number of images
+   Every possible hash key is a bucket of a flat array: the entries of bucket k are
+   entries[bucket_start[k] .. bucket_start[k + 1]). Hash() / HashAll() queue the superpixels of images
+   and build() counts them per bucket, then fills every bucket in place (previously built entries included). */
 class SLICHashTable {
     private:
         const int n = 5;
@@ -33,55 +48,75 @@ class SLICHashTable {
         const int x_bucket_size = max_img_w / x_buckets;
         const int y_bucket_size = max_img_h / y_buckets;
         int dims[5] = {lab_buckets, lab_buckets, lab_buckets, x_buckets, y_buckets};
+        const int bucket_count = lab_buckets * lab_buckets * lab_buckets * x_buckets * y_buckets;
 
-        
+        std::vector<uint32_t> bucket_start;
+        std::vector<HashEntry> entries;
+        // (hash key, entry) of superpixels not built in yet, in shards filled by different threads
+        std::vector<std::vector<std::pair<int, HashEntry>>> pending;
+        int image_count = 0;
 
-    public:
-        std::unordered_map<int, std::vector<HashKey>> hashTable;
-
-        int calculate_hash_key(const HashKey& key) {
-            if (key.pixel_count == 0) return -1;
-
-            // calaculate average color values
-            float l_avg = (float)key.l_tot / key.pixel_count;
-            float a_avg = (float)key.a_tot / key.pixel_count;
-            float b_avg = (float)key.b_tot / key.pixel_count;
-            float x_center = (key.x_range.first + key.x_range.second) / 2.0f;
-            float y_center = (key.y_range.first + key.y_range.second) / 2.0f;
-
-            // calculate color buckets
-            int l_bucket = (int)(l_avg / lab_bucket_size);
-            int a_bucket = (int)(a_avg / lab_bucket_size);
-            int b_bucket = (int)(b_avg / lab_bucket_size);
-            int x_bucket = (int)(x_center / x_bucket_size);
-            int y_bucket = (int)(y_center / y_bucket_size);
-
-            // calculate spatial buckets
-            l_bucket = std::max(0, std::min(l_bucket, dims[0] - 1));
-            a_bucket = std::max(0, std::min(a_bucket, dims[1] - 1));
-            b_bucket = std::max(0, std::min(b_bucket, dims[2] - 1));
-            x_bucket = std::max(0, std::min(x_bucket, dims[3] - 1));
-            y_bucket = std::max(0, std::min(y_bucket, dims[4] - 1));
-
-            // calculate hash key
-            int hash_key = l_bucket;
-            hash_key = hash_key * dims[1] + a_bucket;
-            hash_key = hash_key * dims[2] + b_bucket;
-            hash_key = hash_key * dims[3] + x_bucket;
-            hash_key = hash_key * dims[4] + y_bucket;
+        // bucket of every dimension (l, a, b, x, y), and where in its bucket the value falls (0 to 1)
+        bool bucket_coords(const HashKey& key, int coords[5], float offsets[5]) const {
+            if (key.pixel_count == 0) return false;
 
+            // calaculate average color values and center
+            float values[5] = {
+                (float)key.l_tot / key.pixel_count,
+                (float)key.a_tot / key.pixel_count,
+                (float)key.b_tot / key.pixel_count,
+                (key.x_range.first + key.x_range.second) / 2.0f,
+                (key.y_range.first + key.y_range.second) / 2.0f
+            };
+            float sizes[5] = {(float)lab_bucket_size, (float)lab_bucket_size, (float)lab_bucket_size,
+                              (float)x_bucket_size, (float)y_bucket_size};
+
+            for (int d = 0; d < n; d++) {
+                float scaled = values[d] / sizes[d];
+                coords[d] = std::max(0, std::min((int)scaled, dims[d] - 1));
+                offsets[d] = std::max(0.0f, std::min(scaled - coords[d], 1.0f));
+            }
+            return true;
+        }
+
+        int pack_key(const int coords[5]) const {
+            int hash_key = coords[0];
+            for (int d = 1; d < n; d++) {
+                hash_key = hash_key * dims[d] + coords[d];
+            }
             return hash_key;
         }
 
-        // called for hashing segmented images, and storing them in the instance of this class
+        // hashes one image's superpixels into a shard
+        void hash_into(std::vector<std::pair<int, HashEntry>>& shard, const cv::Mat& input_image,
+                       const cv::Mat& labels, int superpixel_count, int image_id) const {
+            std::vector<HashKey> superpixels = accumulate(input_image, labels, superpixel_count);
+            for (int sp = 0; sp < superpixel_count; sp++) {
+                int key = calculate_hash_key(superpixels[sp]);
+                if (key != -1) {
+                    shard.emplace_back(key, make_entry(superpixels[sp], image_id, sp));
+                }
+            }
+        }
+
+    public:
+        int calculate_hash_key(const HashKey& key) const {
+            int coords[5];
+            float offsets[5];
+            if (!bucket_coords(key, coords, offsets)) return -1;
+            return pack_key(coords);
+        }
+
+        // sums up the color and spatial extent of every superpixel of a segmented image
         // expects a cielab image for input_image
-        void Hash(const cv::Mat& input_image, const cv::Mat& labels, int superpixel_count, unsigned long* pixel_count) {
-            HashKey *superpixels = (HashKey*) calloc(superpixel_count, sizeof(HashKey));
+        static std::vector<HashKey> accumulate(const cv::Mat& input_image, const cv::Mat& labels, int superpixel_count) {
+            std::vector<HashKey> superpixels(superpixel_count, HashKey{});
             for (int row = 0; row < labels.rows; row++) {
+                const cv::Vec3b* lab_row = input_image.ptr<cv::Vec3b>(row);
+                const int* label_row = labels.ptr<int>(row);
                 for (int col = 0; col < labels.cols; col++) {
-                    cv::Vec3b lab_pixel = input_image.at<cv::Vec3b>(row, col);
-                    int sp = labels.at<int>(row, col);
-                    HashKey &curr = superpixels[sp];
+                    const cv::Vec3b& lab_pixel = lab_row[col];
+                    HashKey &curr = superpixels[label_row[col]];
 
                     // add to total color values to aid in calculating average color later
                     curr.l_tot += lab_pixel[0];
@@ -94,7 +129,6 @@ class SLICHashTable {
                         curr.x_range.second = col;
                         curr.y_range.first = row;
                         curr.y_range.second = row;
-                        curr.original_image = &input_image;
 
                     // update spatial extent of superpixel if broader sections are discovered
                     } else {
@@ -104,18 +138,145 @@ class SLICHashTable {
                         if (curr.y_range.second < row) curr.y_range.second = row;
                     }
                     curr.pixel_count += 1;
-                    // hash superpixel if all subpixels have been found
-                    if (curr.pixel_count == pixel_count[sp]) {
-                        int key = calculate_hash_key(curr);
-                        if (key != -1) {
-                            hashTable[key].push_back(curr);
-                        }
+                }
+            }
+            return superpixels;
+        }
+
+        static HashEntry make_entry(const HashKey& key, int image_id, int superpixel_id) {
+            HashEntry entry = {};
+            entry.image_id = image_id;
+            entry.superpixel_id = superpixel_id;
+            entry.l = (uint8_t)(key.l_tot / (long)key.pixel_count);
+            entry.a = (uint8_t)(key.a_tot / (long)key.pixel_count);
+            entry.b = (uint8_t)(key.b_tot / (long)key.pixel_count);
+            entry.x = (uint16_t)((key.x_range.first + key.x_range.second) / 2);
+            entry.y = (uint16_t)((key.y_range.first + key.y_range.second) / 2);
+            return entry;
+        }
+
+        // called for hashing segmented images; image_id is what query matches will report
+        // expects a cielab image for input_image. The superpixels are searchable after build().
+        void Hash(const cv::Mat& input_image, const cv::Mat& labels, int superpixel_count, int image_id) {
+            if (pending.empty()) pending.emplace_back();
+            hash_into(pending.back(), input_image, labels, superpixel_count, image_id);
+            image_count = std::max(image_count, image_id + 1);
+        }
+
+        // hashes many segmented images at once, image i getting image id i. Every thread fills its own
+        // shard, so nothing is shared until build() merges the shards. Searchable after build().
+        void HashAll(const std::vector<cv::Mat>& input_images, const std::vector<cv::Mat>& labels,
+                     const std::vector<int>& superpixel_counts, int thread_count = 0) {
+            int image_total = (int)input_images.size();
+            if (thread_count <= 0) thread_count = std::max(1, (int)std::thread::hardware_concurrency());
+            thread_count = std::max(1, std::min(thread_count, image_total));
+
+            std::vector<std::vector<std::pair<int, HashEntry>>> shards(thread_count);
+            std::atomic<int> next_image(0);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < thread_count; t++) {
+                threads.emplace_back([&, t]() {
+                    for (int i = next_image++; i < image_total; i = next_image++) {
+                        hash_into(shards[t], input_images[i], labels[i], superpixel_counts[i], i);
                     }
+                });
+            }
+            for (auto& thread : threads) thread.join();
+
+            for (auto& shard : shards) pending.push_back(std::move(shard));
+            image_count = std::max(image_count, image_total);
+        }
+
+        // counts the entries of every bucket, then moves each entry straight into its bucket's slice
+        void build() {
+            if (pending.empty()) return;
+
+            std::vector<uint32_t> start(bucket_count + 1, 0);
+            for (int key = 0; key < bucket_count && !bucket_start.empty(); key++) {
+                start[key + 1] += bucket_start[key + 1] - bucket_start[key];
+            }
+            for (const auto& shard : pending) {
+                for (const auto& p : shard) {
+                    start[p.first + 1]++;
                 }
             }
-            free(superpixels);
+            for (int key = 0; key < bucket_count; key++) {
+                start[key + 1] += start[key];
+            }
+
+            std::vector<HashEntry> filled(start[bucket_count]);
+            std::vector<uint32_t> next(start.begin(), start.end() - 1);
+            for (int key = 0; key < bucket_count && !bucket_start.empty(); key++) {
+                for (uint32_t i = bucket_start[key]; i < bucket_start[key + 1]; i++) {
+                    filled[next[key]++] = entries[i];
+                }
+            }
+            for (const auto& shard : pending) {
+                for (const auto& p : shard) {
+                    filled[next[p.first]++] = p.second;
+                }
+            }
+
+            bucket_start.swap(start);
+            entries.swap(filled);
+            pending.clear();
+            pending.shrink_to_fit();
         }
+
+        // votes of every database image for a segmented query image: each query superpixel votes once
+        // for every entry in its bucket and, where it sits within probe_margin (a fraction of a bucket)
+        // of a bucket edge in L, a, b, x or y, in the buckets across those edges too, so near misses
+        // still match. votes[image_id] is a dense counter array of get_image_count() images.
+        std::vector<int> Query(const cv::Mat& input_image, const cv::Mat& labels, int superpixel_count,
+                               float probe_margin = 0.25f) const {
+            std::vector<int> votes(image_count, 0);
+            std::vector<HashKey> superpixels = accumulate(input_image, labels, superpixel_count);
+            for (const HashKey& key : superpixels) {
+                int coords[5];
+                float offsets[5];
+                if (!bucket_coords(key, coords, offsets)) continue;
+
+                // per dimension the bucket itself, plus the neighbor across a nearby edge if there is one
+                int options[5][2];
+                int option_count[5];
+                for (int d = 0; d < n; d++) {
+                    options[d][0] = coords[d];
+                    option_count[d] = 1;
+                    if (offsets[d] < probe_margin && coords[d] > 0) {
+                        options[d][option_count[d]++] = coords[d] - 1;
+                    } else if (offsets[d] > 1.0f - probe_margin && coords[d] < dims[d] - 1) {
+                        options[d][option_count[d]++] = coords[d] + 1;
+                    }
+                }
+
+                // every combination of the options, at most 2^5 buckets
+                int pick[5] = {0, 0, 0, 0, 0};
+                while (true) {
+                    int probe[5];
+                    for (int d = 0; d < n; d++) probe[d] = options[d][pick[d]];
+                    auto matches = bucket(pack_key(probe));
+                    for (const HashEntry* match = matches.first; match != matches.second; match++) {
+                        votes[match->image_id]++;
+                    }
+
+                    int d = 0;
+                    while (d < n && ++pick[d] == option_count[d]) pick[d++] = 0;
+                    if (d == n) break;
+                }
+            }
+            return votes;
+        }
+
+        // entries sharing a hash key, as a contiguous [first, second) range
+        std::pair<const HashEntry*, const HashEntry*> bucket(int key) const {
+            if (key < 0 || key >= bucket_count || bucket_start.empty()) return {nullptr, nullptr};
+            return {entries.data() + bucket_start[key], entries.data() + bucket_start[key + 1]};
+        }
+
+        // one more than the largest image id hashed
+        int get_image_count() const { return image_count; }
+        size_t size() const { return entries.size(); }
 };
 
 
-#endif
\ No newline at end of file
+#endif
@@ -92,7 +92,6 @@ Below is the original OpenCV SLIC implementation header.
 #include <iostream>
 
 #include <set>
-#include <list>
 
 #include <vector>
 #include <map>
@@ -311,9 +310,7 @@ private:
 		const vector< set<int> >& superpixel_neighbors,
 		const vector< vector<float> >& superpixel_average_colors,
 		const vector<int>& superpixel_population,
-		std::list<SuperDuperPixel>& superduperpixels,
-		vector<SuperDuperPixel*>& superduperpixel_pointers,
-		vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators
+		SuperDuperPixelForest& superduperpixels
 	);
 
 	// Groups superpixels into super-duper-pixels based on their color histograms
@@ -324,18 +321,15 @@ private:
 		const vector< set<int> >& superpixel_neighbors,
 		const vector< vector< vector<float> >>& superpixel_color_histograms,
 		const vector<int>& superpixel_population,
-		std::list<SuperDuperPixel>& superduperpixels,
-		vector<SuperDuperPixel*>& superduperpixel_pointers,
-		vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators
+		SuperDuperPixelForest& superduperpixels
 	);
 
 	// Gets the color distance between 2 superpixels' average colors
 	inline float getColorDistance
 	(
-		const std::list<SuperDuperPixel>& superduperpixels,
-		const vector<SuperDuperPixel*>& superduperpixel_pointers,
+		SuperDuperPixelForest& superduperpixels,
 		const vector< vector<float> >& superpixel_average_colors, 
-		vector<float>& average_colors,
+		const vector<float>& average_colors,
 		const int superpixel,
 		const int neighbor
 	);
@@ -344,10 +338,9 @@ private:
 	inline float getColorDistance
 	(
 		const int num_buckets[],
-		const std::list<SuperDuperPixel>& superduperpixels,
-		const vector<SuperDuperPixel*>& superduperpixel_pointers,
+		SuperDuperPixelForest& superduperpixels,
 		const vector< vector< vector<float> >>& superpixel_color_histograms, 
-		vector< vector<float> >& color_histogram,
+		const vector<float>& color_histogram,
 		const int superpixel,
 		const int neighbor
 	);
@@ -360,21 +353,19 @@ private:
 		const int superpixel
 	);
 
-	// Gets a vector of the color histogram for a superpixel
+	// Gets a flattened vector of the color histogram for a superpixel
 	inline void extractColorHistogram
 	(
 		const int num_buckets[],
 		const vector< vector< vector<float> >>& superpixel_color_histograms,
-		vector< vector<float> >& color_histogram,
+		vector<float>& color_histogram,
 		const int superpixel
 	);
 
 	// Combines 2 superpixels into a super-duper-pixel using their average colors
 	inline void combineIntoSuperDuperPixel
 	(
-		std::list<SuperDuperPixel>& superduperpixels,
-		vector<SuperDuperPixel*>& superduperpixel_pointers,
-		vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators,
+		SuperDuperPixelForest& superduperpixels,
 		const vector< vector<float> >& superpixel_average_colors,
 		const vector<float>& average_colors,
 		const vector<int>& superpixel_population,
@@ -386,11 +377,9 @@ private:
 	inline void combineIntoSuperDuperPixel
 	(
 		const int num_buckets[],
-		std::list<SuperDuperPixel>& superduperpixels,
-		vector<SuperDuperPixel*>& superduperpixel_pointers,
-		vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators,
+		SuperDuperPixelForest& superduperpixels,
 		const vector< vector< vector<float> >>& superpixel_color_histograms,
-		const vector< vector<float> >& color_histogram,
+		const vector<float>& color_histogram,
 		const vector<int>& superpixel_population,
 		const int superpixel,
 		const int neighbor
@@ -399,7 +388,7 @@ private:
 	// Gives super-duper-pixels indexes to assign to pixels as labels for what superpixel they're in
 	inline int indexSuperduperpixels
 	(
-		const std::list<SuperDuperPixel>& superduperpixels,
+		SuperDuperPixelForest& superduperpixels,
 		vector<int>& superduperpixel_indexes
 	);
 
@@ -809,12 +798,8 @@ void SuperpixelSLICImpl::duperizeWithAverage(const float max_distance)
 	this->findSuperpixelNeighborsAndAverages(superpixel_neighbors, superpixel_average_colors, superpixel_population);
 
 	// Keep track of super-duper-pixels
-	// Use list to quickly add them to a data structure
-	// Use pointers to keep track of them to directly access them
-	// Use iterators to delete them from lists when they merge with another super-duper-pixel
-	std::list<SuperDuperPixel> superduperpixels;
-	vector<SuperDuperPixel*> superduperpixel_pointers;
-	vector<std::list<SuperDuperPixel>::iterator> superduperpixel_iterators;
+	// Disjoint-set forest over the superpixels, each tree in it is a super-duper-pixel
+	SuperDuperPixelForest superduperpixels(m_numlabels, m_nr_channels, AVERAGE);
 
 	// Group neighboring superpixels into super-duper-pixels if they're similar enough in color
 	this->groupSuperpixels
@@ -823,9 +808,7 @@ void SuperpixelSLICImpl::duperizeWithAverage(const float max_distance)
 		superpixel_neighbors,
 		superpixel_average_colors,
 		superpixel_population,
-		superduperpixels,
-		superduperpixel_pointers,
-		superduperpixel_iterators
+		superduperpixels
 	);
 
 	// Stores which super-duper-pixel each superpixel belong to
@@ -869,12 +852,12 @@ void SuperpixelSLICImpl::duperizeWithHistogram(const int num_buckets[], const fl
 	);
 
 	// Keep track of super-duper-pixels
-	// Use list to quickly add them to a data structure
-	// Use pointers to keep track of them to directly access them
-	// Use iterators to delete them from lists when they merge with another super-duper-pixel
-	std::list<SuperDuperPixel> superduperpixels;
-	vector<SuperDuperPixel*> superduperpixel_pointers;
-	vector<std::list<SuperDuperPixel>::iterator> superduperpixel_iterators;
+	// Disjoint-set forest over the superpixels, each tree in it is a super-duper-pixel
+	// Histograms of every color channel are stored one after another
+	int total_buckets = 0;
+	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
+		total_buckets += num_buckets[color_channel];
+	SuperDuperPixelForest superduperpixels(m_numlabels, total_buckets, HISTOGRAM);
 
 	// Group neighboring superpixels into super-duper-pixels if they're similar enough in color
 	this->groupSuperpixels
@@ -884,9 +867,7 @@ void SuperpixelSLICImpl::duperizeWithHistogram(const int num_buckets[], const fl
 		superpixel_neighbors,
 		superpixel_color_histograms,
 		superpixel_population,
-		superduperpixels,
-		superduperpixel_pointers,
-		superduperpixel_iterators
+		superduperpixels
 	);
 	
 	// Stores which super-duper-pixel each superpixel belong to
@@ -1147,31 +1128,26 @@ void SuperpixelSLICImpl::groupSuperpixels
 	const vector< set<int> >& superpixel_neighbors,
 	const vector< vector<float> >& superpixel_average_colors,
 	const vector<int>& superpixel_population,
-	std::list<SuperDuperPixel>& superduperpixels,
-	vector<SuperDuperPixel*>& superduperpixel_pointers,
-	vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators
+	SuperDuperPixelForest& superduperpixels
 )
 {
-	superduperpixel_pointers = vector<SuperDuperPixel*>(m_numlabels, NULL);
-	superduperpixel_iterators = vector<std::list<SuperDuperPixel>::iterator>(m_numlabels, superduperpixels.end());
+	vector<float> average_colors(m_nr_channels);
 	// Loop through each superpixel
 	// Group them together based on distances between average colors
 	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
 	{
-		vector<float> average_colors(m_nr_channels);
 		this->extractAverageColors(superpixel_average_colors, average_colors, superpixel);
 		// Loop through each neighbor of this superpixel
 		for (int neighbor: superpixel_neighbors[superpixel])
 		{
 			// Don't try to group together superpixels that are already grouped together
-			if (superduperpixel_pointers[neighbor] == superduperpixel_pointers[superpixel] && superduperpixel_pointers[neighbor] != NULL)
+			if (superduperpixels.same_group(neighbor, superpixel))
 			continue;
 
 			// Get color distance to neighbor
 			float neighbor_distance = this->getColorDistance
 			(
 				superduperpixels,
-				superduperpixel_pointers,
 				superpixel_average_colors,
 				average_colors,
 				superpixel,
@@ -1184,8 +1160,6 @@ void SuperpixelSLICImpl::groupSuperpixels
 				this->combineIntoSuperDuperPixel
 				(
 					superduperpixels,
-					superduperpixel_pointers,
-					superduperpixel_iterators,
 					superpixel_average_colors,
 					average_colors,
 					superpixel_population,
@@ -1195,12 +1169,8 @@ void SuperpixelSLICImpl::groupSuperpixels
 			}
 		}
 
-		if (superduperpixel_pointers[superpixel] == NULL)
-		{
-			superduperpixels.push_back(SuperDuperPixel(superpixel, average_colors, superpixel_population[superpixel]));
-			superduperpixel_pointers[superpixel] = &superduperpixels.back();
-			superduperpixel_iterators[superpixel] = --superduperpixels.end();
-		}
+		if (!superduperpixels.in_group(superpixel))
+			superduperpixels.create_group(superpixel, average_colors.data(), superpixel_population[superpixel]);
 	}
 }
 
@@ -1212,24 +1182,20 @@ void SuperpixelSLICImpl::groupSuperpixels
 	const vector< set<int> >& superpixel_neighbors,
 	const vector< vector< vector<float> >>& superpixel_color_histograms,
 	const vector<int>& superpixel_population,
-	std::list<SuperDuperPixel>& superduperpixels,
-	vector<SuperDuperPixel*>& superduperpixel_pointers,
-	vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators
+	SuperDuperPixelForest& superduperpixels
 )
 {
-	superduperpixel_pointers = vector<SuperDuperPixel*>(m_numlabels, NULL);
-	superduperpixel_iterators = vector<std::list<SuperDuperPixel>::iterator>(m_numlabels, superduperpixels.end());
+	vector<float> color_histogram(superduperpixels.get_num_values());
 	// Loop through each superpixel
-	// Group them together based on distances between average colors
+	// Group them together based on distances between color histograms
 	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
 	{
-		vector< vector<float> > color_histogram(m_nr_channels);
 		this->extractColorHistogram(num_buckets, superpixel_color_histograms, color_histogram, superpixel);
 		
 		for (int neighbor: superpixel_neighbors[superpixel])
 		{
 			// Don't try to group together superpixels that are already grouped together
-			if (superduperpixel_pointers[neighbor] == superduperpixel_pointers[superpixel] && superduperpixel_pointers[neighbor] != NULL)
+			if (superduperpixels.same_group(neighbor, superpixel))
 			continue;
 
 			// Get color distance to neighbor
@@ -1237,7 +1203,6 @@ void SuperpixelSLICImpl::groupSuperpixels
 			(
 				num_buckets,
 				superduperpixels,
-				superduperpixel_pointers,
 				superpixel_color_histograms,
 				color_histogram,
 				superpixel,
@@ -1251,8 +1216,6 @@ void SuperpixelSLICImpl::groupSuperpixels
 				(
 					num_buckets,
 					superduperpixels,
-					superduperpixel_pointers,
-					superduperpixel_iterators,
 					superpixel_color_histograms,
 					color_histogram,
 					superpixel_population,
@@ -1262,29 +1225,24 @@ void SuperpixelSLICImpl::groupSuperpixels
 			}
 		}
 
-		if (superduperpixel_pointers[superpixel] == NULL)
-		{
-			superduperpixels.push_back(SuperDuperPixel(superpixel, color_histogram, superpixel_population[superpixel]));
-			superduperpixel_pointers[superpixel] = &superduperpixels.back();
-			superduperpixel_iterators[superpixel] = --superduperpixels.end();
-		}
+		if (!superduperpixels.in_group(superpixel))
+			superduperpixels.create_group(superpixel, color_histogram.data(), superpixel_population[superpixel]);
 	}
 }
 
 // Gets the color distance between 2 superpixels' average colors
 float SuperpixelSLICImpl::getColorDistance
 (
-	const std::list<SuperDuperPixel>& superduperpixels,
-	const vector<SuperDuperPixel*>& superduperpixel_pointers,
+	SuperDuperPixelForest& superduperpixels,
 	const vector< vector<float> >& superpixel_average_colors,
-	vector<float>& average_colors,
+	const vector<float>& average_colors,
 	const int superpixel,
 	const int neighbor
 )
 {
 	// If the neighbor is already in a super-duper-pixel, use the distance to the whole super-duper-pixel it's in instead of just the neighbor
-	if (superduperpixel_pointers[neighbor] != NULL)
-		return (*superduperpixel_pointers[neighbor]).distance_from(average_colors);
+	if (superduperpixels.in_group(neighbor))
+		return superduperpixels.distance_from(neighbor, average_colors.data());
 
 	float neighbor_distance = 0;
 	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
@@ -1306,23 +1264,23 @@ float SuperpixelSLICImpl::getColorDistance
 float SuperpixelSLICImpl::getColorDistance
 (
 	const int num_buckets[],
-	const std::list<SuperDuperPixel>& superduperpixels,
-	const vector<SuperDuperPixel*>& superduperpixel_pointers,
+	SuperDuperPixelForest& superduperpixels,
 	const vector< vector< vector<float> >>& superpixel_color_histograms, 
-	vector< vector<float> >& color_histogram,
+	const vector<float>& color_histogram,
 	const int superpixel,
 	const int neighbor
 )
 {
 	// If the neighbor is already in a super-duper-pixel, use the distance to the whole super-duper-pixel it's in instead of just the neighbor
-	if (superduperpixel_pointers[neighbor] != NULL)
-		return (*superduperpixel_pointers[neighbor]).distance_from(color_histogram);
+	if (superduperpixels.in_group(neighbor))
+		return superduperpixels.distance_from(neighbor, color_histogram.data());
 
 	float neighbor_distance = 0;
+	int value = 0;
 	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
-	for (int bucket = 0; bucket < num_buckets[color_channel]; bucket += 1)
+	for (int bucket = 0; bucket < num_buckets[color_channel]; bucket += 1, value += 1)
 	{
-		float difference = superpixel_color_histograms[color_channel][bucket][superpixel] - superpixel_color_histograms[color_channel][bucket][neighbor];
+		float difference = color_histogram[value] - superpixel_color_histograms[color_channel][bucket][neighbor];
 		// opencv slic algorithm square diff before adding it to dist.
 		// neighbor_distance += difference * difference;
 		// Just take absolute value to do mahnattan distance instead.
@@ -1349,31 +1307,27 @@ void SuperpixelSLICImpl::extractAverageColors
 	}
 }
 
-// Gets a vector of the color histogram for a superpixel
+// Gets a flattened vector (each color channel's buckets one after another) of the color histogram for a superpixel
 void SuperpixelSLICImpl::extractColorHistogram
 (
 	const int num_buckets[],
 	const vector< vector< vector<float> >>& superpixel_color_histograms,
-	vector< vector<float> >& color_histogram,
+	vector<float>& color_histogram,
 	const int superpixel
 )
 {
+	int value = 0;
 	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
+	for (int bucket = 0; bucket < num_buckets[color_channel]; bucket += 1, value += 1)
 	{
-		color_histogram[color_channel] = vector<float>(num_buckets[color_channel]);
-		for (int bucket = 0; bucket < num_buckets[color_channel]; bucket += 1)
-		{
-			color_histogram[color_channel][bucket] = superpixel_color_histograms[color_channel][bucket][superpixel];
-		}
+		color_histogram[value] = superpixel_color_histograms[color_channel][bucket][superpixel];
 	}
 }
 
 // Combines 2 superpixels into a super-duper-pixel using their average colors
 void SuperpixelSLICImpl::combineIntoSuperDuperPixel
 (
-	std::list<SuperDuperPixel>& superduperpixels,
-	vector<SuperDuperPixel*>& superduperpixel_pointers,
-	vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators,
+	SuperDuperPixelForest& superduperpixels,
 	const vector< vector<float> >& superpixel_average_colors,
 	const vector<float>& average_colors,
 	const vector<int>& superpixel_population,
@@ -1382,47 +1336,34 @@ void SuperpixelSLICImpl::combineIntoSuperDuperPixel
 )
 {
 	// If the neighbor is not already in a super-duper-pixel
-	if (superduperpixel_pointers[neighbor] == NULL)
+	if (!superduperpixels.in_group(neighbor))
 	{
 		// If neither superpixels are in a super-duper-pixel
-		if (superduperpixel_pointers[superpixel] == NULL)
+		if (!superduperpixels.in_group(superpixel))
 		{
 			// Create a new super-duper-pixel with the current superpixel
-			superduperpixels.push_back(SuperDuperPixel(superpixel, average_colors, superpixel_population[superpixel]));
-			superduperpixel_pointers[superpixel] = &superduperpixels.back();
-			superduperpixel_iterators[superpixel] = --superduperpixels.end();
+			superduperpixels.create_group(superpixel, average_colors.data(), superpixel_population[superpixel]);
 		}
 		// Add the neighbor to the super-duper-pixel
 		vector<float> neighbor_average_colors(m_nr_channels);
 		this->extractAverageColors(superpixel_average_colors, neighbor_average_colors, neighbor);
-		superduperpixel_pointers[superpixel]->add_superpixel(neighbor, neighbor_average_colors, superpixel_population[neighbor]);
-		superduperpixel_pointers[neighbor] = superduperpixel_pointers[superpixel];
-		superduperpixel_iterators[neighbor] = superduperpixel_iterators[superpixel];
+		superduperpixels.add_superpixel(superpixel, neighbor, neighbor_average_colors.data(), superpixel_population[neighbor]);
 	}
 	// If the neighbor is already in a superpixel
 	else
 	{
 		// If this superpixel is not in a super-duper-pixel yet
-		if (superduperpixel_pointers[superpixel] == NULL)
+		if (!superduperpixels.in_group(superpixel))
 		{
 			// Add it to the neighbor's super-duper-pixel
-			superduperpixel_pointers[neighbor]->add_superpixel(superpixel, average_colors, superpixel_population[superpixel]);
-			superduperpixel_pointers[superpixel] = superduperpixel_pointers[neighbor];
-			superduperpixel_iterators[superpixel] = superduperpixel_iterators[neighbor];
+			superduperpixels.add_superpixel(neighbor, superpixel, average_colors.data(), superpixel_population[superpixel]);
 		}
 		// If this superpixel is also already in a super-duper-pixel
 		// And they're not in the same one
-		else if (superduperpixel_pointers[superpixel] != superduperpixel_pointers[neighbor])
+		else if (!superduperpixels.same_group(superpixel, neighbor))
 		{
-			// Merge the superpixels (move all the superpixels from A to B and delete A)
-			std::list<SuperDuperPixel>::iterator merging_superduperpixel = superduperpixel_iterators[neighbor];
-			(*superduperpixel_pointers[superpixel]) += superduperpixel_pointers[neighbor];
-			for (int connected_neighbor : superduperpixel_pointers[neighbor]->get_superpixels())
-			{
-				superduperpixel_pointers[connected_neighbor] = superduperpixel_pointers[superpixel];
-				superduperpixel_iterators[connected_neighbor] = superduperpixel_iterators[superpixel];
-			}
-			superduperpixels.erase(merging_superduperpixel);
+			// Merge the super-duper-pixels (this superpixel's super-duper-pixel keeps its place in the indexing)
+			superduperpixels.merge(superpixel, neighbor);
 		}
 	}
 }
@@ -1431,57 +1372,42 @@ void SuperpixelSLICImpl::combineIntoSuperDuperPixel
 void SuperpixelSLICImpl::combineIntoSuperDuperPixel
 (
 	const int num_buckets[],
-	std::list<SuperDuperPixel>& superduperpixels,
-	vector<SuperDuperPixel*>& superduperpixel_pointers,
-	vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators,
+	SuperDuperPixelForest& superduperpixels,
 	const vector< vector< vector<float> >>& superpixel_color_histograms,
-	const vector< vector<float> >& color_histogram,
+	const vector<float>& color_histogram,
 	const vector<int>& superpixel_population,
 	const int superpixel,
 	const int neighbor
 )
 {
 	// If the neighbor is not already in a super-duper-pixel
-	if (superduperpixel_pointers[neighbor] == NULL)
+	if (!superduperpixels.in_group(neighbor))
 	{
 		// If neither superpixels are in a super-duper-pixel
-		if (superduperpixel_pointers[superpixel] == NULL)
+		if (!superduperpixels.in_group(superpixel))
 		{
 			// Create a new super-duper-pixel with the current superpixel
-			superduperpixels.push_back(SuperDuperPixel(superpixel, color_histogram, superpixel_population[superpixel]));
-			superduperpixel_pointers[superpixel] = &superduperpixels.back();
-			superduperpixel_iterators[superpixel] = --superduperpixels.end();
+			superduperpixels.create_group(superpixel, color_histogram.data(), superpixel_population[superpixel]);
 		}
 		// Add the neighbor to the super-duper-pixel
-		vector< vector<float>> neighbor_color_histogram(m_nr_channels);
+		vector<float> neighbor_color_histogram(superduperpixels.get_num_values());
 		this->extractColorHistogram(num_buckets, superpixel_color_histograms, neighbor_color_histogram, neighbor);
-		superduperpixel_pointers[superpixel]->add_superpixel(neighbor, neighbor_color_histogram, superpixel_population[neighbor]);
-		superduperpixel_pointers[neighbor] = superduperpixel_pointers[superpixel];
-		superduperpixel_iterators[neighbor] = superduperpixel_iterators[superpixel];
+		superduperpixels.add_superpixel(superpixel, neighbor, neighbor_color_histogram.data(), superpixel_population[neighbor]);
 	}
 	// If the neighbor is already in a superpixel
 	else
 	{
 		// If this superpixel is not in a super-duper-pixel yet
-		if (superduperpixel_pointers[superpixel] == NULL)
+		if (!superduperpixels.in_group(superpixel))
 		{
-			superduperpixel_pointers[neighbor]->add_superpixel(superpixel, color_histogram, superpixel_population[superpixel]);
-			superduperpixel_pointers[superpixel] = superduperpixel_pointers[neighbor];
-			superduperpixel_iterators[superpixel] = superduperpixel_iterators[neighbor];
+			superduperpixels.add_superpixel(neighbor, superpixel, color_histogram.data(), superpixel_population[superpixel]);
 		}
 		// If this superpixel is also already in a super-duper-pixel
 		// And they're not in the same one
-		else if (superduperpixel_pointers[superpixel] != superduperpixel_pointers[neighbor])
+		else if (!superduperpixels.same_group(superpixel, neighbor))
 		{
-			// Merge the superpixels (move all the superpixels from A to B and delete A)
-			std::list<SuperDuperPixel>::iterator merging_superduperpixel = superduperpixel_iterators[neighbor];
-			(*superduperpixel_pointers[superpixel]) += superduperpixel_pointers[neighbor];
-			for (int connected_neighbor : superduperpixel_pointers[neighbor]->get_superpixels())
-			{
-				superduperpixel_pointers[connected_neighbor] = superduperpixel_pointers[superpixel];
-				superduperpixel_iterators[connected_neighbor] = superduperpixel_iterators[superpixel];
-			}
-			superduperpixels.erase(merging_superduperpixel);
+			// Merge the super-duper-pixels (this superpixel's super-duper-pixel keeps its place in the indexing)
+			superduperpixels.merge(superpixel, neighbor);
 		}
 	}
 }
@@ -1489,22 +1415,12 @@ void SuperpixelSLICImpl::combineIntoSuperDuperPixel
 // Gives super-duper-pixels indexes to assign to pixels as labels for what superpixel they're in
 int SuperpixelSLICImpl::indexSuperduperpixels
 (
-	const std::list<SuperDuperPixel>& superduperpixels,
+	SuperDuperPixelForest& superduperpixels,
 	vector<int>& superduperpixel_indexes
 )
 {
-	// Iterate through every super-duper-pixel and give them indexes starting at 0
-	superduperpixel_indexes = vector<int>(m_numlabels, -1);
-	int superduperpixel_count = 0;
-	for (SuperDuperPixel sdp : superduperpixels)
-	{
-		for (int superpixel : sdp.get_superpixels())
-		{
-			superduperpixel_indexes[superpixel] = superduperpixel_count;
-		}
-		superduperpixel_count += 1;
-	}
-	return superduperpixel_count;
+	// Super-duper-pixels are indexed starting at 0 in the order they were created
+	return superduperpixels.index(superduperpixel_indexes);
 }
 
 // Assigns new super-duper-pixel indexes to pixels in the image as labels for what superpixel they're in
@@ -1,6 +1,49 @@
 #include "SuperDuperPixel.hpp"
 #include <assert.h>
 #include <iostream>
+#include <cmath>
+#include <algorithm>
+
+float l1_distance(const float* a, const float* b, int n)
+{
+	float dist = 0;
+	for (int i = 0; i < n; i += 1)
+		dist += std::abs(a[i] - b[i]);
+	return dist;
+}
+
+void weighted_average(float* values, int pixel_count, const float* other_values, int other_pixel_count, int n)
+{
+	int new_pixel_count = pixel_count + other_pixel_count;
+	for (int i = 0; i < n; i += 1)
+	{
+		float this_sum = values[i] * pixel_count;
+		float other_sum = other_values[i] * other_pixel_count;
+		values[i] = (this_sum + other_sum) / new_pixel_count;
+	}
+}
+
+SuperDuperPixelKernels SuperDuperPixelKernels::select(int num_values)
+{
+	SuperDuperPixelKernels kernels;
+	switch (num_values)
+	{
+		// Lab averages (SLICHashTable)
+		case 3:
+			kernels.distance = fixed_l1_distance<3>;
+			kernels.average = fixed_weighted_average<3>;
+			break;
+		// Lab histograms with 8, 64 and 64 buckets (demo.cpp)
+		case 136:
+			kernels.distance = fixed_l1_distance<136>;
+			kernels.average = fixed_weighted_average<136>;
+			break;
+		default:
+			kernels.distance = l1_distance;
+			kernels.average = weighted_average;
+	}
+	return kernels;
+}
 
 SuperDuperPixel::SuperDuperPixel(int superpixel, std::vector<float> average, int pixel_count)
 {
@@ -138,3 +181,148 @@ void SuperDuperPixel::add_histogram_superduperpixels(const SuperDuperPixel* othe
 	}
 	this->pixel_count = new_pixel_count;
 }
+
+SuperDuperPixelForest::SuperDuperPixelForest(int num_superpixels, int num_values, SuperDuperPixelMode mode)
+{
+	this->num_values = num_values;
+	this->mode = mode;
+	this->kernels = SuperDuperPixelKernels::select(num_values);
+	this->parent = std::vector<int>(num_superpixels);
+	for (int superpixel = 0; superpixel < num_superpixels; superpixel += 1)
+	{
+		this->parent[superpixel] = superpixel;
+	}
+	this->tree_size = std::vector<int>(num_superpixels, 1);
+	this->group = std::vector<int>(num_superpixels, -1);
+	// There can never be more groups than superpixels, so this never reallocates while grouping
+	this->group_pixel_count.reserve(num_superpixels);
+	this->group_values.reserve((size_t) num_superpixels * num_values);
+}
+
+SuperDuperPixelMode SuperDuperPixelForest::get_mode() const { return this->mode; }
+int SuperDuperPixelForest::get_num_values() const { return this->num_values; }
+const SuperDuperPixelKernels& SuperDuperPixelForest::get_kernels() const { return this->kernels; }
+
+// Gets the root of the tree a superpixel is in
+int SuperDuperPixelForest::find(int superpixel)
+{
+	int root = superpixel;
+	while (this->parent[root] != root)
+		root = this->parent[root];
+	// Path compression
+	while (this->parent[superpixel] != root)
+	{
+		int next = this->parent[superpixel];
+		this->parent[superpixel] = root;
+		superpixel = next;
+	}
+	return root;
+}
+
+bool SuperDuperPixelForest::in_group(int superpixel) { return this->group[this->find(superpixel)] != -1; }
+bool SuperDuperPixelForest::same_group(int superpixel, int other) { return this->find(superpixel) == this->find(other); }
+
+// Gets the color values of the super-duper-pixel a superpixel is in
+const float* SuperDuperPixelForest::get_values(int superpixel)
+{
+	int group_index = this->group[this->find(superpixel)];
+	assert(group_index != -1);
+	return &this->group_values[(size_t) group_index * this->num_values];
+}
+
+float SuperDuperPixelForest::distance_from(int superpixel, const float* values)
+{
+	// Just use manhattan distance here (same as SuperDuperPixel::distance_from).
+	return this->kernels.distance(this->get_values(superpixel), values, this->num_values);
+}
+
+// Starts a new super-duper-pixel that only contains this superpixel
+void SuperDuperPixelForest::create_group(int superpixel, const float* values, int pixel_count)
+{
+	int root = this->find(superpixel);
+	assert(this->group[root] == -1);
+	this->group[root] = (int) this->group_pixel_count.size();
+	this->group_pixel_count.push_back(pixel_count);
+	this->group_values.insert(this->group_values.end(), values, values + this->num_values);
+}
+
+// Adds a superpixel that isn't in a super-duper-pixel yet to the super-duper-pixel of group_member
+void SuperDuperPixelForest::add_superpixel(int group_member, int superpixel, const float* values, int pixel_count)
+{
+	int root = this->find(group_member);
+	assert(this->group[root] != -1 && this->group[this->find(superpixel)] == -1);
+	this->add_values(this->group[root], values, pixel_count);
+	// superpixel is always a lone root here, so it's never the bigger tree
+	this->parent[superpixel] = root;
+	this->tree_size[root] += 1;
+}
+
+// Merges the super-duper-pixel of other into the super-duper-pixel of superpixel
+// The merged super-duper-pixel keeps the group (and so the final index) of superpixel's super-duper-pixel
+void SuperDuperPixelForest::merge(int superpixel, int other)
+{
+	int root = this->find(superpixel);
+	int other_root = this->find(other);
+	if (root == other_root)
+		return;
+	int group_index = this->group[root];
+	int other_group_index = this->group[other_root];
+	assert(group_index != -1 && other_group_index != -1);
+	switch (this->mode)
+	{
+		case AVERAGE:
+			this->add_values(group_index, &this->group_values[(size_t) other_group_index * this->num_values],
+				this->group_pixel_count[other_group_index]);
+			break;
+		case HISTOGRAM:
+			// SuperDuperPixel::add_histogram_superduperpixels() only adds up the pixel counts, keep doing the same
+			// so the output labels don't change
+			this->group_pixel_count[group_index] += this->group_pixel_count[other_group_index];
+			break;
+	}
+	// Union by size
+	if (this->tree_size[root] < this->tree_size[other_root])
+		std::swap(root, other_root);
+	this->parent[other_root] = root;
+	this->tree_size[root] += this->tree_size[other_root];
+	this->group[root] = group_index;
+	this->group[other_root] = -1;
+}
+
+// Gives every super-duper-pixel an index (in the order they were created) and returns how many there are
+int SuperDuperPixelForest::index(std::vector<int>& superduperpixel_indexes)
+{
+	int num_superpixels = (int) this->parent.size();
+	// Only groups that are still at a root survived merging
+	std::vector<int> group_indexes(this->group_pixel_count.size(), -1);
+	for (int superpixel = 0; superpixel < num_superpixels; superpixel += 1)
+	{
+		if (this->parent[superpixel] == superpixel && this->group[superpixel] != -1)
+			group_indexes[this->group[superpixel]] = 0;
+	}
+	int superduperpixel_count = 0;
+	for (int& group_index : group_indexes)
+	{
+		if (group_index != -1)
+		{
+			group_index = superduperpixel_count;
+			superduperpixel_count += 1;
+		}
+	}
+	superduperpixel_indexes = std::vector<int>(num_superpixels, -1);
+	for (int superpixel = 0; superpixel < num_superpixels; superpixel += 1)
+	{
+		int group_index = this->group[this->find(superpixel)];
+		if (group_index != -1)
+			superduperpixel_indexes[superpixel] = group_indexes[group_index];
+	}
+	return superduperpixel_count;
+}
+
+// Adds colors values to a group's color values, weighted by pixel count (same math as SuperDuperPixel::add_superpixel)
+void SuperDuperPixelForest::add_values(int group_index, const float* values, int pixel_count)
+{
+	float* this_values = &this->group_values[(size_t) group_index * this->num_values];
+	this->kernels.average(this_values, this->group_pixel_count[group_index], values, pixel_count, this->num_values);
+	this->group_pixel_count[group_index] += pixel_count;
+}
@@ -1,4 +1,5 @@
 #include <vector>
+#include <cmath>
 
 enum SuperDuperPixelMode
 {
@@ -6,6 +7,46 @@ enum SuperDuperPixelMode
 	HISTOGRAM = 1
 };
 
+// Manhattan distance between 2 rows of n color values
+float l1_distance(const float* a, const float* b, int n);
+
+// Adds other_values into values, weighted by pixel count: (values * pixel_count + other_values * other_pixel_count) / new_pixel_count
+void weighted_average(float* values, int pixel_count, const float* other_values, int other_pixel_count, int n);
+
+// l1_distance() for a number of floats known at compile time
+// Sums in the same order as l1_distance() so both give the exact same distance, but the loop gets fully unrolled
+template <int N>
+inline float fixed_l1_distance(const float* a, const float* b, int)
+{
+	float dist = 0;
+	for (int i = 0; i < N; i += 1)
+		dist += std::abs(a[i] - b[i]);
+	return dist;
+}
+
+// weighted_average() for a number of floats known at compile time
+template <int N>
+inline void fixed_weighted_average(float* values, int pixel_count, const float* other_values, int other_pixel_count, int)
+{
+	int new_pixel_count = pixel_count + other_pixel_count;
+	for (int i = 0; i < N; i += 1)
+	{
+		float this_sum = values[i] * pixel_count;
+		float other_sum = other_values[i] * other_pixel_count;
+		values[i] = (this_sum + other_sum) / new_pixel_count;
+	}
+}
+
+// Distance and merge routines for one size of color values
+// select() picks compile-time sized routines for the common sizes and the runtime sized ones for everything else
+struct SuperDuperPixelKernels
+{
+	float (*distance)(const float* a, const float* b, int n);
+	void (*average)(float* values, int pixel_count, const float* other_values, int other_pixel_count, int n);
+
+	static SuperDuperPixelKernels select(int num_values);
+};
+
 class SuperDuperPixel
 {
 public:
@@ -30,3 +71,41 @@ private:
 	void add_average_superduperpixels(const SuperDuperPixel* other);
 	void add_histogram_superduperpixels(const SuperDuperPixel* other);
 };
+
+// Disjoint-set forest (union by size with path compression) that groups superpixels into super-duper-pixels.
+// Each group's color values (average colors or a flattened color histogram) are kept in one contiguous buffer
+// so merging never has to copy lists of superpixels around.
+class SuperDuperPixelForest
+{
+public:
+	SuperDuperPixelForest(int num_superpixels, int num_values, SuperDuperPixelMode mode);
+	SuperDuperPixelMode get_mode() const;
+	int get_num_values() const;
+	const SuperDuperPixelKernels& get_kernels() const;
+	int find(int superpixel);
+	bool in_group(int superpixel);
+	bool same_group(int superpixel, int other);
+	const float* get_values(int superpixel);
+	float distance_from(int superpixel, const float* values);
+	void create_group(int superpixel, const float* values, int pixel_count);
+	void add_superpixel(int group_member, int superpixel, const float* values, int pixel_count);
+	void merge(int superpixel, int other);
+	int index(std::vector<int>& superduperpixel_indexes);
+private:
+	int num_values;
+	SuperDuperPixelMode mode;
+	// Distance and merge routines for num_values floats
+	SuperDuperPixelKernels kernels;
+	// Parent of each superpixel in the forest (roots are their own parent)
+	std::vector<int> parent;
+	// Number of superpixels in each tree (only valid for roots)
+	std::vector<int> tree_size;
+	// Group of each root in the order the groups were created (-1 means it's not in a super-duper-pixel yet)
+	std::vector<int> group;
+	// Number of pixels in each group
+	std::vector<int> group_pixel_count;
+	// Color values of each group, num_values floats per group
+	std::vector<float> group_values;
+
+	void add_values(int group_index, const float* values, int pixel_count);
+};
@@ -54,7 +54,9 @@
 
 #include "slic.hpp"
 #include <opencv2/imgproc.hpp>
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <stdexcept>
 #include <iostream>
@@ -64,8 +66,12 @@ namespace sdp_ltridp {
 SDPLTriDPSLIC::SDPLTriDPSLIC(const cv::Mat& image,
                                            const cv::Mat& texture,  // ADDED: texture input
                                            int region_size,
-                                           float ruler)
-    : m_region_size(region_size), m_ruler(ruler)
+                                           float ruler,
+                                           SegmentationWorkspace* workspace)
+    : m_region_size(region_size), m_ruler(ruler),
+      m_convergence(CONVERGENCE_NONE), m_convergence_tolerance(0.0f), m_iterations_run(0),
+      m_instrumented(false), m_trace_callback(nullptr), m_trace_user_data(nullptr),
+      m_workspace(workspace)
 {
     // Validate inputs
     if (image.empty()) {
@@ -94,9 +100,12 @@ SDPLTriDPSLIC::SDPLTriDPSLIC(const cv::Mat& image,
     m_width = image.cols;
     m_height = image.rows;
     
-    // Store input images (deep copy for safety)
-    m_image = image.clone();
-    m_texture = texture.clone();                                        // ADDED: store texture
+    // Take over the workspace buffers, they go back in the destructor
+    swapWorkspace();
+    
+    // Store input images (deep copy for safety, into the workspace buffers if they fit)
+    image.copyTo(m_image);
+    texture.copyTo(m_texture);                                          // ADDED: store texture
     
     // Initialize superpixel segmentation
     initialize();
@@ -104,11 +113,33 @@ SDPLTriDPSLIC::SDPLTriDPSLIC(const cv::Mat& image,
 
 SDPLTriDPSLIC::~SDPLTriDPSLIC()
 {
-    // Automatic cleanup via std::vector and cv::Mat destructors
+    // Automatic cleanup via std::vector and cv::Mat destructors (after returning borrowed buffers)
+    swapWorkspace();
+}
+
+void SDPLTriDPSLIC::swapWorkspace()
+{
+    if (m_workspace == nullptr) {
+        return;
+    }
+    std::swap(m_klabels, m_workspace->labels);
+    std::swap(m_image, m_workspace->image);
+    std::swap(m_texture, m_workspace->texture);
+    std::swap(m_distvec, m_workspace->distances);
+    std::swap(m_previous_labels, m_workspace->previous_labels);
+    std::swap(m_kseedsx, m_workspace->seedsx);
+    std::swap(m_kseedsy, m_workspace->seedsy);
+    std::swap(m_kseeds_gray, m_workspace->seeds_gray);
+    std::swap(m_kseeds_tex, m_workspace->seeds_tex);
+    std::swap(m_previous_seedsx, m_workspace->previous_seedsx);
+    std::swap(m_previous_seedsy, m_workspace->previous_seedsy);
 }
 
 void SDPLTriDPSLIC::initialize()
 {
+    // Always timed, the constructor seeds before instrumentation can be turned on
+    const int64_t start = cv::getTickCount();
+
     // Calculate initial number of superpixels
     // K = N / S² where N = total pixels, S = region_size
     m_numlabels = static_cast<int>(
@@ -117,7 +148,8 @@ void SDPLTriDPSLIC::initialize()
     );
     
     // Initialize label storage (all zeros)
-    m_klabels = cv::Mat(m_height, m_width, CV_32S, cv::Scalar(0));
+    m_klabels.create(m_height, m_width, CV_32S);
+    m_klabels.setTo(cv::Scalar(0));
     
     // Generate initial seeds on regular grid
     getSeeds();
@@ -129,6 +161,16 @@ void SDPLTriDPSLIC::initialize()
     cv::Mat edgemag;
     detectEdges(edgemag);
     perturbSeeds(edgemag);
+
+    updatePeakBytes();
+
+    const double frequency = cv::getTickFrequency();
+    m_stats.seeding_ms = static_cast<double>(cv::getTickCount() - start) * 1000.0 / frequency;
+    if (m_instrumented && m_trace_callback != nullptr) {
+        SLICTraceEvent event = {"seeding", static_cast<int64_t>(static_cast<double>(start) * 1e6 / frequency),
+                                static_cast<int64_t>(m_stats.seeding_ms * 1000.0)};
+        m_trace_callback(event, m_trace_user_data);
+    }
 }
 
 void SDPLTriDPSLIC::detectEdges(cv::Mat& edgemag)
@@ -217,19 +259,399 @@ void SDPLTriDPSLIC::getSeeds()
     }
 }
 
+void SDPLTriDPSLIC::setImage(const cv::Mat& image, const cv::Mat& texture, bool warm_start)
+{
+    if (image.empty() || texture.empty()) {
+        throw std::invalid_argument("Image and texture must not be empty");
+    }
+    if (image.type() != CV_8UC1 || texture.type() != CV_8UC1) {
+        throw std::invalid_argument("Image and texture must be CV_8UC1");
+    }
+    if (image.size() != texture.size()) {
+        throw std::invalid_argument("Image and texture must have same dimensions");
+    }
+    
+    bool same_size = image.cols == m_width && image.rows == m_height;
+    
+    m_width = image.cols;
+    m_height = image.rows;
+    image.copyTo(m_image);
+    texture.copyTo(m_texture);
+    
+    if (!warm_start || !same_size) {
+        initialize();
+        return;
+    }
+    
+    // Keep the seed positions, take their values from the new images
+    for (size_t k = 0; k < m_kseedsx.size(); ++k) {
+        int x = std::min(std::max(static_cast<int>(m_kseedsx[k]), 0), m_width - 1);
+        int y = std::min(std::max(static_cast<int>(m_kseedsy[k]), 0), m_height - 1);
+        m_kseeds_gray[k] = static_cast<float>(m_image.at<uchar>(y, x));
+        m_kseeds_tex[k] = static_cast<float>(m_texture.at<uchar>(y, x));
+    }
+    m_numlabels = static_cast<int>(m_kseeds_gray.size());
+    assignNearestSeeds();
+}
+
+void SDPLTriDPSLIC::assignNearestSeeds()
+{
+    cv::Mat distxy(m_height, m_width, CV_32F, cv::Scalar(std::numeric_limits<float>::max()));
+    m_klabels.create(m_height, m_width, CV_32S);
+    m_klabels.setTo(cv::Scalar(-1));
+
+    // The same 2S x 2S windows the assignment step searches
+    for (int k = 0; k < m_numlabels; ++k) {
+        int cy = static_cast<int>(m_kseedsy[k]);
+        int cx = static_cast<int>(m_kseedsx[k]);
+        int y1 = std::max(0, cy - m_region_size);
+        int y2 = std::min(m_height, cy + m_region_size);
+        int x1 = std::max(0, cx - m_region_size);
+        int x2 = std::min(m_width, cx + m_region_size);
+        for (int y = y1; y < y2; ++y) {
+            float* dist_row = distxy.ptr<float>(y);
+            int* label_row = m_klabels.ptr<int>(y);
+            float dy = y - m_kseedsy[k];
+            for (int x = x1; x < x2; ++x) {
+                float dx = x - m_kseedsx[k];
+                float d = dx * dx + dy * dy;
+                if (d < dist_row[x]) {
+                    dist_row[x] = d;
+                    label_row[x] = k;
+                }
+            }
+        }
+    }
+
+    // Centers that drifted apart can leave pixels outside every window
+    cv::parallel_for_(cv::Range(0, m_height), [&](const cv::Range& rows) {
+        for (int y = rows.start; y < rows.end; ++y) {
+            int* label_row = m_klabels.ptr<int>(y);
+            for (int x = 0; x < m_width; ++x) {
+                if (label_row[x] >= 0) {
+                    continue;
+                }
+                float best = std::numeric_limits<float>::max();
+                label_row[x] = 0;
+                for (int k = 0; k < m_numlabels; ++k) {
+                    float dx = x - m_kseedsx[k];
+                    float dy = y - m_kseedsy[k];
+                    if (dx * dx + dy * dy < best) {
+                        best = dx * dx + dy * dy;
+                        label_row[x] = k;
+                    }
+                }
+            }
+        }
+    });
+}
+
 void SDPLTriDPSLIC::iterate(int num_iterations)
 {
     if (num_iterations <= 0) {
         throw std::invalid_argument("Number of iterations must be positive");
     }
     
+    const int64_t start = stageStart();
+    if (m_instrumented) {
+        m_stats.pixels_relabeled.clear();
+    }
+
     performLTriDPSLIC(num_iterations);
+
+    updatePeakBytes();
+    if (m_instrumented) {
+        m_stats.iterations_run = m_iterations_run;
+        stageEnd("iterate", start, m_stats.iterate_ms);
+    }
 }
 
+namespace {
+
+/**
+ * @brief Assigns the pixels of a band of rows to their nearest cluster center
+ *
+ * Runs through cv::parallel_for_ over image rows. Every band visits the cluster centers in the
+ * same order as a serial sweep would, so each pixel sees the exact same sequence of distance
+ * comparisons and the labels don't depend on how the rows were split up.
+ */
+struct LTriDPAssignInvoker : public cv::ParallelLoopBody {
+    LTriDPAssignInvoker(const cv::Mat& image, const cv::Mat& texture, cv::Mat& distvec, cv::Mat& klabels,
+                        const std::vector<float>& kseedsx, const std::vector<float>& kseedsy,
+                        const std::vector<float>& kseeds_gray, const std::vector<float>& kseeds_tex,
+                        int num_seeds, int region_size, float inv_gray_variance, float inv_texture_variance,
+                        float texture_weight, float feature_scale, float spatial_weight)
+        : image(image), texture(texture), distvec(distvec), klabels(klabels),
+          kseedsx(kseedsx), kseedsy(kseedsy), kseeds_gray(kseeds_gray), kseeds_tex(kseeds_tex),
+          num_seeds(num_seeds), region_size(region_size), inv_gray_variance(inv_gray_variance),
+          inv_texture_variance(inv_texture_variance), texture_weight(texture_weight),
+          feature_scale(feature_scale), spatial_weight(spatial_weight) {}
+
+    void operator()(const cv::Range& rows) const override {
+        const int width = image.cols;
+
+        for (int k = 0; k < num_seeds; ++k) {
+            // Define 2S × 2S search window around cluster center (clipped to this band)
+            int cy = static_cast<int>(kseedsy[k]);
+            int cx = static_cast<int>(kseedsx[k]);
+
+            int y1 = std::max(rows.start, cy - region_size);
+            int y2 = std::min(rows.end, cy + region_size);
+            int x1 = std::max(0, cx - region_size);
+            int x2 = std::min(width, cx + region_size);
+
+            // Get cluster center values
+            float center_gray = kseeds_gray[k];
+            float center_tex = kseeds_tex[k];
+            float center_x = kseedsx[k];
+            float center_y = kseedsy[k];
+
+            // Search neighborhood
+            for (int y = y1; y < y2; ++y) {
+                const uchar* image_row = image.ptr<uchar>(y);
+                const uchar* texture_row = texture.ptr<uchar>(y);
+                float* dist_row = distvec.ptr<float>(y);
+                int* label_row = klabels.ptr<int>(y);
+
+                for (int x = x1; x < x2; ++x) {
+                    // Get pixel values
+                    float pixel_gray = static_cast<float>(image_row[x]);
+                    float pixel_tex = static_cast<float>(texture_row[x]);
+
+                    // Gray distance component (normalized by global variance)
+                    float gray_diff = pixel_gray - center_gray;
+                    float dc = gray_diff * gray_diff * inv_gray_variance;
+
+                    // Texture distance component
+                    float texture_diff = pixel_tex - center_tex;
+                    float dt = texture_diff * texture_diff * inv_texture_variance;
+
+                    // Spatial distance component
+                    float dx_diff = static_cast<float>(x) - center_x;
+                    float dy_diff = static_cast<float>(y) - center_y;
+                    float ds = dx_diff * dx_diff + dy_diff * dy_diff;
+
+                    // Combined distance metric: follow Achanta-style weighting
+                    // where spatial term is scaled by (m / S)^2.
+                    float dist = feature_scale * (dc + texture_weight * dt) + spatial_weight * ds;
+
+                    // Assign to nearest cluster
+                    if (dist < dist_row[x]) {
+                        dist_row[x] = dist;
+                        label_row[x] = k;
+                    }
+                }
+            }
+        }
+    }
+
+    const cv::Mat& image;
+    const cv::Mat& texture;
+    cv::Mat& distvec;
+    cv::Mat& klabels;
+    const std::vector<float>& kseedsx;
+    const std::vector<float>& kseedsy;
+    const std::vector<float>& kseeds_gray;
+    const std::vector<float>& kseeds_tex;
+    int num_seeds;
+    int region_size;
+    float inv_gray_variance;
+    float inv_texture_variance;
+    float texture_weight;
+    float feature_scale;
+    float spatial_weight;
+};
+
+/**
+ * @brief Per-cluster sums of the pixels that pass the gray threshold in a stripe of rows
+ *
+ * Coordinates, gray and texture values are all integers, so they're summed in 64 bits: the
+ * sums are exact whatever the cluster size, and the same for any number of stripes.
+ *
+ * This is not the original serial float accumulation. Once a cluster's float sums passed 2^24
+ * they rounded, so on large clusters (or large coordinates) the centers, and the labels after
+ * them, can differ from the original implementation even on one thread. Runs are only
+ * bit-identical to the serial run of this code, not to that baseline.
+ */
+struct LTriDPCenterSums {
+    std::vector<int64_t> sigma_x;
+    std::vector<int64_t> sigma_y;
+    std::vector<int64_t> sigma_gray;
+    std::vector<int64_t> sigma_tex;
+    std::vector<int> cluster_size;
+
+    explicit LTriDPCenterSums(int num_labels)
+        : sigma_x(num_labels, 0), sigma_y(num_labels, 0), sigma_gray(num_labels, 0),
+          sigma_tex(num_labels, 0), cluster_size(num_labels, 0) {}
+
+    void join(const LTriDPCenterSums& other) {
+        for (size_t k = 0; k < cluster_size.size(); ++k) {
+            sigma_x[k] += other.sigma_x[k];
+            sigma_y[k] += other.sigma_y[k];
+            sigma_gray[k] += other.sigma_gray[k];
+            sigma_tex[k] += other.sigma_tex[k];
+            cluster_size[k] += other.cluster_size[k];
+        }
+    }
+};
+
+/**
+ * @brief Accumulates the gray-threshold filtered cluster sums of each stripe of rows
+ *
+ * Stripe s covers rows [height * s / n, height * (s + 1) / n) and accumulates into its own
+ * LTriDPCenterSums, which are joined afterwards. The sums being exact, the centers don't
+ * depend on the number of stripes (or threads).
+ */
+struct LTriDPCenterSumsInvoker : public cv::ParallelLoopBody {
+    LTriDPCenterSumsInvoker(const cv::Mat& image, const cv::Mat& texture, const cv::Mat& klabels,
+                            const std::vector<float>& kseeds_gray, float gray_threshold,
+                            std::vector<LTriDPCenterSums>& stripe_sums)
+        : image(image), texture(texture), klabels(klabels), kseeds_gray(kseeds_gray),
+          gray_threshold(gray_threshold), stripe_sums(stripe_sums) {}
+
+    void operator()(const cv::Range& stripes) const override {
+        const int height = klabels.rows;
+        const int width = klabels.cols;
+        const int num_stripes = static_cast<int>(stripe_sums.size());
+
+        for (int s = stripes.start; s < stripes.end; ++s) {
+            LTriDPCenterSums& sums = stripe_sums[s];
+            int y_begin = static_cast<int>(static_cast<int64_t>(height) * s / num_stripes);
+            int y_end = static_cast<int>(static_cast<int64_t>(height) * (s + 1) / num_stripes);
+
+            for (int y = y_begin; y < y_end; ++y) {
+                const int* label_row = klabels.ptr<int>(y);
+                const uchar* image_row = image.ptr<uchar>(y);
+                const uchar* texture_row = texture.ptr<uchar>(y);
+
+                for (int x = 0; x < width; ++x) {
+                    int label = label_row[x];
+
+                    // Get pixel gray value
+                    float pixel_gray = static_cast<float>(image_row[x]);
+
+                    // Get cluster center gray value
+                    float center_gray = kseeds_gray[label];
+
+                    // Key modification: Only include pixels within gray threshold
+                    // |gray_center - gray_pixel| < α
+                    float gray_diff = std::abs(center_gray - pixel_gray);
+
+                    if (gray_diff < gray_threshold) {
+                        // Pixel passes threshold - include in center update
+                        sums.sigma_x[label] += x;
+                        sums.sigma_y[label] += y;
+                        sums.sigma_gray[label] += image_row[x];
+                        sums.sigma_tex[label] += texture_row[x];
+                        sums.cluster_size[label]++;
+                    }
+                }
+            }
+        }
+    }
+
+    const cv::Mat& image;
+    const cv::Mat& texture;
+    const cv::Mat& klabels;
+    const std::vector<float>& kseeds_gray;
+    float gray_threshold;
+    std::vector<LTriDPCenterSums>& stripe_sums;
+};
+
+/**
+ * @brief Finds the root of a pixel in a union-find forest, halving the path on the way
+ */
+inline int findComponent(std::vector<int>& parent, int p) {
+    while (parent[p] != p) {
+        parent[p] = parent[parent[p]];
+        p = parent[p];
+    }
+    return p;
+}
+
+/**
+ * @brief Joins the trees of two pixels under the lower root, so every root stays the first
+ * pixel of its component in raster order
+ */
+inline void uniteComponents(std::vector<int>& parent, int p, int q) {
+    p = findComponent(parent, p);
+    q = findComponent(parent, q);
+    if (p < q) {
+        parent[q] = p;
+    } else if (q < p) {
+        parent[p] = q;
+    }
+}
+
+/**
+ * @brief Finds the 4-connected components of equally labeled pixels
+ *
+ * Bands of rows are joined in parallel, each one only touching its own pixels, then the rows
+ * between bands are joined serially and every pixel looks up its root in parallel. component[p]
+ * ends up as the index of the first pixel (in raster order) of the component of pixel p.
+ */
+void findConnectedComponents(const cv::Mat& labels, std::vector<int>& component) {
+    const int height = labels.rows;
+    const int width = labels.cols;
+    const int num_bands = std::max(1, std::min(height, cv::getNumThreads() * 4));
+    std::vector<int> parent(static_cast<size_t>(width) * height);
+    component.resize(parent.size());
+
+    auto band_start = [&](int band) {
+        return static_cast<int>(static_cast<int64_t>(height) * band / num_bands);
+    };
+
+    cv::parallel_for_(cv::Range(0, num_bands), [&](const cv::Range& bands) {
+        for (int band = bands.start; band < bands.end; ++band) {
+            int y_begin = band_start(band);
+            int y_end = band_start(band + 1);
+            for (int y = y_begin; y < y_end; ++y) {
+                const int* label_row = labels.ptr<int>(y);
+                for (int x = 0; x < width; ++x) {
+                    int p = y * width + x;
+                    parent[p] = p;
+                    if (x > 0 && label_row[x - 1] == label_row[x]) {
+                        uniteComponents(parent, p, p - 1);
+                    }
+                    if (y > y_begin && labels.ptr<int>(y - 1)[x] == label_row[x]) {
+                        uniteComponents(parent, p, p - width);
+                    }
+                }
+            }
+        }
+    });
+
+    for (int band = 1; band < num_bands; ++band) {
+        int y = band_start(band);
+        const int* label_row = labels.ptr<int>(y);
+        const int* above_row = labels.ptr<int>(y - 1);
+        for (int x = 0; x < width; ++x) {
+            if (above_row[x] == label_row[x]) {
+                uniteComponents(parent, y * width + x, (y - 1) * width + x);
+            }
+        }
+    }
+
+    // Read-only root walks, no path compression, so rows can be looked up concurrently
+    cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& rows) {
+        for (int y = rows.start; y < rows.end; ++y) {
+            for (int x = 0; x < width; ++x) {
+                int root = y * width + x;
+                while (parent[root] != root) {
+                    root = parent[root];
+                }
+                component[y * width + x] = root;
+            }
+        }
+    });
+}
+
+} // namespace
+
 void SDPLTriDPSLIC::performLTriDPSLIC(int num_iterations)
 {
     // Distance tracking matrix
-    cv::Mat distvec(m_height, m_width, CV_32F);
+    m_distvec.create(m_height, m_width, CV_32F);
     
     // Spatial distance weight
     // Standard SLIC: spatial_weight = (m / S)^2
@@ -256,62 +678,138 @@ void SDPLTriDPSLIC::performLTriDPSLIC(int num_iterations)
     const float inv_texture_variance = 1.0f / (texture_variance + kVarianceEpsilon);
     
     // Main iteration loop
+    m_iterations_run = 0;
     for (int itr = 0; itr < num_iterations; itr++) {
+        if (m_convergence == CONVERGENCE_SEED_DISPLACEMENT) {
+            m_previous_seedsx = m_kseedsx;
+            m_previous_seedsy = m_kseedsy;
+        }
+        // Instrumentation counts the relabeled pixels of every iteration
+        if (m_convergence == CONVERGENCE_LABEL_CHANGE || m_instrumented) {
+            m_klabels.copyTo(m_previous_labels);
+        }
+
         // Reset distance matrix to infinity
-        distvec.setTo(std::numeric_limits<float>::max());
+        m_distvec.setTo(std::numeric_limits<float>::max());
         
         // Step 1: Assign pixels to nearest cluster center
-        for (int k = 0; k < m_numlabels; ++k) {
-            // Define 2S × 2S search window around cluster center
-            int cy = static_cast<int>(m_kseedsy[k]);
-            int cx = static_cast<int>(m_kseedsx[k]);
-            
-            int y1 = std::max(0, cy - m_region_size);
-            int y2 = std::min(m_height, cy + m_region_size);
-            int x1 = std::max(0, cx - m_region_size);
-            int x2 = std::min(m_width, cx + m_region_size);
-            
-            // Get cluster center values
-            float center_gray = m_kseeds_gray[k];
-            float center_tex = m_kseeds_tex[k];
-            float center_x = m_kseedsx[k];
-            float center_y = m_kseedsy[k];
-            
-            // Search neighborhood
-            for (int y = y1; y < y2; ++y) {
-                for (int x = x1; x < x2; ++x) {
-                    // Get pixel values
-                    float pixel_gray = static_cast<float>(m_image.at<uchar>(y, x));
-                    float pixel_tex = static_cast<float>(m_texture.at<uchar>(y, x));  // ADDED: texture pixel value
-                    
-                    // Gray distance component (normalized by global variance)
-                    float gray_diff = pixel_gray - center_gray;
-                    float dc = gray_diff * gray_diff * inv_gray_variance;
-                    
-                    // Texture distance component
-                    float texture_diff = pixel_tex - center_tex;
-                    float dt = texture_diff * texture_diff * inv_texture_variance;
-                    
-                    // Spatial distance component
-                    float dx_diff = static_cast<float>(x) - center_x;
-                    float dy_diff = static_cast<float>(y) - center_y;
-                    float ds = dx_diff * dx_diff + dy_diff * dy_diff;
-                    
-                    // Combined distance metric: follow Achanta-style weighting
-                    // where spatial term is scaled by (m / S)^2.
-                    float dist = feature_scale * (dc + texture_weight * dt) + spatial_weight * ds;
-                    
-                    // Assign to nearest cluster
-                    if (dist < distvec.at<float>(y, x)) {
-                        distvec.at<float>(y, x) = dist;
-                        m_klabels.at<int>(y, x) = k;
-                    }
-                }
-            }
-        }
+        // Bands of rows are assigned in parallel, each one against every cluster center's window
+        LTriDPAssignInvoker assign(m_image, m_texture, m_distvec, m_klabels,
+                                   m_kseedsx, m_kseedsy, m_kseeds_gray, m_kseeds_tex,
+                                   m_numlabels, m_region_size, inv_gray_variance, inv_texture_variance,
+                                   texture_weight, feature_scale, spatial_weight);
+        cv::parallel_for_(cv::Range(0, m_height), assign, cv::getNumThreads() * 4);
         
         // Step 2: Update cluster centers with gray-threshold filtering
         updateCenters();
+
+        // Step 3: Stop early once the segmentation stopped changing
+        m_iterations_run = itr + 1;
+        if (hasConverged(m_previous_seedsx, m_previous_seedsy, m_previous_labels)) {
+            break;
+        }
+    }
+}
+
+void SDPLTriDPSLIC::setConvergenceCriterion(ConvergenceCriterion criterion, float tolerance)
+{
+    if (!(tolerance >= 0.0f)) {
+        throw std::invalid_argument("Convergence tolerance must be a non-negative number");
+    }
+    m_convergence = criterion;
+    m_convergence_tolerance = tolerance;
+}
+
+int SDPLTriDPSLIC::getNumberOfIterationsRun() const
+{
+    return m_iterations_run;
+}
+
+bool SDPLTriDPSLIC::hasConverged(const std::vector<float>& previous_seedsx,
+                                 const std::vector<float>& previous_seedsy,
+                                 const cv::Mat& previous_labels)
+{
+    bool converged = false;
+    if (m_convergence == CONVERGENCE_SEED_DISPLACEMENT) {
+        // Average distance each cluster center moved
+        const size_t num_seeds = std::min(previous_seedsx.size(), m_kseedsx.size());
+        double total_displacement = 0.0;
+        for (size_t k = 0; k < num_seeds; ++k) {
+            float dx = m_kseedsx[k] - previous_seedsx[k];
+            float dy = m_kseedsy[k] - previous_seedsy[k];
+            total_displacement += std::sqrt(dx * dx + dy * dy);
+        }
+        converged = num_seeds == 0 ||
+                    total_displacement / static_cast<double>(num_seeds) < m_convergence_tolerance;
+    }
+    if (m_convergence == CONVERGENCE_LABEL_CHANGE || m_instrumented) {
+        // Fraction of pixels whose label changed
+        const int64_t changed_pixels = countChangedLabels(previous_labels);
+        if (m_instrumented) {
+            m_stats.pixels_relabeled.push_back(changed_pixels);
+        }
+        if (m_convergence == CONVERGENCE_LABEL_CHANGE) {
+            converged = static_cast<double>(changed_pixels) / (static_cast<double>(m_width) * m_height) < m_convergence_tolerance;
+        }
+    }
+    return converged;
+}
+
+int64_t SDPLTriDPSLIC::countChangedLabels(const cv::Mat& previous_labels) const
+{
+    int64_t changed_pixels = 0;
+    for (int y = 0; y < m_height; ++y) {
+        const int* label_row = m_klabels.ptr<int>(y);
+        const int* previous_row = previous_labels.ptr<int>(y);
+        for (int x = 0; x < m_width; ++x) {
+            changed_pixels += label_row[x] != previous_row[x];
+        }
+    }
+    return changed_pixels;
+}
+
+void SDPLTriDPSLIC::setInstrumentation(bool enabled)
+{
+    m_instrumented = enabled;
+}
+
+const SLICStats& SDPLTriDPSLIC::getStats() const
+{
+    return m_stats;
+}
+
+void SDPLTriDPSLIC::setTraceCallback(SLICTraceCallback callback, void* user_data)
+{
+    m_trace_callback = callback;
+    m_trace_user_data = user_data;
+}
+
+void SDPLTriDPSLIC::updatePeakBytes()
+{
+    const size_t bytes = m_klabels.total() * m_klabels.elemSize()
+                       + m_image.total() * m_image.elemSize()
+                       + m_texture.total() * m_texture.elemSize()
+                       + m_distvec.total() * m_distvec.elemSize()
+                       + m_previous_labels.total() * m_previous_labels.elemSize();
+    m_stats.peak_scratch_bytes = std::max(m_stats.peak_scratch_bytes, bytes);
+}
+
+int64_t SDPLTriDPSLIC::stageStart() const
+{
+    return m_instrumented ? cv::getTickCount() : 0;
+}
+
+void SDPLTriDPSLIC::stageEnd(const char* name, int64_t start, double& stage_ms)
+{
+    if (!m_instrumented) {
+        return;
+    }
+    const double frequency = cv::getTickFrequency();
+    stage_ms = static_cast<double>(cv::getTickCount() - start) * 1000.0 / frequency;
+    if (m_trace_callback != nullptr) {
+        SLICTraceEvent event = {name, static_cast<int64_t>(static_cast<double>(start) * 1e6 / frequency),
+                                static_cast<int64_t>(stage_ms * 1000.0)};
+        m_trace_callback(event, m_trace_user_data);
     }
 }
 
@@ -320,50 +818,34 @@ void SDPLTriDPSLIC::updateCenters()
     // Calculate gray threshold α (standard deviation of image)
     const float gray_threshold = calculateGrayThreshold();
     
-    // Accumulation arrays for each cluster
-    std::vector<float> sigma_x(m_numlabels, 0.0f);
-    std::vector<float> sigma_y(m_numlabels, 0.0f);
-    std::vector<float> sigma_gray(m_numlabels, 0.0f);
-    std::vector<float> sigma_tex(m_numlabels, 0.0f);                        // ADDED: texture accumulator
-    std::vector<int> cluster_size(m_numlabels, 0);
-    
     // Accumulate pixel values with gray-threshold filtering                // MODIFIED: gray filtering
     // (Paper modification #2)                                              // MODIFIED: new filtering logic
-    for (int y = 0; y < m_height; ++y) {
-        for (int x = 0; x < m_width; ++x) {
-            int label = m_klabels.at<int>(y, x);
-            
-            // Get pixel gray value
-            float pixel_gray = static_cast<float>(m_image.at<uchar>(y, x));
-            
-            // Get cluster center gray value
-            float center_gray = m_kseeds_gray[label];
-            
-
-            // Key modification: Only include pixels within gray threshold  // MODIFIED: conditional inclusion
-            // |gray_center - gray_pixel| < α                               // MODIFIED: threshold comparison
-            float gray_diff = std::abs(center_gray - pixel_gray);           // ADDED: compute gray difference
-            
-            if (gray_diff < gray_threshold) {                               // ADDED: threshold filter
-                // Pixel passes threshold - include in center update
-                sigma_x[label] += static_cast<float>(x);
-                sigma_y[label] += static_cast<float>(y);
-                sigma_gray[label] += pixel_gray;
-                sigma_tex[label] += static_cast<float>(m_texture.at<uchar>(y, x));  // ADDED: accumulate texture
-                cluster_size[label]++;
-            }
-        }
+    // Each stripe of rows is accumulated in parallel, then the stripes are joined in order
+    const int num_stripes = std::max(1, std::min(cv::getNumThreads(), m_height));
+    std::vector<LTriDPCenterSums> stripe_sums(num_stripes, LTriDPCenterSums(m_numlabels));
+    cv::parallel_for_(cv::Range(0, num_stripes),
+                      LTriDPCenterSumsInvoker(m_image, m_texture, m_klabels, m_kseeds_gray,
+                                              gray_threshold, stripe_sums));
+    for (int s = 1; s < num_stripes; ++s) {
+        stripe_sums[0].join(stripe_sums[s]);
     }
+
+    // Accumulation arrays for each cluster
+    const std::vector<int64_t>& sigma_x = stripe_sums[0].sigma_x;
+    const std::vector<int64_t>& sigma_y = stripe_sums[0].sigma_y;
+    const std::vector<int64_t>& sigma_gray = stripe_sums[0].sigma_gray;
+    const std::vector<int64_t>& sigma_tex = stripe_sums[0].sigma_tex;     // ADDED: texture accumulator
+    const std::vector<int>& cluster_size = stripe_sums[0].cluster_size;
     
     // Compute new cluster centers from filtered pixels
     for (int k = 0; k < m_numlabels; ++k) {
         if (cluster_size[k] > 0) {
             // Average filtered pixels to get new center
-            float count = static_cast<float>(cluster_size[k]);
-            m_kseedsx[k] = sigma_x[k] / count;
-            m_kseedsy[k] = sigma_y[k] / count;
-            m_kseeds_gray[k] = sigma_gray[k] / count;
-            m_kseeds_tex[k] = sigma_tex[k] / count;                      // ADDED: update texture center
+            double count = static_cast<double>(cluster_size[k]);
+            m_kseedsx[k] = static_cast<float>(sigma_x[k] / count);
+            m_kseedsy[k] = static_cast<float>(sigma_y[k] / count);
+            m_kseeds_gray[k] = static_cast<float>(sigma_gray[k] / count);
+            m_kseeds_tex[k] = static_cast<float>(sigma_tex[k] / count);  // ADDED: update texture center
         }
     }
 
@@ -451,6 +933,11 @@ void SDPLTriDPSLIC::enforceLabelConnectivity(int min_element_size)
     if (min_element_size < 0 || min_element_size > 100) {
         throw std::invalid_argument("min_element_size must be in range [0, 100]");
     }
+
+    const int64_t start = stageStart();
+    if (m_instrumented) {
+        m_stats.superpixels_before_connectivity = m_numlabels;
+    }
     
     const int dx4[4] = {-1, 0, 1, 0};
     const int dy4[4] = {0, -1, 0, 1};
@@ -462,56 +949,42 @@ void SDPLTriDPSLIC::enforceLabelConnectivity(int min_element_size)
     int div = static_cast<int>(100.0f / static_cast<float>(min_element_size) + 0.5f);
     int min_sp_sz = std::max(3, supsz / div);
     
-    cv::Mat nlabels(m_height, m_width, CV_32S, cv::Scalar(std::numeric_limits<int>::max()));
+    // Components of equally labeled pixels, each named after its first pixel in raster order
+    std::vector<int> component;
+    findConnectedComponents(m_klabels, component);
+    
+    // Size of each component (stored at its first pixel), replaced by its new label once it has one
+    std::vector<int> nlabel(sz, 0);
+    for (int p = 0; p < sz; ++p) {
+        nlabel[component[p]]++;
+    }
     
     int label = 0;
-    std::vector<int> xvec(sz);
-    std::vector<int> yvec(sz);
     
+    // Visit components in order of their first pixel, as a raster-order flood fill would
     for (int y = 0; y < m_height; ++y) {
         for (int x = 0; x < m_width; ++x) {
-            if (nlabels.at<int>(y, x) == std::numeric_limits<int>::max()) {
-                nlabels.at<int>(y, x) = label;
-                
-                // Start flood fill for new segment
-                xvec[0] = x;
-                yvec[0] = y;
-                
-                // Find adjacent label for small segments
+            const int p = y * m_width + x;
+            if (component[p] == p) {
+                // Find adjacent label for small segments (components starting earlier are labeled)
                 int adjlabel = 0;
                 for (int n = 0; n < 4; ++n) {
-                    int nx = xvec[0] + dx4[n];
-                    int ny = yvec[0] + dy4[n];
+                    int nx = x + dx4[n];
+                    int ny = y + dy4[n];
                     if (nx >= 0 && nx < m_width && ny >= 0 && ny < m_height) {
-                        if (nlabels.at<int>(ny, nx) != std::numeric_limits<int>::max()) {
-                            adjlabel = nlabels.at<int>(ny, nx);
+                        int neighbor = component[ny * m_width + nx];
+                        if (neighbor < p) {
+                            adjlabel = nlabel[neighbor];
                         }
                     }
                 }
                 
-                int count = 1;
-                for (int c = 0; c < count; ++c) {
-                    for (int n = 0; n < 4; ++n) {
-                        int nx = xvec[c] + dx4[n];
-                        int ny = yvec[c] + dy4[n];
-                        
-                        if (nx >= 0 && nx < m_width && ny >= 0 && ny < m_height) {
-                            if (nlabels.at<int>(ny, nx) == std::numeric_limits<int>::max() &&
-                                m_klabels.at<int>(y, x) == m_klabels.at<int>(ny, nx)) {
-                                xvec[count] = nx;
-                                yvec[count] = ny;
-                                nlabels.at<int>(ny, nx) = label;
-                                count++;
-                            }
-                        }
-                    }
-                }
+                int count = nlabel[p];
+                nlabel[p] = label;
                 
                 // If segment too small, merge with adjacent
                 if (count <= min_sp_sz) {
-                    for (int c = 0; c < count; ++c) {
-                        nlabels.at<int>(yvec[c], xvec[c]) = adjlabel;
-                    }
+                    nlabel[p] = adjlabel;
                     label--;
                 }
                 label++;
@@ -519,9 +992,25 @@ void SDPLTriDPSLIC::enforceLabelConnectivity(int min_element_size)
         }
     }
     
+    // Relabel every pixel with the new label of its component
+    cv::Mat nlabels(m_height, m_width, CV_32S);
+    cv::parallel_for_(cv::Range(0, m_height), [&](const cv::Range& rows) {
+        for (int y = rows.start; y < rows.end; ++y) {
+            int* label_row = nlabels.ptr<int>(y);
+            for (int x = 0; x < m_width; ++x) {
+                label_row[x] = nlabel[component[y * m_width + x]];
+            }
+        }
+    });
+    
     // Update labels
-    m_klabels = nlabels.clone();
+    m_klabels = nlabels;
     m_numlabels = label;
+
+    if (m_instrumented) {
+        m_stats.superpixels_after_connectivity = m_numlabels;
+        stageEnd("enforceLabelConnectivity", start, m_stats.connectivity_ms);
+    }
 }
 
 /*
@@ -530,6 +1019,8 @@ void SDPLTriDPSLIC::enforceLabelConnectivity(int min_element_size)
  */
 void SDPLTriDPSLIC::duperizeWithAverage(const float max_distance, const bool use_duper_distance)
 {
+	const int64_t start = this->stageStart();
+
 	// Graph of which superpixels are adjecent to each other
 	// First dimension is each superpixel
 	// Second dimension is index of each neighboring superpixel
@@ -545,10 +1036,10 @@ void SDPLTriDPSLIC::duperizeWithAverage(const float max_distance, const bool use
 
 	this->findSuperpixelNeighborsAndAverages(superpixel_neighbors, superpixel_average_colors, superpixel_population);
 
-	std::list<SuperDuperPixel> superduperpixels;
-	std::vector<SuperDuperPixel*> superduperpixel_pointers;
-	std::vector<std::list<SuperDuperPixel>::iterator> superduperpixel_iterators;
+	// Disjoint-set forest over the superpixels, each tree in it is a super-duper-pixel
+	SuperDuperPixelForest superduperpixels(m_numlabels, m_nr_channels);
 
+	int64_t merges = 0, distance_evaluations = 0;
 	this->groupSuperpixels
 	(
 		max_distance,
@@ -557,8 +1048,8 @@ void SDPLTriDPSLIC::duperizeWithAverage(const float max_distance, const bool use
 		superpixel_average_colors,
 		superpixel_population,
 		superduperpixels,
-		superduperpixel_pointers,
-		superduperpixel_iterators
+		merges,
+		distance_evaluations
 	);
 
 	// Stores which super-duper-pixel each superpixel belong to
@@ -569,6 +1060,13 @@ void SDPLTriDPSLIC::duperizeWithAverage(const float max_distance, const bool use
 	this->assignSuperduperpixels(superduperpixel_indexes);
 
 	m_numlabels = superduperpixel_count;
+
+	if (m_instrumented)
+	{
+		m_stats.merges = merges;
+		m_stats.distance_evaluations = distance_evaluations;
+	}
+	this->stageEnd("duperizeWithAverage", start, m_stats.duperize_ms);
 }
 
 /*
@@ -577,6 +1075,8 @@ void SDPLTriDPSLIC::duperizeWithAverage(const float max_distance, const bool use
  */
 void SDPLTriDPSLIC::duperizeWithHistogram(const int num_buckets[], const float distance, const bool use_duper_distance)
 {
+	const int64_t start = this->stageStart();
+
 	// Graph of which superpixels are adjecent to each other
 	// First dimension is each superpixel
 	// Second dimension is index of each neighboring superpixel
@@ -599,10 +1099,14 @@ void SDPLTriDPSLIC::duperizeWithHistogram(const int num_buckets[], const float d
 		superpixel_population
 	);
 
-	std::list<SuperDuperPixel> superduperpixels;
-	std::vector<SuperDuperPixel*> superduperpixel_pointers;
-	std::vector<std::list<SuperDuperPixel>::iterator> superduperpixel_iterators;
+	// Disjoint-set forest over the superpixels, each tree in it is a super-duper-pixel
+	// Histograms of every color channel are stored one after another
+	int total_buckets = 0;
+	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
+		total_buckets += num_buckets[color_channel];
+	SuperDuperPixelForest superduperpixels(m_numlabels, total_buckets);
 
+	int64_t merges = 0, distance_evaluations = 0;
 	this->groupSuperpixels
 	(
 		num_buckets,
@@ -612,8 +1116,8 @@ void SDPLTriDPSLIC::duperizeWithHistogram(const int num_buckets[], const float d
 		superpixel_color_histograms,
 		superpixel_population,
 		superduperpixels,
-		superduperpixel_pointers,
-		superduperpixel_iterators
+		merges,
+		distance_evaluations
 	);
 	
 	// Stores which super-duper-pixel each superpixel belong to
@@ -624,6 +1128,101 @@ void SDPLTriDPSLIC::duperizeWithHistogram(const int num_buckets[], const float d
 	this->assignSuperduperpixels(superduperpixel_indexes);
 
 	m_numlabels = superduperpixel_count;
+
+	if (m_instrumented)
+	{
+		m_stats.merges = merges;
+		m_stats.distance_evaluations = distance_evaluations;
+	}
+	this->stageEnd("duperizeWithHistogram", start, m_stats.duperize_ms);
+}
+
+/*
+ * Build the agglomeration tree of the superpixels so super-duper-pixels can be made for any distance with a tree cut.
+ * Uses average colors of superpixels as the distance between them.
+ */
+void SDPLTriDPSLIC::buildDendrogramWithAverage(SuperDuperPixelDendrogram& dendrogram)
+{
+	const int64_t start = this->stageStart();
+
+	std::vector< std::set<int> > superpixel_neighbors;
+	std::vector< std::vector<float> > superpixel_average_colors;
+	std::vector<int> superpixel_population;
+
+	this->findSuperpixelNeighborsAndAverages(superpixel_neighbors, superpixel_average_colors, superpixel_population);
+
+	// Average colors of every superpixel one after another
+	std::vector<float> superpixel_values(static_cast<size_t>(m_numlabels) * m_nr_channels);
+	std::vector<float> average_colors(m_nr_channels);
+	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
+	{
+		this->extractAverageColors(superpixel_average_colors, average_colors, superpixel);
+		std::copy(average_colors.begin(), average_colors.end(), superpixel_values.begin() + static_cast<size_t>(superpixel) * m_nr_channels);
+	}
+
+	this->buildDendrogram(superpixel_neighbors, superpixel_values, m_nr_channels, dendrogram);
+
+	this->stageEnd("buildDendrogramWithAverage", start, m_stats.duperize_ms);
+}
+
+/*
+ * Build the agglomeration tree of the superpixels so super-duper-pixels can be made for any distance with a tree cut.
+ * Uses (normalized) color histograms of superpixels as the distance between them.
+ */
+void SDPLTriDPSLIC::buildDendrogramWithHistogram(const int num_buckets[], SuperDuperPixelDendrogram& dendrogram)
+{
+	const int64_t start = this->stageStart();
+
+	std::vector< std::set<int> > superpixel_neighbors;
+	std::vector< std::vector< std::vector<float> >> superpixel_color_histograms;
+	std::vector<int> superpixel_population;
+
+	this->findSuperpixelNeighborsAndHistograms
+	(
+		num_buckets,
+		superpixel_neighbors,
+		superpixel_color_histograms,
+		superpixel_population
+	);
+
+	// Flattened color histograms of every superpixel one after another
+	int total_buckets = 0;
+	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
+		total_buckets += num_buckets[color_channel];
+	std::vector<float> superpixel_values(static_cast<size_t>(m_numlabels) * total_buckets);
+	std::vector<float> color_histogram(total_buckets);
+	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
+	{
+		this->extractColorHistogram(num_buckets, superpixel_color_histograms, color_histogram, superpixel);
+		std::copy(color_histogram.begin(), color_histogram.end(), superpixel_values.begin() + static_cast<size_t>(superpixel) * total_buckets);
+	}
+
+	this->buildDendrogram(superpixel_neighbors, superpixel_values, total_buckets, dendrogram);
+
+	this->stageEnd("buildDendrogramWithHistogram", start, m_stats.duperize_ms);
+}
+
+/*
+ * Relabel the image with the super-duper-pixels of a dendrogram cut at a distance.
+ */
+void SDPLTriDPSLIC::duperizeWithDendrogram(const SuperDuperPixelDendrogram& dendrogram, const float distance)
+{
+	if (dendrogram.labels.size() != m_klabels.size())
+	{
+		throw std::invalid_argument("dendrogram was built from a segmentation of a different size");
+	}
+
+	const int64_t start = this->stageStart();
+
+	m_numlabels = dendrogram.cut(distance, m_klabels);
+
+	// A cut only looks up merges, it doesn't measure distances
+	if (m_instrumented)
+	{
+		m_stats.merges = dendrogram.num_superpixels - m_numlabels;
+		m_stats.distance_evaluations = 0;
+	}
+	this->stageEnd("duperizeWithDendrogram", start, m_stats.duperize_ms);
 }
 
 void SDPLTriDPSLIC::findSuperpixelNeighborsAndAverages
@@ -868,24 +1467,22 @@ void SDPLTriDPSLIC::groupSuperpixels
 	const std::vector< std::set<int> >& superpixel_neighbors,
 	const std::vector< std::vector<float> >& superpixel_average_colors,
 	const std::vector<int>& superpixel_population,
-	std::list<SuperDuperPixel>& superduperpixels,
-	std::vector<SuperDuperPixel*>& superduperpixel_pointers,
-	std::vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators
+	SuperDuperPixelForest& superduperpixels,
+	int64_t& merges,
+	int64_t& distance_evaluations
 )
 {
-	superduperpixel_pointers = std::vector<SuperDuperPixel*>(m_numlabels, NULL);
-	superduperpixel_iterators = std::vector<std::list<SuperDuperPixel>::iterator>(m_numlabels, superduperpixels.end());
+	std::vector<float> average_colors(m_nr_channels);
 	// Loop through each superpixel
 	// Group them together based on distances between average colors
 	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
 	{
-		std::vector<float> average_colors(m_nr_channels);
 		this->extractAverageColors(superpixel_average_colors, average_colors, superpixel);
 		// Loop through each neighbor of this superpixel
 		for (int neighbor: superpixel_neighbors[superpixel])
 		{
 			// Don't try to group together superpixels that are already grouped together
-			if (superduperpixel_pointers[neighbor] == superduperpixel_pointers[superpixel] && superduperpixel_pointers[neighbor] != NULL)
+			if (superduperpixels.same_group(neighbor, superpixel))
 			continue;
 
 			// Get color distance to neighbor
@@ -893,21 +1490,20 @@ void SDPLTriDPSLIC::groupSuperpixels
 			(
 				use_duper_distance,
 				superduperpixels,
-				superduperpixel_pointers,
 				superpixel_average_colors,
 				average_colors,
 				superpixel,
 				neighbor
 			);
+			distance_evaluations += 1;
 
 			// If the distance is close enough, group them into a super-duper-pixel
 			if (neighbor_distance < max_distance)
 			{
+				merges += 1;
 				this->combineIntoSuperDuperPixel
 				(
 					superduperpixels,
-					superduperpixel_pointers,
-					superduperpixel_iterators,
 					superpixel_average_colors,
 					average_colors,
 					superpixel_population,
@@ -917,12 +1513,8 @@ void SDPLTriDPSLIC::groupSuperpixels
 			}
 		}
 
-		if (superduperpixel_pointers[superpixel] == NULL)
-		{
-			superduperpixels.push_back(SuperDuperPixel(superpixel, average_colors, superpixel_population[superpixel]));
-			superduperpixel_pointers[superpixel] = &superduperpixels.back();
-			superduperpixel_iterators[superpixel] = --superduperpixels.end();
-		}
+		if (!superduperpixels.in_group(superpixel))
+			superduperpixels.create_group(superpixel, average_colors.data(), superpixel_population[superpixel]);
 	}
 }
 
@@ -935,24 +1527,22 @@ void SDPLTriDPSLIC::groupSuperpixels
 	const std::vector< std::set<int> >& superpixel_neighbors,
 	const std::vector< std::vector< std::vector<float> >>& superpixel_color_histograms,
 	const std::vector<int>& superpixel_population,
-	std::list<SuperDuperPixel>& superduperpixels,
-	std::vector<SuperDuperPixel*>& superduperpixel_pointers,
-	std::vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators
+	SuperDuperPixelForest& superduperpixels,
+	int64_t& merges,
+	int64_t& distance_evaluations
 )
 {
-	superduperpixel_pointers = std::vector<SuperDuperPixel*>(m_numlabels, NULL);
-	superduperpixel_iterators = std::vector<std::list<SuperDuperPixel>::iterator>(m_numlabels, superduperpixels.end());
+	std::vector<float> color_histogram(superduperpixels.num_values);
 	// Loop through each superpixel
-	// Group them together based on distances between average colors
+	// Group them together based on distances between color histograms
 	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
 	{
-		std::vector< std::vector<float> > color_histogram(m_nr_channels);
 		this->extractColorHistogram(num_buckets, superpixel_color_histograms, color_histogram, superpixel);
 		
 		for (int neighbor: superpixel_neighbors[superpixel])
 		{
 			// Don't try to group together superpixels that are already grouped together
-			if (superduperpixel_pointers[neighbor] == superduperpixel_pointers[superpixel] && superduperpixel_pointers[neighbor] != NULL)
+			if (superduperpixels.same_group(neighbor, superpixel))
 			continue;
 
 			// Get color distance to neighbor
@@ -961,22 +1551,21 @@ void SDPLTriDPSLIC::groupSuperpixels
 				num_buckets,
 				use_duper_distance,
 				superduperpixels,
-				superduperpixel_pointers,
 				superpixel_color_histograms,
 				color_histogram,
 				superpixel,
 				neighbor
 			);
+			distance_evaluations += 1;
 
 			// If the distance is close enough, group them into a super-duper-pixel
 			if (neighbor_distance < max_distance)
 			{
+				merges += 1;
 				this->combineIntoSuperDuperPixel
 				(
 					num_buckets,
 					superduperpixels,
-					superduperpixel_pointers,
-					superduperpixel_iterators,
 					superpixel_color_histograms,
 					color_histogram,
 					superpixel_population,
@@ -986,12 +1575,8 @@ void SDPLTriDPSLIC::groupSuperpixels
 			}
 		}
 
-		if (superduperpixel_pointers[superpixel] == NULL)
-		{
-			superduperpixels.push_back(SuperDuperPixel(superpixel, color_histogram, superpixel_population[superpixel]));
-			superduperpixel_pointers[superpixel] = &superduperpixels.back();
-			superduperpixel_iterators[superpixel] = --superduperpixels.end();
-		}
+		if (!superduperpixels.in_group(superpixel))
+			superduperpixels.create_group(superpixel, color_histogram.data(), superpixel_population[superpixel]);
 	}
 }
 
@@ -999,8 +1584,7 @@ void SDPLTriDPSLIC::groupSuperpixels
 float SDPLTriDPSLIC::getColorDistance
 (
 	const bool use_duper_distance,
-	const std::list<SuperDuperPixel>& superduperpixels,
-	const std::vector<SuperDuperPixel*>& superduperpixel_pointers,
+	SuperDuperPixelForest& superduperpixels,
 	const std::vector< std::vector<float> >& superpixel_average_colors,
 	const std::vector<float>& average_colors,
 	const int superpixel,
@@ -1009,14 +1593,14 @@ float SDPLTriDPSLIC::getColorDistance
 {
 	// If this superpixel is already in a superduperpixel, use the distance from that instead of the individual superpixel
 	// Don't do this if use_duper_distance is false though
-	std::vector<float> avg_colors = use_duper_distance && superduperpixel_pointers[superpixel] != NULL ?
-	(*superduperpixel_pointers[superpixel]).get_average() :
-	average_colors;
+	const float* avg_colors = use_duper_distance && superduperpixels.in_group(superpixel) ?
+	superduperpixels.get_values(superpixel) :
+	average_colors.data();
 
 	// If the neighbor is already in a super-duper-pixel, use the distance to the whole super-duper-pixel it's in instead of just the neighbor
 	// Don't do this if use_duper_distance is false though
-	if (use_duper_distance && superduperpixel_pointers[neighbor] != NULL)
-		return (*superduperpixel_pointers[neighbor]).distance_from(avg_colors);
+	if (use_duper_distance && superduperpixels.in_group(neighbor))
+		return superduperpixels.distance_from(neighbor, avg_colors);
 
 	float neighbor_distance = 0;
 	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
@@ -1039,30 +1623,30 @@ float SDPLTriDPSLIC::getColorDistance
 (
 	const int num_buckets[],
 	const bool use_duper_distance,
-	const std::list<SuperDuperPixel>& superduperpixels,
-	const std::vector<SuperDuperPixel*>& superduperpixel_pointers,
+	SuperDuperPixelForest& superduperpixels,
 	const std::vector< std::vector< std::vector<float> >>& superpixel_color_histograms, 
-	const std::vector< std::vector<float> >& color_histogram,
+	const std::vector<float>& color_histogram,
 	const int superpixel,
 	const int neighbor
 )
 {
 	// If this superpixel is already in a superduperpixel, use the distance from that instead of the individual superpixel
 	// Don't do this if use_duper_distance is false though
-	std::vector< std::vector<float> > histogram = use_duper_distance && superduperpixel_pointers[superpixel] != NULL ?
-	(*superduperpixel_pointers[superpixel]).get_histogram() :
-	color_histogram;
+	const float* histogram = use_duper_distance && superduperpixels.in_group(superpixel) ?
+	superduperpixels.get_values(superpixel) :
+	color_histogram.data();
 
 	// If the neighbor is already in a super-duper-pixel, use the distance to the whole super-duper-pixel it's in instead of just the neighbor
 	// Don't do this if use_duper_distance is false though
-	if (use_duper_distance && superduperpixel_pointers[neighbor] != NULL)
-		return (*superduperpixel_pointers[neighbor]).distance_from(color_histogram);
+	if (use_duper_distance && superduperpixels.in_group(neighbor))
+		return superduperpixels.distance_from(neighbor, color_histogram.data());
 
 	float neighbor_distance = 0;
+	int value = 0;
 	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
-	for (int bucket = 0; bucket < num_buckets[color_channel]; bucket += 1)
+	for (int bucket = 0; bucket < num_buckets[color_channel]; bucket += 1, value += 1)
 	{
-		float difference = histogram[color_channel][bucket] - superpixel_color_histograms[color_channel][bucket][neighbor];
+		float difference = histogram[value] - superpixel_color_histograms[color_channel][bucket][neighbor];
 		// opencv slic algorithm square diff before adding it to dist.
 		// neighbor_distance += difference * difference;
 		// Just take absolute value to do mahnattan distance instead.
@@ -1089,31 +1673,27 @@ void SDPLTriDPSLIC::extractAverageColors
 	}
 }
 
-// Gets a vector of the color histogram for a superpixel
+// Gets a flattened vector (each color channel's buckets one after another) of the color histogram for a superpixel
 void SDPLTriDPSLIC::extractColorHistogram
 (
 	const int num_buckets[],
 	const std::vector< std::vector< std::vector<float> >>& superpixel_color_histograms,
-	std::vector< std::vector<float> >& color_histogram,
+	std::vector<float>& color_histogram,
 	const int superpixel
 )
 {
+	int value = 0;
 	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
+	for (int bucket = 0; bucket < num_buckets[color_channel]; bucket += 1, value += 1)
 	{
-		color_histogram[color_channel] = std::vector<float>(num_buckets[color_channel]);
-		for (int bucket = 0; bucket < num_buckets[color_channel]; bucket += 1)
-		{
-			color_histogram[color_channel][bucket] = superpixel_color_histograms[color_channel][bucket][superpixel];
-		}
+		color_histogram[value] = superpixel_color_histograms[color_channel][bucket][superpixel];
 	}
 }
 
 // Combines 2 superpixels into a super-duper-pixel using their average colors
 void SDPLTriDPSLIC::combineIntoSuperDuperPixel
 (
-	std::list<SuperDuperPixel>& superduperpixels,
-	std::vector<SuperDuperPixel*>& superduperpixel_pointers,
-	std::vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators,
+	SuperDuperPixelForest& superduperpixels,
 	const std::vector< std::vector<float> >& superpixel_average_colors,
 	const std::vector<float>& average_colors,
 	const std::vector<int>& superpixel_population,
@@ -1122,47 +1702,34 @@ void SDPLTriDPSLIC::combineIntoSuperDuperPixel
 )
 {
 	// If the neighbor is not already in a super-duper-pixel
-	if (superduperpixel_pointers[neighbor] == NULL)
+	if (!superduperpixels.in_group(neighbor))
 	{
 		// If neither superpixels are in a super-duper-pixel
-		if (superduperpixel_pointers[superpixel] == NULL)
+		if (!superduperpixels.in_group(superpixel))
 		{
 			// Create a new super-duper-pixel with the current superpixel
-			superduperpixels.push_back(SuperDuperPixel(superpixel, average_colors, superpixel_population[superpixel]));
-			superduperpixel_pointers[superpixel] = &superduperpixels.back();
-			superduperpixel_iterators[superpixel] = --superduperpixels.end();
+			superduperpixels.create_group(superpixel, average_colors.data(), superpixel_population[superpixel]);
 		}
 		// Add the neighbor to the super-duper-pixel
 		std::vector<float> neighbor_average_colors(m_nr_channels);
 		this->extractAverageColors(superpixel_average_colors, neighbor_average_colors, neighbor);
-		superduperpixel_pointers[superpixel]->add_superpixel(neighbor, neighbor_average_colors, superpixel_population[neighbor]);
-		superduperpixel_pointers[neighbor] = superduperpixel_pointers[superpixel];
-		superduperpixel_iterators[neighbor] = superduperpixel_iterators[superpixel];
+		superduperpixels.add_superpixel(superpixel, neighbor, neighbor_average_colors.data(), superpixel_population[neighbor]);
 	}
 	// If the neighbor is already in a superpixel
 	else
 	{
 		// If this superpixel is not in a super-duper-pixel yet
-		if (superduperpixel_pointers[superpixel] == NULL)
+		if (!superduperpixels.in_group(superpixel))
 		{
 			// Add it to the neighbor's super-duper-pixel
-			superduperpixel_pointers[neighbor]->add_superpixel(superpixel, average_colors, superpixel_population[superpixel]);
-			superduperpixel_pointers[superpixel] = superduperpixel_pointers[neighbor];
-			superduperpixel_iterators[superpixel] = superduperpixel_iterators[neighbor];
+			superduperpixels.add_superpixel(neighbor, superpixel, average_colors.data(), superpixel_population[superpixel]);
 		}
 		// If this superpixel is also already in a super-duper-pixel
 		// And they're not in the same one
-		else if (superduperpixel_pointers[superpixel] != superduperpixel_pointers[neighbor])
+		else if (!superduperpixels.same_group(superpixel, neighbor))
 		{
-			// Merge the superpixels (move all the superpixels from A to B and delete A)
-			std::list<SuperDuperPixel>::iterator merging_superduperpixel = superduperpixel_iterators[neighbor];
-			(*superduperpixel_pointers[superpixel]) += superduperpixel_pointers[neighbor];
-			for (int connected_neighbor : superduperpixel_pointers[neighbor]->get_superpixels())
-			{
-				superduperpixel_pointers[connected_neighbor] = superduperpixel_pointers[superpixel];
-				superduperpixel_iterators[connected_neighbor] = superduperpixel_iterators[superpixel];
-			}
-			superduperpixels.erase(merging_superduperpixel);
+			// Merge the super-duper-pixels (this superpixel's super-duper-pixel keeps its place in the indexing)
+			superduperpixels.merge(superpixel, neighbor);
 		}
 	}
 }
@@ -1171,57 +1738,42 @@ void SDPLTriDPSLIC::combineIntoSuperDuperPixel
 void SDPLTriDPSLIC::combineIntoSuperDuperPixel
 (
 	const int num_buckets[],
-	std::list<SuperDuperPixel>& superduperpixels,
-	std::vector<SuperDuperPixel*>& superduperpixel_pointers,
-	std::vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators,
+	SuperDuperPixelForest& superduperpixels,
 	const std::vector< std::vector< std::vector<float> >>& superpixel_color_histograms,
-	const std::vector< std::vector<float> >& color_histogram,
+	const std::vector<float>& color_histogram,
 	const std::vector<int>& superpixel_population,
 	const int superpixel,
 	const int neighbor
 )
 {
 	// If the neighbor is not already in a super-duper-pixel
-	if (superduperpixel_pointers[neighbor] == NULL)
+	if (!superduperpixels.in_group(neighbor))
 	{
 		// If neither superpixels are in a super-duper-pixel
-		if (superduperpixel_pointers[superpixel] == NULL)
+		if (!superduperpixels.in_group(superpixel))
 		{
 			// Create a new super-duper-pixel with the current superpixel
-			superduperpixels.push_back(SuperDuperPixel(superpixel, color_histogram, superpixel_population[superpixel]));
-			superduperpixel_pointers[superpixel] = &superduperpixels.back();
-			superduperpixel_iterators[superpixel] = --superduperpixels.end();
+			superduperpixels.create_group(superpixel, color_histogram.data(), superpixel_population[superpixel]);
 		}
 		// Add the neighbor to the super-duper-pixel
-		std::vector< std::vector<float>> neighbor_color_histogram(m_nr_channels);
+		std::vector<float> neighbor_color_histogram(superduperpixels.num_values);
 		this->extractColorHistogram(num_buckets, superpixel_color_histograms, neighbor_color_histogram, neighbor);
-		superduperpixel_pointers[superpixel]->add_superpixel(neighbor, neighbor_color_histogram, superpixel_population[neighbor]);
-		superduperpixel_pointers[neighbor] = superduperpixel_pointers[superpixel];
-		superduperpixel_iterators[neighbor] = superduperpixel_iterators[superpixel];
+		superduperpixels.add_superpixel(superpixel, neighbor, neighbor_color_histogram.data(), superpixel_population[neighbor]);
 	}
 	// If the neighbor is already in a superpixel
 	else
 	{
 		// If this superpixel is not in a super-duper-pixel yet
-		if (superduperpixel_pointers[superpixel] == NULL)
+		if (!superduperpixels.in_group(superpixel))
 		{
-			superduperpixel_pointers[neighbor]->add_superpixel(superpixel, color_histogram, superpixel_population[superpixel]);
-			superduperpixel_pointers[superpixel] = superduperpixel_pointers[neighbor];
-			superduperpixel_iterators[superpixel] = superduperpixel_iterators[neighbor];
+			superduperpixels.add_superpixel(neighbor, superpixel, color_histogram.data(), superpixel_population[superpixel]);
 		}
 		// If this superpixel is also already in a super-duper-pixel
 		// And they're not in the same one
-		else if (superduperpixel_pointers[superpixel] != superduperpixel_pointers[neighbor])
+		else if (!superduperpixels.same_group(superpixel, neighbor))
 		{
-			// Merge the superpixels (move all the superpixels from A to B and delete A)
-			std::list<SuperDuperPixel>::iterator merging_superduperpixel = superduperpixel_iterators[neighbor];
-			(*superduperpixel_pointers[superpixel]) += superduperpixel_pointers[neighbor];
-			for (int connected_neighbor : superduperpixel_pointers[neighbor]->get_superpixels())
-			{
-				superduperpixel_pointers[connected_neighbor] = superduperpixel_pointers[superpixel];
-				superduperpixel_iterators[connected_neighbor] = superduperpixel_iterators[superpixel];
-			}
-			superduperpixels.erase(merging_superduperpixel);
+			// Merge the super-duper-pixels (this superpixel's super-duper-pixel keeps its place in the indexing)
+			superduperpixels.merge(superpixel, neighbor);
 		}
 	}
 }
@@ -1229,22 +1781,12 @@ void SDPLTriDPSLIC::combineIntoSuperDuperPixel
 // Gives super-duper-pixels indexes to assign to pixels as labels for what superpixel they're in
 int SDPLTriDPSLIC::indexSuperduperpixels
 (
-	const std::list<SuperDuperPixel>& superduperpixels,
+	SuperDuperPixelForest& superduperpixels,
 	std::vector<int>& superduperpixel_indexes
 )
 {
-	// Iterate through every super-duper-pixel and give them indexes starting at 0
-	superduperpixel_indexes = std::vector<int>(m_numlabels, -1);
-	int superduperpixel_count = 0;
-	for (SuperDuperPixel sdp : superduperpixels)
-	{
-		for (int superpixel : sdp.get_superpixels())
-		{
-			superduperpixel_indexes[superpixel] = superduperpixel_count;
-		}
-		superduperpixel_count += 1;
-	}
-	return superduperpixel_count;
+	// Super-duper-pixels are indexed starting at 0 in the order they were created
+	return superduperpixels.index(superduperpixel_indexes);
 }
 
 // Assigns new super-duper-pixel indexes to pixels in the image as labels for what superpixel they're in
@@ -1258,4 +1800,152 @@ void SDPLTriDPSLIC::assignSuperduperpixels(const std::vector<int>& superduperpix
 	}
 }
 
+// Builds a single linkage agglomeration tree out of the superpixel adjacency graph
+void SDPLTriDPSLIC::buildDendrogram
+(
+	const std::vector< std::set<int> >& superpixel_neighbors,
+	const std::vector<float>& superpixel_values,
+	const int num_values,
+	SuperDuperPixelDendrogram& dendrogram
+)
+{
+	// Every pair of adjacent superpixels and the color distance between them
+	// Sorting them by distance (Kruskal's algorithm) gives the merges in the order single linkage does them
+	std::vector<SuperDuperPixelDendrogram::Merge> edges;
+	const SuperDuperPixelKernels kernels = SuperDuperPixelKernels::select(num_values);
+	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
+	{
+		const float* values = &superpixel_values[static_cast<size_t>(superpixel) * num_values];
+		for (int neighbor: superpixel_neighbors[superpixel])
+		{
+			// Only look at each pair once
+			if (neighbor < superpixel)
+				continue;
+
+			const float* neighbor_values = &superpixel_values[static_cast<size_t>(neighbor) * num_values];
+			float neighbor_distance = kernels.distance(values, neighbor_values, num_values);
+			edges.push_back({superpixel, neighbor, neighbor_distance});
+		}
+	}
+	std::stable_sort(edges.begin(), edges.end(),
+		[](const SuperDuperPixelDendrogram::Merge& a, const SuperDuperPixelDendrogram::Merge& b)
+		{ return a.distance < b.distance; });
+
+	dendrogram.num_superpixels = m_numlabels;
+	dendrogram.labels = m_klabels.clone();
+	dendrogram.merges.clear();
+	dendrogram.merges.reserve(m_numlabels > 0 ? m_numlabels - 1 : 0);
+
+	// Disjoint-set forest over the superpixels, node holds the tree node each root's set currently is
+	SuperDuperPixelForest superduperpixels(m_numlabels, 0);
+	std::vector<int> node(m_numlabels);
+	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
+		node[superpixel] = superpixel;
+
+	for (const SuperDuperPixelDendrogram::Merge& edge : edges)
+	{
+		int root = superduperpixels.find(edge.left);
+		int other_root = superduperpixels.find(edge.right);
+		// Skip edges inside a super-duper-pixel that already exists
+		if (root == other_root)
+			continue;
+
+		dendrogram.merges.push_back({node[root], node[other_root], edge.distance});
+		if (superduperpixels.tree_size[root] < superduperpixels.tree_size[other_root])
+			std::swap(root, other_root);
+		superduperpixels.parent[other_root] = root;
+		superduperpixels.tree_size[root] += superduperpixels.tree_size[other_root];
+		node[root] = m_numlabels + static_cast<int>(dendrogram.merges.size()) - 1;
+	}
+
+	if (m_instrumented)
+	{
+		m_stats.merges = static_cast<int64_t>(dendrogram.merges.size());
+		m_stats.distance_evaluations = static_cast<int64_t>(edges.size());
+	}
+}
+
+//////////////////// SuperDuperPixelDendrogram ////////////////////
+
+int SuperDuperPixelDendrogram::count_merges(float distance) const
+{
+	// Merges are sorted by distance so the ones below it are the first ones
+	return static_cast<int>(std::lower_bound(merges.begin(), merges.end(), distance,
+		[](const Merge& merge, float value) { return merge.distance < value; }) - merges.begin());
+}
+
+int SuperDuperPixelDendrogram::cut(float distance, std::vector<int>& indexes) const
+{
+	int num_merges = count_merges(distance);
+
+	// Parent of each node in the cut tree (-1 for the roots)
+	std::vector<int> parent(static_cast<size_t>(num_superpixels) + num_merges, -1);
+	for (int merge = 0; merge < num_merges; merge += 1)
+	{
+		parent[merges[merge].left] = num_superpixels + merge;
+		parent[merges[merge].right] = num_superpixels + merge;
+	}
+
+	// Parents are always made after their children, so going from the last node to the first one
+	// finds each node's root after its parent's
+	std::vector<int> root(parent.size());
+	for (int n = static_cast<int>(parent.size()) - 1; n >= 0; n -= 1)
+	{
+		root[n] = parent[n] == -1 ? n : root[parent[n]];
+	}
+
+	// Index the super-duper-pixels in the order of their lowest superpixel
+	std::vector<int> root_indexes(parent.size(), -1);
+	indexes = std::vector<int>(num_superpixels);
+	int count = 0;
+	for (int superpixel = 0; superpixel < num_superpixels; superpixel += 1)
+	{
+		int& root_index = root_indexes[root[superpixel]];
+		if (root_index == -1)
+			root_index = count++;
+		indexes[superpixel] = root_index;
+	}
+	return count;
+}
+
+int SuperDuperPixelDendrogram::cut(float distance, cv::Mat& labels_out) const
+{
+	std::vector<int> indexes;
+	int count = cut(distance, indexes);
+
+	labels_out.create(labels.size(), CV_32S);
+	for (int y = 0; y < labels.rows; ++y) {
+		const int* label_row = labels.ptr<int>(y);
+		int* out_row = labels_out.ptr<int>(y);
+		for (int x = 0; x < labels.cols; ++x) {
+			out_row[x] = indexes[label_row[x]];
+		}
+	}
+	return count;
+}
+
+void SuperDuperPixelDendrogram::cut(const std::vector<float>& distances, std::vector<cv::Mat>& labels_out, std::vector<int>& counts) const
+{
+	const size_t num_cuts = distances.size();
+	std::vector< std::vector<int> > indexes(num_cuts);
+	counts.resize(num_cuts);
+	labels_out.resize(num_cuts);
+	for (size_t c = 0; c < num_cuts; ++c) {
+		counts[c] = cut(distances[c], indexes[c]);
+		labels_out[c].create(labels.size(), CV_32S);
+	}
+
+	// Relabel every cut while each row of superpixel labels is read
+	for (int y = 0; y < labels.rows; ++y) {
+		const int* label_row = labels.ptr<int>(y);
+		for (size_t c = 0; c < num_cuts; ++c) {
+			const int* cut_indexes = indexes[c].data();
+			int* out_row = labels_out[c].ptr<int>(y);
+			for (int x = 0; x < labels.cols; ++x) {
+				out_row[x] = cut_indexes[label_row[x]];
+			}
+		}
+	}
+}
+
 } // namespace ltridp
@@ -30,120 +30,308 @@
 #define SLIC_HPP
 
 #include <opencv2/core.hpp>
+#include <cstdint>
 #include <vector>
 #include <set>
-#include <list>
 #include <cmath>
+#include <algorithm>
 
 namespace sdp_ltridp {
 
 /**
- * @struct SuperDuperPixel
- * @brief Represents a super-duper-pixel created by merging similar superpixels
+ * @brief Manhattan distance between two rows of n color values
  */
-struct SuperDuperPixel {
-    std::set<int> superpixels;          // Set of superpixel IDs in this super-duper-pixel
-    std::vector<float> average_colors;   // Average color values
-    std::vector<std::vector<float>> color_histogram;  // Color histogram
-    int population;                      // Total number of pixels
-    
-    SuperDuperPixel() : population(0) {}
-    
-    SuperDuperPixel(int initial_superpixel, const std::vector<float>& colors, int pop) 
-        : average_colors(colors), population(pop) {
-        superpixels.insert(initial_superpixel);
+inline float l1Distance(const float* a, const float* b, int n) {
+    float dist = 0.0f;
+    for (int i = 0; i < n; ++i) {
+        dist += std::abs(a[i] - b[i]);
     }
-    
-    SuperDuperPixel(int initial_superpixel, const std::vector<std::vector<float>>& hist, int pop)
-        : color_histogram(hist), population(pop) {
-        superpixels.insert(initial_superpixel);
+    return dist;
+}
+
+/**
+ * @brief Merges other_values into values, weighted by the pixel counts of both
+ */
+inline void weightedAverage(float* values, int pop, const float* other_values, int other_pop, int n) {
+    for (int i = 0; i < n; ++i) {
+        values[i] = (values[i] * pop + other_values[i] * other_pop) / (pop + other_pop);
     }
-    
-    void add_superpixel(int sp_id, const std::vector<float>& colors, int pop) {
-        superpixels.insert(sp_id);
-        // Weighted average of colors
-        for (size_t i = 0; i < average_colors.size() && i < colors.size(); ++i) {
-            average_colors[i] = (average_colors[i] * population + colors[i] * pop) / (population + pop);
+}
+
+/**
+ * @brief l1Distance() for a number of color values known at compile time
+ *
+ * Sums in the same order as l1Distance(), so both give the exact same distance, but the loop
+ * gets fully unrolled.
+ */
+template <int N>
+inline float fixedL1Distance(const float* a, const float* b, int) {
+    float dist = 0.0f;
+    for (int i = 0; i < N; ++i) {
+        dist += std::abs(a[i] - b[i]);
+    }
+    return dist;
+}
+
+/**
+ * @brief weightedAverage() for a number of color values known at compile time
+ */
+template <int N>
+inline void fixedWeightedAverage(float* values, int pop, const float* other_values, int other_pop, int) {
+    for (int i = 0; i < N; ++i) {
+        values[i] = (values[i] * pop + other_values[i] * other_pop) / (pop + other_pop);
+    }
+}
+
+/**
+ * @struct SuperDuperPixelKernels
+ * @brief Distance and merge routines for one number of color values
+ *
+ * select() picks the compile-time sized routines for the gray averages every duperize of the
+ * single channel LTriDP images compares, and the runtime sized ones for histograms (whose
+ * bucket count the caller chooses).
+ */
+struct SuperDuperPixelKernels {
+    float (*distance)(const float* a, const float* b, int n);
+    void (*average)(float* values, int pop, const float* other_values, int other_pop, int n);
+
+    static SuperDuperPixelKernels select(int num_values) {
+        SuperDuperPixelKernels kernels;
+        if (num_values == 1) {
+            kernels.distance = fixedL1Distance<1>;
+            kernels.average = fixedWeightedAverage<1>;
+        } else {
+            kernels.distance = l1Distance;
+            kernels.average = weightedAverage;
         }
-        population += pop;
+        return kernels;
     }
-    
-    void add_superpixel(int sp_id, const std::vector<std::vector<float>>& hist, int pop) {
-        superpixels.insert(sp_id);
-        // Merge histograms
-        if (color_histogram.size() == hist.size()) {
-            for (size_t ch = 0; ch < color_histogram.size(); ++ch) {
-                for (size_t bin = 0; bin < color_histogram[ch].size() && bin < hist[ch].size(); ++bin) {
-                    color_histogram[ch][bin] = (color_histogram[ch][bin] * population + hist[ch][bin] * pop) / (population + pop);
-                }
-            }
+};
+
+/**
+ * @struct SuperDuperPixelForest
+ * @brief Disjoint-set forest (union by size + path compression) that groups superpixels into super-duper-pixels
+ *
+ * Each tree is a super-duper-pixel. Groups are numbered in the order they were created and keep their
+ * color values (average colors or a flattened color histogram) in one contiguous buffer.
+ */
+struct SuperDuperPixelForest {
+    int num_values;                       // Color values per group (channels or total histogram buckets)
+    std::vector<int> parent;              // Parent of each superpixel (roots are their own parent)
+    std::vector<int> tree_size;           // Number of superpixels in each tree (valid for roots)
+    std::vector<int> group;               // Group of each root, -1 if not in a super-duper-pixel yet
+    std::vector<int> group_population;    // Total number of pixels in each group
+    std::vector<float> group_values;      // num_values color values per group
+    SuperDuperPixelKernels kernels;       // Distance and merge routines for num_values values
+
+    SuperDuperPixelForest(int num_superpixels, int values)
+        : num_values(values), parent(num_superpixels), tree_size(num_superpixels, 1), group(num_superpixels, -1),
+          kernels(SuperDuperPixelKernels::select(values)) {
+        for (int sp = 0; sp < num_superpixels; ++sp) {
+            parent[sp] = sp;
         }
-        population += pop;
+        // There can never be more groups than superpixels, so this never reallocates while grouping
+        group_population.reserve(num_superpixels);
+        group_values.reserve(static_cast<size_t>(num_superpixels) * num_values);
     }
-    
-    const std::set<int>& get_superpixels() const {
-        return superpixels;
+
+    int find(int sp) {
+        int root = sp;
+        while (parent[root] != root) {
+            root = parent[root];
+        }
+        while (parent[sp] != root) {
+            int next = parent[sp];
+            parent[sp] = root;
+            sp = next;
+        }
+        return root;
     }
 
-    const std::vector<float>& get_average() const {
-        return average_colors;
+    bool in_group(int sp) { return group[find(sp)] != -1; }
+
+    bool same_group(int sp, int other) { return find(sp) == find(other); }
+
+    const float* get_values(int sp) {
+        return &group_values[static_cast<size_t>(group[find(sp)]) * num_values];
     }
 
-    const std::vector<std::vector<float>>& get_histogram() const {
-        return color_histogram;
+    float distance_from(int sp, const float* values) {
+        return kernels.distance(get_values(sp), values, num_values);
     }
 
-    float distance_from(const std::vector<float>& colors) const {
-        if (average_colors.empty()) {
-            return 0.0f;
-        }
+    void create_group(int sp, const float* values, int pop) {
+        group[find(sp)] = static_cast<int>(group_population.size());
+        group_population.push_back(pop);
+        group_values.insert(group_values.end(), values, values + num_values);
+    }
 
-        float dist = 0.0f;
-        for (size_t i = 0; i < average_colors.size() && i < colors.size(); ++i) {
-            dist += std::abs(average_colors[i] - colors[i]);
-        }
-        return dist;
+    // Adds a superpixel that isn't in a super-duper-pixel yet to the super-duper-pixel of group_member
+    void add_superpixel(int group_member, int sp, const float* values, int pop) {
+        int root = find(group_member);
+        add_values(group[root], values, pop);
+        parent[sp] = root;
+        tree_size[root] += 1;
     }
 
-    float distance_from(const std::vector<std::vector<float>>& histogram) const {
-        if (color_histogram.empty()) {
-            return 0.0f;
+    // Merges other's super-duper-pixel into sp's, the merged super-duper-pixel keeps the group of sp's
+    void merge(int sp, int other) {
+        int root = find(sp);
+        int other_root = find(other);
+        if (root == other_root) {
+            return;
+        }
+        int group_index = group[root];
+        int other_group_index = group[other_root];
+        add_values(group_index, &group_values[static_cast<size_t>(other_group_index) * num_values],
+                   group_population[other_group_index]);
+        if (tree_size[root] < tree_size[other_root]) {
+            std::swap(root, other_root);
         }
+        parent[other_root] = root;
+        tree_size[root] += tree_size[other_root];
+        group[root] = group_index;
+        group[other_root] = -1;
+    }
 
-        float dist = 0.0f;
-        for (size_t ch = 0; ch < color_histogram.size() && ch < histogram.size(); ++ch) {
-            for (size_t bin = 0; bin < color_histogram[ch].size() && bin < histogram[ch].size(); ++bin) {
-                dist += std::abs(color_histogram[ch][bin] - histogram[ch][bin]);
+    // Gives every super-duper-pixel an index in the order they were created, returns how many there are
+    int index(std::vector<int>& indexes) {
+        int num_superpixels = static_cast<int>(parent.size());
+        std::vector<int> group_indexes(group_population.size(), -1);
+        for (int sp = 0; sp < num_superpixels; ++sp) {
+            if (parent[sp] == sp && group[sp] != -1) {
+                group_indexes[group[sp]] = 0;
             }
         }
-        return dist;
-    }
-    
-    SuperDuperPixel& operator+=(const SuperDuperPixel* other) {
-        if (other) {
-            superpixels.insert(other->superpixels.begin(), other->superpixels.end());
-            if (!average_colors.empty() && !other->average_colors.empty()) {
-                for (size_t i = 0; i < average_colors.size() && i < other->average_colors.size(); ++i) {
-                    average_colors[i] = (average_colors[i] * population + other->average_colors[i] * other->population) /
-                                        (population + other->population);
-                }
+        int count = 0;
+        for (int& group_index : group_indexes) {
+            if (group_index != -1) {
+                group_index = count++;
             }
-
-            if (!color_histogram.empty() && !other->color_histogram.empty()) {
-                for (size_t ch = 0; ch < color_histogram.size() && ch < other->color_histogram.size(); ++ch) {
-                    for (size_t bin = 0; bin < color_histogram[ch].size() && bin < other->color_histogram[ch].size(); ++bin) {
-                        color_histogram[ch][bin] = (color_histogram[ch][bin] * population + other->color_histogram[ch][bin] * other->population) /
-                                                   (population + other->population);
-                    }
-                }
+        }
+        indexes = std::vector<int>(num_superpixels, -1);
+        for (int sp = 0; sp < num_superpixels; ++sp) {
+            int group_index = group[find(sp)];
+            if (group_index != -1) {
+                indexes[sp] = group_indexes[group_index];
             }
-
-            population += other->population;
         }
-        return *this;
+        return count;
+    }
+
+    // Weighted average of color values by pixel count
+    void add_values(int group_index, const float* values, int pop) {
+        float* this_values = &group_values[static_cast<size_t>(group_index) * num_values];
+        int population = group_population[group_index];
+        kernels.average(this_values, population, values, pop, num_values);
+        group_population[group_index] = population + pop;
     }
 };
 
+/**
+ * @struct SuperDuperPixelDendrogram
+ * @brief Agglomeration tree over the superpixels of one segmentation, cut at a distance to get super-duper-pixels
+ *
+ * Leaves 0 to num_superpixels - 1 are the superpixels and merge i creates node num_superpixels + i out of two
+ * nodes. Merges are single linkage (the smallest color distance between adjacent superpixels of the two nodes),
+ * so they're stored in nondecreasing distance order and cutting at a distance groups the same superpixels
+ * duperizeWithAverage() / duperizeWithHistogram() would with that distance and use_duper_distance = false.
+ *
+ * The groups are numbered differently though: a cut numbers them in the order of their lowest superpixel,
+ * while a duperize numbers them in the order it created them, so the two labelings only match up to a
+ * relabeling.
+ */
+struct SuperDuperPixelDendrogram {
+    struct Merge {
+        int left;                         // First node merged
+        int right;                        // Second node merged
+        float distance;                   // Color distance the nodes were merged at
+    };
+
+    int num_superpixels;                  // Number of leaves
+    cv::Mat labels;                       // Superpixel labels (CV_32S) the tree was built from
+    std::vector<Merge> merges;            // Merges in nondecreasing distance order
+
+    SuperDuperPixelDendrogram() : num_superpixels(0) {}
+
+    // Number of merges with a distance below the given distance
+    int count_merges(float distance) const;
+
+    // Gives the super-duper-pixel index of each superpixel at a distance, returns how many there are
+    // Super-duper-pixels are indexed in the order of their lowest superpixel
+    int cut(float distance, std::vector<int>& indexes) const;
+
+    // Gives the super-duper-pixel label of each pixel at a distance (CV_32S), returns how many there are
+    int cut(float distance, cv::Mat& labels_out) const;
+
+    // Cuts the tree at several distances in one pass over the labels
+    void cut(const std::vector<float>& distances, std::vector<cv::Mat>& labels_out, std::vector<int>& counts) const;
+};
+
+/**
+ * @enum ConvergenceCriterion
+ * @brief What SDPLTriDPSLIC::iterate() measures to decide that the segmentation has converged
+ */
+enum ConvergenceCriterion {
+    CONVERGENCE_NONE,                     // Always run every iteration
+    CONVERGENCE_SEED_DISPLACEMENT,        // Average distance (pixels) the cluster centers moved in an iteration
+    CONVERGENCE_LABEL_CHANGE              // Fraction (0 to 1) of pixels whose label changed in an iteration
+};
+
+/**
+ * @struct SLICStats
+ * @brief What an SDPLTriDPSLIC measured about its latest calls (see SDPLTriDPSLIC::setInstrumentation())
+ * 
+ * Each field is overwritten by the next call of the stage it belongs to. Durations are wall time in milliseconds.
+ */
+struct SLICStats {
+    double seeding_ms = 0.0;                  // Placing and perturbing the seeds (constructor or setImage())
+    double iterate_ms = 0.0;                  // Last iterate()
+    double connectivity_ms = 0.0;             // Last enforceLabelConnectivity()
+    double duperize_ms = 0.0;                 // Last duperize, dendrogram build or dendrogram cut
+    int iterations_run = 0;                   // Iterations the last iterate() ran
+    std::vector<int64_t> pixels_relabeled;    // Pixels that changed their label in each iteration of the last iterate()
+    int superpixels_before_connectivity = 0;  // Superpixels before the last enforceLabelConnectivity()
+    int superpixels_after_connectivity = 0;   // Superpixels after it
+    int64_t merges = 0;                       // Superpixels merged together by the last duperize (or dendrogram)
+    int64_t distance_evaluations = 0;         // Color distances measured between neighbors by it
+    size_t peak_scratch_bytes = 0;            // Most bytes the per-pixel buffers (labels, images, distances) took so far
+};
+
+/**
+ * @struct SLICTraceEvent
+ * @brief One timed stage of an SDPLTriDPSLIC call, passed to the trace callback when it ends
+ * 
+ * Times are microseconds of the cv::getTickCount() clock, so events map directly onto "complete"
+ * events (ph "X") of the Chrome trace event format.
+ */
+struct SLICTraceEvent {
+    const char* name;                     // Stage ("seeding", "iterate", "enforceLabelConnectivity", ...)
+    int64_t start_us;
+    int64_t duration_us;
+};
+
+// Receives the stages of an instrumented SDPLTriDPSLIC as they end
+typedef void (*SLICTraceCallback)(const SLICTraceEvent& event, void* user_data);
+
+/**
+ * @struct SegmentationWorkspace
+ * @brief Buffers an SDPLTriDPSLIC can borrow so repeated segmentations of same-sized images reuse them
+ * 
+ * Keep one per thread (e.g. across a region-size sweep) and pass it to the constructor. The segmenter takes
+ * the buffers over while it's alive and gives them back in its destructor, so only one segmenter should use
+ * a workspace at a time.
+ */
+struct SegmentationWorkspace {
+    cv::Mat labels;                       // Label matrix
+    cv::Mat image;                        // Copy of the enhanced image
+    cv::Mat texture;                      // Copy of the texture map
+    cv::Mat distances;                    // Distance of each pixel to its cluster center
+    cv::Mat previous_labels;              // Labels an iteration started from (convergence check)
+    std::vector<float> seedsx, seedsy, seeds_gray, seeds_tex;
+    std::vector<float> previous_seedsx, previous_seedsy;
+};
+
 /**
  * @class SDPLTriDPSLIC
  * @brief Texture-enhanced SLIC superpixel segmentation with gray-threshold center updating
@@ -173,8 +361,10 @@ public:
      * @param texture LTriDP texture feature map (0-255)              
      * @param region_size Approximate superpixel size S
      * @param ruler Compactness parameter m
+     * @param workspace Buffers to reuse (optional, must outlive the segmenter)
      */
-    SDPLTriDPSLIC(const cv::Mat& image, const cv::Mat& texture, int region_size = 20, float ruler = 10.0f);
+    SDPLTriDPSLIC(const cv::Mat& image, const cv::Mat& texture, int region_size = 20, float ruler = 10.0f,
+                  SegmentationWorkspace* workspace = nullptr);
     
     /**
      * @brief Destructor - Clean up resources
@@ -200,6 +390,69 @@ public:
      * @param num_iterations Number of k-means iterations (paper used 10)
      */
     void iterate(int num_iterations = 10);
+
+    /**
+     * @brief Replace the image and texture with the next slice or frame of a sequence
+     * 
+     * Pre-conditions:
+     * - image and texture meet the same requirements as in the constructor
+     * 
+     * Post-conditions:
+     * - With warm_start and the same dimensions, the seeds keep their positions, take their
+     *   gray and texture values from the new images and every pixel starts out labeled with
+     *   its nearest seed, so a couple of
+     *   iterate() calls are enough to follow small changes between slices
+     * - Otherwise the seeds are placed on a fresh grid like the constructor does
+     * 
+     * @param image Enhanced grayscale MRI image
+     * @param texture LTriDP texture feature map (0-255)
+     * @param warm_start Start from the current segmentation
+     */
+    void setImage(const cv::Mat& image, const cv::Mat& texture, bool warm_start = true);
+
+    /**
+     * @brief Set a convergence criterion that lets iterate() stop before num_iterations
+     * 
+     * Pre-conditions:
+     * - tolerance is a non-negative number (std::invalid_argument otherwise, NaN included)
+     * 
+     * Post-conditions:
+     * - iterate() stops after the first iteration whose measured change is below tolerance
+     * 
+     * @param criterion What to measure (CONVERGENCE_NONE by default)
+     * @param tolerance Change below which the segmentation counts as converged
+     */
+    void setConvergenceCriterion(ConvergenceCriterion criterion, float tolerance);
+
+    /**
+     * @brief Get the number of iterations the last call to iterate() actually ran
+     */
+    int getNumberOfIterationsRun() const;
+
+    /**
+     * @brief Turn measuring the stages of every call on or off (off by default)
+     * 
+     * Post-conditions:
+     * - While off, only the seeding is timed (the constructor seeds before this can be called)
+     * - While on, getStats() is filled by every call and iterate() also compares the labels before
+     *   and after each iteration to count the relabeled pixels
+     * 
+     * @param enabled Measure the stages (and pass them to the trace callback)
+     */
+    void setInstrumentation(bool enabled);
+
+    /**
+     * @brief Get what was measured about the latest calls
+     */
+    const SLICStats& getStats() const;
+
+    /**
+     * @brief Set a function that gets every stage of an instrumented call as a trace event when it ends
+     * 
+     * @param callback Function to call on the calling thread (nullptr for none)
+     * @param user_data Passed to every call of callback
+     */
+    void setTraceCallback(SLICTraceCallback callback, void* user_data = nullptr);
     
     /**
      * @brief Get superpixel labels for each pixel
@@ -293,6 +546,37 @@ public:
 		const bool use_duper_distance = false
 	);
 
+	/** @brief Builds the agglomeration tree of the current superpixels using their average colors.
+
+	Cutting the tree at any distance gives the super-duper-pixels of duperizeWithAverage(distance, false)
+	without segmenting or measuring the superpixels again, so distance sweeps only need one segmentation.
+	Their labels are numbered differently (see SuperDuperPixelDendrogram).
+
+    @param dendrogram Output tree. It keeps its own copy of the current labels.
+     */
+	void buildDendrogramWithAverage(SuperDuperPixelDendrogram& dendrogram);
+
+	/** @brief Builds the agglomeration tree of the current superpixels using their (normalized) color histograms.
+
+	Cutting the tree at any distance gives the super-duper-pixels of duperizeWithHistogram(num_buckets, distance, false),
+	numbered differently (see SuperDuperPixelDendrogram).
+
+    @param num_buckets The number of histogram buckets to use for each color channel.
+
+    @param dendrogram Output tree. It keeps its own copy of the current labels.
+     */
+	void buildDendrogramWithHistogram(const int num_buckets[], SuperDuperPixelDendrogram& dendrogram);
+
+	/** @brief Relabels the image with the super-duper-pixels of a dendrogram cut at a distance.
+
+	Can be called any number of times with different distances on the same dendrogram.
+
+    @param dendrogram Tree built from a segmentation of this image.
+
+	@param distance The max distance superpixels can be from each other to be combined.
+     */
+	void duperizeWithDendrogram(const SuperDuperPixelDendrogram& dendrogram, const float distance);
+
 protected:
     // Image dimensions
     int m_width;         
@@ -316,6 +600,23 @@ protected:
     std::vector<float> m_kseeds_gray;  // Cluster center gray values
     std::vector<float> m_kseeds_tex;   // Cluster center texture values   // ADDED: texture centers
 
+    // Convergence
+    ConvergenceCriterion m_convergence;  // What iterate() checks to stop early
+    float m_convergence_tolerance;       // Change below which iterate() stops
+    int m_iterations_run;                // Iterations the last iterate() ran
+
+    // Instrumentation
+    bool m_instrumented;                 // Measure the stages of every call
+    SLICStats m_stats;                   // What was measured
+    SLICTraceCallback m_trace_callback;  // Gets every measured stage (nullptr for none)
+    void* m_trace_user_data;
+
+    // Buffers
+    SegmentationWorkspace* m_workspace;  // Where the buffers below are borrowed from (nullptr if none)
+    cv::Mat m_distvec;                   // Distance of each pixel to its cluster center
+    cv::Mat m_previous_labels;           // Labels an iteration started from (convergence check)
+    std::vector<float> m_previous_seedsx, m_previous_seedsy;
+
 private:
     /**
      * @brief Initialize cluster centers on regular grid and perturb away from edges
@@ -327,6 +628,11 @@ private:
      * 4. Move each center to lowest-gradient position in 3×3 neighborhood
      */
     void initialize();
+
+    /**
+     * @brief Swap the buffers with the ones in m_workspace (if there is one)
+     */
+    void swapWorkspace();
     
     /**
      * @brief Detect edges in the image.
@@ -352,6 +658,14 @@ private:
      * in a grid pattern with spacing S (region_size).
      */
     void getSeeds();
+
+    /**
+     * @brief Label every pixel with its spatially nearest cluster center
+     *
+     * Labels left over from enforceLabelConnectivity() or a duperize are renumbered and
+     * don't index the centers anymore, so a warm start has to rebuild them.
+     */
+    void assignNearestSeeds();
     
     /**
      * @brief Perform one iteration of the improved SLIC algorithm
@@ -407,6 +721,38 @@ private:
      */
     float calculateGrayThreshold() const;  // ADDED: threshold calculation
 
+    /**
+     * @brief Check if an iteration changed the segmentation less than the convergence tolerance
+     * 
+     * @param previous_seedsx Cluster center x-coordinates the iteration started from
+     * @param previous_seedsy Cluster center y-coordinates the iteration started from
+     * @param previous_labels Labels the iteration started from
+     * 
+     * Also records the relabeled pixels of the iteration when instrumented.
+     */
+    bool hasConverged(const std::vector<float>& previous_seedsx, const std::vector<float>& previous_seedsy,
+                      const cv::Mat& previous_labels);
+
+    /**
+     * @brief Count the pixels whose label differs from previous_labels
+     */
+    int64_t countChangedLabels(const cv::Mat& previous_labels) const;
+
+    /**
+     * @brief Update m_stats.peak_scratch_bytes with what the per-pixel buffers take now
+     */
+    void updatePeakBytes();
+
+    /**
+     * @brief Start of a stage (0 when not instrumented)
+     */
+    int64_t stageStart() const;
+
+    /**
+     * @brief Store the wall time of a stage in stage_ms and pass it to the trace callback (when instrumented)
+     */
+    void stageEnd(const char* name, int64_t start, double& stage_ms);
+
 	//////////////////// Custom Methods ////////////////////
 
 	// Finds each superpixel's neighboring superpixels and the average color of each superpixel
@@ -462,9 +808,9 @@ private:
 		const std::vector< std::set<int> >& superpixel_neighbors,
 		const std::vector< std::vector<float> >& superpixel_average_colors,
 		const std::vector<int>& superpixel_population,
-		std::list<SuperDuperPixel>& superduperpixels,
-		std::vector<SuperDuperPixel*>& superduperpixel_pointers,
-		std::vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators
+		SuperDuperPixelForest& superduperpixels,
+		int64_t& merges,
+		int64_t& distance_evaluations
 	);
 
 	// Groups superpixels into super-duper-pixels based on their color histograms
@@ -476,17 +822,16 @@ private:
 		const std::vector< std::set<int> >& superpixel_neighbors,
 		const std::vector< std::vector< std::vector<float> >>& superpixel_color_histograms,
 		const std::vector<int>& superpixel_population,
-		std::list<SuperDuperPixel>& superduperpixels,
-		std::vector<SuperDuperPixel*>& superduperpixel_pointers,
-		std::vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators
+		SuperDuperPixelForest& superduperpixels,
+		int64_t& merges,
+		int64_t& distance_evaluations
 	);
 
 	// Gets the color distance between 2 superpixels' average colors
 	inline float getColorDistance
 	(
 		const bool use_duper_distance,
-		const std::list<SuperDuperPixel>& superduperpixels,
-		const std::vector<SuperDuperPixel*>& superduperpixel_pointers,
+		SuperDuperPixelForest& superduperpixels,
 		const std::vector< std::vector<float> >& superpixel_average_colors, 
 		const std::vector<float>& average_colors,
 		const int superpixel,
@@ -498,10 +843,9 @@ private:
 	(
 		const int num_buckets[],
 		const bool use_duper_distance,
-		const std::list<SuperDuperPixel>& superduperpixels,
-		const std::vector<SuperDuperPixel*>& superduperpixel_pointers,
+		SuperDuperPixelForest& superduperpixels,
 		const std::vector< std::vector< std::vector<float> >>& superpixel_color_histograms, 
-		const std::vector< std::vector<float> >& color_histogram,
+		const std::vector<float>& color_histogram,
 		const int superpixel,
 		const int neighbor
 	);
@@ -514,21 +858,19 @@ private:
 		const int superpixel
 	);
 
-	// Gets a std::vector of the color histogram for a superpixel
+	// Gets a flattened std::vector of the color histogram for a superpixel
 	inline void extractColorHistogram
 	(
 		const int num_buckets[],
 		const std::vector< std::vector< std::vector<float> >>& superpixel_color_histograms,
-		std::vector< std::vector<float> >& color_histogram,
+		std::vector<float>& color_histogram,
 		const int superpixel
 	);
 
 	// Combines 2 superpixels into a super-duper-pixel using their average colors
 	inline void combineIntoSuperDuperPixel
 	(
-		std::list<SuperDuperPixel>& superduperpixels,
-		std::vector<SuperDuperPixel*>& superduperpixel_pointers,
-		std::vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators,
+		SuperDuperPixelForest& superduperpixels,
 		const std::vector< std::vector<float> >& superpixel_average_colors,
 		const std::vector<float>& average_colors,
 		const std::vector<int>& superpixel_population,
@@ -540,11 +882,9 @@ private:
 	inline void combineIntoSuperDuperPixel
 	(
 		const int num_buckets[],
-		std::list<SuperDuperPixel>& superduperpixels,
-		std::vector<SuperDuperPixel*>& superduperpixel_pointers,
-		std::vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators,
+		SuperDuperPixelForest& superduperpixels,
 		const std::vector< std::vector< std::vector<float> >>& superpixel_color_histograms,
-		const std::vector< std::vector<float> >& color_histogram,
+		const std::vector<float>& color_histogram,
 		const std::vector<int>& superpixel_population,
 		const int superpixel,
 		const int neighbor
@@ -553,13 +893,23 @@ private:
 	// Gives super-duper-pixels indexes to assign to pixels as labels for what superpixel they're in
 	inline int indexSuperduperpixels
 	(
-		const std::list<SuperDuperPixel>& superduperpixels,
+		SuperDuperPixelForest& superduperpixels,
 		std::vector<int>& superduperpixel_indexes
 	);
 
 	// Assigns new super-duper-pixel indexes to pixels in the image as labels for what superpixel they're in
 	inline void assignSuperduperpixels(const std::vector<int>& superduperpixel_indexes);
 
+	// Builds a single linkage agglomeration tree out of the superpixel adjacency graph
+	// superpixel_values holds num_values color values per superpixel one after another
+	inline void buildDendrogram
+	(
+		const std::vector< std::set<int> >& superpixel_neighbors,
+		const std::vector<float>& superpixel_values,
+		const int num_values,
+		SuperDuperPixelDendrogram& dendrogram
+	);
+
 	static const int m_nr_channels = 1;
 
 	//////////////////// Custom Methods ////////////////////
@@ -0,0 +1,207 @@
+/**
+ * work_stealing_pool.hpp
+ * @brief Thread pool where every worker has its own task deque and idle workers steal
+ *
+ * @author Ketsia Mbaku
+ *
+ * Tasks submitted from inside a task go to the front of the submitting worker's deque and
+ * are run newest first, so a job that fans out (an image into segmentations, a segmentation
+ * into duperize thresholds) keeps working on the data it just produced while it's still in
+ * cache. Idle workers take the oldest task from the back of another worker's deque, which is
+ * usually the biggest piece of work left there.
+ */
+
+#ifndef WORK_STEALING_POOL_HPP
+#define WORK_STEALING_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sdp_ltridp {
+
+/**
+ * @class WorkStealingPool
+ * @brief Runs tasks (that can submit more tasks) on a fixed set of worker threads
+ */
+class WorkStealingPool {
+public:
+    // Tasks get the index of the worker running them, for per-worker buffers
+    using Task = std::function<void(int worker)>;
+
+    /**
+     * @brief Starts the workers
+     *
+     * @param num_threads Number of workers, 0 for one per hardware thread
+     */
+    explicit WorkStealingPool(int num_threads = 0) {
+        if (num_threads <= 0) {
+            num_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        }
+        for (int w = 0; w < num_threads; ++w) {
+            m_workers.emplace_back(new Worker());
+        }
+        for (int w = 0; w < num_threads; ++w) {
+            m_threads.emplace_back([this, w]() { run(w); });
+        }
+    }
+
+    /**
+     * @brief Runs the tasks left and stops the workers
+     */
+    ~WorkStealingPool() {
+        try {
+            wait();
+        } catch (...) {
+            // Nobody is left to rethrow to
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /**
+     * @brief Queues a task
+     *
+     * Post-conditions:
+     * - From a worker of this pool, the task goes to that worker's own deque
+     * - From any other thread, tasks are dealt to the workers round robin
+     */
+    void submit(Task task) {
+        int worker = t_pool == this ? t_worker
+                                    : static_cast<int>(m_next_worker++ % m_workers.size());
+        m_pending.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(m_workers[worker]->mutex);
+            m_workers[worker]->tasks.push_front(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queued += 1;
+        }
+        m_wake.notify_one();
+    }
+
+    /**
+     * @brief Blocks until every submitted task (and every task they submitted) has run
+     *
+     * Rethrows the first exception a task threw, if any.
+     */
+    void wait() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this]() { return m_pending.load() == 0; });
+        if (m_error) {
+            std::exception_ptr error = m_error;
+            m_error = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    /**
+     * @brief Number of workers
+     */
+    int size() const { return static_cast<int>(m_workers.size()); }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;                  // Guards m_queued, m_stop and m_error
+    std::condition_variable m_wake;      // Tasks were queued (or the pool stops)
+    std::condition_variable m_idle;      // Every task has run
+    int m_queued = 0;                    // Tasks sitting in the deques
+    bool m_stop = false;
+    std::exception_ptr m_error;
+    std::atomic<int> m_pending{0};       // Tasks submitted and not finished
+    std::atomic<unsigned> m_next_worker{0};
+
+    // Pool and worker index of the current thread (nullptr / -1 outside the workers)
+    static inline thread_local WorkStealingPool* t_pool = nullptr;
+    static inline thread_local int t_worker = -1;
+
+    // Newest task of the worker's own deque, else the oldest task of another worker's
+    bool take(int worker, Task& task) {
+        {
+            Worker& own = *m_workers[worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        const int num_workers = static_cast<int>(m_workers.size());
+        for (int offset = 1; offset < num_workers; ++offset) {
+            Worker& victim = *m_workers[(worker + offset) % num_workers];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(int worker) {
+        t_pool = this;
+        t_worker = worker;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this]() { return m_stop || m_queued > 0; });
+                if (m_stop && m_queued == 0) {
+                    return;
+                }
+            }
+
+            Task task;
+            if (!take(worker, task)) {
+                // Another worker got there first
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_queued -= 1;
+            }
+
+            try {
+                task(worker);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_error) {
+                    m_error = std::current_exception();
+                }
+            }
+
+            if (m_pending.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_idle.notify_all();
+            }
+        }
+    }
+};
+
+} // namespace sdp_ltridp
+
+#endif // WORK_STEALING_POOL_HPP
@@ -0,0 +1,423 @@
+/**
+ * parameter_sweep.cpp
+ * Parameter sweep of the SDP-LTriDP pipeline: segmentation quality against runtime
+ *
+ * Every combination of region size, ruler, iteration count and duperize distance is run on
+ * every input image, as jobs of a work-stealing pool:
+ * 1. One job per image preprocesses it (enhancement + LTriDP) once
+ * 2. One job per (image, region size, ruler, iterations) segments it and builds the
+ *    super-duper-pixel dendrogram of the segmentation once
+ * 3. One job per duperize distance cuts that dendrogram and evaluates the result
+ *
+ * The metrics are averaged over the images, the configurations no other configuration beats
+ * on both runtime and quality are marked Pareto optimal, and everything is written to a CSV.
+ *
+ * @author Ketsia Mbaku
+*/
+
+#include "pipeline.hpp"
+#include "slic.hpp"
+#include "work_stealing_pool.hpp"
+#include "../../evaluation/evaluator.hpp"
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+struct SweepConfig {
+    int regionSize;
+    float rulerRatio;          // ruler = rulerRatio * regionSize
+    int iterations;
+    float duperizeDistance;    // 0 keeps the superpixels as they are
+};
+
+// One configuration run on one image
+struct SweepSample {
+    bool valid = false;
+    int superpixels = 0;
+    double runtimeMs = 0.0;    // Segmentation + connectivity + dendrogram + cut
+    SuperpixelMetrics metrics;
+};
+
+// One configuration averaged over the images
+struct SweepResult {
+    SweepConfig config;
+    int images = 0;
+    int groundTruthImages = 0;
+    double superpixels = 0.0;
+    double runtimeMs = 0.0;
+    double edgeAlignment = 0.0;
+    double compactness = 0.0;
+    double boundaryRecall = 0.0;
+    double underSegmentation = 0.0;
+    bool pareto = false;
+};
+
+// What every segmentation of an image shares
+struct ImageProducts {
+    cv::Mat enhanced;
+    cv::Mat features;
+    cv::Mat groundTruth;       // CV_32S, empty if there is none
+};
+
+template <typename T>
+bool parseList(const std::string& text, std::vector<T>& values) {
+    values.clear();
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        std::stringstream item_stream(item);
+        T value;
+        if (!(item_stream >> value)) {
+            return false;
+        }
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+double elapsedMs(int64 start) {
+    return static_cast<double>(cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+}
+
+// Whether a is at least as good as b everywhere and better somewhere
+bool dominates(const SweepResult& a, const SweepResult& b, bool use_ground_truth) {
+    std::vector<double> a_costs = {a.runtimeMs, -a.edgeAlignment, a.compactness};
+    std::vector<double> b_costs = {b.runtimeMs, -b.edgeAlignment, b.compactness};
+    if (use_ground_truth) {
+        a_costs.push_back(-a.boundaryRecall);
+        a_costs.push_back(a.underSegmentation);
+        b_costs.push_back(-b.boundaryRecall);
+        b_costs.push_back(b.underSegmentation);
+    }
+
+    bool better = false;
+    for (size_t i = 0; i < a_costs.size(); ++i) {
+        if (a_costs[i] > b_costs[i]) {
+            return false;
+        }
+        better = better || a_costs[i] < b_costs[i];
+    }
+    return better;
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " <input_directory> <output_csv> [options]\n";
+    std::cerr << "\n";
+    std::cerr << "Options (lists are comma separated):\n";
+    std::cerr << "  --gt <directory>       Ground truth label images, named <image name>.png\n";
+    std::cerr << "  --regions <list>       Region sizes (default: 10,20,30)\n";
+    std::cerr << "  --rulers <list>        Ruler as a multiple of the region size (default: 0.5,1)\n";
+    std::cerr << "  --iterations <list>    Iteration counts (default: 5,10)\n";
+    std::cerr << "  --distances <list>     Duperize distances, 0 for none (default: 0,5,10,20)\n";
+    std::cerr << "  --threads <n>          Worker threads, 0 for one per core (default: 0)\n";
+    std::cerr << "\n";
+    std::cerr << "Example:\n";
+    std::cerr << "  " << program << " ../../ltridp/data/input sweep.csv --regions 10,20 --threads 4\n";
+    std::cerr << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    fs::path input_dir(argv[1]);
+    fs::path output_csv(argv[2]);
+    fs::path gt_dir;
+    std::vector<int> region_sizes = {10, 20, 30};
+    std::vector<float> ruler_ratios = {0.5f, 1.0f};
+    std::vector<int> iteration_counts = {5, 10};
+    std::vector<float> distances = {0.0f, 5.0f, 10.0f, 20.0f};
+    int num_threads = 0;
+
+    for (int i = 3; i < argc; ++i) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Error: " << option << " needs a value\n";
+            return 1;
+        }
+        std::string value = argv[++i];
+        bool ok = true;
+        if (option == "--gt") {
+            gt_dir = value;
+        } else if (option == "--regions") {
+            ok = parseList(value, region_sizes);
+        } else if (option == "--rulers") {
+            ok = parseList(value, ruler_ratios);
+        } else if (option == "--iterations") {
+            ok = parseList(value, iteration_counts);
+        } else if (option == "--distances") {
+            ok = parseList(value, distances);
+        } else if (option == "--threads") {
+            std::vector<int> threads;
+            ok = parseList(value, threads) && threads.size() == 1;
+            num_threads = ok ? threads[0] : 0;
+        } else {
+            std::cerr << "Error: Unknown option " << option << "\n";
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (!ok) {
+            std::cerr << "Error: Invalid value for " << option << ": " << value << "\n";
+            return 1;
+        }
+    }
+
+    if (!fs::exists(input_dir) || !fs::is_directory(input_dir)) {
+        std::cerr << "Error: Input directory does not exist: " << input_dir << "\n";
+        return 1;
+    }
+
+    std::vector<fs::path> image_files;
+    for (const auto& entry : fs::directory_iterator(input_dir)) {
+        if (entry.is_regular_file()) {
+            std::string ext = entry.path().extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+            if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" ||
+                ext == ".bmp" || ext == ".tif" || ext == ".tiff") {
+                image_files.push_back(entry.path());
+            }
+        }
+    }
+    std::sort(image_files.begin(), image_files.end());
+
+    if (image_files.empty()) {
+        std::cerr << "\nError: No image files found in " << input_dir << "\n";
+        return 1;
+    }
+
+    // Configurations ordered so that the ones sharing a segmentation are adjacent
+    std::vector<SweepConfig> configs;
+    for (int region_size : region_sizes) {
+        for (float ruler_ratio : ruler_ratios) {
+            for (int iterations : iteration_counts) {
+                for (float distance : distances) {
+                    configs.push_back({region_size, ruler_ratio, iterations, distance});
+                }
+            }
+        }
+    }
+    const int num_distances = static_cast<int>(distances.size());
+    const int num_segmentations = static_cast<int>(configs.size()) / num_distances;
+
+    // The pool supplies the parallelism, so OpenCV's own loops stay on the calling thread
+    cv::setNumThreads(1);
+
+    sdp_ltridp::WorkStealingPool pool(num_threads);
+    std::vector<sdp_ltridp::SegmentationWorkspace> workspaces(pool.size());
+
+    // Every job writes its own slot, so the samples need no locking
+    std::vector<std::vector<SweepSample>> samples(image_files.size(), std::vector<SweepSample>(configs.size()));
+    std::vector<double> preprocess_ms(image_files.size(), 0.0);
+
+    std::cout << "Sweeping " << configs.size() << " configuration(s) over " << image_files.size()
+              << " image(s) on " << pool.size() << " thread(s)\n";
+
+    const int64 sweep_start = cv::getTickCount();
+
+    for (size_t img = 0; img < image_files.size(); ++img) {
+        pool.submit([&, img](int) {
+            cv::Mat original = cv::imread(image_files[img].string(), cv::IMREAD_GRAYSCALE);
+            if (original.empty()) {
+                std::cerr << "Error: Could not load image: " << image_files[img] << "\n";
+                return;
+            }
+
+            auto products = std::make_shared<ImageProducts>();
+            const int64 start = cv::getTickCount();
+            ltridp_slic_improved::StreamingPipeline pipeline(0.5);
+            if (!pipeline.process(original, products->enhanced, products->features)) {
+                std::cerr << "Error: Preprocessing failed: " << image_files[img] << "\n";
+                return;
+            }
+            preprocess_ms[img] = elapsedMs(start);
+
+            if (!gt_dir.empty()) {
+                fs::path gt_path = gt_dir / (image_files[img].stem().string() + ".png");
+                cv::Mat gt = cv::imread(gt_path.string(), cv::IMREAD_UNCHANGED);
+                if (!gt.empty() && gt.channels() == 1 && gt.size() == original.size()) {
+                    gt.convertTo(products->groundTruth, CV_32S);
+                }
+            }
+
+            for (int seg = 0; seg < num_segmentations; ++seg) {
+                pool.submit([&, img, seg, products](int worker) {
+                    const SweepConfig& config = configs[seg * num_distances];
+                    float ruler = config.rulerRatio * static_cast<float>(config.regionSize);
+
+                    auto dendrogram = std::make_shared<sdp_ltridp::SuperDuperPixelDendrogram>();
+                    double segment_ms;
+                    {
+                        sdp_ltridp::SDPLTriDPSLIC slic(products->enhanced, products->features,
+                                                       config.regionSize, ruler, &workspaces[worker]);
+                        slic.setInstrumentation(true);
+                        slic.iterate(config.iterations);
+                        slic.enforceLabelConnectivity(25);
+                        slic.buildDendrogramWithAverage(*dendrogram);
+
+                        const sdp_ltridp::SLICStats& stats = slic.getStats();
+                        segment_ms = stats.seeding_ms + stats.iterate_ms + stats.connectivity_ms + stats.duperize_ms;
+                    }
+
+                    for (int d = 0; d < num_distances; ++d) {
+                        pool.submit([&, img, seg, d, products, dendrogram, segment_ms](int) {
+                            const int c = seg * num_distances + d;
+                            const int64 start = cv::getTickCount();
+                            cv::Mat labels;
+                            int count = dendrogram->cut(configs[c].duperizeDistance, labels);
+                            double cut_ms = elapsedMs(start);
+
+                            SweepSample& sample = samples[img][c];
+                            sample.metrics = SuperpixelEvaluator::evaluateAll(labels, products->groundTruth,
+                                                                              products->enhanced);
+                            sample.superpixels = count;
+                            sample.runtimeMs = segment_ms + cut_ms;
+                            sample.valid = true;
+                        });
+                    }
+                });
+            }
+        });
+    }
+
+    try {
+        pool.wait();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: Sweep failed: " << e.what() << "\n";
+        return 1;
+    }
+
+    const double sweep_ms = elapsedMs(sweep_start);
+
+    // Average every configuration over the images it ran on
+    std::vector<SweepResult> results(configs.size());
+    bool use_ground_truth = true;
+    for (size_t c = 0; c < configs.size(); ++c) {
+        SweepResult& result = results[c];
+        result.config = configs[c];
+        for (size_t img = 0; img < image_files.size(); ++img) {
+            const SweepSample& sample = samples[img][c];
+            if (!sample.valid) {
+                continue;
+            }
+            result.images += 1;
+            result.superpixels += sample.superpixels;
+            result.runtimeMs += sample.runtimeMs;
+            result.edgeAlignment += sample.metrics.edgeAlignmentScore;
+            result.compactness += sample.metrics.averageCompactness;
+            if (sample.metrics.hasGroundTruth) {
+                result.groundTruthImages += 1;
+                result.boundaryRecall += sample.metrics.boundaryRecall;
+                result.underSegmentation += sample.metrics.underSegmentationError;
+            }
+        }
+        if (result.images == 0) {
+            std::cerr << "Error: No image could be processed\n";
+            return 1;
+        }
+        result.superpixels /= result.images;
+        result.runtimeMs /= result.images;
+        result.edgeAlignment /= result.images;
+        result.compactness /= result.images;
+        if (result.groundTruthImages > 0) {
+            result.boundaryRecall /= result.groundTruthImages;
+            result.underSegmentation /= result.groundTruthImages;
+        }
+        // Ground truth metrics only take part when every image had ground truth
+        use_ground_truth = use_ground_truth && result.groundTruthImages == result.images;
+    }
+
+    for (SweepResult& result : results) {
+        result.pareto = std::none_of(results.begin(), results.end(), [&](const SweepResult& other) {
+            return dominates(other, result, use_ground_truth);
+        });
+    }
+
+    std::ofstream csv(output_csv);
+    if (!csv) {
+        std::cerr << "Error: Could not write " << output_csv << "\n";
+        return 1;
+    }
+    csv << "region_size,ruler_ratio,iterations,duperize_distance,images,superpixels,runtime_ms,"
+        << "edge_alignment,compactness,boundary_recall,undersegmentation_error,pareto\n";
+    for (const SweepResult& result : results) {
+        csv << result.config.regionSize << "," << result.config.rulerRatio << ","
+            << result.config.iterations << "," << result.config.duperizeDistance << ","
+            << result.images << "," << result.superpixels << "," << result.runtimeMs << ","
+            << result.edgeAlignment << "," << result.compactness << ",";
+        if (result.groundTruthImages > 0) {
+            csv << result.boundaryRecall << "," << result.underSegmentation;
+        } else {
+            csv << ",";
+        }
+        csv << "," << (result.pareto ? 1 : 0) << "\n";
+    }
+
+    double total_preprocess_ms = 0.0;
+    for (double ms : preprocess_ms) {
+        total_preprocess_ms += ms;
+    }
+
+    // Pareto front, fastest first
+    std::vector<SweepResult> front;
+    for (const SweepResult& result : results) {
+        if (result.pareto) {
+            front.push_back(result);
+        }
+    }
+    std::sort(front.begin(), front.end(), [](const SweepResult& a, const SweepResult& b) {
+        return a.runtimeMs < b.runtimeMs;
+    });
+
+    std::cout << "\n" << std::string(120, '=') << "\n";
+    std::cout << "Pareto Front: Runtime vs. Quality (" << front.size() << " of " << results.size()
+              << " configurations, Lower Compactness is More Compact)\n";
+    std::cout << std::string(120, '=') << "\n";
+    std::cout << std::left << std::setw(8) << "Region"
+              << std::setw(8) << "Ruler"
+              << std::setw(8) << "Iters"
+              << std::setw(10) << "Distance"
+              << std::setw(14) << "Superpixels"
+              << std::setw(14) << "Runtime (ms)"
+              << std::setw(10) << "EA"
+              << std::setw(14) << "Compactness";
+    if (use_ground_truth) {
+        std::cout << std::setw(10) << "BR" << std::setw(10) << "UE";
+    }
+    std::cout << "\n" << std::string(120, '-') << "\n";
+    std::cout << std::fixed;
+    for (const SweepResult& result : front) {
+        std::cout << std::left << std::setw(8) << result.config.regionSize
+                  << std::setw(8) << std::setprecision(2) << result.config.rulerRatio
+                  << std::setw(8) << result.config.iterations
+                  << std::setw(10) << std::setprecision(1) << result.config.duperizeDistance
+                  << std::setw(14) << std::setprecision(0) << result.superpixels
+                  << std::setw(14) << std::setprecision(2) << result.runtimeMs
+                  << std::setw(10) << std::setprecision(4) << result.edgeAlignment
+                  << std::setw(14) << std::setprecision(4) << result.compactness;
+        if (use_ground_truth) {
+            std::cout << std::setw(10) << result.boundaryRecall << std::setw(10) << result.underSegmentation;
+        }
+        std::cout << "\n";
+    }
+    std::cout << std::string(120, '=') << "\n";
+    std::cout << std::setprecision(2)
+              << "Preprocessing (shared by every configuration): " << total_preprocess_ms / image_files.size()
+              << " ms per image\n";
+    std::cout << "Sweep wall time: " << sweep_ms << " ms\n";
+    std::cout << "✓ Saved: " << output_csv << "\n";
+
+    return 0;
+}
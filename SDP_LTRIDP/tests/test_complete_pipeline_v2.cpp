@@ -13,6 +13,7 @@
 
 #include "preprocessing.hpp"
 #include "feature_extraction.hpp"
+#include "pipeline.hpp"
 #include "slic.hpp"
 #include "../../evaluation/evaluator.hpp"
 #include <opencv2/core.hpp>
@@ -107,22 +108,20 @@ bool processImage(const fs::path& input_path, const fs::path& output_dir, std::v
     
     std::cout << "✓ Loaded image: " << original.cols << "×" << original.rows << " pixels\n";
     
-    std::cout << "\nStep 1: Preprocessing...\n";
-    ltridp_slic_improved::Preprocessor preprocessor;
+    std::cout << "\nStep 1-2: Preprocessing + Feature Extraction (LTriDP), streamed over tiles...\n";
+    ltridp_slic_improved::StreamingPipeline pipeline(0.5);
     cv::Mat enhanced;
-    preprocessor.enhance(original, enhanced, 0.5f);
-    std::cout << "  ✓ Complete\n";
-    
-    std::cout << "\nStep 2: Feature Extraction (LTriDP)...\n";
-    ltridp_slic_improved::FeatureExtractor feature_extractor;
     cv::Mat features;
-    feature_extractor.extract(enhanced, features);
+    pipeline.process(original, enhanced, features);
     std::cout << "  ✓ Complete\n";
     
     std::cout << "\nStep 3: Superpixel Segmentation (SDP-LTriDP SLIC)...\n";
     
     std::vector<int> region_sizes = {5, 10, 20, 30};
     
+    // Same image at every region size, so the segmentation buffers can be reused
+    sdp_ltridp::SegmentationWorkspace workspace;
+    
     for (int region_size : region_sizes) {
         std::cout << "\n  Region size: " << region_size << " pixels\n";
 
@@ -152,7 +151,7 @@ bool processImage(const fs::path& input_path, const fs::path& output_dir, std::v
         // SDP-LTriDP SLIC on enhanced image with features
         const float compactness_ratio = 1.0f;
         float ruler = compactness_ratio * static_cast<float>(region_size);
-        sdp_ltridp::SDPLTriDPSLIC slic(enhanced, features, region_size, ruler);
+        sdp_ltridp::SDPLTriDPSLIC slic(enhanced, features, region_size, ruler, &workspace);
 
         slic.iterate(10);
 
@@ -178,9 +177,23 @@ bool processImage(const fs::path& input_path, const fs::path& output_dir, std::v
         double sdp_compactness = SuperpixelEvaluator::computeAverageCompactness(labels);
 
         // Step 4: Duperization
-        std::cout << "    Duperizing with average...\n";
+        // One dendrogram per segmentation, cut at every distance of the sweep in one pass
+        std::cout << "    Duperizing with average (dendrogram)...\n";
+        sdp_ltridp::SuperDuperPixelDendrogram dendrogram;
+        slic.buildDendrogramWithAverage(dendrogram);
+
+        const std::vector<float> sweep_distances = {5.0f, 10.0f, 20.0f};
+        std::vector<cv::Mat> sweep_labels;
+        std::vector<int> sweep_counts;
+        dendrogram.cut(sweep_distances, sweep_labels, sweep_counts);
+        std::cout << "      Sweep:";
+        for (size_t d = 0; d < sweep_distances.size(); ++d) {
+            std::cout << " " << sweep_distances[d] << " -> " << sweep_counts[d];
+        }
+        std::cout << " super-duper-pixels\n";
+
         float duperize_distance = 10.0f;  // Color distance threshold
-        slic.duperizeWithAverage(duperize_distance, true);
+        slic.duperizeWithDendrogram(dendrogram, duperize_distance);
 
         int num_superduperpixels = slic.getNumberOfSuperpixels();
         std::cout << "      After duperize: " << num_superduperpixels << " super-duper-pixels\n";
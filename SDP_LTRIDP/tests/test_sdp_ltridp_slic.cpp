@@ -0,0 +1,227 @@
+/**
+ * test_sdp_ltridp_slic.cpp
+ * @brief Unit tests of SDPLTriDPSLIC on synthetic images
+ */
+
+#include <gtest/gtest.h>
+#include "slic.hpp"
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using namespace sdp_ltridp;
+
+namespace {
+
+// Gray blocks with some noise on top, and a texture map of stripes
+void makeImages(int width, int height, cv::Mat& image, cv::Mat& texture) {
+    image.create(height, width, CV_8UC1);
+    texture.create(height, width, CV_8UC1);
+    cv::RNG rng(4242);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int block = (x / 32) * 5 + (y / 32) * 3;
+            image.at<uchar>(y, x) = cv::saturate_cast<uchar>(block * 23 % 200 + rng.uniform(0, 16));
+            texture.at<uchar>(y, x) = static_cast<uchar>(((x / 8) % 2) * 128 + (y % 64));
+        }
+    }
+}
+
+// Two labelings are the same partition if each label of one maps to exactly one label of the other
+bool samePartition(const cv::Mat& a, const cv::Mat& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    std::map<int, int> a_to_b, b_to_a;
+    for (int y = 0; y < a.rows; ++y) {
+        for (int x = 0; x < a.cols; ++x) {
+            int la = a.at<int>(y, x);
+            int lb = b.at<int>(y, x);
+            auto ab = a_to_b.emplace(la, lb).first;
+            auto ba = b_to_a.emplace(lb, la).first;
+            if (ab->second != lb || ba->second != la) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// enforceLabelConnectivity() as the one segment at a time flood fill it replaced
+cv::Mat referenceConnectivity(const cv::Mat& labels, int num_labels, int min_element_size) {
+    const int dx4[4] = {-1, 0, 1, 0};
+    const int dy4[4] = {0, -1, 0, 1};
+    const int width = labels.cols;
+    const int height = labels.rows;
+    const int supsz = width * height / num_labels;
+    const int div = static_cast<int>(100.0f / static_cast<float>(min_element_size) + 0.5f);
+    const int min_size = std::max(3, supsz / div);
+
+    cv::Mat nlabels(labels.size(), CV_32S, cv::Scalar(-1));
+    std::vector<cv::Point> segment;
+    int label = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            if (nlabels.at<int>(y, x) >= 0) {
+                continue;
+            }
+
+            int adjlabel = 0;
+            for (int n = 0; n < 4; ++n) {
+                const int nx = x + dx4[n];
+                const int ny = y + dy4[n];
+                if (nx >= 0 && nx < width && ny >= 0 && ny < height && nlabels.at<int>(ny, nx) >= 0) {
+                    adjlabel = nlabels.at<int>(ny, nx);
+                }
+            }
+
+            segment.assign(1, cv::Point(x, y));
+            nlabels.at<int>(y, x) = label;
+            for (size_t c = 0; c < segment.size(); ++c) {
+                for (int n = 0; n < 4; ++n) {
+                    const int nx = segment[c].x + dx4[n];
+                    const int ny = segment[c].y + dy4[n];
+                    if (nx >= 0 && nx < width && ny >= 0 && ny < height &&
+                        nlabels.at<int>(ny, nx) < 0 && labels.at<int>(ny, nx) == labels.at<int>(y, x)) {
+                        nlabels.at<int>(ny, nx) = label;
+                        segment.push_back(cv::Point(nx, ny));
+                    }
+                }
+            }
+
+            if (static_cast<int>(segment.size()) <= min_size) {
+                for (const cv::Point& pixel : segment) {
+                    nlabels.at<int>(pixel.y, pixel.x) = adjlabel;
+                }
+                label--;
+            }
+            label++;
+        }
+    }
+    return nlabels;
+}
+
+class SDPLTriDPDendrogramTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        makeImages(160, 128, image, texture);
+    }
+
+    // Superpixels of the test images, the same every time
+    void segment(SDPLTriDPSLIC& slic) {
+        slic.iterate(5);
+        slic.enforceLabelConnectivity(25);
+    }
+
+    cv::Mat image;
+    cv::Mat texture;
+};
+
+} // namespace
+
+// ============================================================================
+// Dendrogram cuts
+// ============================================================================
+
+TEST_F(SDPLTriDPDendrogramTest, CutMatchesGreedyDuperizeUpToRelabeling) {
+    for (float distance : {0.5f, 2.0f, 5.0f, 10.0f, 20.0f, 60.0f}) {
+        SDPLTriDPSLIC tree_slic(image, texture, 12, 10.0f);
+        segment(tree_slic);
+        SuperDuperPixelDendrogram dendrogram;
+        tree_slic.buildDendrogramWithAverage(dendrogram);
+        tree_slic.duperizeWithDendrogram(dendrogram, distance);
+        cv::Mat tree_labels;
+        tree_slic.getLabels(tree_labels);
+
+        SDPLTriDPSLIC greedy_slic(image, texture, 12, 10.0f);
+        segment(greedy_slic);
+        cv::Mat superpixel_labels;
+        greedy_slic.getLabels(superpixel_labels);
+        ASSERT_EQ(cv::countNonZero(superpixel_labels != dendrogram.labels), 0);
+        greedy_slic.duperizeWithAverage(distance, false);
+        cv::Mat greedy_labels;
+        greedy_slic.getLabels(greedy_labels);
+
+        EXPECT_EQ(tree_slic.getNumberOfSuperpixels(), greedy_slic.getNumberOfSuperpixels()) << "distance " << distance;
+        EXPECT_TRUE(samePartition(tree_labels, greedy_labels)) << "distance " << distance;
+    }
+}
+
+TEST_F(SDPLTriDPDendrogramTest, HistogramCutMatchesGreedyDuperizeUpToRelabeling) {
+    const int num_buckets[] = {16};
+    for (float distance : {0.2f, 0.5f, 1.0f}) {
+        SDPLTriDPSLIC tree_slic(image, texture, 12, 10.0f);
+        segment(tree_slic);
+        SuperDuperPixelDendrogram dendrogram;
+        tree_slic.buildDendrogramWithHistogram(num_buckets, dendrogram);
+        tree_slic.duperizeWithDendrogram(dendrogram, distance);
+        cv::Mat tree_labels;
+        tree_slic.getLabels(tree_labels);
+
+        SDPLTriDPSLIC greedy_slic(image, texture, 12, 10.0f);
+        segment(greedy_slic);
+        greedy_slic.duperizeWithHistogram(num_buckets, distance, false);
+        cv::Mat greedy_labels;
+        greedy_slic.getLabels(greedy_labels);
+
+        EXPECT_EQ(tree_slic.getNumberOfSuperpixels(), greedy_slic.getNumberOfSuperpixels()) << "distance " << distance;
+        EXPECT_TRUE(samePartition(tree_labels, greedy_labels)) << "distance " << distance;
+    }
+}
+
+TEST_F(SDPLTriDPDendrogramTest, SweepCutMatchesSingleCuts) {
+    SDPLTriDPSLIC slic(image, texture, 12, 10.0f);
+    segment(slic);
+    SuperDuperPixelDendrogram dendrogram;
+    slic.buildDendrogramWithAverage(dendrogram);
+
+    const std::vector<float> distances = {20.0f, 1.0f, 5.0f};
+    std::vector<cv::Mat> sweep_labels;
+    std::vector<int> sweep_counts;
+    dendrogram.cut(distances, sweep_labels, sweep_counts);
+    ASSERT_EQ(sweep_labels.size(), distances.size());
+
+    for (size_t d = 0; d < distances.size(); ++d) {
+        cv::Mat labels;
+        int count = dendrogram.cut(distances[d], labels);
+        EXPECT_EQ(count, sweep_counts[d]);
+        EXPECT_EQ(cv::countNonZero(labels != sweep_labels[d]), 0);
+    }
+}
+
+TEST_F(SDPLTriDPDendrogramTest, CutAtZeroKeepsEverySuperpixel) {
+    SDPLTriDPSLIC slic(image, texture, 12, 10.0f);
+    segment(slic);
+    const int num_superpixels = slic.getNumberOfSuperpixels();
+    SuperDuperPixelDendrogram dendrogram;
+    slic.buildDendrogramWithAverage(dendrogram);
+
+    cv::Mat labels;
+    EXPECT_EQ(dendrogram.cut(0.0f, labels), num_superpixels);
+    EXPECT_TRUE(samePartition(labels, dendrogram.labels));
+}
+
+// ============================================================================
+// Connectivity
+// ============================================================================
+
+TEST(SDPLTriDPConnectivityTest, MatchesFloodFill) {
+    cv::Mat image, texture;
+    makeImages(203, 151, image, texture);
+    for (int min_element_size : {10, 25, 50}) {
+        SDPLTriDPSLIC slic(image, texture, 12, 10.0f);
+        slic.iterate(3);
+        cv::Mat labels;
+        slic.getLabels(labels);
+        cv::Mat expected = referenceConnectivity(labels, slic.getNumberOfSuperpixels(), min_element_size);
+
+        slic.enforceLabelConnectivity(min_element_size);
+        slic.getLabels(labels);
+        EXPECT_EQ(cv::countNonZero(labels != expected), 0) << "min size " << min_element_size;
+
+        double max_label;
+        cv::minMaxLoc(expected, nullptr, &max_label);
+        EXPECT_EQ(slic.getNumberOfSuperpixels(), static_cast<int>(max_label) + 1);
+    }
+}
@@ -92,21 +92,27 @@ Below is the original OpenCV SLIC implementation header.
 #include <iostream>
 
 #include <set>
-#include <list>
 
 #include <vector>
 #include <map>
+#include <queue>
 #include <algorithm>
 #include <cmath>
 #include <limits>
+#include <climits>
 #include <cstring>
 #include <cstdlib>
 #include <numeric>
 #include <cassert>
 #include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
 #include <opencv2/imgproc.hpp>
 #include "sdp_slic.hpp"
 #include "superduperpixel.hpp"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SDP_SLIC_SSE2
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
@@ -134,17 +140,92 @@ void parallel_reduce(const Range& range, Body& body)
   body(range);
 }
 
+// Runs a split copy of the body on each stripe of a range (used by parallel_reduce_stripes()).
+template<typename Body>
+struct ParallelReduceInvoker : ParallelLoopBody
+{
+    ParallelReduceInvoker( const BlockedRange& _range, const vector<Body*>& _bodies )
+      : range(_range), bodies(_bodies)
+    {
+    }
+
+    virtual void operator()( const cv::Range& stripes ) const CV_OVERRIDE
+    {
+      int nstripes = (int) bodies.size();
+      int64 length = range.end() - range.begin();
+      for ( int s = stripes.start; s < stripes.end; s++ )
+      {
+        int b = range.begin() + (int) (length * s / nstripes);
+        int e = range.begin() + (int) (length * (s + 1) / nstripes);
+        (*bodies[s])( BlockedRange(b, e) );
+      }
+    }
+
+    BlockedRange range;
+    vector<Body*> bodies;
+};
+
+// parallel_reduce() that actually runs in parallel (through parallel_for_).
+// The range is cut into nstripes stripes that each get their own split copy of the body, then the copies are
+// joined back into body in stripe order so the result doesn't depend on how the stripes got scheduled.
+template<typename Body>
+void parallel_reduce_stripes(const BlockedRange& range, Body& body, int nstripes)
+{
+  nstripes = std::max( 1, std::min( nstripes, range.end() - range.begin() ) );
+  vector<Body*> bodies( nstripes, &body );
+  vector< Ptr<Body> > partials;
+  for ( int s = 1; s < nstripes; s++ )
+  {
+    partials.push_back( makePtr<Body>( body, Split() ) );
+    bodies[s] = partials.back().get();
+  }
+  parallel_for_( cv::Range(0, nstripes), ParallelReduceInvoker<Body>( range, bodies ) );
+  for ( int s = 1; s < nstripes; s++ )
+    body.join( *bodies[s] );
+}
+
+struct SuperpixelStats;
+struct PackedGrowParams;
+
 class SuperpixelSLICImpl : public SuperpixelSLIC
 {
 public:
 
-    SuperpixelSLICImpl( InputArray image, int algorithm, int region_size, float ruler );
+    SuperpixelSLICImpl( InputArray image, int algorithm, int region_size, float ruler,
+                        const Ptr<SegmentationWorkspace>& workspace );
 
     virtual ~SuperpixelSLICImpl() CV_OVERRIDE;
 
     // perform amount of iteration
     virtual void iterate( int num_iterations = 10 ) CV_OVERRIDE;
 
+    // stop iterating once the seeds or labels stop changing
+    virtual void setConvergenceCriterion( int criterion, float tolerance ) CV_OVERRIDE;
+
+    // get amount of iterations the last iterate() ran
+    virtual int getNumberOfIterationsRun() const CV_OVERRIDE;
+
+    // run most iterations on a downsampled image, then refine the boundaries at full resolution
+    virtual void setPyramid( int levels, int refine_iterations = 2 ) CV_OVERRIDE;
+
+    // keep distances for bands of rows only and store saved labels in 16 bits
+    virtual void setLowMemory( bool low_memory ) CV_OVERRIDE;
+
+    // get the most memory the per-pixel buffers took so far, per megapixel
+    virtual double getPeakBytesPerMegapixel() const CV_OVERRIDE;
+
+    // time and count the stages of every call
+    virtual void setInstrumentation( bool enabled ) CV_OVERRIDE;
+
+    // get what was measured about the latest calls
+    virtual const SLICStats& getStats() const CV_OVERRIDE;
+
+    // get every instrumented stage as a trace event
+    virtual void setTraceCallback( SLICTraceCallback callback, void* user_data = 0 ) CV_OVERRIDE;
+
+    // replace the image with the next frame, optionally starting from the current segmentation
+    virtual void setImage( InputArray image, bool warm_start = true ) CV_OVERRIDE;
+
     // get amount of superpixels
     virtual int getNumberOfSuperpixels() const CV_OVERRIDE;
 
@@ -169,6 +250,18 @@ public:
 	// combines similar adjacent superpixels into super-duper-pixels using (normalized) color histograms of superpixels
 	virtual void duperizeWithHistogram(const int num_buckets[], const float distance, const bool use_duper_distance = false) CV_OVERRIDE;
 
+	// combines similar adjacent superpixels into super-duper-pixels closest pair first using average colors of superpixels
+	virtual void duperizeBestFirstWithAverage(const float distance, const int num_regions = 0) CV_OVERRIDE;
+
+	// combines similar adjacent superpixels into super-duper-pixels closest pair first using (normalized) color histograms of superpixels
+	virtual void duperizeBestFirstWithHistogram(const int num_buckets[], const float distance, const int num_regions = 0) CV_OVERRIDE;
+
+	// duperizes again with the last duperize parameters, only regrouping superpixels that changed since then
+	virtual void reduperize(const float change_tolerance) CV_OVERRIDE;
+
+	// get the region adjacency graph of the current labels (built once and cached until the labels change)
+	virtual const RegionAdjacencyGraph& getRegionAdjacencyGraph(const bool boundary_lengths = false) CV_OVERRIDE;
+
 
 protected:
 
@@ -202,6 +295,37 @@ protected:
     // current iter
     int m_iterations;
 
+    // convergence criterion (SLICConvergence)
+    int m_convergence;
+
+    // convergence tolerance
+    float m_convergence_tolerance;
+
+    // iterations run by last iterate
+    int m_iterations_run;
+
+    // pyramid levels (0 for none)
+    int m_pyramid_levels;
+
+    // full resolution passes after the pyramid
+    int m_pyramid_refine_iterations;
+
+    // low memory mode
+    bool m_low_memory;
+
+    // most bytes the per-pixel buffers took so far
+    size_t m_peak_bytes;
+
+    // instrumentation on
+    bool m_instrumented;
+
+    // what the instrumentation measured
+    SLICStats m_stats;
+
+    // trace event callback (NULL for none)
+    SLICTraceCallback m_trace_callback;
+    void* m_trace_user_data;
+
 
 private:
 
@@ -230,6 +354,114 @@ private:
     // merge threshold (MSLIC)
     float m_merge;
 
+    // region adjacency graph of m_klabels
+    RegionAdjacencyGraph m_adjacency;
+
+    // false when m_klabels changed since m_adjacency was built
+    bool m_adjacency_valid;
+
+    // thick contour mask of m_klabels, marked by duperize while it relabels (not in low memory mode)
+    Mat m_contour_mask;
+
+    // false when m_klabels changed since m_contour_mask was marked
+    bool m_contour_valid;
+
+    // parameters of a duperize call
+    struct DuperizeParameters
+    {
+      // false until something is duperized
+      bool valid;
+      bool best_first;
+      SuperDuperPixelMode mode;
+      float distance;
+      bool use_duper_distance;
+      int num_regions;
+      // empty for average colors
+      vector<int> num_buckets;
+    };
+
+    // last duperize (reduperize)
+    DuperizeParameters m_last_duperize;
+
+    // superpixel labels from before the last duperize (warm start, reduperize)
+    Mat m_superpixel_labels;
+
+    // color values of each superpixel in the last duperize (reduperize)
+    Mat m_superpixel_colors;
+
+    // super-duper-pixel of each superpixel in the last duperize (reduperize)
+    vector<int> m_superduperpixel_indexes;
+
+    // buffers borrowed from (and given back to) m_workspace
+    Ptr<SegmentationWorkspace> m_workspace;
+
+    // true when m_chvec was split from a Mat (and so can go back to the workspace)
+    bool m_split_channels;
+
+    // interleaved copy of m_chvec for the channel specialized kernels
+    Mat m_packed;
+
+    // distance matrices of the iterations
+    Mat m_distvec;
+    Mat m_distxy;
+    Mat m_distchans;
+
+    // seeds and labels each iteration started from (convergence check)
+    vector<float> m_prev_kseedsx, m_prev_kseedsy;
+    Mat m_prev_klabels;
+
+    // max color distance of each cluster (SLICO)
+    vector<float> m_maxchans;
+
+    // downsampled channels and labels (pyramid)
+    vector<Mat> m_pyramid_chvec;
+    Mat m_pyramid_labels;
+
+    // downsampled pixels next to another superpixel (pyramid)
+    Mat m_pyramid_band;
+
+    // iterate on the OpenCL device (the image was given as a UMat)
+    bool m_use_opencl;
+
+    // image on the device, interleaved float channels
+    UMat m_ocl_image;
+
+    // labels, seeds (x, y, channels of each) and the seed grid on the device
+    UMat m_ocl_labels, m_ocl_prev_labels, m_ocl_changed;
+    UMat m_ocl_seeds, m_ocl_centers;
+    UMat m_ocl_cell_offsets, m_ocl_cell_seeds;
+
+    // OpenCL kernels (built for m_ocl_channels channels)
+    ocl::Kernel m_ocl_assign, m_ocl_update;
+    int m_ocl_channels;
+
+    // swaps the buffers with the ones in m_workspace (if there is one)
+    inline void swapWorkspace();
+
+    // rows the distance matrices cover at a time
+    inline int distanceBandRows() const;
+
+    // copies m_klabels (in 16 bits when low memory allows it)
+    inline void saveLabels( Mat& saved_labels ) const;
+
+    // updates m_peak_bytes with what the per-pixel buffers take now
+    inline void updatePeakBytes();
+
+    // start of a stage (0 when not instrumented)
+    inline int64 stageStart() const;
+
+    // stores the wall time of a stage in stage_ms and passes it to the trace callback
+    inline void stageEnd( const char* name, int64 start, double& stage_ms );
+
+    // number of pixels with another label than in previous_labels
+    inline int64 countChangedLabels( const Mat& previous_labels ) const;
+
+    // takes the seed colors from the image at the seed positions
+    inline void SampleSeedColors();
+
+    // labels every pixel with its spatially nearest seed
+    inline void AssignNearestSeeds();
+
     // initialization
     inline void initialize();
 
@@ -245,6 +477,16 @@ private:
     // fetch seeds
     inline void GetChSeedsK();
 
+    // interleaves the channels into m_packed when a specialized kernel fits them (PackedLayout)
+    inline int PackChannels();
+
+    // what the specialized grow kernels need to grow seed n
+    inline PackedGrowParams PackedGrowSeed( int n, int x1, int x2, int band_start,
+                                            float xywt, float maxchans );
+
+    // recalculates the seeds from the labels, with the kernels of a layout (PACKED_NONE for the generic ones)
+    inline void UpdateSeeds( int layout );
+
     // SLIC
     inline void PerformSLIC( const int& num_iterations );
 
@@ -254,147 +496,131 @@ private:
     // MSLIC
     inline void PerformMSLIC( const int& num_iterations );
 
+    // SLIC or SLICO, coarse-to-fine
+    inline void PerformPyramid( const int& num_iterations );
+
+    // SLIC on the OpenCL device (false if it can't run there)
+    inline bool PerformSLICOpenCL( const int& num_iterations );
+
+    // enforceLabelConnectivity without the stats and trace events, also run by every MSLIC iteration
+    inline void EnforceConnectivity( int min_element_size );
+
     // MSLIC
     inline void SuperpixelSplit();
 
 	//////////////////// Custom Methods ////////////////////
 
-	// Finds each superpixel's neighboring superpixels and the average color of each superpixel
-	inline void findSuperpixelNeighborsAndAverages
+	// Saves what the convergence criterion compares against (seeds or labels) before an iteration
+	inline void saveIterationStart
 	(
-		vector< set<int> >& superpixel_neighbors,
-		vector< vector<float> >& superpixel_average_colors,
-		vector<int>& superpixel_population
+		vector<float>& previous_seedsx,
+		vector<float>& previous_seedsy,
+		Mat& previous_labels
 	);
 
-	// Finds each superpixel's neighboring superpixels and the normalized (between 0 and 1) color histogram of each superpixel
-	inline void findSuperpixelNeighborsAndHistograms
+	// Checks if the last iteration moved the seeds or changed the labels less than the convergence tolerance
+	inline bool hasConverged
 	(
-		const int num_buckets[],
-		vector< set<int> >& superpixel_neighbors,
-		vector< vector< vector<float> >>& superpixel_color_histograms,
-		vector<int>& superpixel_population
+		const vector<float>& previous_seedsx,
+		const vector<float>& previous_seedsy,
+		const Mat& previous_labels
 	);
 
-	// Adds a specific pixel's color to its superpixel's average color
-	inline void addColorsToAverages
+	// Checks if the seeds moved less than the convergence tolerance on average during the last iteration
+	inline bool seedsConverged
 	(
-		vector< vector<float> >& superpixel_average_colors,
-		const int current_superpixel,
-		const int x,
-		const int y
-	);
+		const vector<float>& previous_seedsx,
+		const vector<float>& previous_seedsy
+	) const;
 
-	// Adds a specific pixel's color to its superpixel's color histogram
-	inline void addColorsToHistograms
-	(
-		const int num_buckets[],
-		vector< vector< vector<float> >>& superpixel_color_histograms,
-		const int current_superpixel,
-		const int x,
-		const int y
-	);
+	// Builds the region adjacency graph of m_klabels in one pass over the labels
+	inline void buildRegionAdjacencyGraph(const bool boundary_lengths);
 
-	// Links superpixels to each neighboring superpixel above and to the left of it
-	inline void linkNeighborSuperpixels
-	(
-		vector< set<int> >& superpixel_neighbors,
-		const int current_superpixel,
-		const int x,
-		const int y
-	);
+	// Builds the region adjacency graph of m_klabels from the boundary runs between its superpixels
+	inline void buildRegionAdjacencyGraph(const vector<Vec3i>& runs, const bool boundary_lengths);
 
-	// Groups superpixels into super-duper-pixels based on their average colors
-	inline void groupSuperpixels
+	// Finds the average color of each superpixel
+	// Each row of superpixel_average_colors is the average color of one superpixel
+	inline void findSuperpixelAverages
 	(
-		const float max_distance,
-		const bool use_duper_distance,
-		const vector< set<int> >& superpixel_neighbors,
-		const vector< vector<float> >& superpixel_average_colors,
-		const vector<int>& superpixel_population,
-		std::list<SuperDuperPixel>& superduperpixels,
-		vector<SuperDuperPixel*>& superduperpixel_pointers,
-		vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators
+		Mat& superpixel_average_colors,
+		vector<int>& superpixel_population
 	);
 
-	// Groups superpixels into super-duper-pixels based on their color histograms
-	inline void groupSuperpixels
+	// Finds the normalized (between 0 and 1) color histogram of each superpixel
+	// Each row of superpixel_color_histograms is the histogram of one superpixel (every color channel's buckets one
+	// after another, padded with zeros to SUPERDUPERPIXEL_VALUE_ALIGNMENT)
+	inline void findSuperpixelHistograms
 	(
 		const int num_buckets[],
-		const float max_distance,
-		const bool use_duper_distance,
-		const vector< set<int> >& superpixel_neighbors,
-		const vector< vector< vector<float> >>& superpixel_color_histograms,
-		const vector<int>& superpixel_population,
-		std::list<SuperDuperPixel>& superduperpixels,
-		vector<SuperDuperPixel*>& superduperpixel_pointers,
-		vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators
+		Mat& superpixel_color_histograms,
+		vector<int>& superpixel_population
 	);
 
-	// Gets the color distance between 2 superpixels' average colors
-	inline float getColorDistance
+	// Collects the stats of every superpixel in one (parallel) sweep over the image
+	inline void collectSuperpixelStats(SuperpixelStats& stats);
+
+	// Groups superpixels into super-duper-pixels and relabels the image with them
+	// Superpixels with a kept super-duper-pixel (not -1) start out grouped by it and pairs of them aren't compared
+	inline void duperizeSuperpixels
 	(
+		const float max_distance,
 		const bool use_duper_distance,
-		const std::list<SuperDuperPixel>& superduperpixels,
-		const vector<SuperDuperPixel*>& superduperpixel_pointers,
-		const vector< vector<float> >& superpixel_average_colors, 
-		const vector<float>& average_colors,
-		const int superpixel,
-		const int neighbor
+		const Mat& superpixel_colors,
+		const vector<int>& superpixel_population,
+		const SuperDuperPixelMode mode,
+		const vector<int>& kept_superduperpixels
 	);
 
-	// Gets the color distance between 2 superpixels' color histograms
-	inline float getColorDistance
+	// Finds the super-duper-pixel of the last duperize each superpixel keeps (-1 if it changed too much)
+	inline void matchPreviousSuperpixels
 	(
-		const int num_buckets[],
-		const bool use_duper_distance,
-		const std::list<SuperDuperPixel>& superduperpixels,
-		const vector<SuperDuperPixel*>& superduperpixel_pointers,
-		const vector< vector< vector<float> >>& superpixel_color_histograms, 
-		const vector< vector<float> >& color_histogram,
-		const int superpixel,
-		const int neighbor
+		const float change_tolerance,
+		const Mat& superpixel_colors,
+		vector<int>& kept_superduperpixels
 	);
 
-	// Gets a vector of the average colors for a superpixel
-	inline void extractAverageColors
+	// Merges the closest pair of neighboring super-duper-pixels until they're too far apart or there's few enough
+	// of them, then relabels the image with them
+	// superpixel_colors and superpixel_population end up holding the colors and population of each super-duper-pixel
+	// in the row of its lowest superpixel
+	inline void mergeSuperpixelsBestFirst
 	(
-		const vector< vector<float> >& superpixel_average_colors,
-		vector<float>& average_colors,
-		const int superpixel
+		const float max_distance,
+		const int num_regions,
+		Mat& superpixel_colors,
+		vector<int>& superpixel_population
 	);
 
-	// Gets a vector of the color histogram for a superpixel
-	inline void extractColorHistogram
+	// Groups superpixels into super-duper-pixels based on their color values (average colors or color histograms)
+	inline void groupSuperpixels
 	(
-		const int num_buckets[],
-		const vector< vector< vector<float> >>& superpixel_color_histograms,
-		vector< vector<float> >& color_histogram,
-		const int superpixel
+		const float max_distance,
+		const bool use_duper_distance,
+		const RegionAdjacencyGraph& superpixel_neighbors,
+		const Mat& superpixel_colors,
+		const vector<int>& superpixel_population,
+		const vector<int>& kept_superduperpixels,
+		SuperDuperPixelForest& superduperpixels,
+		int64& merges,
+		int64& distance_evaluations
 	);
 
-	// Combines 2 superpixels into a super-duper-pixel using their average colors
-	inline void combineIntoSuperDuperPixel
+	// Gets the color distance between 2 superpixels' color values
+	inline float getColorDistance
 	(
-		std::list<SuperDuperPixel>& superduperpixels,
-		vector<SuperDuperPixel*>& superduperpixel_pointers,
-		vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators,
-		const vector< vector<float> >& superpixel_average_colors,
-		const vector<float>& average_colors,
-		const vector<int>& superpixel_population,
+		const bool use_duper_distance,
+		SuperDuperPixelForest& superduperpixels,
+		const Mat& superpixel_colors,
 		const int superpixel,
 		const int neighbor
 	);
 
-	// Combines 2 superpixels into a super-duper-pixel using their color histograms
+	// Combines 2 superpixels into a super-duper-pixel
 	inline void combineIntoSuperDuperPixel
 	(
-		const int num_buckets[],
-		std::list<SuperDuperPixel>& superduperpixels,
-		vector<SuperDuperPixel*>& superduperpixel_pointers,
-		vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators,
-		const vector< vector< vector<float> >>& superpixel_color_histograms,
-		const vector< vector<float> >& color_histogram,
+		SuperDuperPixelForest& superduperpixels,
+		const Mat& superpixel_colors,
 		const vector<int>& superpixel_population,
 		const int superpixel,
 		const int neighbor
@@ -403,7 +629,7 @@ private:
 	// Gives super-duper-pixels indexes to assign to pixels as labels for what superpixel they're in
 	inline int indexSuperduperpixels
 	(
-		const std::list<SuperDuperPixel>& superduperpixels,
+		SuperDuperPixelForest& superduperpixels,
 		vector<int>& superduperpixel_indexes
 	);
 
@@ -416,13 +642,28 @@ private:
 
 CV_EXPORTS Ptr<SuperpixelSLIC> createSuperpixelSLIC( InputArray image, int algorithm, int region_size, float ruler )
 {
-    return makePtr<SuperpixelSLICImpl>( image, algorithm, region_size, ruler );
+    return makePtr<SuperpixelSLICImpl>( image, algorithm, region_size, ruler, Ptr<SegmentationWorkspace>() );
+}
+
+CV_EXPORTS Ptr<SuperpixelSLIC> createSuperpixelSLIC( InputArray image, const Ptr<SegmentationWorkspace>& workspace,
+                                                     int algorithm, int region_size, float ruler )
+{
+    return makePtr<SuperpixelSLICImpl>( image, algorithm, region_size, ruler, workspace );
 }
 
-SuperpixelSLICImpl::SuperpixelSLICImpl( InputArray _image, int _algorithm, int _region_size, float _ruler )
-                   : m_algorithm(_algorithm), m_region_size(_region_size), m_ruler(_ruler)
+SuperpixelSLICImpl::SuperpixelSLICImpl( InputArray _image, int _algorithm, int _region_size, float _ruler,
+                                        const Ptr<SegmentationWorkspace>& _workspace )
+                   : m_algorithm(_algorithm), m_region_size(_region_size), m_ruler(_ruler),
+                     m_convergence(SLIC_CONVERGENCE_NONE), m_convergence_tolerance(0.0f), m_iterations_run(0),
+                     m_pyramid_levels(0), m_pyramid_refine_iterations(2), m_low_memory(false), m_peak_bytes(0),
+                     m_instrumented(false), m_trace_callback(NULL), m_trace_user_data(NULL),
+                     m_workspace(_workspace), m_split_channels(_image.isMat() || _image.isUMat()),
+                     m_use_opencl(false), m_ocl_channels(0)
 {
-    if ( _image.isMat() )
+    // take over the workspace buffers, they go back in the destructor
+    swapWorkspace();
+
+    if ( _image.isMat() || _image.isUMat() )
     {
       Mat image = _image.getMat();
 
@@ -436,6 +677,11 @@ SuperpixelSLICImpl::SuperpixelSLICImpl( InputArray _image, int _algorithm, int _
 
       // intialize channels
       split( image, m_chvec );
+
+      // a UMat also stays on the device (when there is one)
+      m_use_opencl = _image.isUMat() && ocl::useOpenCL();
+      if ( m_use_opencl )
+        _image.getUMat().convertTo( m_ocl_image, CV_32F );
     }
     else if ( _image.isMatVector() )
     {
@@ -458,6 +704,8 @@ SuperpixelSLICImpl::SuperpixelSLICImpl( InputArray _image, int _algorithm, int _
 
 SuperpixelSLICImpl::~SuperpixelSLICImpl()
 {
+    swapWorkspace();
+
     m_chvec.clear();
     m_kseeds.clear();
     m_kseedsx.clear();
@@ -472,6 +720,9 @@ int SuperpixelSLICImpl::getNumberOfSuperpixels() const
 
 void SuperpixelSLICImpl::initialize()
 {
+    // always timed, the constructor seeds before instrumentation can be turned on
+    int64 start = getTickCount();
+
     // total amount of superpixels given its size as input
     m_numlabels = int(float(m_width * m_height)
                 /  float(m_region_size * m_region_size));
@@ -480,7 +731,16 @@ void SuperpixelSLICImpl::initialize()
     m_kseeds.resize( m_nr_channels );
 
     // intitialize label storage
-    m_klabels = Mat( m_height, m_width, CV_32S, Scalar::all(0) );
+    m_klabels.create( m_height, m_width, CV_32S );
+    m_klabels.setTo( Scalar::all(0) );
+    m_adjacency_valid = false;
+    m_contour_valid = false;
+
+    // nothing duperized yet
+    m_last_duperize.valid = false;
+    m_superpixel_labels.release();
+    m_superpixel_colors.release();
+    m_superduperpixel_indexes.clear();
 
     // perturb seeds is not absolutely necessary,
     // one can set this flag to false
@@ -511,14 +771,38 @@ void SuperpixelSLICImpl::initialize()
       m_merge = 4.0f;
       m_adaptk.resize( m_numlabels, 1.0f );
     }
+
+    updatePeakBytes();
+
+    m_stats.seeding_ms = double( getTickCount() - start ) * 1000.0 / getTickFrequency();
+    if ( m_instrumented && m_trace_callback )
+    {
+      SLICTraceEvent event = { "seeding", (int64) ( double( start ) * 1e6 / getTickFrequency() ),
+                               (int64) ( m_stats.seeding_ms * 1000.0 ) };
+      m_trace_callback( event, m_trace_user_data );
+    }
 }
 
 void SuperpixelSLICImpl::iterate( int num_iterations )
 {
     // store total iterations
     m_iterations = num_iterations;
+    m_iterations_run = 0;
 
-    if( m_algorithm == SLICO )
+    int64 start = stageStart();
+    if ( m_instrumented )
+      m_stats.pixels_relabeled.clear();
+
+    // only SLIC has OpenCL kernels, anything else (or a device that fails) runs on the CPU
+    if( m_use_opencl && m_algorithm == SLIC && m_pyramid_levels == 0 &&
+        PerformSLICOpenCL( num_iterations ) )
+    {
+      // labels and seeds are back on the host
+    }
+    else if( m_pyramid_levels > 0 &&
+        ( ( m_algorithm == SLIC ) || ( m_algorithm == SLICO ) ) )
+      PerformPyramid( num_iterations );
+    else if( m_algorithm == SLICO )
       PerformSLICO( num_iterations );
     else if( m_algorithm == SLIC )
       PerformSLIC( num_iterations );
@@ -529,141 +813,588 @@ void SuperpixelSLICImpl::iterate( int num_iterations )
 
     // re-update amount of labels
     m_numlabels = (int)m_kseeds[0].size();
-}
 
-void SuperpixelSLICImpl::getLabels(OutputArray labels_out) const
-{
-    labels_out.assign( m_klabels );
+    // labels changed
+    m_adjacency_valid = false;
+    m_contour_valid = false;
+
+    updatePeakBytes();
+    // the interleaved channels are only scratch of the iterations (MSLIC and the OpenCL path don't pack
+    // at all), so a later peak doesn't count a stale copy
+    m_packed.release();
+
+    if ( m_instrumented )
+    {
+      m_stats.iterations_run = m_iterations_run;
+      stageEnd( "iterate", start, m_stats.iterate_ms );
+    }
 }
 
-void SuperpixelSLICImpl::getLabelContourMask(OutputArray _mask, bool _thick_line) const
+void SuperpixelSLICImpl::setImage( InputArray _image, bool warm_start )
 {
-    // default width
-    int line_width = 2;
+    vector<Mat> chvec;
+    if ( _image.isMat() || _image.isUMat() )
+      split( _image.getMat(), chvec );
+    else if ( _image.isMatVector() )
+      _image.getMatVector( chvec );
+    else
+      CV_Error( Error::StsInternal, "Invalid InputArray." );
 
-    if ( !_thick_line ) line_width = 1;
+    // array should be valid
+    CV_Assert( !chvec.empty() && !chvec[0].empty() );
 
-    _mask.create( m_height, m_width, CV_8UC1 );
-    Mat mask = _mask.getMat();
+    // a frame with another layout can't reuse the segmentation
+    bool same_layout = (int) chvec.size() == m_nr_channels
+                    && chvec[0].size() == Size( m_width, m_height )
+                    && chvec[0].depth() == m_chvec[0].depth();
+
+    m_chvec = chvec;
+    m_split_channels = _image.isMat() || _image.isUMat();
+    m_use_opencl = _image.isUMat() && ocl::useOpenCL();
+    if ( m_use_opencl )
+      _image.getUMat().convertTo( m_ocl_image, CV_32F );
+    else
+      m_ocl_image.release();
+    m_width = m_chvec[0].size().width;
+    m_height = m_chvec[0].size().height;
+    m_nr_channels = (int) m_chvec.size();
 
-    mask.setTo(0);
+    if ( !warm_start || !same_layout )
+    {
+      initialize();
+      return;
+    }
 
-    const int dx8[8] = { -1, -1,  0,  1, 1, 1, 0, -1 };
-    const int dy8[8] = {  0, -1, -1, -1, 0, 1, 1,  1 };
+    // seeds stay where they are but take their colors from the new frame
+    SampleSeedColors();
 
-    int sz = m_width*m_height;
+    // the labels left over were renumbered by connectivity (or duperize), so they
+    // don't index the seeds anymore and pixels no window reaches would keep them
+    m_numlabels = (int) m_kseeds[0].size();
+    AssignNearestSeeds();
+    m_adjacency_valid = false;
+    m_contour_valid = false;
 
-    vector<bool> istaken(sz, false);
+    if( m_algorithm == MSLIC )
+      m_adaptk.resize( m_numlabels, 1.0f );
+}
 
-    int mainindex = 0;
-    for( int j = 0; j < m_height; j++ )
+inline void SuperpixelSLICImpl::SampleSeedColors()
+{
+    int numseeds = (int) m_kseedsx.size();
+    for( int n = 0; n < numseeds; n++ )
     {
-      for( int k = 0; k < m_width; k++ )
-      {
-        int np = 0;
-        for( int i = 0; i < 8; i++ )
+        int X = min( max( (int) m_kseedsx[n], 0 ), m_width - 1 );
+        int Y = min( max( (int) m_kseedsy[n], 0 ), m_height - 1 );
+
+        switch ( m_chvec[0].depth() )
         {
-          int x = k + dx8[i];
-          int y = j + dy8[i];
+          case CV_8U:
+            for( int b = 0; b < m_nr_channels; b++ )
+              m_kseeds[b][n] = m_chvec[b].at<uchar>(Y,X);
+            break;
+
+          case CV_8S:
+            for( int b = 0; b < m_nr_channels; b++ )
+              m_kseeds[b][n] = m_chvec[b].at<char>(Y,X);
+            break;
+
+          case CV_16U:
+            for( int b = 0; b < m_nr_channels; b++ )
+              m_kseeds[b][n] = m_chvec[b].at<ushort>(Y,X);
+            break;
+
+          case CV_16S:
+            for( int b = 0; b < m_nr_channels; b++ )
+              m_kseeds[b][n] = m_chvec[b].at<short>(Y,X);
+            break;
+
+          case CV_32S:
+            for( int b = 0; b < m_nr_channels; b++ )
+              m_kseeds[b][n] = (float) m_chvec[b].at<int>(Y,X);
+            break;
+
+          case CV_32F:
+            for( int b = 0; b < m_nr_channels; b++ )
+              m_kseeds[b][n] = m_chvec[b].at<float>(Y,X);
+            break;
+
+          case CV_64F:
+            for( int b = 0; b < m_nr_channels; b++ )
+              m_kseeds[b][n] = (float) m_chvec[b].at<double>(Y,X);
+            break;
+
+          default:
+            CV_Error( Error::StsInternal, "Invalid matrix depth" );
+            break;
+        }
+    }
+}
 
-          if( (x >= 0 && x < m_width) && (y >= 0 && y < m_height) )
-          {
-            int index = y*m_width + x;
+inline void SuperpixelSLICImpl::AssignNearestSeeds()
+{
+    Mat distxy( m_height, m_width, CV_32F, Scalar::all(FLT_MAX) );
+    m_klabels.create( m_height, m_width, CV_32S );
+    m_klabels.setTo( Scalar::all(-1) );
 
-            if( false == istaken[index] )
+    // the same windows the grow steps search
+    for( int n = 0; n < m_numlabels; n++ )
+    {
+        const int y1 = max(0,          (int) m_kseedsy[n] - m_region_size);
+        const int y2 = min(m_height,   (int) m_kseedsy[n] + m_region_size);
+        const int x1 = max(0,          (int) m_kseedsx[n] - m_region_size);
+        const int x2 = min(m_width,    (int) m_kseedsx[n] + m_region_size);
+        for( int y = y1; y < y2; y++ )
+        {
+          float* dist = distxy.ptr<float>(y);
+          int* labels = m_klabels.ptr<int>(y);
+          const float dy = y - m_kseedsy[n];
+          for( int x = x1; x < x2; x++ )
+          {
+            const float dx = x - m_kseedsx[n];
+            const float d = dx * dx + dy * dy;
+            if( d < dist[x] )
             {
-              if( m_klabels.at<int>(j,k) != m_klabels.at<int>(y,x) ) np++;
+              dist[x] = d;
+              labels[x] = n;
             }
           }
         }
-        if( np > line_width )
+    }
+
+    // seeds that drifted apart can leave pixels outside every window
+    parallel_for_( Range(0, m_height), [&]( const Range& range )
+    {
+        for( int y = range.start; y < range.end; y++ )
         {
-           mask.at<char>(j,k) = (uchar)255;
-           istaken[mainindex] = true;
+          int* labels = m_klabels.ptr<int>(y);
+          for( int x = 0; x < m_width; x++ )
+          {
+            if( labels[x] >= 0 )
+              continue;
+
+            float best = FLT_MAX;
+            labels[x] = 0;
+            for( int n = 0; n < m_numlabels; n++ )
+            {
+              const float dx = x - m_kseedsx[n];
+              const float dy = y - m_kseedsy[n];
+              if( dx * dx + dy * dy < best )
+              {
+                best = dx * dx + dy * dy;
+                labels[x] = n;
+              }
+            }
+          }
         }
-        mainindex++;
-      }
-    }
+    } );
 }
 
-/*
- * EnforceLabelConnectivity
- *
- *   1. finding an adjacent label for each new component at the start
- *   2. if a certain component is too small, assigning the previously found
- *      adjacent label to this component, and not incrementing the label.
- *
- */
-void SuperpixelSLICImpl::enforceLabelConnectivity( int min_element_size )
+void SuperpixelSLICImpl::setConvergenceCriterion( int criterion, float tolerance )
 {
+    if ( criterion != SLIC_CONVERGENCE_NONE && criterion != SLIC_CONVERGENCE_SEED_DISPLACEMENT
+      && criterion != SLIC_CONVERGENCE_LABEL_CHANGE )
+      CV_Error( Error::StsBadArg, "No such convergence criterion" );
+    if ( !( tolerance >= 0.0f ) )
+      CV_Error( Error::StsBadArg, "Convergence tolerance must be a non-negative number" );
+
+    m_convergence = criterion;
+    m_convergence_tolerance = tolerance;
+}
 
-    if ( min_element_size == 0 ) return;
-    CV_Assert( min_element_size >= 0 && min_element_size <= 100 );
+int SuperpixelSLICImpl::getNumberOfIterationsRun() const
+{
+    return m_iterations_run;
+}
 
-    vector<float> adaptk( m_numlabels, 1.0f );
+void SuperpixelSLICImpl::setLowMemory( bool low_memory )
+{
+    m_low_memory = low_memory;
+}
 
-    if( m_algorithm == MSLIC )
-    {
-      adaptk.clear();
-    }
+double SuperpixelSLICImpl::getPeakBytesPerMegapixel() const
+{
+    return (double) m_peak_bytes / ( (double) m_width * m_height / 1e6 );
+}
 
-    const int dx4[4] = { -1,  0,  1,  0 };
-    const int dy4[4] = {  0, -1,  0,  1 };
+inline int SuperpixelSLICImpl::distanceBandRows() const
+{
+    // a band covers two seed windows, so most seeds touch at most two bands
+    if ( !m_low_memory )
+      return m_height;
+    return min( m_height, max( 4 * m_region_size, 16 ) );
+}
 
-    const int sz = m_width * m_height;
-    const int supsz = sz / m_numlabels;
+inline void SuperpixelSLICImpl::saveLabels( Mat& saved_labels ) const
+{
+    if ( m_low_memory && m_numlabels <= USHRT_MAX + 1 )
+      m_klabels.convertTo( saved_labels, CV_16U );
+    else
+      m_klabels.copyTo( saved_labels );
+}
 
-    int div = int(100.0f/(float)min_element_size + 0.5f);
-    int min_sp_sz = max(3, supsz / div);
+inline void SuperpixelSLICImpl::updatePeakBytes()
+{
+    size_t bytes = m_klabels.total() * m_klabels.elemSize()
+                 + m_distvec.total() * m_distvec.elemSize()
+                 + m_distxy.total() * m_distxy.elemSize()
+                 + m_distchans.total() * m_distchans.elemSize()
+                 + m_prev_klabels.total() * m_prev_klabels.elemSize()
+                 + m_superpixel_labels.total() * m_superpixel_labels.elemSize()
+                 + m_pyramid_labels.total() * m_pyramid_labels.elemSize()
+                 + m_pyramid_band.total() * m_pyramid_band.elemSize()
+                 + m_contour_mask.total() * m_contour_mask.elemSize();
+
+    // channels that are only headers of the caller's matrices don't count
+    if ( m_split_channels )
+      for ( size_t b = 0; b < m_chvec.size(); b++ )
+        bytes += m_chvec[b].total() * m_chvec[b].elemSize();
+    for ( size_t b = 0; b < m_pyramid_chvec.size(); b++ )
+      bytes += m_pyramid_chvec[b].total() * m_pyramid_chvec[b].elemSize();
+    // a single channel is packed without a copy
+    if ( m_packed.channels() > 1 )
+      bytes += m_packed.total() * m_packed.elemSize();
+
+    m_peak_bytes = max( m_peak_bytes, bytes );
+    m_stats.peak_scratch_bytes = m_peak_bytes;
+}
 
-    Mat nlabels( m_height, m_width, CV_32S, Scalar(INT_MAX) );
+void SuperpixelSLICImpl::setInstrumentation( bool enabled )
+{
+    m_instrumented = enabled;
+}
 
-    int label = 0;
-    vector<int> xvec(sz);
-    vector<int> yvec(sz);
+const SLICStats& SuperpixelSLICImpl::getStats() const
+{
+    return m_stats;
+}
 
-    // MSLIC
-    int currentlabel;
-    float diffch = 0.0f;
-    vector<float> adjch;
-    vector<float> curch;
-    map<int,int> hashtable;
+void SuperpixelSLICImpl::setTraceCallback( SLICTraceCallback callback, void* user_data )
+{
+    m_trace_callback = callback;
+    m_trace_user_data = user_data;
+}
 
-    if( m_algorithm == MSLIC )
+inline int64 SuperpixelSLICImpl::stageStart() const
+{
+    return m_instrumented ? getTickCount() : 0;
+}
+
+inline void SuperpixelSLICImpl::stageEnd( const char* name, int64 start, double& stage_ms )
+{
+    if ( !m_instrumented )
+      return;
+
+    const double frequency = getTickFrequency();
+    stage_ms = double( getTickCount() - start ) * 1000.0 / frequency;
+    if ( m_trace_callback )
     {
-      hashtable[-1] = 0;
-      adjch.resize( m_nr_channels, 0 );
-      curch.resize( m_nr_channels, 0 );
+      SLICTraceEvent event = { name, (int64) ( double( start ) * 1e6 / frequency ), (int64) ( stage_ms * 1000.0 ) };
+      m_trace_callback( event, m_trace_user_data );
     }
+}
 
-    //adjacent label
-    int adjlabel = 0;
+void SuperpixelSLICImpl::setPyramid( int levels, int refine_iterations )
+{
+    if ( levels < 0 || refine_iterations < 0 )
+      CV_Error( Error::StsBadArg, "Pyramid levels and refinement iterations must not be negative" );
 
-    for( int j = 0; j < m_height; j++ )
-    {
-        for( int k = 0; k < m_width; k++ )
-        {
-            if( nlabels.at<int>(j,k) == INT_MAX )
-            {
-                nlabels.at<int>(j,k) = label;
-                //--------------------
-                // Start a new segment
-                //--------------------
-                xvec[0] = k;
-                yvec[0] = j;
-                currentlabel = m_klabels.at<int>(j,k);
-                //-------------------------------------------------------
+    m_pyramid_levels = levels;
+    m_pyramid_refine_iterations = refine_iterations;
+}
+
+void SuperpixelSLICImpl::getLabels(OutputArray labels_out) const
+{
+    // copied so the label buffer can be reused (by a workspace or the next segmentation)
+    m_klabels.copyTo( labels_out );
+}
+
+inline void SuperpixelSLICImpl::swapWorkspace()
+{
+    if ( !m_workspace )
+      return;
+
+    // channels are only pooled when they were split from a Mat, otherwise they are the caller's
+    if ( m_split_channels )
+      std::swap( m_chvec, m_workspace->channels );
+    std::swap( m_klabels, m_workspace->labels );
+    std::swap( m_kseeds, m_workspace->seeds );
+    std::swap( m_kseedsx, m_workspace->seeds_x );
+    std::swap( m_kseedsy, m_workspace->seeds_y );
+    std::swap( m_distvec, m_workspace->distances );
+    std::swap( m_distxy, m_workspace->spatial_distances );
+    std::swap( m_distchans, m_workspace->color_distances );
+    std::swap( m_prev_kseedsx, m_workspace->previous_seeds_x );
+    std::swap( m_prev_kseedsy, m_workspace->previous_seeds_y );
+    std::swap( m_prev_klabels, m_workspace->previous_labels );
+}
+
+// Marks the contour pixels of a row of labels in mask_row: pixels with more than line_width of their 8
+// neighbors in another superpixel, not counting the neighbors before them (to the left and in the row
+// above) that are contour pixels already. above and below are NULL at the top and bottom of the image.
+static void MarkContourRow( const int* above, const int* row, const int* below,
+                            const uchar* mask_above, uchar* mask_row, int width, int line_width )
+{
+    for( int x = 0; x < width; x++ )
+    {
+      const int label = row[x];
+      const int x1 = max( x - 1, 0 );
+      const int x2 = min( x + 1, width - 1 );
+      int np = 0;
+
+      if( x > 0 && !mask_row[x - 1] && row[x - 1] != label ) np++;
+      if( x + 1 < width && row[x + 1] != label ) np++;
+      if( above )
+        for( int xx = x1; xx <= x2; xx++ )
+          if( !mask_above[xx] && above[xx] != label ) np++;
+      // nothing after this pixel is marked yet
+      if( below )
+        for( int xx = x1; xx <= x2; xx++ )
+          if( below[xx] != label ) np++;
+
+      mask_row[x] = np > line_width ? (uchar)255 : (uchar)0;
+    }
+}
+
+void SuperpixelSLICImpl::getLabelContourMask(OutputArray _mask, bool _thick_line) const
+{
+    // duperize already marked the thick contours of these labels
+    if ( _thick_line && m_contour_valid )
+    {
+      m_contour_mask.copyTo( _mask );
+      return;
+    }
+
+    // default width
+    int line_width = 2;
+
+    if ( !_thick_line ) line_width = 1;
+
+    _mask.create( m_height, m_width, CV_8UC1 );
+    Mat mask = _mask.getMat();
+
+    for( int y = 0; y < m_height; y++ )
+    {
+      MarkContourRow( y > 0 ? m_klabels.ptr<int>(y - 1) : NULL, m_klabels.ptr<int>(y),
+                      y + 1 < m_height ? m_klabels.ptr<int>(y + 1) : NULL,
+                      y > 0 ? mask.ptr<uchar>(y - 1) : NULL, mask.ptr<uchar>(y), m_width, line_width );
+    }
+}
+
+// root of a pixel in the union-find forest of FindConnectedComponents
+static inline int FindComponent( vector<int>& parent, int p )
+{
+    while( parent[p] != p )
+    {
+      parent[p] = parent[parent[p]];
+      p = parent[p];
+    }
+    return p;
+}
+
+// joins the components of 2 pixels under the lower root
+static inline void UniteComponents( vector<int>& parent, int p, int q )
+{
+    p = FindComponent( parent, p );
+    q = FindComponent( parent, q );
+    if( p < q )
+      parent[q] = p;
+    else if( q < p )
+      parent[p] = q;
+}
+
+struct ComponentsInvoker : ParallelLoopBody
+{
+    enum Step { UNITE_BANDS, FIND_ROOTS };
+
+    ComponentsInvoker( const Mat* _labels, vector<int>* _parent, vector<int>* _component,
+                       int _nbands, Step _step )
+    {
+      labels = _labels;
+      parent = _parent;
+      component = _component;
+      nbands = _nbands;
+      step = _step;
+    }
+
+    void operator ()(const cv::Range& range) const CV_OVERRIDE
+    {
+      const int width = labels->cols;
+      const int height = labels->rows;
+      for( int band = range.start; band < range.end; band++ )
+      {
+        const int y1 = band * height / nbands;
+        const int y2 = (band + 1) * height / nbands;
+        for( int y = y1; y < y2; y++ )
+        {
+          const int* row = labels->ptr<int>(y);
+          const int* row_above = y > y1 ? labels->ptr<int>(y - 1) : NULL;
+          for( int x = 0; x < width; x++ )
+          {
+            int p = y * width + x;
+            if( step == UNITE_BANDS )
+            {
+              // each band only touches its own pixels
+              (*parent)[p] = p;
+              if( x > 0 && row[x - 1] == row[x] )
+                UniteComponents( *parent, p, p - 1 );
+              if( row_above != NULL && row_above[x] == row[x] )
+                UniteComponents( *parent, p, p - width );
+            }
+            else
+            {
+              // read only, so bands can share the forest
+              int root = p;
+              while( (*parent)[root] != root )
+                root = (*parent)[root];
+              (*component)[p] = root;
+            }
+          }
+        }
+      }
+    }
+
+    const Mat* labels;
+    vector<int>* parent;
+    vector<int>* component;
+    int nbands;
+    Step step;
+};
+
+/*
+ * FindConnectedComponents
+ *
+ *   Finds the 4-connected components of pixels with the same label by
+ * union-find in parallel bands of rows, then joins the bands. Every
+ * component is named by the raster index of its first pixel.
+ *
+ */
+static void FindConnectedComponents( const Mat& labels, vector<int>& component )
+{
+    const int width = labels.cols;
+    const int height = labels.rows;
+    const int nbands = max( 1, min( height, getNumThreads() * 4 ) );
+
+    vector<int> parent( (size_t) width * height );
+    component.resize( parent.size() );
+    parallel_for_( Range(0, nbands), ComponentsInvoker( &labels, &parent, &component,
+                   nbands, ComponentsInvoker::UNITE_BANDS ) );
+
+    for( int band = 1; band < nbands; band++ )
+    {
+      const int y = band * height / nbands;
+      const int* row = labels.ptr<int>(y);
+      const int* row_above = labels.ptr<int>(y - 1);
+      for( int x = 0; x < width; x++ )
+        if( row_above[x] == row[x] )
+          UniteComponents( parent, y * width + x, (y - 1) * width + x );
+    }
+
+    parallel_for_( Range(0, nbands), ComponentsInvoker( &labels, &parent, &component,
+                   nbands, ComponentsInvoker::FIND_ROOTS ) );
+}
+
+/*
+ * EnforceLabelConnectivity
+ *
+ *   1. finding an adjacent label for each new component at the start
+ *   2. if a certain component is too small, assigning the previously found
+ *      adjacent label to this component, and not incrementing the label.
+ *
+ */
+void SuperpixelSLICImpl::enforceLabelConnectivity( int min_element_size )
+{
+
+    if ( min_element_size == 0 ) return;
+    CV_Assert( min_element_size >= 0 && min_element_size <= 100 );
+
+    int64 start = stageStart();
+    if ( m_instrumented )
+      m_stats.superpixels_before_connectivity = m_numlabels;
+
+    EnforceConnectivity( min_element_size );
+
+    if ( m_instrumented )
+    {
+      m_stats.superpixels_after_connectivity = m_numlabels;
+      stageEnd( "enforceLabelConnectivity", start, m_stats.connectivity_ms );
+    }
+}
+
+inline void SuperpixelSLICImpl::EnforceConnectivity( int min_element_size )
+{
+    vector<float> adaptk( m_numlabels, 1.0f );
+
+    if( m_algorithm == MSLIC )
+    {
+      adaptk.clear();
+    }
+
+    const int dx4[4] = { -1,  0,  1,  0 };
+    const int dy4[4] = {  0, -1,  0,  1 };
+
+    const int sz = m_width * m_height;
+    const int supsz = sz / m_numlabels;
+
+    int div = int(100.0f/(float)min_element_size + 0.5f);
+    int min_sp_sz = max(3, supsz / div);
+
+    // components of same-labeled pixels, named after their first pixel
+    vector<int> component;
+    FindConnectedComponents( m_klabels, component );
+
+    // size of each component (under its first pixel),
+    // replaced by its new label once it got one
+    vector<int> nlabel( sz, 0 );
+    for( int p = 0; p < sz; p++ )
+      nlabel[component[p]]++;
+
+    int label = 0;
+
+    // MSLIC
+    int currentlabel;
+    float diffch = 0.0f;
+    vector<float> adjch;
+    vector<float> curch;
+    map<int,int> hashtable;
+
+    if( m_algorithm == MSLIC )
+    {
+      hashtable[-1] = 0;
+      adjch.resize( m_nr_channels, 0 );
+      curch.resize( m_nr_channels, 0 );
+    }
+
+    //adjacent label
+    int adjlabel = 0;
+
+    // components in the order of their first pixel, like a flood fill
+    // in raster order would find them
+    for( int j = 0; j < m_height; j++ )
+    {
+        for( int k = 0; k < m_width; k++ )
+        {
+            const int p = j * m_width + k;
+            if( component[p] == p )
+            {
+                //--------------------
+                // Start a new segment
+                //--------------------
+                currentlabel = m_klabels.at<int>(j,k);
+                //-------------------------------------------------------
                 // Quickly find an adjacent label for use later if needed
                 //-------------------------------------------------------
                 for( int n = 0; n < 4; n++ )
                 {
-                    int x = xvec[0] + dx4[n];
-                    int y = yvec[0] + dy4[n];
+                    int x = k + dx4[n];
+                    int y = j + dy4[n];
                     if( (x >= 0 && x < m_width) && (y >= 0 && y < m_height) )
                     {
-                        if( nlabels.at<int>(y,x) != INT_MAX )
+                        // components starting earlier are labeled already
+                        int neighbor = component[y * m_width + x];
+                        if( neighbor < p )
                         {
-                            adjlabel = nlabels.at<int>(y,x);
+                            adjlabel = nlabel[neighbor];
                             if( m_algorithm == MSLIC )
                             {
                                 for( int b = 0; b < m_nr_channels; b++ )
@@ -690,27 +1421,8 @@ void SuperpixelSLICImpl::enforceLabelConnectivity( int min_element_size )
                     adaptk.push_back( m_adaptk[currentlabel] );
                 }
 
-                int count(1);
-                for( int c = 0; c < count; c++ )
-                {
-                    for( int n = 0; n < 4; n++ )
-                    {
-                        int x = xvec[c] + dx4[n];
-                        int y = yvec[c] + dy4[n];
-
-                        if( (x >= 0 && x < m_width) && (y >= 0 && y < m_height) )
-                        {
-                            if( INT_MAX == nlabels.at<int>(y,x) &&
-                                m_klabels.at<int>(j,k) == m_klabels.at<int>(y,x) )
-                            {
-                                xvec[count] = x;
-                                yvec[count] = y;
-                                nlabels.at<int>(y,x) = label;
-                                count++;
-                            }
-                        }
-                    }
-                }
+                int count = nlabel[p];
+                nlabel[p] = label;
                 // MSLIC only
                 if( m_algorithm == MSLIC )
                 {
@@ -739,10 +1451,7 @@ void SuperpixelSLICImpl::enforceLabelConnectivity( int min_element_size )
                               hashtable[adjlabel] += hashtable[(int)adaptk.size()-1];
                           }
 
-                          for( int c = 0; c < count; c++ )
-                          {
-                              nlabels.at<int>(yvec[c],xvec[c]) = adjlabel;
-                          }
+                          nlabel[p] = adjlabel;
 
                           label--;
                           adaptk.pop_back();
@@ -755,10 +1464,7 @@ void SuperpixelSLICImpl::enforceLabelConnectivity( int min_element_size )
                       //-------------------------------------------------------
                       if( count <= min_sp_sz )
                       {
-                          for( int c = 0; c < count; c++ )
-                          {
-                              nlabels.at<int>(yvec[c],xvec[c]) = adjlabel;
-                          }
+                          nlabel[p] = adjlabel;
                           label--;
                       }
                   }
@@ -771,10 +1477,7 @@ void SuperpixelSLICImpl::enforceLabelConnectivity( int min_element_size )
                   //-------------------------------------------------------
                   if( count <= min_sp_sz )
                   {
-                      for( int c = 0; c < count; c++ )
-                      {
-                          nlabels.at<int>(yvec[c],xvec[c]) = adjlabel;
-                      }
+                      nlabel[p] = adjlabel;
                       label--;
                   }
                 }
@@ -782,66 +1485,328 @@ void SuperpixelSLICImpl::enforceLabelConnectivity( int min_element_size )
             }
         }
     }
+
+    // relabel every pixel with its component's new label
+    Mat nlabels( m_height, m_width, CV_32S );
+    parallel_for_( Range(0, m_height), [&]( const Range& range )
+    {
+        for( int y = range.start; y < range.end; y++ )
+        {
+          int* row = nlabels.ptr<int>(y);
+          const int* components = &component[(size_t) y * m_width];
+          for( int x = 0; x < m_width; x++ )
+            row[x] = nlabel[components[x]];
+        }
+    } );
+
     // replace old
     m_klabels = nlabels;
     m_numlabels = label;
+    m_adjacency_valid = false;
+    m_contour_valid = false;
 
     m_adaptk.clear();
     m_adaptk = adaptk;
 }
 
+// Collects the boundary runs between different superpixels in rows [y_begin, y_end) of a label image
+// Each run is (superpixel, neighbor, number of 4-connected pixel pairs in the run)
+// Consecutive pixels on a horizontal boundary between the same superpixels are collapsed into one run
+static void collectBoundaryRuns(const Mat& labels, const int y_begin, const int y_end, vector<Vec3i>& runs)
+{
+	for (int y = y_begin; y < y_end; y += 1)
+	{
+		const int* row = labels.ptr<int>(y);
+		const int* row_above = y > 0 ? labels.ptr<int>(y - 1) : NULL;
+		// Index of the run the pixel to the left and its above neighbor were added to (-1 if there's none)
+		int vertical_run = -1;
+		for (int x = 0; x < labels.cols; x += 1)
+		{
+			int current_superpixel = row[x];
+			if (x > 0 && row[x - 1] != current_superpixel)
+				runs.push_back(Vec3i(current_superpixel, row[x - 1], 1));
+			if (row_above != NULL && row_above[x] != current_superpixel)
+			{
+				if (vertical_run != -1 && runs[vertical_run][0] == current_superpixel && runs[vertical_run][1] == row_above[x])
+					runs[vertical_run][2] += 1;
+				else
+				{
+					vertical_run = (int) runs.size();
+					runs.push_back(Vec3i(current_superpixel, row_above[x], 1));
+				}
+			}
+			else
+				vertical_run = -1;
+		}
+	}
+}
+
+/*
+ * SuperpixelStats
+ *
+ *   Per-superpixel stats used for duperization, accumulated over rows of the image in one sweep:
+ *   population, channel sums (average mode) or bucket counts (histogram mode), and the boundary runs
+ *   the region adjacency graph is built from.
+ *   Each stripe of rows accumulates into its own partial buffers which are joined at the end
+ *   (see parallel_reduce_stripes()).
+ */
+struct SuperpixelStats
+{
+    SuperpixelStats( const vector<Mat>& _chvec, const Mat& _klabels, const int _numlabels,
+                     const int _nr_channels, const int* _num_buckets, const int _row_size,
+                     const bool _find_runs )
+    {
+      chvec = _chvec;
+      klabels = _klabels;
+      numlabels = _numlabels;
+      nr_channels = _nr_channels;
+      num_buckets = _num_buckets;
+      row_size = _row_size;
+      find_runs = _find_runs;
+
+      population.assign(numlabels, 0);
+      if ( num_buckets == NULL )
+        sums.assign((size_t) numlabels * nr_channels, 0.0);
+      else
+        counts.assign((size_t) numlabels * row_size, 0);
+    }
+
+    SuperpixelStats( const SuperpixelStats& stats, Split )
+    {
+      // same parameters with fresh zeroed buffers
+      chvec = stats.chvec;
+      klabels = stats.klabels;
+      numlabels = stats.numlabels;
+      nr_channels = stats.nr_channels;
+      num_buckets = stats.num_buckets;
+      row_size = stats.row_size;
+      find_runs = stats.find_runs;
+
+      population.assign(numlabels, 0);
+      if ( num_buckets == NULL )
+        sums.assign((size_t) numlabels * nr_channels, 0.0);
+      else
+        counts.assign((size_t) numlabels * row_size, 0);
+    }
+
+    void operator()( const BlockedRange& range )
+    {
+      switch ( chvec[0].depth() )
+      {
+        case CV_8U:  accumulate<uchar>( range );  break;
+        case CV_8S:  accumulate<schar>( range );  break;
+        case CV_16U: accumulate<ushort>( range ); break;
+        case CV_16S: accumulate<short>( range );  break;
+        case CV_32S: accumulate<int>( range );    break;
+        case CV_32F: accumulate<float>( range );  break;
+        case CV_64F: accumulate<double>( range ); break;
+
+        default:
+          CV_Error( Error::StsInternal, "Invalid matrix depth" );
+          break;
+      }
+
+      if ( find_runs )
+        collectBoundaryRuns( klabels, range.begin(), range.end(), runs );
+    }
+
+    void join( SuperpixelStats& stats )
+    {
+      for ( int l = 0; l < numlabels; l++ )
+        population[l] += stats.population[l];
+      for ( size_t i = 0; i < sums.size(); i++ )
+        sums[i] += stats.sums[i];
+      for ( size_t i = 0; i < counts.size(); i++ )
+        counts[i] += stats.counts[i];
+      runs.insert( runs.end(), stats.runs.begin(), stats.runs.end() );
+    }
+
+    template<typename T>
+    void accumulate( const BlockedRange& range )
+    {
+      // histogram bucket sizes of integer types (floating point values are assumed to be between 0 and 1)
+      vector<int> bucket_size( nr_channels, 1 );
+      if ( num_buckets != NULL && std::numeric_limits<T>::is_integer )
+      {
+        int max_value = (int) std::numeric_limits<T>::max();
+        for ( int b = 0; b < nr_channels; b++ )
+          bucket_size[b] = max_value / num_buckets[b] + (max_value % num_buckets[b] != 0);
+      }
+
+      vector<const T*> rows( nr_channels );
+      for ( int y = range.begin(); y < range.end(); y++ )
+      {
+        const int* labels = klabels.ptr<int>(y);
+        for ( int b = 0; b < nr_channels; b++ )
+          rows[b] = chvec[b].ptr<T>(y);
+
+        for ( int x = 0; x < klabels.cols; x++ )
+        {
+          int idx = labels[x];
+          population[idx]++;
+
+          if ( num_buckets == NULL )
+          {
+            double* sum = &sums[(size_t) idx * nr_channels];
+            for ( int b = 0; b < nr_channels; b++ )
+              sum[b] += rows[b][x];
+          }
+          else
+          {
+            int* count = &counts[(size_t) idx * row_size];
+            for ( int b = 0; b < nr_channels; b++ )
+            {
+              int bucket_index;
+              if ( std::numeric_limits<T>::is_integer )
+                bucket_index = (int) rows[b][x] / bucket_size[b];
+              else
+              {
+                bucket_index = (int) (rows[b][x] * num_buckets[b]);
+                // Subtract 1 if the bucket index is too big (value of 1.0 * num_buckets would be out of bounds)
+                bucket_index -= (int) (bucket_index == num_buckets[b]);
+              }
+              count[bucket_index]++;
+              count += num_buckets[b];
+            }
+          }
+        }
+      }
+    }
+
+    Mat klabels;
+    int numlabels;
+    int nr_channels;
+    const int* num_buckets;
+    int row_size;
+    bool find_runs;
+    vector<Mat> chvec;
+    vector<int> population;
+    // channel sums of each superpixel (average mode), numlabels x nr_channels
+    vector<double> sums;
+    // bucket counts of each superpixel (histogram mode), numlabels x row_size
+    vector<int> counts;
+    // boundary runs between superpixels
+    vector<Vec3i> runs;
+};
+
+// Saves what the convergence criterion compares against (seeds or labels) before an iteration
+void SuperpixelSLICImpl::saveIterationStart
+(
+	vector<float>& previous_seedsx,
+	vector<float>& previous_seedsy,
+	Mat& previous_labels
+)
+{
+	if (m_convergence == SLIC_CONVERGENCE_SEED_DISPLACEMENT)
+	{
+		previous_seedsx = m_kseedsx;
+		previous_seedsy = m_kseedsy;
+	}
+
+	// Instrumentation counts the relabeled pixels of every iteration
+	if (m_convergence == SLIC_CONVERGENCE_LABEL_CHANGE || m_instrumented)
+	{
+		saveLabels(previous_labels);
+	}
+}
+
+// Checks if the last iteration moved the seeds or changed the labels less than the convergence tolerance
+bool SuperpixelSLICImpl::hasConverged
+(
+	const vector<float>& previous_seedsx,
+	const vector<float>& previous_seedsy,
+	const Mat& previous_labels
+)
+{
+	bool converged = false;
+	if (m_convergence == SLIC_CONVERGENCE_SEED_DISPLACEMENT)
+		converged = this->seedsConverged(previous_seedsx, previous_seedsy);
+
+	if (m_convergence == SLIC_CONVERGENCE_LABEL_CHANGE || m_instrumented)
+	{
+		// Fraction of pixels that got a different label
+		int64 changed_pixels = this->countChangedLabels(previous_labels);
+		if (m_instrumented)
+			m_stats.pixels_relabeled.push_back(changed_pixels);
+		if (m_convergence == SLIC_CONVERGENCE_LABEL_CHANGE)
+			converged = (double) changed_pixels / ((double) m_width * m_height) < m_convergence_tolerance;
+	}
+	return converged;
+}
+
+// Checks if the seeds moved less than the convergence tolerance on average
+bool SuperpixelSLICImpl::seedsConverged
+(
+	const vector<float>& previous_seedsx,
+	const vector<float>& previous_seedsy
+) const
+{
+	// Average distance each seed moved
+	int num_seeds = (int) min(previous_seedsx.size(), m_kseedsx.size());
+	if (num_seeds == 0)
+		return true;
+	double total_displacement = 0;
+	for (int n = 0; n < num_seeds; n += 1)
+	{
+		float dx = m_kseedsx[n] - previous_seedsx[n];
+		float dy = m_kseedsy[n] - previous_seedsy[n];
+		total_displacement += std::sqrt(dx * dx + dy * dy);
+	}
+	return total_displacement / num_seeds < m_convergence_tolerance;
+}
+
+// Counts the pixels with another label than in previous_labels
+int64 SuperpixelSLICImpl::countChangedLabels(const Mat& previous_labels) const
+{
+	int64 changed_pixels = 0;
+	for (int y = 0; y < m_height; y += 1)
+	{
+		const int* labels = m_klabels.ptr<int>(y);
+		if (previous_labels.depth() == CV_16U)
+		{
+			const ushort* previous = previous_labels.ptr<ushort>(y);
+			for (int x = 0; x < m_width; x += 1)
+				changed_pixels += labels[x] != previous[x];
+		}
+		else
+		{
+			const int* previous = previous_labels.ptr<int>(y);
+			for (int x = 0; x < m_width; x += 1)
+				changed_pixels += labels[x] != previous[x];
+		}
+	}
+	return changed_pixels;
+}
+
 /*
  * Combine adjacent superpixels into super-duper-pixels if they're similar enough in color.
  * Uses average colors of superpixels to determine if they're similar enough in color.
  */
 void SuperpixelSLICImpl::duperizeWithAverage(const float max_distance, const bool use_duper_distance)
 {
-	// Graph of which superpixels are adjecent to each other
-	// First dimension is each superpixel
-	// Second dimension is index of each neighboring superpixel
-	vector< set<int> > superpixel_neighbors;
+	int64 start = this->stageStart();
 
 	// Average colors of each superpixel
-	// First dimension is each color channel
-	// Second dimension is each superpixel
-	vector< vector<float> > superpixel_average_colors;
+	// Each row is a superpixel, each column is a color channel
+	Mat superpixel_average_colors;
 
 	// The number of pixels in each superpixel
 	vector<int> superpixel_population;
 
-	// Find which superpixels are neighbors and get the average color of each superpixel
-	this->findSuperpixelNeighborsAndAverages(superpixel_neighbors, superpixel_average_colors, superpixel_population);
+	// Get the average color of each superpixel
+	this->findSuperpixelAverages(superpixel_average_colors, superpixel_population);
 
-	// Keep track of super-duper-pixels
-	// Use list to quickly add them to a data structure
-	// Use pointers to keep track of them to directly access them
-	// Use iterators to delete them from lists when they merge with another super-duper-pixel
-	std::list<SuperDuperPixel> superduperpixels;
-	vector<SuperDuperPixel*> superduperpixel_pointers;
-	vector<std::list<SuperDuperPixel>::iterator> superduperpixel_iterators;
+	m_last_duperize.valid = true;
+	m_last_duperize.best_first = false;
+	m_last_duperize.mode = AVERAGE;
+	m_last_duperize.distance = max_distance;
+	m_last_duperize.use_duper_distance = use_duper_distance;
+	m_last_duperize.num_regions = 0;
+	m_last_duperize.num_buckets.clear();
 
-	// Group neighboring superpixels into super-duper-pixels if they're similar enough in color
-	this->groupSuperpixels
-	(
-		max_distance,
-		use_duper_distance,
-		superpixel_neighbors,
-		superpixel_average_colors,
-		superpixel_population,
-		superduperpixels,
-		superduperpixel_pointers,
-		superduperpixel_iterators
-	);
+	this->duperizeSuperpixels(max_distance, use_duper_distance, superpixel_average_colors, superpixel_population, AVERAGE, vector<int>());
 
-	// Stores which super-duper-pixel each superpixel belong to
-	// super-duper-pixel value of -1 means it doesn't belong to a superduperpixel yet
-	vector<int> superduperpixel_indexes(m_numlabels, -1);
-	// Get indexes for each new super-duper-pixel
-	int superduperpixel_count = this->indexSuperduperpixels(superduperpixels, superduperpixel_indexes);
-	// Assign the new super-duper-pixel indexes to the pixels that belong to them
-	this->assignSuperduperpixels(superduperpixel_indexes);
-	// Change the number of labels since there are (most likely) less now
-	m_numlabels = superduperpixel_count;
+	this->stageEnd("duperizeWithAverage", start, m_stats.duperize_ms);
 }
 
 /*
@@ -850,421 +1815,616 @@ void SuperpixelSLICImpl::duperizeWithAverage(const float max_distance, const boo
  */
 void SuperpixelSLICImpl::duperizeWithHistogram(const int num_buckets[], const float distance, const bool use_duper_distance)
 {
-	// Graph of which superpixels are adjecent to each other
-	// First dimension is each superpixel
-	// Second dimension is index of each neighboring superpixel
-	vector< set<int> > superpixel_neighbors(m_numlabels);
-
-	// The number of pixels in each superpixel
-	vector<int> superpixel_population(m_numlabels, 0);
+	int64 start = this->stageStart();
 
 	// Color histograms of each superpixel
-	// First dimension is each color channel
-	// Second dimension is each histogram basket
-	// Third dimension is each superpixel
-	vector< vector< vector<float> >> superpixel_color_histograms;
+	// Each row is a superpixel, the buckets of every color channel are stored one after another in the row
+	Mat superpixel_color_histograms;
 
-	// Find which superpixels are neighbors and get the color histogram of each superpixel
-	this->findSuperpixelNeighborsAndHistograms
+	// The number of pixels in each superpixel
+	vector<int> superpixel_population;
+
+	// Get the color histogram of each superpixel
+	this->findSuperpixelHistograms
 	(
 		num_buckets,
-		superpixel_neighbors,
 		superpixel_color_histograms,
 		superpixel_population
 	);
 
+	m_last_duperize.valid = true;
+	m_last_duperize.best_first = false;
+	m_last_duperize.mode = HISTOGRAM;
+	m_last_duperize.distance = distance;
+	m_last_duperize.use_duper_distance = use_duper_distance;
+	m_last_duperize.num_regions = 0;
+	m_last_duperize.num_buckets.assign(num_buckets, num_buckets + m_nr_channels);
+
+	this->duperizeSuperpixels(distance, use_duper_distance, superpixel_color_histograms, superpixel_population, HISTOGRAM, vector<int>());
+
+	this->stageEnd("duperizeWithHistogram", start, m_stats.duperize_ms);
+}
+
+/*
+ * Duperize again with the parameters of the last duperize, only regrouping superpixels that changed since then.
+ */
+void SuperpixelSLICImpl::reduperize(const float change_tolerance)
+{
+	if (!m_last_duperize.valid)
+		CV_Error(Error::StsBadArg, "Nothing to reduperize, duperize first");
+
+	// Copy since duperizing overwrites them
+	const DuperizeParameters parameters = m_last_duperize;
+	const int* num_buckets = parameters.num_buckets.empty() ? NULL : &parameters.num_buckets[0];
+
+	// Best-first merges depend on every region so they can't be partly kept (and time themselves)
+	if (parameters.best_first)
+	{
+		if (parameters.mode == AVERAGE)
+			this->duperizeBestFirstWithAverage(parameters.distance, parameters.num_regions);
+		else
+			this->duperizeBestFirstWithHistogram(num_buckets, parameters.distance, parameters.num_regions);
+		return;
+	}
+
+	int64 start = this->stageStart();
+
+	Mat superpixel_colors;
+	vector<int> superpixel_population;
+	if (parameters.mode == AVERAGE)
+		this->findSuperpixelAverages(superpixel_colors, superpixel_population);
+	else
+		this->findSuperpixelHistograms(num_buckets, superpixel_colors, superpixel_population);
+
+	// Super-duper-pixel each superpixel keeps from the last duperize (-1 for superpixels that changed)
+	vector<int> kept_superduperpixels;
+	this->matchPreviousSuperpixels(change_tolerance, superpixel_colors, kept_superduperpixels);
+
+	this->duperizeSuperpixels
+	(
+		parameters.distance,
+		parameters.use_duper_distance,
+		superpixel_colors,
+		superpixel_population,
+		parameters.mode,
+		kept_superduperpixels
+	);
+
+	this->stageEnd("reduperize", start, m_stats.duperize_ms);
+}
+
+// Finds the super-duper-pixel of the last duperize each superpixel keeps (-1 if it changed too much)
+void SuperpixelSLICImpl::matchPreviousSuperpixels
+(
+	const float change_tolerance,
+	const Mat& superpixel_colors,
+	vector<int>& kept_superduperpixels
+)
+{
+	kept_superduperpixels.assign(m_numlabels, -1);
+	if (m_superpixel_labels.size() != m_klabels.size() || m_superpixel_colors.cols != superpixel_colors.cols)
+		return;
+
+	// Centroid of each superpixel
+	vector<double> sum_x(m_numlabels, 0), sum_y(m_numlabels, 0);
+	vector<int> pixel_count(m_numlabels, 0);
+	for (int y = 0; y < m_height; y += 1)
+	{
+		const int* labels = m_klabels.ptr<int>(y);
+		for (int x = 0; x < m_width; x += 1)
+		{
+			sum_x[labels[x]] += x;
+			sum_y[labels[x]] += y;
+			pixel_count[labels[x]] += 1;
+		}
+	}
+
+	// Match each superpixel with the previous superpixel under its centroid and keep that one's super-duper-pixel
+	// if their stats are close enough
+	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
+	{
+		if (pixel_count[superpixel] == 0)
+			continue;
+		int x = min(max(cvRound(sum_x[superpixel] / pixel_count[superpixel]), 0), m_width - 1);
+		int y = min(max(cvRound(sum_y[superpixel] / pixel_count[superpixel]), 0), m_height - 1);
+		int previous_superpixel = m_superpixel_labels.depth() == CV_16U
+			? m_superpixel_labels.at<ushort>(y, x) : m_superpixel_labels.at<int>(y, x);
+		if (previous_superpixel < 0 || previous_superpixel >= m_superpixel_colors.rows)
+			continue;
+
+		float change = l1_distance
+		(
+			superpixel_colors.ptr<float>(superpixel),
+			m_superpixel_colors.ptr<float>(previous_superpixel),
+			superpixel_colors.cols
+		);
+		if (change < change_tolerance)
+			kept_superduperpixels[superpixel] = m_superduperpixel_indexes[previous_superpixel];
+	}
+}
+
+// Groups superpixels into super-duper-pixels and relabels the image with them
+void SuperpixelSLICImpl::duperizeSuperpixels
+(
+	const float max_distance,
+	const bool use_duper_distance,
+	const Mat& superpixel_colors,
+	const vector<int>& superpixel_population,
+	const SuperDuperPixelMode mode,
+	const vector<int>& kept_superduperpixels
+)
+{
+	// Graph of which superpixels are adjecent to each other
+	const RegionAdjacencyGraph& superpixel_neighbors = this->getRegionAdjacencyGraph();
+
 	// Keep track of super-duper-pixels
-	// Use list to quickly add them to a data structure
-	// Use pointers to keep track of them to directly access them
-	// Use iterators to delete them from lists when they merge with another super-duper-pixel
-	std::list<SuperDuperPixel> superduperpixels;
-	vector<SuperDuperPixel*> superduperpixel_pointers;
-	vector<std::list<SuperDuperPixel>::iterator> superduperpixel_iterators;
+	// Disjoint-set forest over the superpixels, each tree in it is a super-duper-pixel
+	SuperDuperPixelForest superduperpixels(m_numlabels, superpixel_colors.cols, mode);
+
+	// Superpixels that kept a super-duper-pixel start out grouped by it
+	if (!kept_superduperpixels.empty())
+	{
+		// First superpixel put in each kept super-duper-pixel
+		vector<int> group_members(*std::max_element(kept_superduperpixels.begin(), kept_superduperpixels.end()) + 1, -1);
+		for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
+		{
+			int kept = kept_superduperpixels[superpixel];
+			if (kept == -1)
+				continue;
+			if (group_members[kept] == -1)
+			{
+				superduperpixels.create_group(superpixel, superpixel_colors.ptr<float>(superpixel), superpixel_population[superpixel]);
+				group_members[kept] = superpixel;
+			}
+			else
+				superduperpixels.add_superpixel(group_members[kept], superpixel, superpixel_colors.ptr<float>(superpixel), superpixel_population[superpixel]);
+		}
+	}
 
 	// Group neighboring superpixels into super-duper-pixels if they're similar enough in color
+	int64 merges = 0, distance_evaluations = 0;
 	this->groupSuperpixels
 	(
-		num_buckets,
-		distance,
+		max_distance,
 		use_duper_distance,
 		superpixel_neighbors,
-		superpixel_color_histograms,
+		superpixel_colors,
 		superpixel_population,
+		kept_superduperpixels,
 		superduperpixels,
-		superduperpixel_pointers,
-		superduperpixel_iterators
+		merges,
+		distance_evaluations
 	);
-	
+	if (m_instrumented)
+	{
+		m_stats.merges = merges;
+		m_stats.distance_evaluations = distance_evaluations;
+	}
+
 	// Stores which super-duper-pixel each superpixel belong to
 	// super-duper-pixel value of -1 means it doesn't belong to a superduperpixel yet
 	vector<int> superduperpixel_indexes(m_numlabels, -1);
 	// Get indexes for each new super-duper-pixel
 	int superduperpixel_count = this->indexSuperduperpixels(superduperpixels, superduperpixel_indexes);
+	// Keep the grouping for reduperize
+	m_superpixel_colors = superpixel_colors;
+	m_superduperpixel_indexes = superduperpixel_indexes;
 	// Assign the new super-duper-pixel indexes to the pixels that belong to them
 	this->assignSuperduperpixels(superduperpixel_indexes);
 	// Change the number of labels since there are (most likely) less now
 	m_numlabels = superduperpixel_count;
 }
 
-// Finds each superpixel's neighboring superpixels and the average color of each superpixel
-void SuperpixelSLICImpl::findSuperpixelNeighborsAndAverages
-(
-	vector< set<int> >& superpixel_neighbors,
-	vector< vector<float> >& superpixel_average_colors,
-	vector<int>& superpixel_population
-)
+/*
+ * Combine adjacent superpixels into super-duper-pixels by always merging the closest pair first.
+ * Uses average colors of superpixels to determine how close they are.
+ */
+void SuperpixelSLICImpl::duperizeBestFirstWithAverage(const float distance, const int num_regions)
 {
-	superpixel_neighbors = vector< set<int> >(m_numlabels);
-	superpixel_average_colors = vector< vector<float> >(m_nr_channels, vector<float>(m_numlabels, 0));
-	superpixel_population = vector<int>(m_numlabels, 0);
-	// Loop through each pixel
-	// Find superpixel connections
-	// Get average color of superpixels
-	for (int y = 0; y < m_height; y += 1)
-	for (int x = 0; x < m_width; x += 1)
-	{
-		int current_superpixel = m_klabels.at<int>(y, x);
-		this->linkNeighborSuperpixels(superpixel_neighbors, current_superpixel, x, y);
-		// Keeps count of the number of pixels in each superpixel (for calculating average color)
-		superpixel_population[current_superpixel] += 1;
-		this->addColorsToAverages(superpixel_average_colors, current_superpixel, x, y);
-	}
-	
-	// Loop through each superpixel
-	// Remove superpixels being connected to themselves
-	// Divide each superpixel average color value by the number of pixels in that superpixel to get the actual average
-	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
-	{
-		superpixel_neighbors[superpixel].erase(superpixel);
-		for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
-		{
-			superpixel_average_colors[color_channel][superpixel] /= superpixel_population[superpixel];
-		}
-	}
+	int64 start = this->stageStart();
+
+	Mat superpixel_average_colors;
+	vector<int> superpixel_population;
+	this->findSuperpixelAverages(superpixel_average_colors, superpixel_population);
+
+	m_last_duperize.valid = true;
+	m_last_duperize.best_first = true;
+	m_last_duperize.mode = AVERAGE;
+	m_last_duperize.distance = distance;
+	m_last_duperize.num_regions = num_regions;
+	m_last_duperize.num_buckets.clear();
+
+	this->mergeSuperpixelsBestFirst(distance, num_regions, superpixel_average_colors, superpixel_population);
+
+	this->stageEnd("duperizeBestFirstWithAverage", start, m_stats.duperize_ms);
 }
 
-// Finds each superpixel's neighboring superpixels and the normalized (between 0 and 1) color histogram of each superpixel
-void SuperpixelSLICImpl::findSuperpixelNeighborsAndHistograms
-(
-	const int num_buckets[],
-	vector< set<int> >& superpixel_neighbors,
-	vector< vector< vector<float> >>& superpixel_color_histograms,
-	vector<int>& superpixel_population
-)
+/*
+ * Combine adjacent superpixels into super-duper-pixels by always merging the closest pair first.
+ * Uses (normalized) color histograms of superpixels to determine how close they are.
+ */
+void SuperpixelSLICImpl::duperizeBestFirstWithHistogram(const int num_buckets[], const float distance, const int num_regions)
 {
-	superpixel_neighbors = vector< set<int> >(m_numlabels);
-	superpixel_color_histograms = vector< vector< vector<float> >>(m_nr_channels);
-	// Initialize each color of the histograms in a loop since they could have different numbers of buckets
-	for (int channel = 0; channel < m_nr_channels; channel += 1)
-	{
-		superpixel_color_histograms[channel] = vector< vector<float> >(num_buckets[channel], vector<float>(m_numlabels, 0.0));
-	}
-	superpixel_population = vector<int>(m_numlabels, 0);
+	int64 start = this->stageStart();
 
-	// Loop through each pixel
-	// Find superpixel connections
-	// Get color histograms of superpixels
-	for (int y = 0; y < m_height; y += 1)
-	for (int x = 0; x < m_width; x += 1)
-	{
-		int current_superpixel = m_klabels.at<int>(y, x);
-		this->linkNeighborSuperpixels(superpixel_neighbors, current_superpixel, x, y);
-		// Keeps count of the number of pixels in each superpixel (for normalizing color histogram values to percentages)
-		superpixel_population[current_superpixel] += 1;
-		this->addColorsToHistograms(num_buckets, superpixel_color_histograms, current_superpixel, x, y);
-	}
+	Mat superpixel_color_histograms;
+	vector<int> superpixel_population;
+	this->findSuperpixelHistograms(num_buckets, superpixel_color_histograms, superpixel_population);
 
-	// Loop through each superpixel
-	// Remove superpixels being connected to themselves
-	// Divide each superpixel color histogram value by the number of pixels in that superpixel to normalize them into percentages
-	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
-	{
-		superpixel_neighbors[superpixel].erase(superpixel);
-		for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
-		for (int bucket = 0; bucket < num_buckets[color_channel]; bucket += 1)
-		{
-			superpixel_color_histograms[color_channel][bucket][superpixel] /= superpixel_population[superpixel];
-		}
-	}
+	m_last_duperize.valid = true;
+	m_last_duperize.best_first = true;
+	m_last_duperize.mode = HISTOGRAM;
+	m_last_duperize.distance = distance;
+	m_last_duperize.num_regions = num_regions;
+	m_last_duperize.num_buckets.assign(num_buckets, num_buckets + m_nr_channels);
+
+	this->mergeSuperpixelsBestFirst(distance, num_regions, superpixel_color_histograms, superpixel_population);
+
+	this->stageEnd("duperizeBestFirstWithHistogram", start, m_stats.duperize_ms);
 }
 
-// Links superpixels to each neighboring superpixel above and to the left of it
-void SuperpixelSLICImpl::linkNeighborSuperpixels
-(
-	vector< set<int> >& superpixel_neighbors,
-	const int current_superpixel,
-	const int x,
-	const int y
-)
+// A possible merge of 2 neighboring regions in best-first merging
+// It's out of date once either region changed after it was made (the versions don't match anymore)
+struct RegionMergeCandidate
 {
-	// Create connections between adjacent superpixels based on where adjacent pixels are
-	// in different superpixels
-	bool not_left_column = x > 0;
-	bool not_top_row = y > 0;
-	if (not_left_column)
+	float distance;
+	int region;
+	int neighbor;
+	int region_version;
+	int neighbor_version;
+
+	// Orders candidates so the closest pair is on top of a priority_queue (ties go to the lowest regions)
+	bool operator<(const RegionMergeCandidate& other) const
 	{
-		int superpixel_to_left = m_klabels.at<int>(y, x - 1);
-		superpixel_neighbors[current_superpixel].insert(superpixel_to_left);
-		superpixel_neighbors[superpixel_to_left].insert(current_superpixel);
+		if (distance != other.distance)
+			return distance > other.distance;
+		if (region != other.region)
+			return region > other.region;
+		return neighbor > other.neighbor;
 	}
-	if (not_top_row)
+};
+
+// Finds which region a superpixel (or an old region) belongs to now
+static int findRegion(vector<int>& region_parent, int region)
+{
+	while (region_parent[region] != region)
 	{
-		int superpixel_above = m_klabels.at<int>(y - 1, x);
-		superpixel_neighbors[current_superpixel].insert(superpixel_above);
-		superpixel_neighbors[superpixel_above].insert(current_superpixel);
+		region_parent[region] = region_parent[region_parent[region]];
+		region = region_parent[region];
 	}
+	return region;
 }
 
-// Adds a specific pixel's color to its superpixel's average color
-void SuperpixelSLICImpl::addColorsToAverages
+// Merges the closest pair of neighboring regions of a region adjacency graph until they're too far apart or there's
+// few enough of them
+int mergeRegionsBestFirst
 (
-	vector< vector<float> >& superpixel_average_colors,
-	const int current_superpixel,
-	const int x,
-	const int y
+	const RegionAdjacencyGraph& superpixel_neighbors,
+	const float max_distance,
+	const int num_regions,
+	Mat& superpixel_colors,
+	vector<int>& superpixel_population,
+	vector<int>& superduperpixel_indexes,
+	int64* distance_evaluations
 )
 {
-	// Get average colors for each superpixel
-	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
+	const int num_superpixels = superpixel_colors.rows;
+	int64 evaluations = 0;
+	const int num_values = superpixel_colors.cols;
+	// Distance and merge routines for rows of num_values floats
+	const SuperDuperPixelKernels kernels = SuperDuperPixelKernels::select(num_values);
+
+	// Regions start as single superpixels, every region is named after (and keeps its stats in the row of) its
+	// lowest superpixel, so a merge always keeps the lower of the 2 names
+	vector<int> region_parent(num_superpixels);
+	// Number of times each region has grown, for throwing out candidates made before that
+	vector<int> region_version(num_superpixels, 0);
+	// Neighbors of each region (can hold old names of regions that have since been merged)
+	vector< vector<int> > region_neighbors(num_superpixels);
+	priority_queue<RegionMergeCandidate> candidates;
+	for (int superpixel = 0; superpixel < num_superpixels; superpixel += 1)
 	{
-		switch ( m_chvec[0].depth() )
+		region_parent[superpixel] = superpixel;
+		const int* neighbors_begin = superpixel_neighbors.neighbors.data() + superpixel_neighbors.offsets[superpixel];
+		const int* neighbors_end = superpixel_neighbors.neighbors.data() + superpixel_neighbors.offsets[superpixel + 1];
+		region_neighbors[superpixel].assign(neighbors_begin, neighbors_end);
+		for (const int* neighbor = neighbors_begin; neighbor != neighbors_end; neighbor += 1)
 		{
-			case CV_8U:
-				superpixel_average_colors[color_channel][current_superpixel] += m_chvec[color_channel].at<uchar>(y, x);
-				break;
-
-			case CV_8S:
-				superpixel_average_colors[color_channel][current_superpixel] += m_chvec[color_channel].at<char>(y, x);
-				break;
-
-			case CV_16U:
-				superpixel_average_colors[color_channel][current_superpixel] += m_chvec[color_channel].at<ushort>(y, x);
-				break;
-
-			case CV_16S:
-				superpixel_average_colors[color_channel][current_superpixel] += m_chvec[color_channel].at<short>(y, x);
-				break;
-
-			case CV_32S:
-				superpixel_average_colors[color_channel][current_superpixel] += m_chvec[color_channel].at<int>(y, x);
-				break;
+			if (*neighbor < superpixel)
+				continue;
+			float neighbor_distance = kernels.distance(superpixel_colors.ptr<float>(superpixel), superpixel_colors.ptr<float>(*neighbor), num_values);
+			evaluations += 1;
+			candidates.push({neighbor_distance, superpixel, *neighbor, 0, 0});
+		}
+	}
 
-			case CV_32F:
-				superpixel_average_colors[color_channel][current_superpixel] += m_chvec[color_channel].at<float>(y, x);
-				break;
+	int region_count = num_superpixels;
+	while (!candidates.empty() && region_count > num_regions)
+	{
+		RegionMergeCandidate candidate = candidates.top();
+		candidates.pop();
 
-			case CV_64F:
-				superpixel_average_colors[color_channel][current_superpixel] += (float) m_chvec[color_channel].at<double>(y, x);
-				break;
+		// Skip candidates for regions that were merged away or grew since the candidate was made
+		if (region_parent[candidate.region] != candidate.region || region_parent[candidate.neighbor] != candidate.neighbor
+			|| region_version[candidate.region] != candidate.region_version
+			|| region_version[candidate.neighbor] != candidate.neighbor_version)
+			continue;
 
-			default:
-				CV_Error( Error::StsInternal, "Invalid matrix depth" );
-				break;
+		// The closest pair is too far apart, so every other one is too
+		if (candidate.distance >= max_distance)
+			break;
+
+		int region = candidate.region;
+		int merged_region = candidate.neighbor;
+		kernels.average
+		(
+			superpixel_colors.ptr<float>(region),
+			superpixel_population[region],
+			superpixel_colors.ptr<float>(merged_region),
+			superpixel_population[merged_region],
+			num_values
+		);
+		superpixel_population[region] += superpixel_population[merged_region];
+		region_parent[merged_region] = region;
+		region_version[region] += 1;
+		region_count -= 1;
+
+		// Neighbors of the merged region are the neighbors of both regions (besides themselves) under their current names
+		vector<int>& neighbors = region_neighbors[region];
+		neighbors.insert(neighbors.end(), region_neighbors[merged_region].begin(), region_neighbors[merged_region].end());
+		vector<int>().swap(region_neighbors[merged_region]);
+		for (int& neighbor : neighbors)
+			neighbor = findRegion(region_parent, neighbor);
+		std::sort(neighbors.begin(), neighbors.end());
+		neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+		neighbors.erase(std::remove(neighbors.begin(), neighbors.end(), region), neighbors.end());
+
+		for (int neighbor : neighbors)
+		{
+			float neighbor_distance = kernels.distance(superpixel_colors.ptr<float>(region), superpixel_colors.ptr<float>(neighbor), num_values);
+			evaluations += 1;
+			int low = std::min(region, neighbor);
+			int high = std::max(region, neighbor);
+			candidates.push({neighbor_distance, low, high, region_version[low], region_version[high]});
 		}
 	}
+
+	// Index super-duper-pixels in the order of their lowest superpixel
+	superduperpixel_indexes.assign(num_superpixels, -1);
+	int superduperpixel_count = 0;
+	for (int superpixel = 0; superpixel < num_superpixels; superpixel += 1)
+	{
+		int region = findRegion(region_parent, superpixel);
+		if (region == superpixel)
+			superduperpixel_indexes[superpixel] = superduperpixel_count++;
+		else
+			superduperpixel_indexes[superpixel] = superduperpixel_indexes[region];
+	}
+	if (distance_evaluations)
+		*distance_evaluations = evaluations;
+	return superduperpixel_count;
 }
 
-// Adds a specific pixel's color to its superpixel's color histogram
-void SuperpixelSLICImpl::addColorsToHistograms
+// Merges the closest pair of neighboring super-duper-pixels until they're too far apart or there's few enough of them
+void SuperpixelSLICImpl::mergeSuperpixelsBestFirst
 (
-	const int num_buckets[],
-	vector< vector< vector<float> >>& superpixel_color_histograms,
-	const int current_superpixel,
-	const int x,
-	const int y
+	const float max_distance,
+	const int num_regions,
+	Mat& superpixel_colors,
+	vector<int>& superpixel_population
 )
 {
-	// Get color histograms for each superpixel
-	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
+	vector<int> superduperpixel_indexes;
+	int64 distance_evaluations = 0;
+	int superduperpixel_count = mergeRegionsBestFirst
+	(
+		this->getRegionAdjacencyGraph(),
+		max_distance,
+		num_regions,
+		superpixel_colors,
+		superpixel_population,
+		superduperpixel_indexes,
+		m_instrumented ? &distance_evaluations : NULL
+	);
+	if (m_instrumented)
 	{
-		int bucket_index;
-		switch ( m_chvec[0].depth() )
-		{
-			case CV_8U:
-			{
-				int max = std::numeric_limits<uchar>::max();
-				int bucket_size = max / num_buckets[color_channel] + ((int) max % num_buckets[color_channel] != 0);
-				bucket_index = m_chvec[color_channel].at<uchar>(y, x) / bucket_size;
-				break;
-			}
-
-			case CV_8S:
-			{
-				int max = std::numeric_limits<char>::max();
-				int bucket_size = max / num_buckets[color_channel] + ((int) max % num_buckets[color_channel] != 0);
-				bucket_index = m_chvec[color_channel].at<char>(y, x) / bucket_size;
-				break;
-			}
-
-			case CV_16U:
-			{
-				int max = std::numeric_limits<ushort>::max();
-				int bucket_size = max / num_buckets[color_channel] + ((int) max % num_buckets[color_channel] != 0);
-				bucket_index = m_chvec[color_channel].at<ushort>(y, x) / bucket_size;
-				break;
-			}
+		// Every merge takes one region away
+		m_stats.merges = superpixel_colors.rows - superduperpixel_count;
+		m_stats.distance_evaluations = distance_evaluations;
+	}
+	this->assignSuperduperpixels(superduperpixel_indexes);
+	m_numlabels = superduperpixel_count;
+}
 
-			case CV_16S:
-			{
-				int max = std::numeric_limits<short>::max();
-				int bucket_size = max / num_buckets[color_channel] + ((int) max % num_buckets[color_channel] != 0);
-				bucket_index = m_chvec[color_channel].at<short>(y, x) / bucket_size;
-				break;
-			}
+// Gets the region adjacency graph of the current labels, building it if the labels changed since it was last built
+const RegionAdjacencyGraph& SuperpixelSLICImpl::getRegionAdjacencyGraph(const bool boundary_lengths)
+{
+	if (!m_adjacency_valid || (boundary_lengths && !m_adjacency.hasBoundaryLengths() && !m_adjacency.neighbors.empty()))
+		this->buildRegionAdjacencyGraph(boundary_lengths);
+	return m_adjacency;
+}
 
-			case CV_32S:
-			{
-				int max = std::numeric_limits<int>::max();
-				int bucket_size = max / num_buckets[color_channel] + ((int) max % num_buckets[color_channel] != 0);
-				bucket_index = m_chvec[color_channel].at<int>(y, x) / bucket_size;
-				break;
-			}
+// Builds the region adjacency graph of m_klabels in one pass over the labels
+void SuperpixelSLICImpl::buildRegionAdjacencyGraph(const bool boundary_lengths)
+{
+	vector<Vec3i> runs;
+	collectBoundaryRuns(m_klabels, 0, m_height, runs);
+	this->buildRegionAdjacencyGraph(runs, boundary_lengths);
+}
 
-			case CV_32F:
-			{
-				// Assume range lies between 0 and 1 for values that are float types
-				bucket_index = ((int) (m_chvec[color_channel].at<float>(y, x) * num_buckets[color_channel]));
-				// Subtract 1 if the bucket index is too big (value of 1.0 * num_buckets would be out of bounds)
-				bucket_index -= (int) (bucket_index == num_buckets[color_channel]);
-				break;
-			}
+// Builds the region adjacency graph of m_klabels from the boundary runs between its superpixels
+void SuperpixelSLICImpl::buildRegionAdjacencyGraph(const vector<Vec3i>& runs, const bool boundary_lengths)
+{
+	// Bucket every run under both of its superpixels (counting sort by superpixel)
+	vector<int> run_offsets(m_numlabels + 1, 0);
+	for (const Vec3i& run : runs)
+	{
+		run_offsets[run[0] + 1] += 1;
+		run_offsets[run[1] + 1] += 1;
+	}
+	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
+		run_offsets[superpixel + 1] += run_offsets[superpixel];
+	vector<int> run_neighbors(run_offsets[m_numlabels]);
+	vector<int> run_lengths(run_offsets[m_numlabels]);
+	vector<int> fill(run_offsets.begin(), run_offsets.end() - 1);
+	for (const Vec3i& run : runs)
+	{
+		run_neighbors[fill[run[0]]] = run[1];
+		run_lengths[fill[run[0]]++] = run[2];
+		run_neighbors[fill[run[1]]] = run[0];
+		run_lengths[fill[run[1]]++] = run[2];
+	}
 
-			case CV_64F:
+	// Deduplicate each superpixel's neighbors (summing up boundary lengths) and sort them
+	m_adjacency.offsets.assign(m_numlabels + 1, 0);
+	m_adjacency.neighbors.clear();
+	m_adjacency.boundary_lengths.clear();
+	// Where each neighbor is in the current superpixel's row of the graph (-1 if it's not there yet)
+	vector<int> neighbor_slot(m_numlabels, -1);
+	vector< std::pair<int, int> > row_edges;
+	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
+	{
+		row_edges.clear();
+		for (int run = run_offsets[superpixel]; run < run_offsets[superpixel + 1]; run += 1)
+		{
+			int neighbor = run_neighbors[run];
+			if (neighbor_slot[neighbor] == -1)
 			{
-				// Assume range lies between 0 and 1 for values that are float types
-				bucket_index = ((int) (m_chvec[color_channel].at<double>(y, x) * num_buckets[color_channel]));
-				// Subtract 1 if the bucket index is too big (value of 1.0 * num_buckets would be out of bounds)
-				bucket_index -= (int) (bucket_index == num_buckets[color_channel]);
-				break;
+				neighbor_slot[neighbor] = (int) row_edges.size();
+				row_edges.push_back(std::make_pair(neighbor, 0));
 			}
-
-			default:
-				CV_Error( Error::StsInternal, "Invalid matrix depth" );
-				break;
+			row_edges[neighbor_slot[neighbor]].second += run_lengths[run];
 		}
-		superpixel_color_histograms[color_channel][bucket_index][current_superpixel] += 1;
+		std::sort(row_edges.begin(), row_edges.end());
+		for (const std::pair<int, int>& edge : row_edges)
+		{
+			neighbor_slot[edge.first] = -1;
+			m_adjacency.neighbors.push_back(edge.first);
+			if (boundary_lengths)
+				m_adjacency.boundary_lengths.push_back(edge.second);
+		}
+		m_adjacency.offsets[superpixel + 1] = (int) m_adjacency.neighbors.size();
 	}
+	m_adjacency_valid = true;
 }
 
-// Groups superpixels into super-duper-pixels based on their average colors
-void SuperpixelSLICImpl::groupSuperpixels
+// Collects the stats of every superpixel in one (parallel) sweep over the image
+// Also builds the region adjacency graph from the same sweep if the cached one is out of date
+void SuperpixelSLICImpl::collectSuperpixelStats(SuperpixelStats& stats)
+{
+	parallel_reduce_stripes(BlockedRange(0, m_height), stats, getNumThreads());
+	if (stats.find_runs)
+	{
+		this->buildRegionAdjacencyGraph(stats.runs, false);
+		stats.runs.clear();
+	}
+}
+
+// Finds the average color of each superpixel
+void SuperpixelSLICImpl::findSuperpixelAverages
 (
-	const float max_distance,
-	const bool use_duper_distance,
-	const vector< set<int> >& superpixel_neighbors,
-	const vector< vector<float> >& superpixel_average_colors,
-	const vector<int>& superpixel_population,
-	std::list<SuperDuperPixel>& superduperpixels,
-	vector<SuperDuperPixel*>& superduperpixel_pointers,
-	vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators
+	Mat& superpixel_average_colors,
+	vector<int>& superpixel_population
 )
 {
-	superduperpixel_pointers = vector<SuperDuperPixel*>(m_numlabels, NULL);
-	superduperpixel_iterators = vector<std::list<SuperDuperPixel>::iterator>(m_numlabels, superduperpixels.end());
-	// Loop through each superpixel
-	// Group them together based on distances between average colors
+	SuperpixelStats stats(m_chvec, m_klabels, m_numlabels, m_nr_channels, NULL, m_nr_channels, !m_adjacency_valid);
+	this->collectSuperpixelStats(stats);
+
+	// Divide each superpixel's color sums by the number of pixels in that superpixel to get the actual average
+	superpixel_average_colors = Mat(m_numlabels, m_nr_channels, CV_32F, Scalar::all(0));
 	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
 	{
-		vector<float> average_colors(m_nr_channels);
-		this->extractAverageColors(superpixel_average_colors, average_colors, superpixel);
-		// Loop through each neighbor of this superpixel
-		for (int neighbor: superpixel_neighbors[superpixel])
+		float* average_colors = superpixel_average_colors.ptr<float>(superpixel);
+		const double* sums = &stats.sums[(size_t) superpixel * m_nr_channels];
+		for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
 		{
-			// Don't try to group together superpixels that are already grouped together
-			if (superduperpixel_pointers[neighbor] == superduperpixel_pointers[superpixel] && superduperpixel_pointers[neighbor] != NULL)
-			continue;
-
-			// Get color distance to neighbor
-			float neighbor_distance = this->getColorDistance
-			(
-				use_duper_distance,
-				superduperpixels,
-				superduperpixel_pointers,
-				superpixel_average_colors,
-				average_colors,
-				superpixel,
-				neighbor
-			);
-
-			// If the distance is close enough, group them into a super-duper-pixel
-			if (neighbor_distance < max_distance)
-			{
-				this->combineIntoSuperDuperPixel
-				(
-					superduperpixels,
-					superduperpixel_pointers,
-					superduperpixel_iterators,
-					superpixel_average_colors,
-					average_colors,
-					superpixel_population,
-					superpixel,
-					neighbor
-				);
-			}
+			average_colors[color_channel] = (float) (sums[color_channel] / stats.population[superpixel]);
 		}
+	}
+	superpixel_population.swap(stats.population);
+}
 
-		if (superduperpixel_pointers[superpixel] == NULL)
+// Finds the normalized (between 0 and 1) color histogram of each superpixel
+void SuperpixelSLICImpl::findSuperpixelHistograms
+(
+	const int num_buckets[],
+	Mat& superpixel_color_histograms,
+	vector<int>& superpixel_population
+)
+{
+	// Every color channel's buckets are stored one after another in each row
+	// Rows are padded with zeros (which don't change L1 distances) so each one starts on an aligned address
+	int total_buckets = 0;
+	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
+		total_buckets += num_buckets[color_channel];
+	int row_size = alignSize(total_buckets, SUPERDUPERPIXEL_VALUE_ALIGNMENT);
+
+	SuperpixelStats stats(m_chvec, m_klabels, m_numlabels, m_nr_channels, num_buckets, row_size, !m_adjacency_valid);
+	this->collectSuperpixelStats(stats);
+
+	// Divide each superpixel's bucket counts by the number of pixels in that superpixel to normalize them into percentages
+	superpixel_color_histograms = Mat(m_numlabels, row_size, CV_32F, Scalar::all(0));
+	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
+	{
+		float* color_histogram = superpixel_color_histograms.ptr<float>(superpixel);
+		const int* counts = &stats.counts[(size_t) superpixel * row_size];
+		for (int bucket = 0; bucket < total_buckets; bucket += 1)
 		{
-			superduperpixels.push_back(SuperDuperPixel(superpixel, average_colors, superpixel_population[superpixel]));
-			superduperpixel_pointers[superpixel] = &superduperpixels.back();
-			superduperpixel_iterators[superpixel] = --superduperpixels.end();
+			color_histogram[bucket] = (float) counts[bucket] / stats.population[superpixel];
 		}
 	}
+	superpixel_population.swap(stats.population);
 }
 
-// Groups superpixels into super-duper-pixels based on their color histograms
+// Groups superpixels into super-duper-pixels based on their color values (average colors or color histograms)
 void SuperpixelSLICImpl::groupSuperpixels
 (
-	const int num_buckets[],
 	const float max_distance,
 	const bool use_duper_distance,
-	const vector< set<int> >& superpixel_neighbors,
-	const vector< vector< vector<float> >>& superpixel_color_histograms,
+	const RegionAdjacencyGraph& superpixel_neighbors,
+	const Mat& superpixel_colors,
 	const vector<int>& superpixel_population,
-	std::list<SuperDuperPixel>& superduperpixels,
-	vector<SuperDuperPixel*>& superduperpixel_pointers,
-	vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators
+	const vector<int>& kept_superduperpixels,
+	SuperDuperPixelForest& superduperpixels,
+	int64& merges,
+	int64& distance_evaluations
 )
 {
-	superduperpixel_pointers = vector<SuperDuperPixel*>(m_numlabels, NULL);
-	superduperpixel_iterators = vector<std::list<SuperDuperPixel>::iterator>(m_numlabels, superduperpixels.end());
 	// Loop through each superpixel
-	// Group them together based on distances between average colors
+	// Group them together based on distances between color values
 	for (int superpixel = 0; superpixel < m_numlabels; superpixel += 1)
 	{
-		vector< vector<float> > color_histogram(m_nr_channels);
-		this->extractColorHistogram(num_buckets, superpixel_color_histograms, color_histogram, superpixel);
-		
-		for (int neighbor: superpixel_neighbors[superpixel])
+		// Loop through each neighbor of this superpixel
+		for (int edge = superpixel_neighbors.offsets[superpixel]; edge < superpixel_neighbors.offsets[superpixel + 1]; edge += 1)
 		{
+			int neighbor = superpixel_neighbors.neighbors[edge];
 			// Don't try to group together superpixels that are already grouped together
-			if (superduperpixel_pointers[neighbor] == superduperpixel_pointers[superpixel] && superduperpixel_pointers[neighbor] != NULL)
+			if (superduperpixels.same_group(neighbor, superpixel))
+			continue;
+
+			// Superpixels that both kept their super-duper-pixels keep how they were grouped
+			if (!kept_superduperpixels.empty() && kept_superduperpixels[superpixel] != -1 && kept_superduperpixels[neighbor] != -1)
 			continue;
 
 			// Get color distance to neighbor
 			float neighbor_distance = this->getColorDistance
 			(
-				num_buckets,
 				use_duper_distance,
 				superduperpixels,
-				superduperpixel_pointers,
-				superpixel_color_histograms,
-				color_histogram,
+				superpixel_colors,
 				superpixel,
 				neighbor
 			);
+			distance_evaluations += 1;
 
 			// If the distance is close enough, group them into a super-duper-pixel
 			if (neighbor_distance < max_distance)
 			{
+				merges += 1;
 				this->combineIntoSuperDuperPixel
 				(
-					num_buckets,
 					superduperpixels,
-					superduperpixel_pointers,
-					superduperpixel_iterators,
-					superpixel_color_histograms,
-					color_histogram,
+					superpixel_colors,
 					superpixel_population,
 					superpixel,
 					neighbor
@@ -1272,242 +2432,77 @@ void SuperpixelSLICImpl::groupSuperpixels
 			}
 		}
 
-		if (superduperpixel_pointers[superpixel] == NULL)
-		{
-			superduperpixels.push_back(SuperDuperPixel(superpixel, color_histogram, superpixel_population[superpixel]));
-			superduperpixel_pointers[superpixel] = &superduperpixels.back();
-			superduperpixel_iterators[superpixel] = --superduperpixels.end();
-		}
+		if (!superduperpixels.in_group(superpixel))
+			superduperpixels.create_group(superpixel, superpixel_colors.ptr<float>(superpixel), superpixel_population[superpixel]);
 	}
 }
 
-// Gets the color distance between 2 superpixels' average colors
+// Gets the color distance between 2 superpixels' color values
 float SuperpixelSLICImpl::getColorDistance
 (
 	const bool use_duper_distance,
-	const std::list<SuperDuperPixel>& superduperpixels,
-	const vector<SuperDuperPixel*>& superduperpixel_pointers,
-	const vector< vector<float> >& superpixel_average_colors,
-	const vector<float>& average_colors,
+	SuperDuperPixelForest& superduperpixels,
+	const Mat& superpixel_colors,
 	const int superpixel,
 	const int neighbor
 )
 {
-	// If this superpixel is already in a superduperpixel, use the distance from that instead of the individual superpixel
-	// Don't do this if use_duper_distance is false though
-	vector<float> avg_colors = use_duper_distance && superduperpixel_pointers[superpixel] != NULL ?
-	(*superduperpixel_pointers[superpixel]).get_average() :
-	average_colors;
-
-	// If the neighbor is already in a super-duper-pixel, use the distance to the whole super-duper-pixel it's in instead of just the neighbor
-	// Don't do this if use_duper_distance is false though
-	if (use_duper_distance && superduperpixel_pointers[neighbor] != NULL)
-		return (*superduperpixel_pointers[neighbor]).distance_from(avg_colors);
-
-	float neighbor_distance = 0;
-	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
-	{
-		float difference = avg_colors[color_channel] - superpixel_average_colors[color_channel][neighbor];
-		// opencv slic algorithm square diff before adding it to dist.
-		// neighbor_distance += difference * difference;
-		// Just take absolute value to do mahnattan distance instead.
-		neighbor_distance += abs(difference);
-	}
-	// Just use manhattan distance here.
-	// Could do this to be more precise (euclidian distance, would also need to square the diff above), but OpenCV
-	// SLIC algorithm doesn't use it either.
-	// neighbor_distance = sqrt(neighbor_distance);
-	return neighbor_distance;
-}
+	const float* colors = superpixel_colors.ptr<float>(superpixel);
 
-// Gets the color distance between 2 superpixels' color histograms
-float SuperpixelSLICImpl::getColorDistance
-(
-	const int num_buckets[],
-	const bool use_duper_distance,
-	const std::list<SuperDuperPixel>& superduperpixels,
-	const vector<SuperDuperPixel*>& superduperpixel_pointers,
-	const vector< vector< vector<float> >>& superpixel_color_histograms, 
-	const vector< vector<float> >& color_histogram,
-	const int superpixel,
-	const int neighbor
-)
-{
 	// If this superpixel is already in a superduperpixel, use the distance from that instead of the individual superpixel
 	// Don't do this if use_duper_distance is false though
-	vector< vector<float> > histogram = use_duper_distance && superduperpixel_pointers[superpixel] != NULL ?
-	(*superduperpixel_pointers[superpixel]).get_histogram() :
-	color_histogram;
+	const float* duper_colors = use_duper_distance && superduperpixels.in_group(superpixel) ?
+	superduperpixels.get_values(superpixel) :
+	colors;
 
 	// If the neighbor is already in a super-duper-pixel, use the distance to the whole super-duper-pixel it's in instead of just the neighbor
 	// Don't do this if use_duper_distance is false though
-	if (use_duper_distance && superduperpixel_pointers[neighbor] != NULL)
-		return (*superduperpixel_pointers[neighbor]).distance_from(color_histogram);
+	// (histograms have always been compared against this superpixel's own histogram here)
+	if (use_duper_distance && superduperpixels.in_group(neighbor))
+		return superduperpixels.distance_from(neighbor, superduperpixels.get_mode() == HISTOGRAM ? colors : duper_colors);
 
-	float neighbor_distance = 0;
-	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
-	for (int bucket = 0; bucket < num_buckets[color_channel]; bucket += 1)
-	{
-		float difference = histogram[color_channel][bucket] - superpixel_color_histograms[color_channel][bucket][neighbor];
-		// opencv slic algorithm square diff before adding it to dist.
-		// neighbor_distance += difference * difference;
-		// Just take absolute value to do mahnattan distance instead.
-		neighbor_distance += abs(difference);
-	}
 	// Just use manhattan distance here.
-	// Could do this to be more precise (euclidian distance, would also need to square the diff above), but OpenCV
-	// SLIC algorithm doesn't use it either.
-	// neighbor_distance = sqrt(neighbor_distance);
-	return neighbor_distance;
-}
-
-// Gets a vector of the average colors for a superpixel
-void SuperpixelSLICImpl::extractAverageColors
-(
-	const vector< vector<float> >& superpixel_average_colors,
-	vector<float>& average_colors,
-	const int superpixel
-)
-{
-	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
-	{
-		average_colors[color_channel] = superpixel_average_colors[color_channel][superpixel];
-	}
-}
-
-// Gets a vector of the color histogram for a superpixel
-void SuperpixelSLICImpl::extractColorHistogram
-(
-	const int num_buckets[],
-	const vector< vector< vector<float> >>& superpixel_color_histograms,
-	vector< vector<float> >& color_histogram,
-	const int superpixel
-)
-{
-	for (int color_channel = 0; color_channel < m_nr_channels; color_channel += 1)
-	{
-		color_histogram[color_channel] = vector<float>(num_buckets[color_channel]);
-		for (int bucket = 0; bucket < num_buckets[color_channel]; bucket += 1)
-		{
-			color_histogram[color_channel][bucket] = superpixel_color_histograms[color_channel][bucket][superpixel];
-		}
-	}
+	// Could do this to be more precise (euclidian distance), but OpenCV SLIC algorithm doesn't use it either.
+	return superduperpixels.get_kernels().distance(duper_colors, superpixel_colors.ptr<float>(neighbor), superpixel_colors.cols);
 }
 
-// Combines 2 superpixels into a super-duper-pixel using their average colors
+// Combines 2 superpixels into a super-duper-pixel
 void SuperpixelSLICImpl::combineIntoSuperDuperPixel
 (
-	std::list<SuperDuperPixel>& superduperpixels,
-	vector<SuperDuperPixel*>& superduperpixel_pointers,
-	vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators,
-	const vector< vector<float> >& superpixel_average_colors,
-	const vector<float>& average_colors,
+	SuperDuperPixelForest& superduperpixels,
+	const Mat& superpixel_colors,
 	const vector<int>& superpixel_population,
 	const int superpixel,
 	const int neighbor
 )
 {
 	// If the neighbor is not already in a super-duper-pixel
-	if (superduperpixel_pointers[neighbor] == NULL)
+	if (!superduperpixels.in_group(neighbor))
 	{
 		// If neither superpixels are in a super-duper-pixel
-		if (superduperpixel_pointers[superpixel] == NULL)
+		if (!superduperpixels.in_group(superpixel))
 		{
 			// Create a new super-duper-pixel with the current superpixel
-			superduperpixels.push_back(SuperDuperPixel(superpixel, average_colors, superpixel_population[superpixel]));
-			superduperpixel_pointers[superpixel] = &superduperpixels.back();
-			superduperpixel_iterators[superpixel] = --superduperpixels.end();
+			superduperpixels.create_group(superpixel, superpixel_colors.ptr<float>(superpixel), superpixel_population[superpixel]);
 		}
 		// Add the neighbor to the super-duper-pixel
-		vector<float> neighbor_average_colors(m_nr_channels);
-		this->extractAverageColors(superpixel_average_colors, neighbor_average_colors, neighbor);
-		superduperpixel_pointers[superpixel]->add_superpixel(neighbor, neighbor_average_colors, superpixel_population[neighbor]);
-		superduperpixel_pointers[neighbor] = superduperpixel_pointers[superpixel];
-		superduperpixel_iterators[neighbor] = superduperpixel_iterators[superpixel];
+		superduperpixels.add_superpixel(superpixel, neighbor, superpixel_colors.ptr<float>(neighbor), superpixel_population[neighbor]);
 	}
 	// If the neighbor is already in a superpixel
 	else
 	{
 		// If this superpixel is not in a super-duper-pixel yet
-		if (superduperpixel_pointers[superpixel] == NULL)
+		if (!superduperpixels.in_group(superpixel))
 		{
 			// Add it to the neighbor's super-duper-pixel
-			superduperpixel_pointers[neighbor]->add_superpixel(superpixel, average_colors, superpixel_population[superpixel]);
-			superduperpixel_pointers[superpixel] = superduperpixel_pointers[neighbor];
-			superduperpixel_iterators[superpixel] = superduperpixel_iterators[neighbor];
-		}
-		// If this superpixel is also already in a super-duper-pixel
-		// And they're not in the same one
-		else if (superduperpixel_pointers[superpixel] != superduperpixel_pointers[neighbor])
-		{
-			// Merge the superpixels (move all the superpixels from A to B and delete A)
-			std::list<SuperDuperPixel>::iterator merging_superduperpixel = superduperpixel_iterators[neighbor];
-			(*superduperpixel_pointers[superpixel]) += superduperpixel_pointers[neighbor];
-			for (int connected_neighbor : superduperpixel_pointers[neighbor]->get_superpixels())
-			{
-				superduperpixel_pointers[connected_neighbor] = superduperpixel_pointers[superpixel];
-				superduperpixel_iterators[connected_neighbor] = superduperpixel_iterators[superpixel];
-			}
-			superduperpixels.erase(merging_superduperpixel);
-		}
-	}
-}
-
-// Combines 2 superpixels into a super-duper-pixel using their color histograms
-void SuperpixelSLICImpl::combineIntoSuperDuperPixel
-(
-	const int num_buckets[],
-	std::list<SuperDuperPixel>& superduperpixels,
-	vector<SuperDuperPixel*>& superduperpixel_pointers,
-	vector<std::list<SuperDuperPixel>::iterator>& superduperpixel_iterators,
-	const vector< vector< vector<float> >>& superpixel_color_histograms,
-	const vector< vector<float> >& color_histogram,
-	const vector<int>& superpixel_population,
-	const int superpixel,
-	const int neighbor
-)
-{
-	// If the neighbor is not already in a super-duper-pixel
-	if (superduperpixel_pointers[neighbor] == NULL)
-	{
-		// If neither superpixels are in a super-duper-pixel
-		if (superduperpixel_pointers[superpixel] == NULL)
-		{
-			// Create a new super-duper-pixel with the current superpixel
-			superduperpixels.push_back(SuperDuperPixel(superpixel, color_histogram, superpixel_population[superpixel]));
-			superduperpixel_pointers[superpixel] = &superduperpixels.back();
-			superduperpixel_iterators[superpixel] = --superduperpixels.end();
-		}
-		// Add the neighbor to the super-duper-pixel
-		vector< vector<float>> neighbor_color_histogram(m_nr_channels);
-		this->extractColorHistogram(num_buckets, superpixel_color_histograms, neighbor_color_histogram, neighbor);
-		superduperpixel_pointers[superpixel]->add_superpixel(neighbor, neighbor_color_histogram, superpixel_population[neighbor]);
-		superduperpixel_pointers[neighbor] = superduperpixel_pointers[superpixel];
-		superduperpixel_iterators[neighbor] = superduperpixel_iterators[superpixel];
-	}
-	// If the neighbor is already in a superpixel
-	else
-	{
-		// If this superpixel is not in a super-duper-pixel yet
-		if (superduperpixel_pointers[superpixel] == NULL)
-		{
-			superduperpixel_pointers[neighbor]->add_superpixel(superpixel, color_histogram, superpixel_population[superpixel]);
-			superduperpixel_pointers[superpixel] = superduperpixel_pointers[neighbor];
-			superduperpixel_iterators[superpixel] = superduperpixel_iterators[neighbor];
+			superduperpixels.add_superpixel(neighbor, superpixel, superpixel_colors.ptr<float>(superpixel), superpixel_population[superpixel]);
 		}
 		// If this superpixel is also already in a super-duper-pixel
 		// And they're not in the same one
-		else if (superduperpixel_pointers[superpixel] != superduperpixel_pointers[neighbor])
+		else if (!superduperpixels.same_group(superpixel, neighbor))
 		{
-			// Merge the superpixels (move all the superpixels from A to B and delete A)
-			std::list<SuperDuperPixel>::iterator merging_superduperpixel = superduperpixel_iterators[neighbor];
-			(*superduperpixel_pointers[superpixel]) += superduperpixel_pointers[neighbor];
-			for (int connected_neighbor : superduperpixel_pointers[neighbor]->get_superpixels())
-			{
-				superduperpixel_pointers[connected_neighbor] = superduperpixel_pointers[superpixel];
-				superduperpixel_iterators[connected_neighbor] = superduperpixel_iterators[superpixel];
-			}
-			superduperpixels.erase(merging_superduperpixel);
+			// Merge the super-duper-pixels (this superpixel's super-duper-pixel keeps its place in the indexing)
+			superduperpixels.merge(superpixel, neighbor);
 		}
 	}
 }
@@ -1515,33 +2510,50 @@ void SuperpixelSLICImpl::combineIntoSuperDuperPixel
 // Gives super-duper-pixels indexes to assign to pixels as labels for what superpixel they're in
 int SuperpixelSLICImpl::indexSuperduperpixels
 (
-	const std::list<SuperDuperPixel>& superduperpixels,
+	SuperDuperPixelForest& superduperpixels,
 	vector<int>& superduperpixel_indexes
 )
 {
-	// Iterate through every super-duper-pixel and give them indexes starting at 0
-	superduperpixel_indexes = vector<int>(m_numlabels, -1);
-	int superduperpixel_count = 0;
-	for (SuperDuperPixel sdp : superduperpixels)
-	{
-		for (int superpixel : sdp.get_superpixels())
-		{
-			superduperpixel_indexes[superpixel] = superduperpixel_count;
-		}
-		superduperpixel_count += 1;
-	}
-	return superduperpixel_count;
+	// Super-duper-pixels are indexed starting at 0 in the order they were created
+	return superduperpixels.index(superduperpixel_indexes);
 }
 
 // Assigns new super-duper-pixel indexes to pixels in the image as labels for what superpixel they're in
 void SuperpixelSLICImpl::assignSuperduperpixels(const vector<int>& superduperpixel_indexes)
 {
+	// Keep the superpixel labels for warm starts and reduperize
+	saveLabels(m_superpixel_labels);
+
 	// Change m_klabels so pixels use superduperpixel indexes instead of their old superpixel labels
-	for (int y = 0; y < m_height; y += 1)
-	for (int x = 0; x < m_width; x += 1)
+	// In the same pass, mark the thick contours of the new labels a row behind (a row's contours need the row
+	// below relabeled), so getLabelContourMask() doesn't have to scan the labels again
+	const bool mark_contours = !m_low_memory;
+	if (mark_contours)
+		m_contour_mask.create(m_height, m_width, CV_8U);
+	else
+		m_contour_mask.release();
+	const int* indexes = superduperpixel_indexes.data();
+	for (int y = 0; y <= m_height; y += 1)
 	{
-		m_klabels.at<int>(y, x) = superduperpixel_indexes[m_klabels.at<int>(y, x)];
+		if (y < m_height)
+		{
+			int* row = m_klabels.ptr<int>(y);
+			for (int x = 0; x < m_width; x += 1)
+				row[x] = indexes[row[x]];
+		}
+		if (mark_contours && y > 0)
+		{
+			const int contour_y = y - 1;
+			MarkContourRow(contour_y > 0 ? m_klabels.ptr<int>(contour_y - 1) : NULL, m_klabels.ptr<int>(contour_y),
+				y < m_height ? m_klabels.ptr<int>(y) : NULL,
+				contour_y > 0 ? m_contour_mask.ptr<uchar>(contour_y - 1) : NULL, m_contour_mask.ptr<uchar>(contour_y),
+				m_width, 2);
+		}
 	}
+	m_adjacency_valid = false;
+	m_contour_valid = mark_contours;
+
+	updatePeakBytes();
 }
 
 /*
@@ -1821,6 +2833,8 @@ inline void SuperpixelSLICImpl::GetChSeedsK()
     }
 }
 
+// CN is the number of channels, 0 when only known at run time (nr_channels)
+template<int CN = 0>
 struct SeedNormInvoker : ParallelLoopBody
 {
     SeedNormInvoker( vector< vector<float> >* _kseeds, vector< vector<float> >* _sigma,
@@ -1843,7 +2857,7 @@ struct SeedNormInvoker : ParallelLoopBody
       {
             if( clustersize->at(k) <= 0 ) clustersize->at(k) = 1;
 
-            for ( int b = 0; b < nr_channels; b++ )
+            for ( int b = 0; b < ( CN > 0 ? CN : nr_channels ); b++ )
               kseeds->at(b)[k] = sigma->at(b)[k] / float(clustersize->at(k));
 
             kseedsx->at(k) = sigmax->at(k) / float(clustersize->at(k));
@@ -1988,7 +3002,7 @@ struct SLICOGrowInvoker : ParallelLoopBody
     SLICOGrowInvoker( vector<Mat>* _chvec, Mat* _distchans, Mat* _distxy, Mat* _distvec,
                       Mat* _klabels, float _kseedsxn, float _kseedsyn, float _xywt,
                       float _maxchansn, vector< vector<float> > *_kseeds,
-                      int _x1, int _x2, int _nr_channels, int _n )
+                      int _x1, int _x2, int _nr_channels, int _n, int _band_start )
     {
       chvec = _chvec;
       distchans = _distchans;
@@ -2004,6 +3018,7 @@ struct SLICOGrowInvoker : ParallelLoopBody
       n = _n;
       xywt = _xywt;
       nr_channels = _nr_channels;
+      band_start = _band_start;
     }
 
     void operator ()(const cv::Range& range) const CV_OVERRIDE
@@ -2015,7 +3030,7 @@ struct SLICOGrowInvoker : ParallelLoopBody
         for( int x = x1; x < x2; x++ )
         {
           CV_Assert( y < rows && x < cols && y >= 0 && x >= 0 );
-          distchans->at<float>(y,x) = 0;
+          distchans->at<float>(y - band_start,x) = 0;
 
             switch ( chvec->at(0).depth() )
             {
@@ -2024,7 +3039,7 @@ struct SLICOGrowInvoker : ParallelLoopBody
                 {
                   float diff = chvec->at(b).at<uchar>(y,x)
                              - kseeds->at(b)[n];
-                  distchans->at<float>(y,x) += diff * diff;
+                  distchans->at<float>(y - band_start,x) += diff * diff;
                 }
                 break;
 
@@ -2033,7 +3048,7 @@ struct SLICOGrowInvoker : ParallelLoopBody
                 {
                   float diff = chvec->at(b).at<char>(y,x)
                              - kseeds->at(b)[n];
-                  distchans->at<float>(y,x) += diff * diff;
+                  distchans->at<float>(y - band_start,x) += diff * diff;
                 }
                 break;
 
@@ -2042,7 +3057,7 @@ struct SLICOGrowInvoker : ParallelLoopBody
                 {
                   float diff = chvec->at(b).at<ushort>(y,x)
                              - kseeds->at(b)[n];
-                  distchans->at<float>(y,x) += diff * diff;
+                  distchans->at<float>(y - band_start,x) += diff * diff;
                 }
                 break;
 
@@ -2051,7 +3066,7 @@ struct SLICOGrowInvoker : ParallelLoopBody
                 {
                   float diff = chvec->at(b).at<short>(y,x)
                              - kseeds->at(b)[n];
-                  distchans->at<float>(y,x) += diff * diff;
+                  distchans->at<float>(y - band_start,x) += diff * diff;
                 }
                 break;
 
@@ -2060,7 +3075,7 @@ struct SLICOGrowInvoker : ParallelLoopBody
                 {
                   float diff = chvec->at(b).at<int>(y,x)
                              - kseeds->at(b)[n];
-                  distchans->at<float>(y,x) += diff * diff;
+                  distchans->at<float>(y - band_start,x) += diff * diff;
                 }
                 break;
 
@@ -2069,50 +3084,412 @@ struct SLICOGrowInvoker : ParallelLoopBody
                 {
                   float diff = chvec->at(b).at<float>(y,x)
                              - kseeds->at(b)[n];
-                  distchans->at<float>(y,x) += diff * diff;
+                  distchans->at<float>(y - band_start,x) += diff * diff;
+                }
+                break;
+
+              case CV_64F:
+                for( int b = 0; b < nr_channels; b++ )
+                {
+                  float diff = float(chvec->at(b).at<double>(y,x)
+                             - kseeds->at(b)[n]);
+                  distchans->at<float>(y - band_start,x) += diff * diff;
                 }
                 break;
 
-              case CV_64F:
-                for( int b = 0; b < nr_channels; b++ )
-                {
-                  float diff = float(chvec->at(b).at<double>(y,x)
-                             - kseeds->at(b)[n]);
-                  distchans->at<float>(y,x) += diff * diff;
-                }
-                break;
+              default:
+                CV_Error( Error::StsInternal, "Invalid matrix depth" );
+                break;
+            }
+
+
+          float difx = x - kseedsxn;
+          float dify = y - kseedsyn;
+          distxy->at<float>(y - band_start,x) = difx*difx + dify*dify;
+
+          // only varying m, prettier superpixels
+          float dist = distchans->at<float>(y - band_start,x)
+                     / maxchansn + distxy->at<float>(y - band_start,x)/xywt;
+
+          if( dist < distvec->at<float>(y - band_start,x) )
+          {
+            distvec->at<float>(y - band_start,x) = dist;
+            klabels->at<int>(y,x) = n;
+          }
+        } // end for x
+      } // end for y
+    }
+
+    Mat* klabels;
+    vector< vector<float> > *kseeds;
+    float maxchansn, xywt;
+    vector<Mat>* chvec;
+    Mat *distchans, *distxy, *distvec;
+    float kseedsxn, kseedsyn;
+    int x1, x2, nr_channels, n;
+    // first row of the distance matrices
+    int band_start;
+};
+
+/*
+ *    Channel specialized kernels
+ *
+ *    The invokers above switch on the depth and loop over the channel planes
+ * for every pixel. For the common layouts (1 or 3 channels of 8U or 32F) the
+ * channels are interleaved into one Mat and the kernels below are
+ * instantiated for the channel count and depth instead, growing a seed over
+ * its row span 4 pixels at a time with SSE2 (one at a time without it). They
+ * do the same float operations in the same order as the generic kernels, so
+ * the labels and seeds come out the same (as long as the compiler doesn't fuse
+ * multiply-adds: every CMake target compiling this file passes -ffp-contract=off
+ * to GCC and Clang, and a build without it can get different labels on FMA
+ * targets such as aarch64).
+ *
+ */
+enum PackedLayout
+{
+    PACKED_NONE = 0,  // generic kernels
+    PACKED_8UC1,
+    PACKED_8UC3,
+    PACKED_32FC1,
+    PACKED_32FC3
+};
+
+// what a specialized grow kernel needs to know about one seed
+struct PackedGrowParams
+{
+    const Mat* packed;
+    Mat* distvec;
+    // color and spatial distances (SLICO only)
+    Mat* distchans;
+    Mat* distxy;
+    Mat* klabels;
+    float seed[3];
+    float seedx, seedy;
+    float xywt;
+    // max color distance of the seed (SLICO only)
+    float maxchans;
+    int x1, x2;
+    int n;
+    // first row of the distance matrices
+    int band_start;
+};
+
+#if defined(SDP_SLIC_SSE2)
+// channel b of 4 consecutive pixels
+template<typename T, int CN>
+static inline __m128 LoadChannel4( const T* pixels, int b )
+{
+    return _mm_setr_ps( (float) pixels[b], (float) pixels[CN + b],
+                        (float) pixels[2 * CN + b], (float) pixels[3 * CN + b] );
+}
+
+template<>
+inline __m128 LoadChannel4<float, 1>( const float* pixels, int )
+{
+    return _mm_loadu_ps( pixels );
+}
+
+template<>
+inline __m128 LoadChannel4<uchar, 1>( const uchar* pixels, int )
+{
+    int bytes;
+    memcpy( &bytes, pixels, sizeof(bytes) );
+    const __m128i zero = _mm_setzero_si128();
+    __m128i wide = _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( bytes ), zero ), zero );
+    return _mm_cvtepi32_ps( wide );
+}
+#endif
+
+template<typename T, int CN, bool SLICO>
+struct PackedGrowInvoker : ParallelLoopBody
+{
+    PackedGrowInvoker( const PackedGrowParams& _params ) : params(_params)
+    {
+    }
+
+    void operator ()(const cv::Range& range) const CV_OVERRIDE
+    {
+      const PackedGrowParams& p = params;
+      for (int y = range.start; y < range.end; ++y)
+      {
+        const T* pixels = p.packed->ptr<T>(y);
+        float* distvec = p.distvec->ptr<float>(y - p.band_start);
+        float* distchans = SLICO ? p.distchans->ptr<float>(y - p.band_start) : NULL;
+        float* distxy = SLICO ? p.distxy->ptr<float>(y - p.band_start) : NULL;
+        int* labels = p.klabels->ptr<int>(y);
+        const float dify = y - p.seedy;
+        const float dify2 = dify * dify;
+
+        int x = p.x1;
+#if defined(SDP_SLIC_SSE2)
+        __m128 seed[CN];
+        for( int b = 0; b < CN; b++ )
+          seed[b] = _mm_set1_ps( p.seed[b] );
+        const __m128 seedx = _mm_set1_ps( p.seedx );
+        const __m128 dify2s = _mm_set1_ps( dify2 );
+        const __m128 xywt = _mm_set1_ps( p.xywt );
+        const __m128 maxchans = _mm_set1_ps( p.maxchans );
+        const __m128 four = _mm_set1_ps( 4.0f );
+        const __m128i label = _mm_set1_epi32( p.n );
+        __m128 xs = _mm_setr_ps( (float) x, (float) ( x + 1 ), (float) ( x + 2 ), (float) ( x + 3 ) );
+        for( ; x + 4 <= p.x2; x += 4, xs = _mm_add_ps( xs, four ) )
+        {
+          __m128 chans = _mm_setzero_ps();
+          for( int b = 0; b < CN; b++ )
+          {
+            __m128 diff = _mm_sub_ps( LoadChannel4<T, CN>( pixels + x * CN, b ), seed[b] );
+            chans = _mm_add_ps( chans, _mm_mul_ps( diff, diff ) );
+          }
+          __m128 difx = _mm_sub_ps( xs, seedx );
+          __m128 xy = _mm_add_ps( _mm_mul_ps( difx, difx ), dify2s );
+
+          __m128 dist;
+          if( SLICO )
+          {
+            _mm_storeu_ps( distchans + x, chans );
+            _mm_storeu_ps( distxy + x, xy );
+            dist = _mm_add_ps( _mm_div_ps( chans, maxchans ), _mm_div_ps( xy, xywt ) );
+          }
+          else
+            dist = _mm_add_ps( chans, _mm_div_ps( xy, xywt ) );
+
+          // keep the closer of the seed and the pixel's current one
+          __m128 current = _mm_loadu_ps( distvec + x );
+          __m128 closer = _mm_cmplt_ps( dist, current );
+          _mm_storeu_ps( distvec + x, _mm_or_ps( _mm_and_ps( closer, dist ), _mm_andnot_ps( closer, current ) ) );
+
+          __m128i mask = _mm_castps_si128( closer );
+          __m128i current_labels = _mm_loadu_si128( (const __m128i*) ( labels + x ) );
+          _mm_storeu_si128( (__m128i*) ( labels + x ),
+                            _mm_or_si128( _mm_and_si128( mask, label ), _mm_andnot_si128( mask, current_labels ) ) );
+        }
+#endif
+        for( ; x < p.x2; x++ )
+        {
+          const T* pixel = pixels + x * CN;
+          float chans = 0;
+          for( int b = 0; b < CN; b++ )
+          {
+            float diff = pixel[b] - p.seed[b];
+            chans += diff * diff;
+          }
+          float difx = x - p.seedx;
+          float xy = difx*difx + dify2;
+
+          float dist;
+          if( SLICO )
+          {
+            distchans[x] = chans;
+            distxy[x] = xy;
+            dist = chans / p.maxchans + xy / p.xywt;
+          }
+          else
+            dist = chans + xy / p.xywt;
+
+          if( dist < distvec[x] )
+          {
+            distvec[x] = dist;
+            labels[x] = p.n;
+          }
+        } // end for x
+      } // end for y
+    }
+
+    PackedGrowParams params;
+};
+
+// grows one seed over rows with the kernel of a layout
+template<bool SLICO>
+static inline void PackedGrow( int layout, const cv::Range& rows, const PackedGrowParams& params )
+{
+    switch ( layout )
+    {
+      case PACKED_8UC1:
+        parallel_for_( rows, PackedGrowInvoker<uchar, 1, SLICO>( params ) );
+        break;
+
+      case PACKED_8UC3:
+        parallel_for_( rows, PackedGrowInvoker<uchar, 3, SLICO>( params ) );
+        break;
+
+      case PACKED_32FC1:
+        parallel_for_( rows, PackedGrowInvoker<float, 1, SLICO>( params ) );
+        break;
+
+      case PACKED_32FC3:
+        parallel_for_( rows, PackedGrowInvoker<float, 3, SLICO>( params ) );
+        break;
+
+      default:
+        CV_Error( Error::StsInternal, "Invalid packed layout" );
+        break;
+    }
+}
+
+// SeedsCenters of interleaved pixels
+template<typename T, int CN>
+struct PackedSeedsCenters
+{
+    PackedSeedsCenters( const Mat& _packed, const Mat& _klabels, const int _numlabels )
+    {
+      packed = _packed;
+      klabels = _klabels;
+      numlabels = _numlabels;
+
+      sigma.resize(CN);
+      for( int b = 0; b < CN; b++ )
+        sigma[b].assign(numlabels, 0);
+
+      sigmax.assign(numlabels, 0);
+      sigmay.assign(numlabels, 0);
+      clustersize.assign(numlabels, 0);
+    }
+
+    PackedSeedsCenters( const PackedSeedsCenters& counter, Split )
+    {
+      *this = counter;
+      for( int b = 0; b < CN; b++ )
+        fill(sigma[b].begin(), sigma[b].end(), 0.0f);
+
+      fill(sigmax.begin(), sigmax.end(), 0.0f);
+      fill(sigmay.begin(), sigmay.end(), 0.0f);
+      fill(clustersize.begin(), clustersize.end(), 0);
+    }
+
+    void operator()( const BlockedRange& range )
+    {
+      float* sums[CN];
+      for( int b = 0; b < CN; b++ )
+        sums[b] = &sigma[b][0];
+
+      // column by column like SeedsCenters, so the sums add up in the same order
+      for ( int x = range.begin(); x != range.end(); x++ )
+      {
+        for( int y = 0; y < klabels.rows; y++ )
+        {
+            int idx = klabels.ptr<int>(y)[x];
+            const T* pixel = packed.ptr<T>(y) + x * CN;
+            for( int b = 0; b < CN; b++ )
+              sums[b][idx] += pixel[b];
+
+            sigmax[idx] += x;
+            sigmay[idx] += y;
+
+            clustersize[idx]++;
+        }
+      }
+    }
+
+    void join( PackedSeedsCenters& sc )
+    {
+      for (int l = 0; l < numlabels; l++)
+      {
+        sigmax[l] += sc.sigmax[l];
+        sigmay[l] += sc.sigmay[l];
+        for( int b = 0; b < CN; b++ )
+            sigma[b][l] += sc.sigma[b][l];
+        clustersize[l] += sc.clustersize[l];
+      }
+    }
+
+    Mat packed;
+    Mat klabels;
+    int numlabels;
+    vector<float> sigmax;
+    vector<float> sigmay;
+    vector<int> clustersize;
+    vector< vector<float> > sigma;
+};
+
+// averages the pixels of every seed with the kernels of a layout
+template<typename T, int CN>
+static inline void PackedUpdateSeeds( const Mat& packed, const Mat& klabels, int numlabels,
+                                      vector< vector<float> >& kseeds, vector<float>& kseedsx,
+                                      vector<float>& kseedsy )
+{
+    PackedSeedsCenters<T, CN> sc( packed, klabels, numlabels );
+    parallel_reduce( BlockedRange(0, klabels.cols), sc );
+    parallel_for_( Range(0, numlabels), SeedNormInvoker<CN>( &kseeds, &sc.sigma,
+                   &sc.clustersize, &sc.sigmax, &sc.sigmay, &kseedsx, &kseedsy, CN ) );
+}
+
+inline int SuperpixelSLICImpl::PackChannels()
+{
+    int depth = m_chvec[0].depth();
+    if( ( m_nr_channels != 1 && m_nr_channels != 3 ) || ( depth != CV_8U && depth != CV_32F ) )
+    {
+      m_packed.release();
+      return PACKED_NONE;
+    }
+
+    // one channel is already interleaved
+    if( m_nr_channels == 1 )
+      m_packed = m_chvec[0];
+    else
+      merge( m_chvec, m_packed );
 
-              default:
-                CV_Error( Error::StsInternal, "Invalid matrix depth" );
-                break;
-            }
+    if( depth == CV_8U )
+      return m_nr_channels == 1 ? PACKED_8UC1 : PACKED_8UC3;
+    return m_nr_channels == 1 ? PACKED_32FC1 : PACKED_32FC3;
+}
+
+inline PackedGrowParams SuperpixelSLICImpl::PackedGrowSeed( int n, int x1, int x2, int band_start,
+                                                            float xywt, float maxchans )
+{
+    PackedGrowParams params;
+    params.packed = &m_packed;
+    params.distvec = &m_distvec;
+    params.distchans = &m_distchans;
+    params.distxy = &m_distxy;
+    params.klabels = &m_klabels;
+    for( int b = 0; b < m_nr_channels; b++ )
+      params.seed[b] = m_kseeds[b][n];
+    params.seedx = m_kseedsx[n];
+    params.seedy = m_kseedsy[n];
+    params.xywt = xywt;
+    params.maxchans = maxchans;
+    params.x1 = x1;
+    params.x2 = x2;
+    params.n = n;
+    params.band_start = band_start;
+    return params;
+}
 
+inline void SuperpixelSLICImpl::UpdateSeeds( int layout )
+{
+    switch ( layout )
+    {
+      case PACKED_8UC1:
+        PackedUpdateSeeds<uchar, 1>( m_packed, m_klabels, m_numlabels, m_kseeds, m_kseedsx, m_kseedsy );
+        return;
 
-          float difx = x - kseedsxn;
-          float dify = y - kseedsyn;
-          distxy->at<float>(y,x) = difx*difx + dify*dify;
+      case PACKED_8UC3:
+        PackedUpdateSeeds<uchar, 3>( m_packed, m_klabels, m_numlabels, m_kseeds, m_kseedsx, m_kseedsy );
+        return;
 
-          // only varying m, prettier superpixels
-          float dist = distchans->at<float>(y,x)
-                     / maxchansn + distxy->at<float>(y,x)/xywt;
+      case PACKED_32FC1:
+        PackedUpdateSeeds<float, 1>( m_packed, m_klabels, m_numlabels, m_kseeds, m_kseedsx, m_kseedsy );
+        return;
 
-          if( dist < distvec->at<float>(y,x) )
-          {
-            distvec->at<float>(y,x) = dist;
-            klabels->at<int>(y,x) = n;
-          }
-        } // end for x
-      } // end for y
+      case PACKED_32FC3:
+        PackedUpdateSeeds<float, 3>( m_packed, m_klabels, m_numlabels, m_kseeds, m_kseedsx, m_kseedsy );
+        return;
+
+      default:
+        break;
     }
 
-    Mat* klabels;
-    vector< vector<float> > *kseeds;
-    float maxchansn, xywt;
-    vector<Mat>* chvec;
-    Mat *distchans, *distxy, *distvec;
-    float kseedsxn, kseedsyn;
-    int x1, x2, nr_channels, n;
-};
+    // parallel reduce structure
+    SeedsCenters sc( m_chvec, m_klabels, m_numlabels, m_nr_channels );
+
+    // accumulate center distances
+    parallel_reduce( BlockedRange(0, m_width), sc );
+
+    // normalize centers
+    parallel_for_( Range(0, m_numlabels), SeedNormInvoker<>( &m_kseeds, &sc.sigma,
+                   &sc.clustersize, &sc.sigmax, &sc.sigmay, &m_kseedsx, &m_kseedsy, m_nr_channels  ) );
+}
 
 /*
  *
@@ -2134,12 +3511,22 @@ struct SLICOGrowInvoker : ParallelLoopBody
  */
 inline void SuperpixelSLICImpl::PerformSLICO( const int&  itrnum )
 {
-    Mat distxy( m_height, m_width, CV_32F, Scalar::all(FLT_MAX) );
-    Mat distvec( m_height, m_width, CV_32F, Scalar::all(FLT_MAX) );
-    Mat distchans( m_height, m_width, CV_32F, Scalar::all(FLT_MAX) );
+    // specialized kernels for the channels, if there are any
+    const int layout = PackChannels();
+
+    const int band_rows = distanceBandRows();
+    const bool banded = band_rows < m_height;
+
+    m_distxy.create( band_rows, m_width, CV_32F );
+    m_distxy.setTo( Scalar::all(FLT_MAX) );
+    m_distvec.create( band_rows, m_width, CV_32F );
+    m_distchans.create( band_rows, m_width, CV_32F );
+    m_distchans.setTo( Scalar::all(FLT_MAX) );
 
     // this is the variable value of M, just start with 10
-    vector<float> maxchans( m_numlabels, FLT_MIN );
+    // (kept for the refinement passes of the pyramid)
+    vector<float>& maxchans = m_maxchans;
+    maxchans.assign( m_numlabels, FLT_MIN );
     // this is the variable value of M, just start with 10
     vector<float> maxxy( m_numlabels, FLT_MIN );
     // note: this is different from how usual SLIC/LKM works
@@ -2147,54 +3534,74 @@ inline void SuperpixelSLICImpl::PerformSLICO( const int&  itrnum )
 
     for( int itr = 0; itr < itrnum; itr++ )
     {
-        distvec.setTo(FLT_MAX);
-        for( int n = 0; n < m_numlabels; n++ )
-        {
-            int y1 = max(0, (int) m_kseedsy[n] - m_region_size);
-            int y2 = min(m_height, (int) m_kseedsy[n] + m_region_size);
-            int x1 = max(0, (int) m_kseedsx[n] - m_region_size);
-            int x2 = min((int) m_width,(int) m_kseedsx[n] + m_region_size);
-
-            parallel_for_( Range(y1, y2), SLICOGrowInvoker( &m_chvec, &distchans, &distxy, &distvec,
-                           &m_klabels, m_kseedsx[n], m_kseedsy[n], xywt, maxchans[n], &m_kseeds,
-                           x1, x2, m_nr_channels, n ) );
-        }
-        //-----------------------------------------------------------------
-        // Assign the max color distance for a cluster
-        //-----------------------------------------------------------------
+        saveIterationStart( m_prev_kseedsx, m_prev_kseedsy, m_prev_klabels );
+
         if( itr == 0 )
         {
             maxchans.assign(m_numlabels,FLT_MIN);
             maxxy.assign(m_numlabels,FLT_MIN);
         }
 
-        for( int x = 0; x < m_width; x++ )
+        // the grow step uses the max color distances of the last iteration
+        vector<float> nextmaxchans( maxchans );
+
+        // one band of rows after the other (the whole image unless low memory)
+        for( int band_start = 0; band_start < m_height; band_start += band_rows )
         {
-          for( int y = 0; y < m_height; y++ )
+          int band_end = min( m_height, band_start + band_rows );
+
+          // distances don't carry over between bands
+          if( banded )
+          {
+            m_distxy.setTo( Scalar::all(FLT_MAX) );
+            m_distchans.setTo( Scalar::all(FLT_MAX) );
+          }
+
+          m_distvec.setTo(FLT_MAX);
+          for( int n = 0; n < m_numlabels; n++ )
+          {
+              int y1 = max(band_start, (int) m_kseedsy[n] - m_region_size);
+              int y2 = min(band_end, (int) m_kseedsy[n] + m_region_size);
+              int x1 = max(0, (int) m_kseedsx[n] - m_region_size);
+              int x2 = min((int) m_width,(int) m_kseedsx[n] + m_region_size);
+              if( y1 >= y2 )
+                continue;
+
+              if( layout != PACKED_NONE )
+                PackedGrow<true>( layout, Range(y1, y2),
+                                  PackedGrowSeed( n, x1, x2, band_start, xywt, maxchans[n] ) );
+              else
+                parallel_for_( Range(y1, y2), SLICOGrowInvoker( &m_chvec, &m_distchans, &m_distxy, &m_distvec,
+                               &m_klabels, m_kseedsx[n], m_kseedsy[n], xywt, maxchans[n], &m_kseeds,
+                               x1, x2, m_nr_channels, n, band_start ) );
+          }
+          //-----------------------------------------------------------------
+          // Assign the max color distance for a cluster
+          //-----------------------------------------------------------------
+          for( int x = 0; x < m_width; x++ )
           {
-              int idx = m_klabels.at<int>(y,x);
+            for( int y = band_start; y < band_end; y++ )
+            {
+                int idx = m_klabels.at<int>(y,x);
 
-              if( maxchans[idx] < distchans.at<float>(y,x) )
-                  maxchans[idx] = distchans.at<float>(y,x);
+                if( nextmaxchans[idx] < m_distchans.at<float>(y - band_start,x) )
+                    nextmaxchans[idx] = m_distchans.at<float>(y - band_start,x);
 
-              if( maxxy[idx] < distxy.at<float>(y,x) )
-                  maxxy[idx] = distxy.at<float>(y,x);
+                if( maxxy[idx] < m_distxy.at<float>(y - band_start,x) )
+                    maxxy[idx] = m_distxy.at<float>(y - band_start,x);
+            }
           }
         }
+        maxchans.swap( nextmaxchans );
         //-----------------------------------------------------------------
         // Recalculate the centroid and store in the seed values
         //-----------------------------------------------------------------
 
-        // parallel reduce structure
-        SeedsCenters sc( m_chvec, m_klabels, m_numlabels, m_nr_channels );
-
-        // accumulate center distances
-        parallel_reduce( BlockedRange(0, m_width), sc );
-
-        // normalize centers
-        parallel_for_( Range(0, m_numlabels), SeedNormInvoker( &m_kseeds, &sc.sigma,
-                       &sc.clustersize, &sc.sigmax, &sc.sigmay, &m_kseedsx, &m_kseedsy, m_nr_channels  ) );
+        UpdateSeeds( layout );
 
+        m_iterations_run = itr + 1;
+        if ( hasConverged( m_prev_kseedsx, m_prev_kseedsy, m_prev_klabels ) )
+          break;
     }
 }
 
@@ -2203,7 +3610,7 @@ struct SLICGrowInvoker : ParallelLoopBody
     SLICGrowInvoker( vector<Mat>* _chvec, Mat* _distvec, Mat* _klabels,
                      float _kseedsxn, float _kseedsyn, float _xywt,
                      vector< vector<float> > *_kseeds, int _x1, int _x2,
-                     int _nr_channels, int _n )
+                     int _nr_channels, int _n, int _band_start )
     {
       chvec = _chvec;
       distvec = _distvec;
@@ -2216,6 +3623,7 @@ struct SLICGrowInvoker : ParallelLoopBody
       n = _n;
       xywt = _xywt;
       nr_channels = _nr_channels;
+      band_start = _band_start;
     }
 
     void operator ()(const cv::Range& range) const CV_OVERRIDE
@@ -2304,9 +3712,9 @@ struct SLICGrowInvoker : ParallelLoopBody
           //this would be more exact but expensive
           //dist = sqrt(dist) + sqrt(distxy/xywt);
 
-          if( dist < distvec->at<float>(y,x) )
+          if( dist < distvec->at<float>(y - band_start,x) )
           {
-            distvec->at<float>(y,x) = dist;
+            distvec->at<float>(y - band_start,x) = dist;
             klabels->at<int>(y,x) = n;
           }
         } //end for x
@@ -2320,8 +3728,517 @@ struct SLICGrowInvoker : ParallelLoopBody
     Mat *distvec;
     float kseedsxn, kseedsyn;
     int x1, x2, nr_channels, n;
+    // first row of the distance matrix
+    int band_start;
+};
+
+static inline float PixelValue( const Mat& channel, int y, int x )
+{
+    switch ( channel.depth() )
+    {
+      case CV_8U:  return channel.at<uchar>(y,x);
+      case CV_8S:  return channel.at<char>(y,x);
+      case CV_16U: return channel.at<ushort>(y,x);
+      case CV_16S: return channel.at<short>(y,x);
+      case CV_32S: return (float) channel.at<int>(y,x);
+      case CV_32F: return channel.at<float>(y,x);
+      case CV_64F: return (float) channel.at<double>(y,x);
+      default:
+        CV_Error( Error::StsInternal, "Invalid matrix depth" );
+        return 0;
+    }
+}
+
+struct PyramidRefineInvoker : ParallelLoopBody
+{
+    PyramidRefineInvoker( const vector<Mat>* _chvec, const Mat* _coarse_labels, const Mat* _band,
+                          Mat* _klabels, const vector< vector<float> >* _kseeds,
+                          const vector<float>* _kseedsx, const vector<float>* _kseedsy,
+                          const vector<float>* _colorwt, float _xywt, float _fx, float _fy,
+                          int _nr_channels, bool _assign_interior )
+    {
+      chvec = _chvec;
+      coarse_labels = _coarse_labels;
+      band = _band;
+      klabels = _klabels;
+      kseeds = _kseeds;
+      kseedsx = _kseedsx;
+      kseedsy = _kseedsy;
+      colorwt = _colorwt;
+      xywt = _xywt;
+      fx = _fx;
+      fy = _fy;
+      nr_channels = _nr_channels;
+      assign_interior = _assign_interior;
+    }
+
+    void operator ()(const cv::Range& range) const CV_OVERRIDE
+    {
+      int cols = klabels->cols;
+      int coarse_cols = coarse_labels->cols;
+      int coarse_rows = coarse_labels->rows;
+
+      vector<float> color( nr_channels );
+      for (int y = range.start; y < range.end; ++y)
+      {
+        int cy = min( int( y / fy ), coarse_rows - 1 );
+        int* labels = klabels->ptr<int>(y);
+        for( int x = 0; x < cols; x++ )
+        {
+          int cx = min( int( x / fx ), coarse_cols - 1 );
+
+          // away from the boundaries the downsampled label stays
+          if( !band->at<uchar>(cy,cx) )
+          {
+            if( assign_interior )
+              labels[x] = coarse_labels->at<int>(cy,cx);
+            continue;
+          }
+
+          for( int b = 0; b < nr_channels; b++ )
+            color[b] = PixelValue( chvec->at(b), y, x );
+
+          // closest of the superpixels around the downsampled pixel
+          int candidates[9];
+          int nr_candidates = 0;
+          float best_dist = FLT_MAX;
+          int best_label = coarse_labels->at<int>(cy,cx);
+          for( int ny = max( cy - 1, 0 ); ny <= min( cy + 1, coarse_rows - 1 ); ny++ )
+          {
+            for( int nx = max( cx - 1, 0 ); nx <= min( cx + 1, coarse_cols - 1 ); nx++ )
+            {
+              int n = coarse_labels->at<int>(ny,nx);
+              if( std::find( candidates, candidates + nr_candidates, n ) != candidates + nr_candidates )
+                continue;
+              candidates[nr_candidates++] = n;
+
+              float distchans = 0;
+              for( int b = 0; b < nr_channels; b++ )
+              {
+                float diff = color[b] - kseeds->at(b)[n];
+                distchans += diff * diff;
+              }
+
+              float difx = x - kseedsx->at(n);
+              float dify = y - kseedsy->at(n);
+              float dist = distchans * colorwt->at(n) + ( difx*difx + dify*dify ) / xywt;
+              if( dist < best_dist )
+              {
+                best_dist = dist;
+                best_label = n;
+              }
+            }
+          }
+          labels[x] = best_label;
+        } // end for x
+      } // end for y
+    }
+
+    const vector<Mat>* chvec;
+    const Mat* coarse_labels;
+    const Mat* band;
+    Mat* klabels;
+    const vector< vector<float> >* kseeds;
+    const vector<float>* kseedsx;
+    const vector<float>* kseedsy;
+    const vector<float>* colorwt;
+    float xywt, fx, fy;
+    int nr_channels;
+    bool assign_interior;
 };
 
+/*
+ *    PerformPyramid
+ *
+ *    Runs SLIC or SLICO on the image downsampled by 2^levels, then upsamples
+ * the labels and seeds and reassigns only the pixels near the boundaries at
+ * full resolution.
+ *
+ */
+inline void SuperpixelSLICImpl::PerformPyramid( const int& itrnum )
+{
+    // drop levels while the downsampled superpixels would be too small
+    int levels = m_pyramid_levels;
+    while( levels > 0 && ( m_region_size >> levels ) < 4 )
+      levels--;
+
+    int refine = min( m_pyramid_refine_iterations, itrnum );
+    if( levels == 0 || refine == itrnum )
+    {
+      if( m_algorithm == SLICO )
+        PerformSLICO( itrnum );
+      else
+        PerformSLIC( itrnum );
+      return;
+    }
+
+    const int scale = 1 << levels;
+    const int width = m_width;
+    const int height = m_height;
+    const int region_size = m_region_size;
+    const int coarse_width = max( 1, ( width + scale / 2 ) / scale );
+    const int coarse_height = max( 1, ( height + scale / 2 ) / scale );
+    const float fx = float(width) / float(coarse_width);
+    const float fy = float(height) / float(coarse_height);
+
+    // downsample the channels (resize has no 8S or 32S area interpolation)
+    m_pyramid_chvec.resize( m_nr_channels );
+    for( int b = 0; b < m_nr_channels; b++ )
+    {
+      if( m_chvec[b].depth() == CV_8S || m_chvec[b].depth() == CV_32S )
+      {
+        Mat channel;
+        m_chvec[b].convertTo( channel, CV_32F );
+        resize( channel, m_pyramid_chvec[b], Size( coarse_width, coarse_height ), 0, 0, INTER_AREA );
+      }
+      else
+        resize( m_chvec[b], m_pyramid_chvec[b], Size( coarse_width, coarse_height ), 0, 0, INTER_AREA );
+    }
+
+    // iterate on the downsampled image
+    for( int n = 0; n < m_numlabels; n++ )
+    {
+      m_kseedsx[n] = ( m_kseedsx[n] + 0.5f ) / fx - 0.5f;
+      m_kseedsy[n] = ( m_kseedsy[n] + 0.5f ) / fy - 0.5f;
+    }
+    std::swap( m_chvec, m_pyramid_chvec );
+    std::swap( m_klabels, m_pyramid_labels );
+    m_width = coarse_width;
+    m_height = coarse_height;
+    m_region_size = max( 1, cvRound( float(region_size) / float(scale) ) );
+
+    m_klabels.create( m_height, m_width, CV_32S );
+    m_klabels.setTo( Scalar::all(0) );
+    if( m_algorithm == SLICO )
+      PerformSLICO( itrnum - refine );
+    else
+      PerformSLIC( itrnum - refine );
+    int coarse_iterations = m_iterations_run;
+
+    std::swap( m_chvec, m_pyramid_chvec );
+    std::swap( m_klabels, m_pyramid_labels );
+    m_width = width;
+    m_height = height;
+    m_region_size = region_size;
+    for( int n = 0; n < m_numlabels; n++ )
+    {
+      m_kseedsx[n] = ( m_kseedsx[n] + 0.5f ) * fx - 0.5f;
+      m_kseedsy[n] = ( m_kseedsy[n] + 0.5f ) * fy - 0.5f;
+    }
+
+    // mark the downsampled pixels with another superpixel around them
+    m_pyramid_band.create( coarse_height, coarse_width, CV_8U );
+    for( int cy = 0; cy < coarse_height; cy++ )
+    {
+      for( int cx = 0; cx < coarse_width; cx++ )
+      {
+        int label = m_pyramid_labels.at<int>(cy,cx);
+        uchar boundary = 0;
+        for( int ny = max( cy - 1, 0 ); ny <= min( cy + 1, coarse_height - 1 ) && !boundary; ny++ )
+          for( int nx = max( cx - 1, 0 ); nx <= min( cx + 1, coarse_width - 1 ); nx++ )
+            if( m_pyramid_labels.at<int>(ny,nx) != label )
+            {
+              boundary = 1;
+              break;
+            }
+        m_pyramid_band.at<uchar>(cy,cx) = boundary;
+      }
+    }
+
+    // same distance as the downsampled iterations, in full resolution pixels
+    vector<float> colorwt( m_numlabels, 1.0f );
+    float xywt;
+    if( m_algorithm == SLICO )
+    {
+      xywt = float(m_region_size*m_region_size);
+      for( int n = 0; n < m_numlabels; n++ )
+        colorwt[n] = 1.0f / m_maxchans[n];
+    }
+    else
+      xywt = (m_region_size/m_ruler)*(m_region_size/m_ruler);
+
+    // refine the boundaries at full resolution (the first pass also upsamples the labels)
+    const int layout = PackChannels();
+    m_klabels.create( m_height, m_width, CV_32S );
+    for( int itr = 0; itr < refine; itr++ )
+    {
+        parallel_for_( Range(0, m_height), PyramidRefineInvoker( &m_chvec, &m_pyramid_labels, &m_pyramid_band,
+                       &m_klabels, &m_kseeds, &m_kseedsx, &m_kseedsy, &colorwt, xywt, fx, fy,
+                       m_nr_channels, itr == 0 ) );
+
+        UpdateSeeds( layout );
+    }
+
+    m_iterations_run = coarse_iterations + refine;
+}
+
+/*
+ * OpenCL kernels of SLIC, built with NCH (number of channels) and WG (work
+ * group size of slic_update) defined. Seeds are stored as x, y and the NCH
+ * channel values one after another.
+ *
+ * slic_assign runs per pixel and picks the closest of the seeds whose search
+ * window covers it (the same windows, distance and tie breaking as
+ * SLICGrowInvoker), looking them up in a grid of region_size cells.
+ *
+ * slic_update runs a work group per seed and averages the pixels labeled with
+ * it inside its search window. SeedsCenters averages them over the whole
+ * image instead, so this differs from the CPU whenever a pixel keeps the
+ * label of a seed whose window moved off it, and its float sums add up in
+ * another order. The labels are close to the CPU's, not the same.
+ */
+static const char* const slic_opencl_source = R"CLC(
+__kernel void slic_assign( __global const uchar* image, int image_step, int image_offset,
+                           __global uchar* labels, int labels_step, int labels_offset,
+                           int rows, int cols, __global const float* seeds,
+                           __global const int* cell_offsets, __global const int* cell_seeds,
+                           int cells_x, int cells_y, int region_size, float xywt )
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if( x >= cols || y >= rows )
+        return;
+
+    __global const float* pixel = (__global const float*)( image + image_offset + y * image_step ) + x * NCH;
+    __global int* label = (__global int*)( labels + labels_offset + y * labels_step ) + x;
+
+    int cx = min( x / region_size, cells_x - 1 );
+    int cy = min( y / region_size, cells_y - 1 );
+
+    float best_dist = FLT_MAX;
+    int best_seed = -1;
+    for( int ny = max( cy - 1, 0 ); ny <= min( cy + 1, cells_y - 1 ); ny++ )
+    {
+        for( int nx = max( cx - 1, 0 ); nx <= min( cx + 1, cells_x - 1 ); nx++ )
+        {
+            int cell = ny * cells_x + nx;
+            for( int i = cell_offsets[cell]; i < cell_offsets[cell + 1]; i++ )
+            {
+                int n = cell_seeds[i];
+                __global const float* seed = seeds + n * ( NCH + 2 );
+
+                int sx = (int) seed[0];
+                int sy = (int) seed[1];
+                if( x < sx - region_size || x >= sx + region_size ||
+                    y < sy - region_size || y >= sy + region_size )
+                    continue;
+
+                float dist = 0.0f;
+                for( int b = 0; b < NCH; b++ )
+                {
+                    float diff = pixel[b] - seed[2 + b];
+                    dist += diff * diff;
+                }
+                float difx = x - seed[0];
+                float dify = y - seed[1];
+                dist += ( difx * difx + dify * dify ) / xywt;
+
+                if( dist < best_dist || ( dist == best_dist && n < best_seed ) )
+                {
+                    best_dist = dist;
+                    best_seed = n;
+                }
+            }
+        }
+    }
+
+    // pixels no window covers keep their label
+    if( best_seed >= 0 )
+        *label = best_seed;
+}
+
+__kernel void slic_update( __global const uchar* image, int image_step, int image_offset,
+                           __global const uchar* labels, int labels_step, int labels_offset,
+                           int rows, int cols, __global const float* seeds, int region_size,
+                           __global float* centers )
+{
+    int n = get_group_id(0);
+    int lid = get_local_id(0);
+    __global const float* seed = seeds + n * ( NCH + 2 );
+
+    int x1 = max( 0, (int) seed[0] - region_size );
+    int x2 = min( cols, (int) seed[0] + region_size );
+    int y1 = max( 0, (int) seed[1] - region_size );
+    int y2 = min( rows, (int) seed[1] + region_size );
+    int width = max( x2 - x1, 0 );
+    int total = width * max( y2 - y1, 0 );
+
+    // x, y, channels and pixel count
+    float sums[NCH + 3];
+    for( int k = 0; k < NCH + 3; k++ )
+        sums[k] = 0.0f;
+
+    for( int i = lid; i < total; i += WG )
+    {
+        int y = y1 + i / width;
+        int x = x1 + i % width;
+        if( *( (__global const int*)( labels + labels_offset + y * labels_step ) + x ) != n )
+            continue;
+
+        __global const float* pixel = (__global const float*)( image + image_offset + y * image_step ) + x * NCH;
+        sums[0] += x;
+        sums[1] += y;
+        for( int b = 0; b < NCH; b++ )
+            sums[2 + b] += pixel[b];
+        sums[NCH + 2] += 1.0f;
+    }
+
+    __local float partial[WG * ( NCH + 3 )];
+    for( int k = 0; k < NCH + 3; k++ )
+        partial[lid * ( NCH + 3 ) + k] = sums[k];
+    barrier( CLK_LOCAL_MEM_FENCE );
+
+    for( int stride = WG / 2; stride > 0; stride >>= 1 )
+    {
+        if( lid < stride )
+            for( int k = 0; k < NCH + 3; k++ )
+                partial[lid * ( NCH + 3 ) + k] += partial[( lid + stride ) * ( NCH + 3 ) + k];
+        barrier( CLK_LOCAL_MEM_FENCE );
+    }
+
+    // empty clusters go to 0 like on the CPU
+    if( lid == 0 )
+    {
+        float count = max( partial[NCH + 2], 1.0f );
+        for( int k = 0; k < NCH + 2; k++ )
+            centers[n * ( NCH + 2 ) + k] = partial[k] / count;
+    }
+}
+)CLC";
+
+// work group size of slic_update (a power of 2)
+static const int SLIC_OPENCL_WORK_GROUP = 64;
+
+/*
+ *    PerformSLICOpenCL
+ *
+ *    SLIC with the assignment and the center update on the OpenCL device.
+ * Only the seeds go back and forth between iterations, the labels come
+ * back to the host once at the end.
+ *
+ */
+inline bool SuperpixelSLICImpl::PerformSLICOpenCL( const int& itrnum )
+{
+    const int seed_size = m_nr_channels + 2;
+
+    // build the kernels for this many channels
+    if( m_ocl_channels != m_nr_channels || m_ocl_assign.empty() || m_ocl_update.empty() )
+    {
+      ocl::ProgramSource source( slic_opencl_source );
+      String options = format( "-D NCH=%d -D WG=%d", m_nr_channels, SLIC_OPENCL_WORK_GROUP );
+      if( !m_ocl_assign.create( "slic_assign", source, options ) ||
+          !m_ocl_update.create( "slic_update", source, options ) )
+      {
+        m_ocl_channels = 0;
+        return false;
+      }
+      m_ocl_channels = m_nr_channels;
+    }
+
+    const float xywt = (m_region_size/m_ruler)*(m_region_size/m_ruler);
+    const int cells_x = max( 1, ( m_width + m_region_size - 1 ) / m_region_size );
+    const int cells_y = max( 1, ( m_height + m_region_size - 1 ) / m_region_size );
+
+    m_klabels.copyTo( m_ocl_labels );
+    m_ocl_centers.create( 1, m_numlabels * seed_size, CV_32F );
+
+    Mat seeds( 1, m_numlabels * seed_size, CV_32F );
+    Mat cell_offsets( 1, cells_x * cells_y + 1, CV_32S );
+    Mat cell_seeds( 1, max( m_numlabels, 1 ), CV_32S );
+    vector<int> seed_cells( m_numlabels );
+
+    for( int itr = 0; itr < itrnum; itr++ )
+    {
+        // seeds and the grid cell of each (clamped to the grid, in seed order within a cell)
+        float* seed = seeds.ptr<float>();
+        int* offsets = cell_offsets.ptr<int>();
+        int* indexes = cell_seeds.ptr<int>();
+        std::fill( offsets, offsets + cells_x * cells_y + 1, 0 );
+        for( int n = 0; n < m_numlabels; n++ )
+        {
+            seed[n * seed_size] = m_kseedsx[n];
+            seed[n * seed_size + 1] = m_kseedsy[n];
+            for( int b = 0; b < m_nr_channels; b++ )
+              seed[n * seed_size + 2 + b] = m_kseeds[b][n];
+
+            int cx = min( max( (int) m_kseedsx[n] / m_region_size, 0 ), cells_x - 1 );
+            int cy = min( max( (int) m_kseedsy[n] / m_region_size, 0 ), cells_y - 1 );
+            seed_cells[n] = cy * cells_x + cx;
+            offsets[seed_cells[n] + 1]++;
+        }
+        for( int cell = 0; cell < cells_x * cells_y; cell++ )
+          offsets[cell + 1] += offsets[cell];
+        vector<int> filled( offsets, offsets + cells_x * cells_y );
+        for( int n = 0; n < m_numlabels; n++ )
+          indexes[filled[seed_cells[n]]++] = n;
+
+        seeds.copyTo( m_ocl_seeds );
+        cell_offsets.copyTo( m_ocl_cell_offsets );
+        cell_seeds.copyTo( m_ocl_cell_seeds );
+
+        if ( m_convergence == SLIC_CONVERGENCE_SEED_DISPLACEMENT )
+        {
+          m_prev_kseedsx = m_kseedsx;
+          m_prev_kseedsy = m_kseedsy;
+        }
+        if ( m_convergence == SLIC_CONVERGENCE_LABEL_CHANGE || m_instrumented )
+          m_ocl_labels.copyTo( m_ocl_prev_labels );
+
+        size_t assign_size[2] = { (size_t) m_width, (size_t) m_height };
+        m_ocl_assign.args( ocl::KernelArg::ReadOnlyNoSize( m_ocl_image ),
+                           ocl::KernelArg::ReadWriteNoSize( m_ocl_labels ), m_height, m_width,
+                           ocl::KernelArg::PtrReadOnly( m_ocl_seeds ),
+                           ocl::KernelArg::PtrReadOnly( m_ocl_cell_offsets ),
+                           ocl::KernelArg::PtrReadOnly( m_ocl_cell_seeds ),
+                           cells_x, cells_y, m_region_size, xywt );
+        if( !m_ocl_assign.run( 2, assign_size, NULL, false ) )
+          return false;
+
+        size_t update_size[1] = { (size_t) m_numlabels * SLIC_OPENCL_WORK_GROUP };
+        size_t update_group[1] = { (size_t) SLIC_OPENCL_WORK_GROUP };
+        m_ocl_update.args( ocl::KernelArg::ReadOnlyNoSize( m_ocl_image ),
+                           ocl::KernelArg::ReadOnlyNoSize( m_ocl_labels ), m_height, m_width,
+                           ocl::KernelArg::PtrReadOnly( m_ocl_seeds ), m_region_size,
+                           ocl::KernelArg::PtrWriteOnly( m_ocl_centers ) );
+        if( !m_ocl_update.run( 1, update_size, update_group, true ) )
+          return false;
+
+        // only the seeds come back every iteration
+        m_ocl_centers.copyTo( seeds );
+        seed = seeds.ptr<float>();
+        for( int n = 0; n < m_numlabels; n++ )
+        {
+            m_kseedsx[n] = seed[n * seed_size];
+            m_kseedsy[n] = seed[n * seed_size + 1];
+            for( int b = 0; b < m_nr_channels; b++ )
+              m_kseeds[b][n] = seed[n * seed_size + 2 + b];
+        }
+
+        m_iterations_run = itr + 1;
+        int64 changed_pixels = 0;
+        if ( m_convergence == SLIC_CONVERGENCE_LABEL_CHANGE || m_instrumented )
+        {
+          compare( m_ocl_labels, m_ocl_prev_labels, m_ocl_changed, CMP_NE );
+          changed_pixels = countNonZero( m_ocl_changed );
+          if ( m_instrumented )
+            m_stats.pixels_relabeled.push_back( changed_pixels );
+        }
+        if ( m_convergence == SLIC_CONVERGENCE_SEED_DISPLACEMENT )
+        {
+          if ( seedsConverged( m_prev_kseedsx, m_prev_kseedsy ) )
+            break;
+        }
+        else if ( m_convergence == SLIC_CONVERGENCE_LABEL_CHANGE )
+        {
+          if ( (double) changed_pixels / ( (double) m_width * m_height ) < m_convergence_tolerance )
+            break;
+        }
+    }
+
+    m_ocl_labels.copyTo( m_klabels );
+    return true;
+}
+
 /*
  *    PerformSuperpixelSLIC
  *
@@ -2331,23 +4248,41 @@ struct SLICGrowInvoker : ParallelLoopBody
  */
 inline void SuperpixelSLICImpl::PerformSLIC( const int&  itrnum )
 {
-    Mat distvec( m_height, m_width, CV_32F );
+    // specialized kernels for the channels, if there are any
+    const int layout = PackChannels();
+
+    const int band_rows = distanceBandRows();
+    m_distvec.create( band_rows, m_width, CV_32F );
 
     const float xywt = (m_region_size/m_ruler)*(m_region_size/m_ruler);
 
     for( int itr = 0; itr < itrnum; itr++ )
     {
-        distvec.setTo(FLT_MAX);
-        for( int n = 0; n < m_numlabels; n++ )
+        saveIterationStart( m_prev_kseedsx, m_prev_kseedsy, m_prev_klabels );
+
+        // one band of rows after the other (the whole image unless low memory)
+        for( int band_start = 0; band_start < m_height; band_start += band_rows )
         {
-            int y1 = max(0, (int) m_kseedsy[n] - m_region_size);
-            int y2 = min(m_height, (int) m_kseedsy[n] + m_region_size);
-            int x1 = max(0, (int) m_kseedsx[n] - m_region_size);
-            int x2 = min((int) m_width,(int) m_kseedsx[n] + m_region_size);
-
-            parallel_for_( Range(y1, y2), SLICGrowInvoker( &m_chvec, &distvec,
-                           &m_klabels, m_kseedsx[n], m_kseedsy[n], xywt, &m_kseeds,
-                           x1, x2, m_nr_channels, n ) );
+          int band_end = min( m_height, band_start + band_rows );
+
+          m_distvec.setTo(FLT_MAX);
+          for( int n = 0; n < m_numlabels; n++ )
+          {
+              int y1 = max(band_start, (int) m_kseedsy[n] - m_region_size);
+              int y2 = min(band_end, (int) m_kseedsy[n] + m_region_size);
+              int x1 = max(0, (int) m_kseedsx[n] - m_region_size);
+              int x2 = min((int) m_width,(int) m_kseedsx[n] + m_region_size);
+              if( y1 >= y2 )
+                continue;
+
+              if( layout != PACKED_NONE )
+                PackedGrow<false>( layout, Range(y1, y2),
+                                   PackedGrowSeed( n, x1, x2, band_start, xywt, 0.0f ) );
+              else
+                parallel_for_( Range(y1, y2), SLICGrowInvoker( &m_chvec, &m_distvec,
+                               &m_klabels, m_kseedsx[n], m_kseedsy[n], xywt, &m_kseeds,
+                               x1, x2, m_nr_channels, n, band_start ) );
+          }
         }
 
         //-----------------------------------------------------------------
@@ -2355,16 +4290,11 @@ inline void SuperpixelSLICImpl::PerformSLIC( const int&  itrnum )
         //-----------------------------------------------------------------
         // instead of reassigning memory on each iteration, just reset.
 
-        // parallel reduce structure
-        SeedsCenters sc( m_chvec, m_klabels, m_numlabels, m_nr_channels );
-
-        // accumulate center distances
-        parallel_reduce( BlockedRange(0, m_width), sc );
-
-        // normalize centers
-        parallel_for_( Range(0, m_numlabels), SeedNormInvoker( &m_kseeds, &sc.sigma,
-                       &sc.clustersize, &sc.sigmax, &sc.sigmay, &m_kseedsx, &m_kseedsy, m_nr_channels  ) );
+        UpdateSeeds( layout );
 
+        m_iterations_run = itr + 1;
+        if ( hasConverged( m_prev_kseedsx, m_prev_kseedsy, m_prev_klabels ) )
+          break;
     }
 }
 
@@ -2379,7 +4309,8 @@ inline void SuperpixelSLICImpl::PerformMSLIC( const int&  itrnum )
     for( int b = 0; b < m_nr_channels; b++ )
       sigma[b].resize(m_numlabels, 0);
 
-    Mat distvec( m_height, m_width, CV_32F );
+    const int band_rows = distanceBandRows();
+    m_distvec.create( band_rows, m_width, CV_32F );
 
     const float xywt = (m_region_size/m_ruler)*(m_region_size/m_ruler);
 
@@ -2392,23 +4323,32 @@ inline void SuperpixelSLICImpl::PerformMSLIC( const int&  itrnum )
     for( int itr = 0; itr < itrnum; itr++ )
     {
         m_cur_iter = itr;
+        saveIterationStart( m_prev_kseedsx, m_prev_kseedsy, m_prev_klabels );
 
-        distvec.setTo(FLT_MAX);
-        for( int n = 0; n < m_numlabels; n++ )
+        // one band of rows after the other (the whole image unless low memory)
+        for( int band_start = 0; band_start < m_height; band_start += band_rows )
         {
-            if ( m_adaptk[n] < 1.0f )
-                offset = int(m_region_size * m_adaptk[n]);
-            else
-                offset = int(m_region_size * m_adaptk[n]);
-
-            int y1 = max(0,        (int) m_kseedsy[n] - offset);
-            int y2 = min(m_height, (int) m_kseedsy[n] + offset);
-            int x1 = max(0,        (int) m_kseedsx[n] - offset);
-            int x2 = min(m_width,  (int) m_kseedsx[n] + offset);
+          int band_end = min( m_height, band_start + band_rows );
 
-            parallel_for_( Range(y1, y2), SLICGrowInvoker( &m_chvec, &distvec,
-                           &m_klabels, m_kseedsx[n], m_kseedsy[n], xywt, &m_kseeds,
-                           x1, x2, m_nr_channels, n ) );
+          m_distvec.setTo(FLT_MAX);
+          for( int n = 0; n < m_numlabels; n++ )
+          {
+              if ( m_adaptk[n] < 1.0f )
+                  offset = int(m_region_size * m_adaptk[n]);
+              else
+                  offset = int(m_region_size * m_adaptk[n]);
+
+              int y1 = max(band_start, (int) m_kseedsy[n] - offset);
+              int y2 = min(band_end,   (int) m_kseedsy[n] + offset);
+              int x1 = max(0,          (int) m_kseedsx[n] - offset);
+              int x2 = min(m_width,    (int) m_kseedsx[n] + offset);
+              if( y1 >= y2 )
+                continue;
+
+              parallel_for_( Range(y1, y2), SLICGrowInvoker( &m_chvec, &m_distvec,
+                             &m_klabels, m_kseedsx[n], m_kseedsy[n], xywt, &m_kseeds,
+                             x1, x2, m_nr_channels, n, band_start ) );
+          }
         }
 
         //-----------------------------------------------------------------
@@ -2423,12 +4363,19 @@ inline void SuperpixelSLICImpl::PerformMSLIC( const int&  itrnum )
         parallel_reduce( BlockedRange(0, m_width), sc );
 
         // normalize centers
-        parallel_for_( Range(0, m_numlabels), SeedNormInvoker( &m_kseeds, &sc.sigma,
+        parallel_for_( Range(0, m_numlabels), SeedNormInvoker<>( &m_kseeds, &sc.sigma,
                        &sc.clustersize, &sc.sigmax, &sc.sigmay, &m_kseedsx, &m_kseedsy, m_nr_channels ) );
 
-        // 13% as in original paper
-        enforceLabelConnectivity( 13 );
+        // checked before connectivity and splitting renumber the seeds
+        bool converged = hasConverged( m_prev_kseedsx, m_prev_kseedsy, m_prev_klabels );
+
+        // 13% as in original paper, left out of the stats (which describe the user's call)
+        EnforceConnectivity( 13 );
         SuperpixelSplit();
+
+        m_iterations_run = itr + 1;
+        if ( converged )
+          break;
     }
 }
 
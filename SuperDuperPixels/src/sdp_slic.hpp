@@ -59,6 +59,116 @@ using namespace cv;
 
     enum SLICType { SLIC = 100, SLICO = 101, MSLIC = 102 };
 
+    /** @brief What SuperpixelSLIC::iterate measures to decide that the segmentation has converged.
+
+    SLIC_CONVERGENCE_NONE always runs every iteration. SLIC_CONVERGENCE_SEED_DISPLACEMENT stops once the seeds
+    moved less than the tolerance (average distance in pixels) during an iteration. SLIC_CONVERGENCE_LABEL_CHANGE
+    stops once less than the tolerance (fraction between 0 and 1) of the pixels changed their label during an
+    iteration.
+     */
+    enum SLICConvergence { SLIC_CONVERGENCE_NONE = 0, SLIC_CONVERGENCE_SEED_DISPLACEMENT = 1, SLIC_CONVERGENCE_LABEL_CHANGE = 2 };
+
+/** @brief Region adjacency graph of a superpixel segmentation, stored in compressed sparse row (CSR) form.
+
+The neighbors of superpixel i are neighbors[offsets[i]] to neighbors[offsets[i + 1] - 1], sorted in
+ascending order and without duplicates. A superpixel is never its own neighbor. Two superpixels are
+neighbors if any of their pixels are 4-connected.
+
+If the graph was built with boundary lengths, boundary_lengths[k] is the number of 4-connected pixel
+pairs shared by superpixel i and neighbors[k] (the length of their shared boundary). Otherwise
+boundary_lengths is empty.
+ */
+struct CV_EXPORTS RegionAdjacencyGraph
+{
+    std::vector<int> offsets;
+    std::vector<int> neighbors;
+    std::vector<int> boundary_lengths;
+
+    //! Number of superpixels (nodes) in the graph
+    int getNumberOfSuperpixels() const { return offsets.empty() ? 0 : (int) offsets.size() - 1; }
+
+    //! Number of neighbors of a superpixel
+    int degree( int superpixel ) const { return offsets[superpixel + 1] - offsets[superpixel]; }
+
+    //! True if the graph stores boundary lengths
+    bool hasBoundaryLengths() const { return !neighbors.empty() && boundary_lengths.size() == neighbors.size(); }
+};
+
+/** @brief Buffers a SuperpixelSLIC object can borrow, so repeated segmentations of same-sized images reuse
+their memory instead of allocating it again.
+
+Keep one alive per thread and pass it to createSuperpixelSLIC(). The SuperpixelSLIC object takes the buffers
+over while it's alive and gives them back when it's destroyed, so a workspace should only be used by one
+SuperpixelSLIC object at a time.
+ */
+struct CV_EXPORTS_W SegmentationWorkspace
+{
+    //! Label matrix
+    Mat labels;
+    //! Image channels (only reused when the image is given as one Mat)
+    std::vector<Mat> channels;
+    //! Seed channel values and positions
+    std::vector< std::vector<float> > seeds;
+    std::vector<float> seeds_x, seeds_y;
+    //! Distance matrices of the iterations
+    Mat distances, spatial_distances, color_distances;
+    //! Seeds and labels an iteration started from (convergence check)
+    std::vector<float> previous_seeds_x, previous_seeds_y;
+    Mat previous_labels;
+};
+
+/** @brief What a SuperpixelSLIC object measured about its latest calls, see SuperpixelSLIC::setInstrumentation().
+
+Each field is overwritten by the next call of the stage it belongs to, so after a segmentation the struct
+describes the last seeding, iterate(), enforceLabelConnectivity() and duperize call. The connectivity passes
+MSLIC runs inside every iteration count towards iterate_ms, not the connectivity fields. Durations are wall
+time in milliseconds.
+ */
+struct CV_EXPORTS SLICStats
+{
+    //! Wall time of placing and perturbing the seeds (in the constructor or in setImage())
+    double seeding_ms;
+    //! Wall time of the last iterate()
+    double iterate_ms;
+    //! Wall time of the last enforceLabelConnectivity()
+    double connectivity_ms;
+    //! Wall time of the last duperize or reduperize call
+    double duperize_ms;
+    //! Iterations the last iterate() ran
+    int iterations_run;
+    //! Pixels that changed their label in each iteration of the last iterate() (the downsampled iterations
+    //! only of a pyramid, the refinement passes aren't counted)
+    std::vector<int64> pixels_relabeled;
+    //! Superpixels before and after the last enforceLabelConnectivity()
+    int superpixels_before_connectivity, superpixels_after_connectivity;
+    //! Superpixels (or super-duper-pixels) merged together by the last duperize
+    int64 merges;
+    //! Color distances measured between neighbors by the last duperize
+    int64 distance_evaluations;
+    //! Most bytes the per-pixel buffers took so far (see SuperpixelSLIC::getPeakBytesPerMegapixel())
+    size_t peak_scratch_bytes;
+
+    SLICStats() : seeding_ms(0), iterate_ms(0), connectivity_ms(0), duperize_ms(0), iterations_run(0),
+                  superpixels_before_connectivity(0), superpixels_after_connectivity(0), merges(0),
+                  distance_evaluations(0), peak_scratch_bytes(0) {}
+};
+
+/** @brief One timed stage of a SuperpixelSLIC call, passed to a SLICTraceCallback when it ends.
+
+Times are in microseconds of the getTickCount() clock, so events can be written out as "complete" events
+(ph "X", ts start_us, dur duration_us) of the Chrome trace event format.
+ */
+struct CV_EXPORTS SLICTraceEvent
+{
+    //! Name of the stage ("seeding", "iterate", "enforceLabelConnectivity", "duperizeWithAverage", ...)
+    const char* name;
+    int64 start_us;
+    int64 duration_us;
+};
+
+//! Receives the stages of an instrumented SuperpixelSLIC object as they end
+typedef void (*SLICTraceCallback)( const SLICTraceEvent& event, void* user_data );
+
 /** @brief Class implementing the SLIC (Simple Linear Iterative Clustering) superpixels
 algorithm described in @cite Achanta2012.
 
@@ -96,6 +206,85 @@ public:
      */
     CV_WRAP virtual void iterate( int num_iterations = 10 ) = 0;
 
+    /** @brief Sets a convergence criterion that lets iterate() stop before running all of its iterations.
+
+    @param criterion One of SLICConvergence (SLIC_CONVERGENCE_NONE by default).
+    @param tolerance iterate() stops after the first iteration that moved the seeds (or changed the labels)
+    less than this. See SLICConvergence for its units. Negative and NaN tolerances are rejected.
+     */
+    CV_WRAP virtual void setConvergenceCriterion( int criterion, float tolerance ) = 0;
+
+    /** @brief Returns the number of iterations the last call to iterate() actually ran.
+     */
+    CV_WRAP virtual int getNumberOfIterationsRun() const = 0;
+
+    /** @brief Makes iterate() run coarse-to-fine, which is several times faster on large images.
+
+    Most iterations then run on the image downsampled levels times by 2 (with the region size scaled
+    down accordingly). The labels and seeds are then upsampled and a few refinement passes at full
+    resolution only reassign pixels near superpixel boundaries, choosing between the superpixels around
+    them. Levels are dropped while the downsampled region size would be smaller than 4 pixels. Only
+    SLIC and SLICO run coarse-to-fine, MSLIC always iterates at full resolution.
+
+    @param levels Number of times the image is halved (0, the default, turns the pyramid off).
+    @param refine_iterations Number of full resolution refinement passes, they count towards the
+    iterations passed to iterate().
+     */
+    CV_WRAP virtual void setPyramid( int levels, int refine_iterations = 2 ) = 0;
+
+    /** @brief Trades some speed for less memory per image, for running many segmentations at once.
+
+    The distances of the iterations are then only stored for a band of rows at a time (a few region
+    sizes high) instead of for the whole image, and the labels kept for the convergence check and for
+    warm starts are stored in 16 bits when there are at most 65536 superpixels. The segmentation is the
+    same as without it, except that SLICO doesn't carry the distances of pixels no seed reached over
+    from the previous iteration. The channels are kept in the depth of the input image, so pass 8-bit
+    images to keep them small.
+
+    @param low_memory True to turn the low memory mode on (it's off by default).
+     */
+    CV_WRAP virtual void setLowMemory( bool low_memory ) = 0;
+
+    /** @brief Returns the most memory the per-pixel buffers (labels, distances, copied channels and
+    pyramid levels) took so far, in bytes per megapixel of the image.
+
+    Meant for sizing worker pools. Buffers sized by the number of superpixels and the temporaries of
+    a single call aren't counted.
+     */
+    CV_WRAP virtual double getPeakBytesPerMegapixel() const = 0;
+
+    /** @brief Turns measuring the stages of every call on or off (it's off by default).
+
+    While it's off nothing is timed or counted besides the seeding in the constructor, which is timed
+    since it runs before instrumentation can be turned on. While it's on, every iterate() also compares the
+    labels before and after each iteration to count the relabeled pixels.
+
+    @param enabled True to fill the struct returned by getStats() (and call the trace callback).
+     */
+    CV_WRAP virtual void setInstrumentation( bool enabled ) = 0;
+
+    /** @brief Returns what was measured about the latest calls, see SLICStats.
+     */
+    virtual const SLICStats& getStats() const = 0;
+
+    /** @brief Sets a function that gets every stage of an instrumented call as a trace event when it ends.
+
+    @param callback Function to call (NULL, the default, for none). It's called on the thread making the call.
+    @param user_data Passed to every call of callback.
+     */
+    virtual void setTraceCallback( SLICTraceCallback callback, void* user_data = 0 ) = 0;
+
+    /** @brief Replaces the image with the next frame of a video or image sequence.
+
+    @param image Next frame to segment.
+    @param warm_start If true, the current segmentation is the starting point: the seeds keep their
+    positions (and take their colors from the new frame) and every pixel starts out labeled with its
+    nearest seed, so a couple of iterate() calls are enough to refine them. If false, or if
+    the frame doesn't have the same size, channels and depth as the current image, the object starts
+    again from a fresh grid of seeds like createSuperpixelSLIC() does.
+     */
+    CV_WRAP virtual void setImage( InputArray image, bool warm_start = true ) = 0;
+
     /** @brief Returns the segmentation labeling of the image.
 
     Each label represents a superpixel, and each pixel is assigned to one superpixel label.
@@ -116,7 +305,9 @@ public:
     @param thick_line If false, the border is only one pixel wide, otherwise all pixels at the border
     are masked.
 
-    The function return the boundaries of the superpixel segmentation.
+    The function return the boundaries of the superpixel segmentation. Duperizing marks the thick
+    boundaries of its labels while it relabels the pixels (except in low memory mode), so right after a
+    duperize call the thick mask is only copied.
      */
     CV_WRAP virtual void getLabelContourMask( OutputArray image, bool thick_line = true ) const = 0;
 
@@ -174,6 +365,72 @@ public:
 		const bool use_duper_distance = false
 	) = 0;
 
+	/** @brief Combines adjacent superpixels into super-duper-pixels by always merging the closest pair first.
+
+	Uses average colors of superpixels to determine how similar they are. Unlike duperizeWithAverage, the
+	result doesn't depend on how the superpixels are numbered. Every merged super-duper-pixel's average color
+	is the average color of all of its pixels, and its distances to its neighbors are measured from that.
+
+    @param distance Merging stops once the closest pair of neighboring super-duper-pixels is at least this
+	far apart.
+
+	@param num_regions Merging also stops once there are only this many super-duper-pixels left (0 for no
+	limit). Pass FLT_MAX as distance to get exactly num_regions super-duper-pixels (if there are that many
+	superpixels to begin with).
+     */
+	CV_WRAP virtual void duperizeBestFirstWithAverage(const float distance, const int num_regions = 0) = 0;
+
+	/** @brief Combines adjacent superpixels into super-duper-pixels by always merging the closest pair first.
+
+	Uses distances between (normalized) color histograms of superpixels to determine how similar they are.
+	Unlike duperizeWithHistogram, the result doesn't depend on how the superpixels are numbered. Every merged
+	super-duper-pixel's histogram is the normalized histogram of all of its pixels, and its distances to its
+	neighbors are measured from that.
+
+    @param num_buckets The number of histogram buckets to use for each color channel
+	(RGB, HSV, LAB, etc.).
+
+	@param distance Merging stops once the closest pair of neighboring super-duper-pixels is at least this
+	far apart.
+
+	@param num_regions Merging also stops once there are only this many super-duper-pixels left (0 for no
+	limit). Pass FLT_MAX as distance to get exactly num_regions super-duper-pixels (if there are that many
+	superpixels to begin with).
+     */
+	CV_WRAP virtual void duperizeBestFirstWithHistogram
+	(
+		const int num_buckets[],
+		const float distance,
+		const int num_regions = 0
+	) = 0;
+
+	/** @brief Duperizes the superpixels again with the same parameters as the last duperize call, only
+	regrouping superpixels that changed since then.
+
+	Meant for warm starts (see setImage): after iterating (and enforcing connectivity) on the new frame,
+	each superpixel is matched with the superpixel of the last duperize under its centroid. Superpixels
+	whose stats are closer than change_tolerance to their match keep their match's super-duper-pixel, and
+	only pairs of neighbors where at least one superpixel changed are compared again. Best-first duperizing
+	always starts over since its merges depend on every region.
+
+	@param change_tolerance The max distance (in the same units as the duperize distance) the stats of a
+	superpixel can move and still count as unchanged.
+	 */
+	CV_WRAP virtual void reduperize(const float change_tolerance) = 0;
+
+	/** @brief Returns the region adjacency graph of the current segmentation.
+
+	The graph is built in a single pass over the labels the first time it's needed and then reused
+	(by this function and by duperizeWithAverage / duperizeWithHistogram) until the labels change.
+
+	@param boundary_lengths If true, the graph also stores the length of the boundary shared by each pair
+	of neighboring superpixels. A cached graph without boundary lengths is rebuilt if they're requested.
+
+	The returned reference stays valid until the next call that changes the labels (iterate,
+	enforceLabelConnectivity or duperize).
+	 */
+	virtual const RegionAdjacencyGraph& getRegionAdjacencyGraph(const bool boundary_lengths = false) = 0;
+
 
 };
 
@@ -194,11 +451,53 @@ CieLAB color space. An example of SLIC versus SLICO and MSLIC is ilustrated in t
 
 ![image](pics/superpixels_slic.png)
 
+If image is a UMat and OpenCL is available (see ocl::useOpenCL()), SLIC runs the assignment and center
+update of iterate() on the OpenCL device, with only the seeds copied back between iterations and the labels
+copied back once at the end. Everything else (SLICO, MSLIC, the pyramid, connectivity and duperizing) runs on
+the CPU, as does SLIC when the kernels can't be built or run. The device only averages each seed's pixels inside
+its search window and sums them in another order, so its labels come close to the CPU's but aren't guaranteed to
+be the same; pass a Mat to stay on the CPU.
+
  */
 
     CV_EXPORTS_W Ptr<SuperpixelSLIC> createSuperpixelSLIC( InputArray image, int algorithm = SLICO,
                                                            int region_size = 10, float ruler = 10.0f );
 
+/** @brief Initialize a SuperpixelSLIC object that borrows its buffers from a SegmentationWorkspace
+
+@param image Image to segment
+@param workspace Buffers to reuse, see SegmentationWorkspace
+@param algorithm Chooses the algorithm variant to use (see above)
+@param region_size Chooses an average superpixel size measured in pixels
+@param ruler Chooses the enforcement of superpixel smoothness factor of superpixel
+
+Same as createSuperpixelSLIC() above, but segmenting images with the same size as the last one segmented with
+the workspace doesn't allocate label, seed or distance buffers again.
+ */
+    CV_EXPORTS_W Ptr<SuperpixelSLIC> createSuperpixelSLIC( InputArray image, const Ptr<SegmentationWorkspace>& workspace,
+                                                           int algorithm = SLICO, int region_size = 10,
+                                                           float ruler = 10.0f );
+
+/** @brief Merges the closest pair of neighboring regions of a region adjacency graph first, like
+SuperpixelSLIC::duperizeBestFirstWithAverage() does with its superpixels.
+
+Meant for graphs built outside a SuperpixelSLIC object, e.g. across the tiles of a TiledSuperpixelSLIC.
+
+@param graph Region adjacency graph of the regions.
+@param max_distance Merging stops once the closest pair is at least this far apart (L1 distance).
+@param num_regions Merging also stops once there are only this many regions left (0 for no limit).
+@param region_colors One row of color values per region. Rows of merged regions end up holding the stats of
+the merged region in the row of its lowest region.
+@param region_population Number of pixels of each region, updated like region_colors.
+@param region_indexes Gets the merged region of each region, numbered in the order of their lowest region.
+@param distance_evaluations If not NULL, gets the number of distances measured between regions.
+@return Number of merged regions.
+ */
+    CV_EXPORTS int mergeRegionsBestFirst( const RegionAdjacencyGraph& graph, const float max_distance,
+                                          const int num_regions, Mat& region_colors,
+                                          std::vector<int>& region_population, std::vector<int>& region_indexes,
+                                          int64* distance_evaluations = NULL );
+
 //! @}
 
 #endif
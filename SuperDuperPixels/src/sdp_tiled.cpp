@@ -0,0 +1,482 @@
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <numeric>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "sdp_tiled.hpp"
+
+using namespace std;
+
+// What a tile leaves behind once its labels are on disk
+struct TileSegmentation
+{
+	// Superpixels with pixels in the tile, numbered from 0 in the order they first show up
+	int num_superpixels;
+	// Channel sums (num_superpixels x channels) and pixel count of each superpixel
+	vector<double> sums;
+	vector<int> population;
+	// Neighboring superpixels inside the tile (lower one first, without duplicates)
+	vector< pair<int, int> > neighbors;
+	// Labels of the tile across each of its seams, 2 * overlap thick with the seam in the middle
+	// (-1 where the tile's superpixel there has no pixels in the tile itself)
+	Mat left_strip, right_strip, top_strip, bottom_strip;
+	// False if its labels couldn't be written
+	bool written;
+};
+
+// Finds a superpixel's root in a union-find forest (with path halving)
+static int findRoot(vector<int>& parent, int superpixel)
+{
+	while (parent[superpixel] != superpixel)
+	{
+		parent[superpixel] = parent[parent[superpixel]];
+		superpixel = parent[superpixel];
+	}
+	return superpixel;
+}
+
+// Builds a region adjacency graph (without boundary lengths) from pairs of neighboring regions (lower one first)
+static void buildGraph(const int num_regions, vector< pair<int, int> >& edges, RegionAdjacencyGraph& graph)
+{
+	std::sort(edges.begin(), edges.end());
+	edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+	graph.offsets.assign(num_regions + 1, 0);
+	for (const pair<int, int>& edge : edges)
+	{
+		graph.offsets[edge.first + 1] += 1;
+		graph.offsets[edge.second + 1] += 1;
+	}
+	for (int region = 0; region < num_regions; region += 1)
+		graph.offsets[region + 1] += graph.offsets[region];
+
+	graph.neighbors.resize(graph.offsets[num_regions]);
+	graph.boundary_lengths.clear();
+	vector<int> fill(graph.offsets.begin(), graph.offsets.end() - 1);
+	for (const pair<int, int>& edge : edges)
+	{
+		graph.neighbors[fill[edge.first]++] = edge.second;
+		graph.neighbors[fill[edge.second]++] = edge.first;
+	}
+	for (int region = 0; region < num_regions; region += 1)
+		std::sort(graph.neighbors.begin() + graph.offsets[region], graph.neighbors.begin() + graph.offsets[region + 1]);
+}
+
+// Tile-local labels of a rectangle of the image (-1 where the label has no pixels in the tile itself)
+static Mat localStrip(const Mat& labels, const Rect& padded, const Rect& strip, const vector<int>& local_labels)
+{
+	Mat local(strip.size(), CV_32S);
+	for (int y = 0; y < strip.height; y += 1)
+	{
+		const int* row = labels.ptr<int>(strip.y - padded.y + y) + (strip.x - padded.x);
+		int* local_row = local.ptr<int>(y);
+		for (int x = 0; x < strip.width; x += 1)
+			local_row[x] = local_labels[row[x]];
+	}
+	return local;
+}
+
+// Segments one tile, writes its labels and keeps what the seams and the merged graph need
+static void segmentTile
+(
+	ImageTileSource& source,
+	const Rect& core,
+	const Rect& padded,
+	const int overlap,
+	const int algorithm,
+	const int region_size,
+	const float ruler,
+	const int iterations,
+	const int min_element_size,
+	fstream& labels_file,
+	mutex& labels_mutex,
+	TileSegmentation& result
+)
+{
+	const Size image_size = source.getSize();
+
+	Mat tile;
+	source.read(padded, tile);
+	Ptr<SuperpixelSLIC> slic = createSuperpixelSLIC(tile, algorithm, region_size, ruler);
+	slic->iterate(iterations);
+	slic->enforceLabelConnectivity(min_element_size);
+	Mat labels;
+	slic->getLabels(labels);
+
+	// Number the superpixels with pixels in the tile itself
+	const Rect core_in_tile = core - padded.tl();
+	vector<int> local_labels(slic->getNumberOfSuperpixels(), -1);
+	Mat core_labels(core.size(), CV_32S);
+	result.num_superpixels = 0;
+	for (int y = 0; y < core.height; y += 1)
+	{
+		const int* row = labels.ptr<int>(core_in_tile.y + y) + core_in_tile.x;
+		int* core_row = core_labels.ptr<int>(y);
+		for (int x = 0; x < core.width; x += 1)
+		{
+			int& local = local_labels[row[x]];
+			if (local < 0)
+				local = result.num_superpixels++;
+			core_row[x] = local;
+		}
+	}
+
+	// Stats and neighbors of the superpixels
+	const int num_channels = tile.channels();
+	Mat core_values;
+	tile(core_in_tile).convertTo(core_values, CV_64F);
+	result.sums.assign((size_t) result.num_superpixels * num_channels, 0.0);
+	result.population.assign(result.num_superpixels, 0);
+	result.neighbors.clear();
+	for (int y = 0; y < core.height; y += 1)
+	{
+		const int* row = core_labels.ptr<int>(y);
+		const int* next_row = y + 1 < core.height ? core_labels.ptr<int>(y + 1) : NULL;
+		const double* values = core_values.ptr<double>(y);
+		for (int x = 0; x < core.width; x += 1)
+		{
+			double* sums = &result.sums[(size_t) row[x] * num_channels];
+			for (int c = 0; c < num_channels; c += 1)
+				sums[c] += values[x * num_channels + c];
+			result.population[row[x]] += 1;
+
+			if (x + 1 < core.width && row[x + 1] != row[x])
+				result.neighbors.push_back(std::minmax(row[x], row[x + 1]));
+			if (next_row != NULL && next_row[x] != row[x])
+				result.neighbors.push_back(std::minmax(row[x], next_row[x]));
+		}
+	}
+	std::sort(result.neighbors.begin(), result.neighbors.end());
+	result.neighbors.erase(std::unique(result.neighbors.begin(), result.neighbors.end()), result.neighbors.end());
+
+	// Labels across the seams (the tile's padding covers the margin on the far side of each of them)
+	if (core.x > 0)
+		result.left_strip = localStrip(labels, padded, Rect(core.x - overlap, core.y, 2 * overlap, core.height) & padded, local_labels);
+	if (core.x + core.width < image_size.width)
+		result.right_strip = localStrip(labels, padded, Rect(core.x + core.width - overlap, core.y, 2 * overlap, core.height) & padded, local_labels);
+	if (core.y > 0)
+		result.top_strip = localStrip(labels, padded, Rect(core.x, core.y - overlap, core.width, 2 * overlap) & padded, local_labels);
+	if (core.y + core.height < image_size.height)
+		result.bottom_strip = localStrip(labels, padded, Rect(core.x, core.y + core.height - overlap, core.width, 2 * overlap) & padded, local_labels);
+
+	// Write the tile's labels row by row at their place in the file
+	lock_guard<mutex> lock(labels_mutex);
+	for (int y = 0; y < core.height; y += 1)
+	{
+		labels_file.seekp(((streamoff) (core.y + y) * image_size.width + core.x) * (streamoff) sizeof(int));
+		labels_file.write((const char*) core_labels.ptr<int>(y), (streamsize) core.width * sizeof(int));
+	}
+	result.written = labels_file.good();
+}
+
+// Reconciles the superpixels along a seam between 2 tiles and adds the neighbors across it
+// A first tile piece and a second tile piece are the same superpixel if more than half of the margin pixels of
+// each (as both tiles labeled them) are pixels where the 2 tiles agree on them
+static int reconcileSeam
+(
+	const Mat& first_strip,
+	const int first_base,
+	const Mat& second_strip,
+	const int second_base,
+	const bool vertical,
+	const int overlap,
+	vector<int>& parent,
+	vector< pair<int, int> >& edges
+)
+{
+	unordered_map<int64, int> votes;
+	unordered_map<int, int> first_size, second_size;
+	for (int y = 0; y < first_strip.rows; y += 1)
+	{
+		const int* first_row = first_strip.ptr<int>(y);
+		const int* second_row = second_strip.ptr<int>(y);
+		for (int x = 0; x < first_strip.cols; x += 1)
+		{
+			if (first_row[x] >= 0)
+				first_size[first_row[x]] += 1;
+			if (second_row[x] >= 0)
+				second_size[second_row[x]] += 1;
+			if (first_row[x] >= 0 && second_row[x] >= 0)
+				votes[((int64) first_row[x] << 32) | (unsigned int) second_row[x]] += 1;
+		}
+	}
+
+	int merges = 0;
+	for (const pair<const int64, int>& vote : votes)
+	{
+		int first = (int) (vote.first >> 32);
+		int second = (int) (vote.first & 0xffffffff);
+		if (2 * vote.second <= std::max(first_size[first], second_size[second]))
+			continue;
+		int first_root = findRoot(parent, first_base + first);
+		int second_root = findRoot(parent, second_base + second);
+		if (first_root == second_root)
+			continue;
+		parent[std::max(first_root, second_root)] = std::min(first_root, second_root);
+		merges += 1;
+	}
+
+	// Pixels on either side of the seam are 4-connected neighbors
+	if (vertical)
+	{
+		for (int y = 0; y < first_strip.rows; y += 1)
+			edges.push_back(std::minmax(first_base + first_strip.at<int>(y, overlap - 1), second_base + second_strip.at<int>(y, overlap)));
+	}
+	else
+	{
+		for (int x = 0; x < first_strip.cols; x += 1)
+			edges.push_back(std::minmax(first_base + first_strip.at<int>(overlap - 1, x), second_base + second_strip.at<int>(overlap, x)));
+	}
+	return merges;
+}
+
+MatTileSource::MatTileSource(const Mat& image) : image(image)
+{
+}
+
+Size MatTileSource::getSize() const
+{
+	return this->image.size();
+}
+
+void MatTileSource::read(const Rect& roi, Mat& tile)
+{
+	this->image(roi).copyTo(tile);
+}
+
+TiledSuperpixelSLIC::TiledSuperpixelSLIC(int algorithm, int region_size, float ruler, int tile_size, int overlap)
+	: algorithm(algorithm), region_size(region_size), ruler(ruler), tile_size(tile_size),
+	  overlap(overlap < 0 ? 2 * region_size : overlap), iterations(10), min_element_size(25), num_superpixels(0),
+	  num_seam_merges(0)
+{
+	if (tile_size <= 0 || region_size <= 0)
+		CV_Error(Error::StsBadArg, "Tile and region sizes must be positive");
+
+	// Seams need a margin on both sides, inside the tiles next to them
+	this->overlap = std::max(1, std::min(this->overlap, tile_size));
+}
+
+void TiledSuperpixelSLIC::setIterations(int iterations)
+{
+	this->iterations = iterations;
+}
+
+void TiledSuperpixelSLIC::setMinElementSize(int min_element_size)
+{
+	this->min_element_size = min_element_size;
+}
+
+int TiledSuperpixelSLIC::getNumberOfSuperpixels() const
+{
+	return this->num_superpixels;
+}
+
+int TiledSuperpixelSLIC::getNumberOfSeamMerges() const
+{
+	return this->num_seam_merges;
+}
+
+const RegionAdjacencyGraph& TiledSuperpixelSLIC::getRegionAdjacencyGraph() const
+{
+	return this->adjacency;
+}
+
+int TiledSuperpixelSLIC::segment(ImageTileSource& source, const string& labels_path, float duperize_distance, int num_regions)
+{
+	const Size image_size = source.getSize();
+	const int tiles_x = (image_size.width + this->tile_size - 1) / this->tile_size;
+	const int tiles_y = (image_size.height + this->tile_size - 1) / this->tile_size;
+	this->num_superpixels = 0;
+	this->num_seam_merges = 0;
+	this->adjacency = RegionAdjacencyGraph();
+	if (image_size.area() <= 0)
+		return 0;
+
+	// Size the file up front so every tile can be written at its place
+	fstream labels_file(labels_path, ios::in | ios::out | ios::binary | ios::trunc);
+	if (!labels_file)
+		return -1;
+	labels_file.seekp((streamoff) image_size.width * image_size.height * (streamoff) sizeof(int) - 1);
+	labels_file.put(0);
+	mutex labels_mutex;
+
+	// Every superpixel of the image (numbered tile by tile) with its stats, neighbors and union-find parent
+	int num_channels = 0;
+	vector<int> parent;
+	vector<double> sums;
+	vector<int> population;
+	vector< pair<int, int> > edges;
+	// Number of the first superpixel of each tile
+	vector<int> tile_bases(tiles_x * tiles_y, 0);
+	bool written = true;
+
+	// Rows of tiles one after the other (the tiles of a row in parallel), so only the seams to the last row stay
+	vector<TileSegmentation> previous_row, row;
+	for (int tile_y = 0; tile_y < tiles_y; tile_y += 1)
+	{
+		row.assign(tiles_x, TileSegmentation());
+		parallel_for_(Range(0, tiles_x), [&](const Range& range)
+		{
+			for (int tile_x = range.start; tile_x < range.end; tile_x += 1)
+			{
+				Rect core(tile_x * this->tile_size, tile_y * this->tile_size, this->tile_size, this->tile_size);
+				core &= Rect(Point(0, 0), image_size);
+				Rect padded(core.x - this->overlap, core.y - this->overlap, core.width + 2 * this->overlap, core.height + 2 * this->overlap);
+				padded &= Rect(Point(0, 0), image_size);
+				segmentTile(source, core, padded, this->overlap, this->algorithm, this->region_size, this->ruler,
+					this->iterations, this->min_element_size, labels_file, labels_mutex, row[tile_x]);
+			}
+		});
+
+		// Add the row's superpixels to the image's
+		for (int tile_x = 0; tile_x < tiles_x; tile_x += 1)
+		{
+			TileSegmentation& tile = row[tile_x];
+			int base = (int) parent.size();
+			tile_bases[tile_y * tiles_x + tile_x] = base;
+			written = written && tile.written;
+			if (tile.num_superpixels > 0)
+				num_channels = (int) (tile.sums.size() / tile.num_superpixels);
+
+			parent.resize(base + tile.num_superpixels);
+			std::iota(parent.begin() + base, parent.end(), base);
+			sums.insert(sums.end(), tile.sums.begin(), tile.sums.end());
+			population.insert(population.end(), tile.population.begin(), tile.population.end());
+			for (const pair<int, int>& neighbors : tile.neighbors)
+				edges.push_back(make_pair(base + neighbors.first, base + neighbors.second));
+			vector<double>().swap(tile.sums);
+			vector<int>().swap(tile.population);
+			vector< pair<int, int> >().swap(tile.neighbors);
+		}
+
+		// Reconcile the seams inside the row and with the last one
+		for (int tile_x = 1; tile_x < tiles_x; tile_x += 1)
+		{
+			this->num_seam_merges += reconcileSeam(row[tile_x - 1].right_strip, tile_bases[tile_y * tiles_x + tile_x - 1],
+				row[tile_x].left_strip, tile_bases[tile_y * tiles_x + tile_x], true, this->overlap, parent, edges);
+		}
+		if (tile_y > 0)
+		{
+			for (int tile_x = 0; tile_x < tiles_x; tile_x += 1)
+			{
+				this->num_seam_merges += reconcileSeam(previous_row[tile_x].bottom_strip, tile_bases[(tile_y - 1) * tiles_x + tile_x],
+					row[tile_x].top_strip, tile_bases[tile_y * tiles_x + tile_x], false, this->overlap, parent, edges);
+			}
+		}
+		previous_row.swap(row);
+	}
+	if (!written)
+		return -1;
+
+	// Reconciled superpixels, numbered in the order of their lowest piece
+	const int num_pieces = (int) parent.size();
+	vector<int> superpixel_indexes(num_pieces);
+	int superpixel_count = 0;
+	for (int piece = 0; piece < num_pieces; piece += 1)
+	{
+		int root = findRoot(parent, piece);
+		superpixel_indexes[piece] = root == piece ? superpixel_count++ : superpixel_indexes[root];
+	}
+
+	Mat superpixel_colors = Mat::zeros(superpixel_count, num_channels, CV_32F);
+	vector<int> superpixel_population(superpixel_count, 0);
+	vector<double> superpixel_sums((size_t) superpixel_count * num_channels, 0.0);
+	for (int piece = 0; piece < num_pieces; piece += 1)
+	{
+		int superpixel = superpixel_indexes[piece];
+		superpixel_population[superpixel] += population[piece];
+		for (int c = 0; c < num_channels; c += 1)
+			superpixel_sums[(size_t) superpixel * num_channels + c] += sums[(size_t) piece * num_channels + c];
+	}
+	for (int superpixel = 0; superpixel < superpixel_count; superpixel += 1)
+	{
+		for (int c = 0; c < num_channels; c += 1)
+			superpixel_colors.at<float>(superpixel, c) = (float) (superpixel_sums[(size_t) superpixel * num_channels + c] / std::max(superpixel_population[superpixel], 1));
+	}
+	vector<double>().swap(sums);
+	vector<double>().swap(superpixel_sums);
+
+	vector< pair<int, int> > superpixel_edges;
+	superpixel_edges.reserve(edges.size());
+	for (const pair<int, int>& edge : edges)
+	{
+		int first = superpixel_indexes[edge.first];
+		int second = superpixel_indexes[edge.second];
+		if (first != second)
+			superpixel_edges.push_back(std::minmax(first, second));
+	}
+	vector< pair<int, int> >().swap(edges);
+	buildGraph(superpixel_count, superpixel_edges, this->adjacency);
+	this->num_superpixels = superpixel_count;
+
+	// Duperize across the tiles on the merged graph
+	vector<int> final_labels(num_pieces);
+	if (duperize_distance > 0)
+	{
+		vector<int> superduperpixel_indexes;
+		this->num_superpixels = mergeRegionsBestFirst(this->adjacency, duperize_distance, num_regions, superpixel_colors,
+			superpixel_population, superduperpixel_indexes);
+		for (int piece = 0; piece < num_pieces; piece += 1)
+			final_labels[piece] = superduperpixel_indexes[superpixel_indexes[piece]];
+
+		vector< pair<int, int> > superduperpixel_edges;
+		for (const pair<int, int>& edge : superpixel_edges)
+		{
+			int first = superduperpixel_indexes[edge.first];
+			int second = superduperpixel_indexes[edge.second];
+			if (first != second)
+				superduperpixel_edges.push_back(std::minmax(first, second));
+		}
+		buildGraph(this->num_superpixels, superduperpixel_edges, this->adjacency);
+	}
+	else
+	{
+		final_labels.swap(superpixel_indexes);
+	}
+
+	// Relabel the file tile by tile with the final labels
+	vector<int> labels_row;
+	for (int tile_y = 0; tile_y < tiles_y; tile_y += 1)
+	{
+		for (int tile_x = 0; tile_x < tiles_x; tile_x += 1)
+		{
+			Rect core(tile_x * this->tile_size, tile_y * this->tile_size, this->tile_size, this->tile_size);
+			core &= Rect(Point(0, 0), image_size);
+			const int base = tile_bases[tile_y * tiles_x + tile_x];
+			labels_row.resize(core.width);
+			for (int y = 0; y < core.height; y += 1)
+			{
+				streamoff offset = ((streamoff) (core.y + y) * image_size.width + core.x) * (streamoff) sizeof(int);
+				labels_file.seekg(offset);
+				labels_file.read((char*) labels_row.data(), (streamsize) core.width * sizeof(int));
+				for (int x = 0; x < core.width; x += 1)
+					labels_row[x] = final_labels[base + labels_row[x]];
+				labels_file.seekp(offset);
+				labels_file.write((const char*) labels_row.data(), (streamsize) core.width * sizeof(int));
+			}
+		}
+	}
+	labels_file.flush();
+	if (!labels_file.good())
+		return -1;
+
+	return this->num_superpixels;
+}
+
+bool TiledSuperpixelSLIC::readLabels(const string& labels_path, Size image_size, const Rect& roi, Mat& labels)
+{
+	ifstream labels_file(labels_path, ios::binary);
+	if (!labels_file || (roi & Rect(Point(0, 0), image_size)) != roi)
+		return false;
+
+	labels.create(roi.size(), CV_32S);
+	for (int y = 0; y < roi.height; y += 1)
+	{
+		labels_file.seekg(((streamoff) (roi.y + y) * image_size.width + roi.x) * (streamoff) sizeof(int));
+		labels_file.read((char*) labels.ptr<int>(y), (streamsize) roi.width * sizeof(int));
+	}
+	return labels_file.good();
+}
@@ -0,0 +1,121 @@
+#ifndef __SDP_TILED_HPP__
+#define __SDP_TILED_HPP__
+#ifdef __cplusplus
+
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+#include "sdp_slic.hpp"
+using namespace cv;
+
+//! @addtogroup ximgproc_superpixel
+//! @{
+
+/** @brief Source of the pixels of an image that is too large to keep in one Mat (e.g. a whole-slide image or an
+aerial mosaic), read one rectangle at a time.
+
+read() is called from several threads at once, so it has to be thread safe.
+ */
+class CV_EXPORTS ImageTileSource
+{
+public:
+	virtual ~ImageTileSource() {}
+
+	//! Size of the whole image
+	virtual Size getSize() const = 0;
+
+	//! Reads the pixels of roi (always inside the image) into tile
+	virtual void read(const Rect& roi, Mat& tile) = 0;
+};
+
+/** @brief ImageTileSource over a Mat, e.g. one that maps a raw image file into memory.
+ */
+class CV_EXPORTS MatTileSource : public ImageTileSource
+{
+public:
+	explicit MatTileSource(const Mat& image);
+	virtual Size getSize() const CV_OVERRIDE;
+	virtual void read(const Rect& roi, Mat& tile) CV_OVERRIDE;
+private:
+	Mat image;
+};
+
+/** @brief Segments an image tile by tile with SuperpixelSLIC, so memory stays bounded by the tile size rather than
+the image size.
+
+The image is cut into tiles that overlap by a margin. Each tile is segmented on its own (in parallel) and its
+superpixels are cut back to the tile without the margin. Both tiles along a seam segmented the margins around it,
+so a superpixel that crosses the seam shows up in both: two pieces on either side of the seam are reconciled into
+one superpixel when they cover mostly the same pixels of the margins. Labels are written to a raw file (row
+major, one int per pixel) one tile at a time, and only the margins of the last row of tiles, the superpixel stats
+and their adjacency stay in memory.
+
+After the seams are reconciled, superpixels can be duperized with best-first merging on the region adjacency
+graph of the whole image (see mergeRegionsBestFirst()), so super-duper-pixels cross tile boundaries too.
+ */
+class CV_EXPORTS TiledSuperpixelSLIC
+{
+public:
+	/** @brief Sets up the segmentation of every tile
+
+	@param algorithm SLICType of the segmentation of every tile
+	@param region_size Average superpixel size measured in pixels
+	@param ruler Smoothness factor of the superpixels
+	@param tile_size Width and height of the tiles (not counting the margins)
+	@param overlap Width of the margin each tile overlaps its neighbors by (2 * region_size if negative)
+	 */
+	TiledSuperpixelSLIC(int algorithm = SLICO, int region_size = 10, float ruler = 10.0f, int tile_size = 2048, int overlap = -1);
+
+	//! Number of SuperpixelSLIC::iterate() iterations of every tile (10 by default)
+	void setIterations(int iterations);
+
+	//! Minimum element size in percents for SuperpixelSLIC::enforceLabelConnectivity() of every tile (25 by default)
+	void setMinElementSize(int min_element_size);
+
+	/** @brief Segments an image tile by tile and writes its labels to a file
+
+	@param source Pixels of the image
+	@param labels_path Raw file that gets the labels (one int per pixel in row major order)
+	@param duperize_distance Duperizes the superpixels of the whole image best first until the closest pair is at
+	least this far apart (0 to only reconcile the seams)
+	@param num_regions Best-first merging also stops once there are only this many super-duper-pixels left
+	@return Number of (super-duper-)pixels in the labels, or -1 if the labels file can't be written
+	 */
+	int segment(ImageTileSource& source, const std::string& labels_path, float duperize_distance = 0.0f, int num_regions = 0);
+
+	//! Number of (super-duper-)pixels of the last segmentation
+	int getNumberOfSuperpixels() const;
+
+	//! Number of superpixel pieces reconciled across seams in the last segmentation
+	int getNumberOfSeamMerges() const;
+
+	//! Region adjacency graph of the labels of the last segmentation
+	const RegionAdjacencyGraph& getRegionAdjacencyGraph() const;
+
+	/** @brief Reads a rectangle of a labels file written by segment()
+
+	@param labels_path Labels file
+	@param image_size Size of the whole image
+	@param roi Rectangle to read
+	@param labels Gets the labels of roi (CV_32SC1)
+	@return False if the file can't be read
+	 */
+	static bool readLabels(const std::string& labels_path, Size image_size, const Rect& roi, Mat& labels);
+
+private:
+	int algorithm;
+	int region_size;
+	float ruler;
+	int tile_size;
+	int overlap;
+	int iterations;
+	int min_element_size;
+	int num_superpixels;
+	int num_seam_merges;
+	RegionAdjacencyGraph adjacency;
+};
+
+//! @}
+
+#endif
+#endif
@@ -1,6 +1,119 @@
 #include "SuperDuperPixel.hpp"
 #include <assert.h>
 #include <iostream>
+#include <cmath>
+#include <algorithm>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SUPERDUPERPIXEL_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+float l1_distance(const float* a, const float* b, int n)
+{
+	int i = 0;
+	float dist = 0;
+#if defined(__AVX__)
+	const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+	__m256 sum = _mm256_setzero_ps();
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 diff = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+		sum = _mm256_add_ps(sum, _mm256_andnot_ps(sign_mask, diff));
+	}
+	__m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+	sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+	sum4 = _mm_add_ss(sum4, _mm_shuffle_ps(sum4, sum4, 1));
+	dist = _mm_cvtss_f32(sum4);
+#elif defined(SUPERDUPERPIXEL_SSE2)
+	const __m128 sign_mask = _mm_set1_ps(-0.0f);
+	__m128 sum = _mm_setzero_ps();
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 diff = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+		sum = _mm_add_ps(sum, _mm_andnot_ps(sign_mask, diff));
+	}
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	dist = _mm_cvtss_f32(sum);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	float32x4_t sum = vdupq_n_f32(0.0f);
+	for (; i + 4 <= n; i += 4)
+	{
+		sum = vaddq_f32(sum, vabdq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+	}
+	float32x2_t sum2 = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+	dist = vget_lane_f32(vpadd_f32(sum2, sum2), 0);
+#endif
+	for (; i < n; i += 1)
+	{
+		dist += std::abs(a[i] - b[i]);
+	}
+	return dist;
+}
+
+void weighted_average(float* values, int pixel_count, const float* other_values, int other_pixel_count, int n)
+{
+	int i = 0;
+	int new_pixel_count = pixel_count + other_pixel_count;
+#if defined(__AVX__)
+	const __m256 count = _mm256_set1_ps((float) pixel_count);
+	const __m256 other_count = _mm256_set1_ps((float) other_pixel_count);
+	const __m256 new_count = _mm256_set1_ps((float) new_pixel_count);
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 this_sum = _mm256_mul_ps(_mm256_loadu_ps(values + i), count);
+		__m256 other_sum = _mm256_mul_ps(_mm256_loadu_ps(other_values + i), other_count);
+		_mm256_storeu_ps(values + i, _mm256_div_ps(_mm256_add_ps(this_sum, other_sum), new_count));
+	}
+#elif defined(SUPERDUPERPIXEL_SSE2)
+	const __m128 count = _mm_set1_ps((float) pixel_count);
+	const __m128 other_count = _mm_set1_ps((float) other_pixel_count);
+	const __m128 new_count = _mm_set1_ps((float) new_pixel_count);
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 this_sum = _mm_mul_ps(_mm_loadu_ps(values + i), count);
+		__m128 other_sum = _mm_mul_ps(_mm_loadu_ps(other_values + i), other_count);
+		_mm_storeu_ps(values + i, _mm_div_ps(_mm_add_ps(this_sum, other_sum), new_count));
+	}
+#endif
+	for (; i < n; i += 1)
+	{
+		float this_sum = values[i] * pixel_count;
+		float other_sum = other_values[i] * other_pixel_count;
+		values[i] = (this_sum + other_sum) / new_pixel_count;
+	}
+}
+
+SuperDuperPixelKernels SuperDuperPixelKernels::select(int num_values)
+{
+	SuperDuperPixelKernels kernels;
+	switch (num_values)
+	{
+		// Gray averages (LTriDP)
+		case 1:
+			kernels.distance = fixed_l1_distance<1>;
+			kernels.average = fixed_weighted_average<1>;
+			break;
+		// Lab averages
+		case 3:
+			kernels.distance = fixed_l1_distance<3>;
+			kernels.average = fixed_weighted_average<3>;
+			break;
+		// Lab histograms with 8, 64 and 64 buckets (SuperpixelImageSearch)
+		case 136:
+			kernels.distance = fixed_l1_distance<136>;
+			kernels.average = fixed_weighted_average<136>;
+			break;
+		default:
+			kernels.distance = l1_distance;
+			kernels.average = weighted_average;
+	}
+	return kernels;
+}
 
 SuperDuperPixel::SuperDuperPixel(int superpixel, std::vector<float> average, int pixel_count)
 {
@@ -19,24 +132,15 @@ SuperDuperPixel::SuperDuperPixel(int superpixel, std::vector< std::vector<float>
 }
 
 SuperDuperPixelMode SuperDuperPixel::get_mode() { return this->mode; }
-std::vector<int> SuperDuperPixel::get_superpixels() { return this->superpixels; }
-std::vector<float> SuperDuperPixel::get_average() { return this->average; }
-std::vector< std::vector<float> > SuperDuperPixel::get_histogram() { return this->histogram; }
+const std::vector<int>& SuperDuperPixel::get_superpixels() const { return this->superpixels; }
+const std::vector<float>& SuperDuperPixel::get_average() const { return this->average; }
+const std::vector< std::vector<float> >& SuperDuperPixel::get_histogram() const { return this->histogram; }
 
 float SuperDuperPixel::distance_from(const std::vector<float>& average)
 {
-    assert(this->average.size() == average.size());
-    float dist = 0;
-    for (int color_channel = 0; color_channel < this->average.size(); color_channel += 1)
-    {
-        float diff = this->average[color_channel] - average[color_channel];
-        // OpenCV SLIC algorithm square diff before adding it to dist.
-        // dist += diff * diff;
-        // Just take absolute value to do manhattan distance instead.
-        dist += abs(diff);
-    }
-    // Just use manhattan distance here.
-    return dist;
+	assert(this->average.size() == average.size());
+	// Just use manhattan distance here (OpenCV SLIC algorithm squares the diffs instead).
+	return l1_distance(this->average.data(), average.data(), (int) this->average.size());
 }
 
 float SuperDuperPixel::distance_from(const std::vector< std::vector<float> >& histogram)
@@ -46,19 +150,11 @@ float SuperDuperPixel::distance_from(const std::vector< std::vector<float> >& hi
 	for (int color_channel = 0; color_channel < this->histogram.size(); color_channel += 1)
 	{
 		assert(this->histogram[color_channel].size() == histogram[color_channel].size());
-		for (int bucket = 0; bucket < this->histogram[color_channel].size(); bucket += 1)
-		{
-			float diff = this->histogram[color_channel][bucket] - histogram[color_channel][bucket];
-			// OpenCV SLIC algorithm square diff before adding it to dist.
-			// dist += diff * diff;
-			// Just take absolute value to do mahnattan distance instead.
-			dist += abs(diff);
-		}
+		// Just use manhattan distance here.
+		// Could do this to be more precise (euclidian distance), but OpenCV SLIC algorithm doesn't use it either.
+		dist += l1_distance(this->histogram[color_channel].data(), histogram[color_channel].data(),
+			(int) this->histogram[color_channel].size());
 	}
-	// Just use manhattan distance here.
-	// Could do this to be more precise (euclidian distance, would also need to square the diff above), but OpenCV
-	// SLIC algorithm doesn't use it either.
-	// dist = sqrt(dist);
 	return dist;
 }
 
@@ -66,32 +162,21 @@ void SuperDuperPixel::add_superpixel(int superpixel, const std::vector<float>& a
 {
 	assert(this->average.size() == average.size());
 	this->superpixels.push_back(superpixel);
-	int new_pixel_count = this->pixel_count + pixel_count;
-	for (int color_channel = 0; color_channel < this->average.size(); color_channel += 1)
-	{
-		float this_sum = this->average[color_channel] * this->pixel_count;
-		float other_sum = average[color_channel] * pixel_count;
-		this->average[color_channel] = (this_sum + other_sum) / new_pixel_count;
-	}
-	this->pixel_count = new_pixel_count;
+	weighted_average(this->average.data(), this->pixel_count, average.data(), pixel_count, (int) this->average.size());
+	this->pixel_count += pixel_count;
 }
 
 void SuperDuperPixel::add_superpixel(int superpixel, const std::vector< std::vector<float> >& histogram, int pixel_count)
 {
 	assert(this->histogram.size() == histogram.size());
 	this->superpixels.push_back(superpixel);
-	int new_pixel_count = this->pixel_count + pixel_count;
 	for (int color_channel = 0; color_channel < this->histogram.size(); color_channel += 1)
 	{
 		assert(this->histogram[color_channel].size() == histogram[color_channel].size());
-		for (int bucket = 0; bucket < this->histogram[color_channel].size(); bucket += 1)
-		{
-			float this_sum = this->histogram[color_channel][bucket] * this->pixel_count;
-			float other_sum = histogram[color_channel][bucket] * pixel_count;
-			this->histogram[color_channel][bucket] = (this_sum + other_sum) / new_pixel_count;
-		}
+		weighted_average(this->histogram[color_channel].data(), this->pixel_count, histogram[color_channel].data(), pixel_count,
+			(int) this->histogram[color_channel].size());
 	}
-	this->pixel_count = new_pixel_count;
+	this->pixel_count += pixel_count;
 }
 
 void SuperDuperPixel::operator+=(const SuperDuperPixel* other)
@@ -137,3 +222,148 @@ void SuperDuperPixel::add_histogram_superduperpixels(const SuperDuperPixel* othe
 	}
 	this->pixel_count = new_pixel_count;
 }
+
+SuperDuperPixelForest::SuperDuperPixelForest(int num_superpixels, int num_values, SuperDuperPixelMode mode)
+{
+	this->num_values = num_values;
+	this->mode = mode;
+	this->kernels = SuperDuperPixelKernels::select(num_values);
+	this->parent = std::vector<int>(num_superpixels);
+	for (int superpixel = 0; superpixel < num_superpixels; superpixel += 1)
+	{
+		this->parent[superpixel] = superpixel;
+	}
+	this->tree_size = std::vector<int>(num_superpixels, 1);
+	this->group = std::vector<int>(num_superpixels, -1);
+	// There can never be more groups than superpixels, so this never reallocates while grouping
+	this->group_pixel_count.reserve(num_superpixels);
+	this->group_values.reserve((size_t) num_superpixels * num_values);
+}
+
+SuperDuperPixelMode SuperDuperPixelForest::get_mode() const { return this->mode; }
+int SuperDuperPixelForest::get_num_values() const { return this->num_values; }
+const SuperDuperPixelKernels& SuperDuperPixelForest::get_kernels() const { return this->kernels; }
+
+// Gets the root of the tree a superpixel is in
+int SuperDuperPixelForest::find(int superpixel)
+{
+	int root = superpixel;
+	while (this->parent[root] != root)
+		root = this->parent[root];
+	// Path compression
+	while (this->parent[superpixel] != root)
+	{
+		int next = this->parent[superpixel];
+		this->parent[superpixel] = root;
+		superpixel = next;
+	}
+	return root;
+}
+
+bool SuperDuperPixelForest::in_group(int superpixel) { return this->group[this->find(superpixel)] != -1; }
+bool SuperDuperPixelForest::same_group(int superpixel, int other) { return this->find(superpixel) == this->find(other); }
+
+// Gets the color values of the super-duper-pixel a superpixel is in
+const float* SuperDuperPixelForest::get_values(int superpixel)
+{
+	int group_index = this->group[this->find(superpixel)];
+	assert(group_index != -1);
+	return &this->group_values[(size_t) group_index * this->num_values];
+}
+
+float SuperDuperPixelForest::distance_from(int superpixel, const float* values)
+{
+	// Just use manhattan distance here (same as SuperDuperPixel::distance_from).
+	return this->kernels.distance(this->get_values(superpixel), values, this->num_values);
+}
+
+// Starts a new super-duper-pixel that only contains this superpixel
+void SuperDuperPixelForest::create_group(int superpixel, const float* values, int pixel_count)
+{
+	int root = this->find(superpixel);
+	assert(this->group[root] == -1);
+	this->group[root] = (int) this->group_pixel_count.size();
+	this->group_pixel_count.push_back(pixel_count);
+	this->group_values.insert(this->group_values.end(), values, values + this->num_values);
+}
+
+// Adds a superpixel that isn't in a super-duper-pixel yet to the super-duper-pixel of group_member
+void SuperDuperPixelForest::add_superpixel(int group_member, int superpixel, const float* values, int pixel_count)
+{
+	int root = this->find(group_member);
+	assert(this->group[root] != -1 && this->group[this->find(superpixel)] == -1);
+	this->add_values(this->group[root], values, pixel_count);
+	// superpixel is always a lone root here, so it's never the bigger tree
+	this->parent[superpixel] = root;
+	this->tree_size[root] += 1;
+}
+
+// Merges the super-duper-pixel of other into the super-duper-pixel of superpixel
+// The merged super-duper-pixel keeps the group (and so the final index) of superpixel's super-duper-pixel
+void SuperDuperPixelForest::merge(int superpixel, int other)
+{
+	int root = this->find(superpixel);
+	int other_root = this->find(other);
+	if (root == other_root)
+		return;
+	int group_index = this->group[root];
+	int other_group_index = this->group[other_root];
+	assert(group_index != -1 && other_group_index != -1);
+	switch (this->mode)
+	{
+		case AVERAGE:
+			this->add_values(group_index, &this->group_values[(size_t) other_group_index * this->num_values],
+				this->group_pixel_count[other_group_index]);
+			break;
+		case HISTOGRAM:
+			// SuperDuperPixel::add_histogram_superduperpixels() only adds up the pixel counts, keep doing the same
+			// so the output labels don't change
+			this->group_pixel_count[group_index] += this->group_pixel_count[other_group_index];
+			break;
+	}
+	// Union by size
+	if (this->tree_size[root] < this->tree_size[other_root])
+		std::swap(root, other_root);
+	this->parent[other_root] = root;
+	this->tree_size[root] += this->tree_size[other_root];
+	this->group[root] = group_index;
+	this->group[other_root] = -1;
+}
+
+// Gives every super-duper-pixel an index (in the order they were created) and returns how many there are
+int SuperDuperPixelForest::index(std::vector<int>& superduperpixel_indexes)
+{
+	int num_superpixels = (int) this->parent.size();
+	// Only groups that are still at a root survived merging
+	std::vector<int> group_indexes(this->group_pixel_count.size(), -1);
+	for (int superpixel = 0; superpixel < num_superpixels; superpixel += 1)
+	{
+		if (this->parent[superpixel] == superpixel && this->group[superpixel] != -1)
+			group_indexes[this->group[superpixel]] = 0;
+	}
+	int superduperpixel_count = 0;
+	for (int& group_index : group_indexes)
+	{
+		if (group_index != -1)
+		{
+			group_index = superduperpixel_count;
+			superduperpixel_count += 1;
+		}
+	}
+	superduperpixel_indexes = std::vector<int>(num_superpixels, -1);
+	for (int superpixel = 0; superpixel < num_superpixels; superpixel += 1)
+	{
+		int group_index = this->group[this->find(superpixel)];
+		if (group_index != -1)
+			superduperpixel_indexes[superpixel] = group_indexes[group_index];
+	}
+	return superduperpixel_count;
+}
+
+// Adds color values to a group's color values, weighted by pixel count (same math as SuperDuperPixel::add_superpixel)
+void SuperDuperPixelForest::add_values(int group_index, const float* values, int pixel_count)
+{
+	float* this_values = &this->group_values[(size_t) group_index * this->num_values];
+	this->kernels.average(this_values, this->group_pixel_count[group_index], values, pixel_count, this->num_values);
+	this->group_pixel_count[group_index] += pixel_count;
+}
@@ -1,4 +1,5 @@
 #include <vector>
+#include <cmath>
 
 enum SuperDuperPixelMode
 {
@@ -6,15 +7,85 @@ enum SuperDuperPixelMode
 	HISTOGRAM = 1
 };
 
+// Number of floats color values are padded to (so rows of a flat buffer are 32 byte aligned for SIMD)
+const int SUPERDUPERPIXEL_VALUE_ALIGNMENT = 8;
+
+// Manhattan (L1) distance between 2 arrays of n floats
+// Vectorized with AVX, SSE2 or NEON when the compiler targets them
+float l1_distance(const float* a, const float* b, int n);
+
+// Weighted average (by pixel count) of 2 arrays of n floats, stored in values
+// Does the same math as the scalar code: (values * pixel_count + other_values * other_pixel_count) / new_pixel_count
+void weighted_average(float* values, int pixel_count, const float* other_values, int other_pixel_count, int n);
+
+// Number of floats l1_distance() sums at once (the width of the SIMD registers it uses)
+#if defined(__AVX__)
+const int SUPERDUPERPIXEL_SIMD_WIDTH = 8;
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+const int SUPERDUPERPIXEL_SIMD_WIDTH = 4;
+#else
+const int SUPERDUPERPIXEL_SIMD_WIDTH = 1;
+#endif
+
+// l1_distance() for a number of floats known at compile time
+// Sums in the same lanes and order as l1_distance() so both give the exact same distance, but the loops get fully unrolled
+template <int N>
+inline float fixed_l1_distance(const float* a, const float* b, int)
+{
+	const int width = SUPERDUPERPIXEL_SIMD_WIDTH;
+	const int vector_end = width > 1 ? N / width * width : 0;
+	float lanes[width] = {};
+	for (int i = 0; i < vector_end; i += width)
+	{
+		for (int lane = 0; lane < width; lane += 1)
+			lanes[lane] += std::abs(a[i + lane] - b[i + lane]);
+	}
+	// Horizontal sum of the lanes, pairing them up the way the SIMD shuffles do
+	float dist = 0;
+	if (width == 8)
+	{
+		float halves[4];
+		for (int lane = 0; lane < 4; lane += 1)
+			halves[lane] = lanes[lane] + lanes[(lane + 4) % width];
+		dist = (halves[0] + halves[2]) + (halves[1] + halves[3]);
+	}
+	else if (width == 4)
+		dist = (lanes[0] + lanes[2 % width]) + (lanes[1 % width] + lanes[3 % width]);
+	for (int i = vector_end; i < N; i += 1)
+		dist += std::abs(a[i] - b[i]);
+	return dist;
+}
+
+// weighted_average() for a number of floats known at compile time
+template <int N>
+inline void fixed_weighted_average(float* values, int pixel_count, const float* other_values, int other_pixel_count, int)
+{
+	const float count = (float) pixel_count;
+	const float other_count = (float) other_pixel_count;
+	const float new_count = (float) (pixel_count + other_pixel_count);
+	for (int i = 0; i < N; i += 1)
+		values[i] = (values[i] * count + other_values[i] * other_count) / new_count;
+}
+
+// Distance and merge routines for one size of color values
+// select() picks compile-time sized routines for the common sizes and the runtime sized ones for everything else
+struct SuperDuperPixelKernels
+{
+	float (*distance)(const float* a, const float* b, int n);
+	void (*average)(float* values, int pixel_count, const float* other_values, int other_pixel_count, int n);
+
+	static SuperDuperPixelKernels select(int num_values);
+};
+
 class SuperDuperPixel
 {
 public:
 	SuperDuperPixel(int superpixel, std::vector<float> average, int pixel_count);
 	SuperDuperPixel(int superpixel, std::vector< std::vector<float> >, int pixel_count);
 	SuperDuperPixelMode get_mode();
-	std::vector<int> get_superpixels();
-	std::vector<float> get_average();
-	std::vector< std::vector<float> > get_histogram();
+	const std::vector<int>& get_superpixels() const;
+	const std::vector<float>& get_average() const;
+	const std::vector< std::vector<float> >& get_histogram() const;
 	float distance_from(const std::vector<float>& average);
 	float distance_from(const std::vector< std::vector<float> >& histogram);
 	void add_superpixel(int superpixel, const std::vector<float>& average, int pixel_count);
@@ -32,3 +103,41 @@ private:
 	void add_average_superduperpixels(const SuperDuperPixel* other);
 	void add_histogram_superduperpixels(const SuperDuperPixel* other);
 };
+
+// Disjoint-set forest (union by size with path compression) that groups superpixels into super-duper-pixels.
+// Each group's color values (average colors or a flattened color histogram) are kept in one contiguous buffer
+// so merging never has to copy lists of superpixels around.
+class SuperDuperPixelForest
+{
+public:
+	SuperDuperPixelForest(int num_superpixels, int num_values, SuperDuperPixelMode mode);
+	SuperDuperPixelMode get_mode() const;
+	int get_num_values() const;
+	const SuperDuperPixelKernels& get_kernels() const;
+	int find(int superpixel);
+	bool in_group(int superpixel);
+	bool same_group(int superpixel, int other);
+	const float* get_values(int superpixel);
+	float distance_from(int superpixel, const float* values);
+	void create_group(int superpixel, const float* values, int pixel_count);
+	void add_superpixel(int group_member, int superpixel, const float* values, int pixel_count);
+	void merge(int superpixel, int other);
+	int index(std::vector<int>& superduperpixel_indexes);
+private:
+	int num_values;
+	SuperDuperPixelMode mode;
+	// Distance and merge routines for num_values floats
+	SuperDuperPixelKernels kernels;
+	// Parent of each superpixel in the forest (roots are their own parent)
+	std::vector<int> parent;
+	// Number of superpixels in each tree (only valid for roots)
+	std::vector<int> tree_size;
+	// Group of each root in the order the groups were created (-1 means it's not in a super-duper-pixel yet)
+	std::vector<int> group;
+	// Number of pixels in each group
+	std::vector<int> group_pixel_count;
+	// Color values of each group, num_values floats per group
+	std::vector<float> group_values;
+
+	void add_values(int group_index, const float* values, int pixel_count);
+};
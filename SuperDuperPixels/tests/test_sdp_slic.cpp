@@ -0,0 +1,418 @@
+// test_sdp_slic.cpp
+// Unit tests of SDP-SLIC on synthetic images
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include "sdp_slic.hpp"
+using namespace cv;
+
+// Blocks of flat colors with some noise on top, shifted right by offset pixels
+static Mat makeFrame(int width, int height, int offset)
+{
+	Mat frame(height, width, CV_8UC3);
+	for (int y = 0; y < height; y += 1)
+	{
+		for (int x = 0; x < width; x += 1)
+		{
+			int block = ((x + offset) / 40) * 7 + (y / 40) * 3;
+			frame.at<Vec3b>(y, x) = Vec3b((uchar)(block * 37 % 256), (uchar)(block * 91 % 256), (uchar)(block * 53 % 256));
+		}
+	}
+	Mat noise(height, width, CV_8UC3);
+	RNG rng(12345 + offset);
+	rng.fill(noise, RNG::UNIFORM, Scalar::all(0), Scalar::all(12));
+	return frame + noise;
+}
+
+// Every pixel is labeled with one of the superpixels of slic
+static void expectLabelsInRange(const Ptr<SuperpixelSLIC>& slic)
+{
+	Mat labels;
+	slic->getLabels(labels);
+	double min_label, max_label;
+	minMaxLoc(labels, &min_label, &max_label);
+	EXPECT_GE(min_label, 0);
+	EXPECT_LT(max_label, slic->getNumberOfSuperpixels());
+}
+
+//=============================================================================
+// Input Validation
+//=============================================================================
+
+TEST(SDPSLICConvergenceTest, RejectsNegativeTolerance)
+{
+	Ptr<SuperpixelSLIC> slic = createSuperpixelSLIC(makeFrame(120, 120, 0), SLICO, 12, 10.0f);
+	EXPECT_THROW(slic->setConvergenceCriterion(SLIC_CONVERGENCE_SEED_DISPLACEMENT, -0.5f), cv::Exception);
+}
+
+TEST(SDPSLICConvergenceTest, RejectsNaNTolerance)
+{
+	Ptr<SuperpixelSLIC> slic = createSuperpixelSLIC(makeFrame(120, 120, 0), SLICO, 12, 10.0f);
+	EXPECT_THROW(slic->setConvergenceCriterion(SLIC_CONVERGENCE_LABEL_CHANGE, std::nanf("")), cv::Exception);
+}
+
+TEST(SDPSLICConvergenceTest, AcceptsZeroTolerance)
+{
+	Ptr<SuperpixelSLIC> slic = createSuperpixelSLIC(makeFrame(120, 120, 0), SLICO, 12, 10.0f);
+	EXPECT_NO_THROW(slic->setConvergenceCriterion(SLIC_CONVERGENCE_LABEL_CHANGE, 0.0f));
+}
+
+//=============================================================================
+// Packed Kernels
+//=============================================================================
+
+// Labels of image segmented with the packed kernels (8U or 32F) and of the same values in a depth only the
+// generic kernels handle (16U or 64F), after the same iterations
+static void segmentBothWays(const Mat& image, int algorithm, Mat& packed_labels, Mat& generic_labels)
+{
+	Mat generic_image;
+	image.convertTo(generic_image, image.depth() == CV_8U ? CV_16U : CV_64F);
+
+	Ptr<SuperpixelSLIC> packed = createSuperpixelSLIC(image, algorithm, 12, 10.0f);
+	packed->iterate(5);
+	packed->getLabels(packed_labels);
+
+	Ptr<SuperpixelSLIC> generic = createSuperpixelSLIC(generic_image, algorithm, 12, 10.0f);
+	generic->iterate(5);
+	generic->getLabels(generic_labels);
+	EXPECT_EQ(packed->getNumberOfSuperpixels(), generic->getNumberOfSuperpixels());
+}
+
+// Every layout the packed kernels specialize
+static std::vector<Mat> makePackedLayouts()
+{
+	Mat color = makeFrame(160, 120, 0);
+	Mat gray;
+	cvtColor(color, gray, COLOR_BGR2GRAY);
+	Mat color_float, gray_float;
+	color.convertTo(color_float, CV_32F, 1.0 / 255.0);
+	gray.convertTo(gray_float, CV_32F, 1.0 / 255.0);
+	return std::vector<Mat>{ gray, color, gray_float, color_float };
+}
+
+TEST(SDPSLICPackedTest, SLICMatchesGenericKernels)
+{
+	for (const Mat& image : makePackedLayouts())
+	{
+		Mat packed_labels, generic_labels;
+		segmentBothWays(image, SLIC, packed_labels, generic_labels);
+		EXPECT_EQ(countNonZero(packed_labels != generic_labels), 0) << "type " << image.type();
+	}
+}
+
+TEST(SDPSLICPackedTest, SLICOMatchesGenericKernels)
+{
+	for (const Mat& image : makePackedLayouts())
+	{
+		Mat packed_labels, generic_labels;
+		segmentBothWays(image, SLICO, packed_labels, generic_labels);
+		EXPECT_EQ(countNonZero(packed_labels != generic_labels), 0) << "type " << image.type();
+	}
+}
+
+//=============================================================================
+// Low Memory
+//=============================================================================
+
+// Labels of image segmented with and without the low memory mode, after the same iterations and connectivity
+// (several bands of rows high, so the seeds are swept over more than one band)
+static void segmentWithAndWithoutLowMemory(const Mat& image, int algorithm, Mat& normal_labels, Mat& low_memory_labels,
+	double& normal_peak, double& low_memory_peak)
+{
+	Ptr<SuperpixelSLIC> normal = createSuperpixelSLIC(image, algorithm, 12, 10.0f);
+	normal->setConvergenceCriterion(SLIC_CONVERGENCE_LABEL_CHANGE, 0.001f);
+	normal->iterate(10);
+	normal->enforceLabelConnectivity(25);
+	normal->getLabels(normal_labels);
+	normal_peak = normal->getPeakBytesPerMegapixel();
+
+	Ptr<SuperpixelSLIC> low_memory = createSuperpixelSLIC(image, algorithm, 12, 10.0f);
+	low_memory->setLowMemory(true);
+	low_memory->setConvergenceCriterion(SLIC_CONVERGENCE_LABEL_CHANGE, 0.001f);
+	low_memory->iterate(10);
+	low_memory->enforceLabelConnectivity(25);
+	low_memory->getLabels(low_memory_labels);
+	low_memory_peak = low_memory->getPeakBytesPerMegapixel();
+
+	EXPECT_EQ(normal->getNumberOfIterationsRun(), low_memory->getNumberOfIterationsRun());
+	EXPECT_EQ(normal->getNumberOfSuperpixels(), low_memory->getNumberOfSuperpixels());
+}
+
+TEST(SDPSLICLowMemoryTest, SLICMatchesNormalMode)
+{
+	Mat color = makeFrame(240, 300, 0);
+	Mat color_float;
+	color.convertTo(color_float, CV_32F, 1.0 / 255.0);
+	for (const Mat& image : { color, color_float })
+	{
+		Mat normal_labels, low_memory_labels;
+		double normal_peak, low_memory_peak;
+		segmentWithAndWithoutLowMemory(image, SLIC, normal_labels, low_memory_labels, normal_peak, low_memory_peak);
+		EXPECT_EQ(countNonZero(normal_labels != low_memory_labels), 0) << "type " << image.type();
+		EXPECT_LT(low_memory_peak, normal_peak) << "type " << image.type();
+	}
+}
+
+TEST(SDPSLICLowMemoryTest, MSLICMatchesNormalMode)
+{
+	Mat normal_labels, low_memory_labels;
+	double normal_peak, low_memory_peak;
+	segmentWithAndWithoutLowMemory(makeFrame(240, 300, 0), MSLIC, normal_labels, low_memory_labels,
+		normal_peak, low_memory_peak);
+	EXPECT_EQ(countNonZero(normal_labels != low_memory_labels), 0);
+	EXPECT_LT(low_memory_peak, normal_peak);
+}
+
+//=============================================================================
+// Connectivity
+//=============================================================================
+
+// enforceLabelConnectivity() as the one segment at a time flood fill (SLIC and SLICO only)
+static Mat referenceConnectivity(const Mat& labels, int num_labels, int min_element_size)
+{
+	const int dx4[4] = { -1,  0,  1,  0 };
+	const int dy4[4] = {  0, -1,  0,  1 };
+	const int width = labels.cols, height = labels.rows;
+	const int supsz = width * height / num_labels;
+	const int min_sp_sz = std::max(3, supsz / int(100.0f / (float)min_element_size + 0.5f));
+
+	Mat nlabels(labels.size(), CV_32S, Scalar(-1));
+	std::vector<Point> segment;
+	int label = 0;
+	for (int y = 0; y < height; y += 1)
+	{
+		for (int x = 0; x < width; x += 1)
+		{
+			if (nlabels.at<int>(y, x) >= 0)
+				continue;
+
+			int adjlabel = 0;
+			for (int n = 0; n < 4; n += 1)
+			{
+				Point neighbor(x + dx4[n], y + dy4[n]);
+				if (neighbor.x >= 0 && neighbor.x < width && neighbor.y >= 0 && neighbor.y < height &&
+					nlabels.at<int>(neighbor) >= 0)
+					adjlabel = nlabels.at<int>(neighbor);
+			}
+
+			segment.assign(1, Point(x, y));
+			nlabels.at<int>(y, x) = label;
+			for (size_t c = 0; c < segment.size(); c += 1)
+			{
+				for (int n = 0; n < 4; n += 1)
+				{
+					Point neighbor(segment[c].x + dx4[n], segment[c].y + dy4[n]);
+					if (neighbor.x >= 0 && neighbor.x < width && neighbor.y >= 0 && neighbor.y < height &&
+						nlabels.at<int>(neighbor) < 0 && labels.at<int>(neighbor) == labels.at<int>(y, x))
+					{
+						nlabels.at<int>(neighbor) = label;
+						segment.push_back(neighbor);
+					}
+				}
+			}
+
+			if ((int)segment.size() <= min_sp_sz)
+			{
+				for (const Point& pixel : segment)
+					nlabels.at<int>(pixel) = adjlabel;
+				label -= 1;
+			}
+			label += 1;
+		}
+	}
+	return nlabels;
+}
+
+TEST(SDPSLICConnectivityTest, MatchesFloodFill)
+{
+	Mat frame = makeFrame(203, 151, 0);
+	const int algorithms[] = { SLIC, SLICO };
+	const int min_element_sizes[] = { 10, 25, 50 };
+	for (int algorithm : algorithms)
+	{
+		for (int min_element_size : min_element_sizes)
+		{
+			Ptr<SuperpixelSLIC> slic = createSuperpixelSLIC(frame, algorithm, 12, 10.0f);
+			slic->iterate(3);
+			Mat labels;
+			slic->getLabels(labels);
+			Mat expected = referenceConnectivity(labels, slic->getNumberOfSuperpixels(), min_element_size);
+
+			slic->enforceLabelConnectivity(min_element_size);
+			slic->getLabels(labels);
+			EXPECT_EQ(countNonZero(labels != expected), 0) << "algorithm " << algorithm << ", min size " << min_element_size;
+
+			double max_label;
+			minMaxLoc(expected, NULL, &max_label);
+			EXPECT_EQ(slic->getNumberOfSuperpixels(), (int)max_label + 1);
+		}
+	}
+}
+
+//=============================================================================
+// Contours
+//=============================================================================
+
+// The one pixel at a time contour scan getLabelContourMask() did before it used row pointers
+static Mat referenceContourMask(const Mat& labels, bool thick_line)
+{
+	const int line_width = thick_line ? 2 : 1;
+	const int dx8[8] = { -1, -1,  0,  1, 1, 1, 0, -1 };
+	const int dy8[8] = {  0, -1, -1, -1, 0, 1, 1,  1 };
+	Mat mask = Mat::zeros(labels.size(), CV_8UC1);
+	std::vector<bool> istaken(labels.total(), false);
+	for (int y = 0; y < labels.rows; y += 1)
+	{
+		for (int x = 0; x < labels.cols; x += 1)
+		{
+			int np = 0;
+			for (int i = 0; i < 8; i += 1)
+			{
+				int nx = x + dx8[i], ny = y + dy8[i];
+				if (nx >= 0 && nx < labels.cols && ny >= 0 && ny < labels.rows && !istaken[ny * labels.cols + nx] &&
+					labels.at<int>(y, x) != labels.at<int>(ny, nx))
+					np += 1;
+			}
+			if (np > line_width)
+			{
+				mask.at<uchar>(y, x) = 255;
+				istaken[y * labels.cols + x] = true;
+			}
+		}
+	}
+	return mask;
+}
+
+static void expectContoursMatchReference(const Ptr<SuperpixelSLIC>& slic)
+{
+	Mat labels, thick_mask, thin_mask;
+	slic->getLabels(labels);
+	slic->getLabelContourMask(thick_mask, true);
+	slic->getLabelContourMask(thin_mask, false);
+	EXPECT_EQ(countNonZero(thick_mask != referenceContourMask(labels, true)), 0);
+	EXPECT_EQ(countNonZero(thin_mask != referenceContourMask(labels, false)), 0);
+}
+
+TEST(SDPSLICContourTest, MatchesReferenceScan)
+{
+	Ptr<SuperpixelSLIC> slic = createSuperpixelSLIC(makeFrame(173, 121, 0), SLICO, 12, 10.0f);
+	slic->iterate(5);
+	slic->enforceLabelConnectivity(25);
+	expectContoursMatchReference(slic);
+}
+
+TEST(SDPSLICContourTest, MarkedWhileDuperizingMatchesReferenceScan)
+{
+	for (bool low_memory : { false, true })
+	{
+		Ptr<SuperpixelSLIC> slic = createSuperpixelSLIC(makeFrame(173, 121, 0), SLICO, 12, 10.0f);
+		slic->setLowMemory(low_memory);
+		slic->iterate(5);
+		slic->enforceLabelConnectivity(25);
+		slic->duperizeWithAverage(20.0f);
+		expectContoursMatchReference(slic);
+
+		// The contours marked by duperize are stale once the labels change again
+		slic->setImage(makeFrame(173, 121, 3), true);
+		slic->iterate(2);
+		expectContoursMatchReference(slic);
+	}
+}
+
+//=============================================================================
+// Warm starts
+//=============================================================================
+
+TEST(SDPSLICWarmStartTest, LabelsIndexSeedsAfterConnectivity)
+{
+	Ptr<SuperpixelSLIC> slic = createSuperpixelSLIC(makeFrame(240, 180, 0), SLICO, 12, 10.0f);
+	slic->iterate(5);
+	slic->enforceLabelConnectivity(25);
+
+	// Connectivity renumbered the labels, the warm start has to give them back to the seeds
+	slic->setImage(makeFrame(240, 180, 3), true);
+	expectLabelsInRange(slic);
+
+	slic->iterate(3);
+	expectLabelsInRange(slic);
+	slic->enforceLabelConnectivity(25);
+	expectLabelsInRange(slic);
+}
+
+TEST(SDPSLICWarmStartTest, LabelsIndexSeedsAfterDuperize)
+{
+	for (int algorithm : { SLIC, SLICO, MSLIC })
+	{
+		Ptr<SuperpixelSLIC> slic = createSuperpixelSLIC(makeFrame(240, 180, 0), algorithm, 12, 10.0f);
+		slic->iterate(5);
+		slic->enforceLabelConnectivity(25);
+		slic->duperizeWithAverage(20.0f);
+
+		slic->setImage(makeFrame(240, 180, 3), true);
+		expectLabelsInRange(slic);
+		slic->iterate(3);
+		expectLabelsInRange(slic);
+	}
+}
+
+TEST(SDPSLICWarmStartTest, ReduperizeNeedsDuperize)
+{
+	Ptr<SuperpixelSLIC> slic = createSuperpixelSLIC(makeFrame(120, 120, 0), SLICO, 12, 10.0f);
+	slic->iterate(3);
+	EXPECT_THROW(slic->reduperize(1.0f), cv::Exception);
+}
+
+TEST(SDPSLICWarmStartTest, ReduperizeUnchangedFrameKeepsGrouping)
+{
+	Mat frame = makeFrame(240, 180, 0);
+	Ptr<SuperpixelSLIC> slic = createSuperpixelSLIC(frame, SLICO, 12, 10.0f);
+	slic->iterate(5);
+	slic->enforceLabelConnectivity(25);
+	slic->duperizeWithAverage(20.0f);
+	const int num_regions = slic->getNumberOfSuperpixels();
+
+	// Same frame and a warm start: every superpixel keeps the super-duper-pixel under its centroid,
+	// so reduperizing can only merge the regions of the last duperize further
+	slic->setImage(frame, true);
+	slic->iterate(5);
+	slic->enforceLabelConnectivity(25);
+	slic->reduperize(1e6f);
+	expectLabelsInRange(slic);
+	EXPECT_GT(slic->getNumberOfSuperpixels(), 0);
+	EXPECT_LE(slic->getNumberOfSuperpixels(), num_regions);
+}
+
+//=============================================================================
+// Instrumentation
+//=============================================================================
+
+// Collects the names of the trace events of a SuperpixelSLIC object
+static void collectEventName(const SLICTraceEvent& event, void* user_data)
+{
+	static_cast<std::vector<std::string>*>(user_data)->push_back(event.name);
+}
+
+TEST(SDPSLICInstrumentationTest, MSLICStatsDescribeUserConnectivityCall)
+{
+	Ptr<SuperpixelSLIC> slic = createSuperpixelSLIC(makeFrame(240, 180, 0), MSLIC, 12, 10.0f);
+	std::vector<std::string> events;
+	slic->setInstrumentation(true);
+	slic->setTraceCallback(collectEventName, &events);
+
+	// The connectivity passes inside every MSLIC iteration are part of iterate, not of the connectivity stage
+	slic->iterate(3);
+	EXPECT_EQ(std::count(events.begin(), events.end(), "enforceLabelConnectivity"), 0);
+	EXPECT_EQ(slic->getStats().superpixels_before_connectivity, 0);
+	EXPECT_EQ(slic->getStats().connectivity_ms, 0.0);
+
+	const int num_superpixels = slic->getNumberOfSuperpixels();
+	slic->enforceLabelConnectivity(25);
+	EXPECT_EQ(std::count(events.begin(), events.end(), "enforceLabelConnectivity"), 1);
+	EXPECT_EQ(slic->getStats().superpixels_before_connectivity, num_superpixels);
+	EXPECT_EQ(slic->getStats().superpixels_after_connectivity, slic->getNumberOfSuperpixels());
+}
@@ -0,0 +1,194 @@
+// test_sdp_tiled.cpp
+// Unit tests of the tiled SDP-SLIC segmentation on synthetic images larger than one tile
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <set>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "sdp_tiled.hpp"
+using namespace cv;
+
+// Blocks of flat colors with some noise on top
+static Mat makeImage(int width, int height)
+{
+	Mat image(height, width, CV_8UC3);
+	for (int y = 0; y < height; y += 1)
+	{
+		for (int x = 0; x < width; x += 1)
+		{
+			int block = (x / 40) * 7 + (y / 40) * 3;
+			image.at<Vec3b>(y, x) = Vec3b((uchar)(block * 37 % 256), (uchar)(block * 91 % 256), (uchar)(block * 53 % 256));
+		}
+	}
+	Mat noise(height, width, CV_8UC3);
+	RNG rng(12345);
+	rng.fill(noise, RNG::UNIFORM, Scalar::all(0), Scalar::all(12));
+	return image + noise;
+}
+
+class SDPTiledTest : public ::testing::Test
+{
+protected:
+	static constexpr int width = 250;
+	static constexpr int height = 200;
+	static constexpr int tile_size = 96;
+
+	void SetUp() override
+	{
+		image = makeImage(width, height);
+		labels_path = std::string(::testing::UnitTest::GetInstance()->current_test_info()->name()) + "_labels.raw";
+	}
+
+	void TearDown() override
+	{
+		std::remove(labels_path.c_str());
+	}
+
+	// Segments the image with tiled and reads all of its labels back
+	int segment(TiledSuperpixelSLIC& tiled, Mat& labels, float duperize_distance = 0.0f)
+	{
+		MatTileSource source(image);
+		int count = tiled.segment(source, labels_path, duperize_distance);
+		EXPECT_TRUE(TiledSuperpixelSLIC::readLabels(labels_path, image.size(), Rect(0, 0, width, height), labels));
+		return count;
+	}
+
+	// Tile of a pixel
+	static int tileOf(int x, int y)
+	{
+		const int tiles_x = (width + tile_size - 1) / tile_size;
+		return (y / tile_size) * tiles_x + x / tile_size;
+	}
+
+	Mat image;
+	std::string labels_path;
+};
+
+//=============================================================================
+// Labels
+//=============================================================================
+
+TEST_F(SDPTiledTest, LabelsAreCompact)
+{
+	TiledSuperpixelSLIC tiled(SLICO, 12, 10.0f, tile_size);
+	Mat labels;
+	int count = segment(tiled, labels);
+	ASSERT_GT(count, 0);
+	EXPECT_EQ(count, tiled.getNumberOfSuperpixels());
+
+	// Every pixel has one of the superpixels and every superpixel has pixels
+	std::vector<int> population(count, 0);
+	for (int y = 0; y < height; y += 1)
+	{
+		for (int x = 0; x < width; x += 1)
+		{
+			int label = labels.at<int>(y, x);
+			ASSERT_GE(label, 0);
+			ASSERT_LT(label, count);
+			population[label] += 1;
+		}
+	}
+	for (int superpixel = 0; superpixel < count; superpixel += 1)
+		EXPECT_GT(population[superpixel], 0) << "superpixel " << superpixel;
+
+	const RegionAdjacencyGraph& graph = tiled.getRegionAdjacencyGraph();
+	EXPECT_EQ((int) graph.offsets.size(), count + 1);
+}
+
+TEST_F(SDPTiledTest, LabelsAreContinuousAcrossSeams)
+{
+	TiledSuperpixelSLIC tiled(SLICO, 12, 10.0f, tile_size);
+	Mat labels;
+	ASSERT_GT(segment(tiled, labels), 0);
+	EXPECT_GT(tiled.getNumberOfSeamMerges(), 0);
+
+	// Without reconciliation every pixel pair across a seam would have different labels, with it most superpixels
+	// crossing the seam keep their label on both sides
+	int seam_pairs = 0, same_pairs = 0;
+	for (int seam = tile_size; seam < width; seam += tile_size)
+	{
+		for (int y = 0; y < height; y += 1)
+		{
+			seam_pairs += 1;
+			same_pairs += labels.at<int>(y, seam - 1) == labels.at<int>(y, seam);
+		}
+	}
+	for (int seam = tile_size; seam < height; seam += tile_size)
+	{
+		for (int x = 0; x < width; x += 1)
+		{
+			seam_pairs += 1;
+			same_pairs += labels.at<int>(seam - 1, x) == labels.at<int>(seam, x);
+		}
+	}
+	ASSERT_GT(seam_pairs, 0);
+	EXPECT_GT(same_pairs, seam_pairs / 2);
+}
+
+TEST_F(SDPTiledTest, NoDuplicateLabelsAcrossTiles)
+{
+	TiledSuperpixelSLIC tiled(SLICO, 12, 10.0f, tile_size);
+	Mat labels;
+	int count = segment(tiled, labels);
+	ASSERT_GT(count, 0);
+
+	// Tiles each superpixel has pixels in, and tiles it crosses a seam of
+	std::vector< std::set<int> > tiles(count), crossing_tiles(count);
+	for (int y = 0; y < height; y += 1)
+	{
+		for (int x = 0; x < width; x += 1)
+		{
+			int label = labels.at<int>(y, x);
+			tiles[label].insert(tileOf(x, y));
+			if (x + 1 < width && tileOf(x + 1, y) != tileOf(x, y) && labels.at<int>(y, x + 1) == label)
+			{
+				crossing_tiles[label].insert(tileOf(x, y));
+				crossing_tiles[label].insert(tileOf(x + 1, y));
+			}
+			if (y + 1 < height && tileOf(x, y + 1) != tileOf(x, y) && labels.at<int>(y + 1, x) == label)
+			{
+				crossing_tiles[label].insert(tileOf(x, y));
+				crossing_tiles[label].insert(tileOf(x, y + 1));
+			}
+		}
+	}
+
+	// A label in several tiles is a superpixel reconciled across their seams, not 2 superpixels sharing an id
+	for (int superpixel = 0; superpixel < count; superpixel += 1)
+	{
+		if (tiles[superpixel].size() > 1)
+			EXPECT_EQ(tiles[superpixel], crossing_tiles[superpixel]) << "superpixel " << superpixel;
+	}
+}
+
+TEST_F(SDPTiledTest, OneTileHasNoSeams)
+{
+	TiledSuperpixelSLIC tiled(SLICO, 12, 10.0f, width);
+	Mat labels;
+	int count = segment(tiled, labels);
+	EXPECT_GT(count, 0);
+	EXPECT_EQ(tiled.getNumberOfSeamMerges(), 0);
+}
+
+//=============================================================================
+// Duperizing
+//=============================================================================
+
+TEST_F(SDPTiledTest, DuperizeMergesAcrossTiles)
+{
+	TiledSuperpixelSLIC tiled(SLICO, 12, 10.0f, tile_size);
+	Mat labels;
+	int superpixels = segment(tiled, labels);
+	ASSERT_GT(superpixels, 0);
+
+	int regions = segment(tiled, labels, 20.0f);
+	ASSERT_GT(regions, 0);
+	EXPECT_LT(regions, superpixels);
+	double min_label, max_label;
+	minMaxLoc(labels, &min_label, &max_label);
+	EXPECT_GE(min_label, 0);
+	EXPECT_LT(max_label, regions);
+	EXPECT_EQ((int) tiled.getRegionAdjacencyGraph().offsets.size(), regions + 1);
+}
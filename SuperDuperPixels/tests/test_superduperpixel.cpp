@@ -0,0 +1,249 @@
+// test_superduperpixel.cpp
+// Unit tests of SuperDuperPixelForest against the list-based grouping it replaced, on random adjacency graphs
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <random>
+#include <set>
+#include <vector>
+#include "superduperpixel.hpp"
+
+// Random superpixels: a connected chain plus random extra edges, random colors and pixel counts
+struct RandomGraph
+{
+	std::vector< std::set<int> > neighbors;
+	// Color values of each superpixel, num_values per superpixel
+	std::vector< std::vector<float> > values;
+	std::vector<int> population;
+};
+
+static RandomGraph makeGraph(int num_superpixels, int num_values, int num_extra_edges, unsigned int seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_int_distribution<int> superpixel_distribution(0, num_superpixels - 1);
+	std::uniform_real_distribution<float> value_distribution(0.0f, 100.0f);
+	std::uniform_int_distribution<int> population_distribution(1, 400);
+
+	RandomGraph graph;
+	graph.neighbors.resize(num_superpixels);
+	for (int superpixel = 0; superpixel + 1 < num_superpixels; superpixel += 1)
+	{
+		graph.neighbors[superpixel].insert(superpixel + 1);
+		graph.neighbors[superpixel + 1].insert(superpixel);
+	}
+	for (int edge = 0; edge < num_extra_edges; edge += 1)
+	{
+		int a = superpixel_distribution(rng);
+		int b = superpixel_distribution(rng);
+		if (a == b)
+			continue;
+		graph.neighbors[a].insert(b);
+		graph.neighbors[b].insert(a);
+	}
+	graph.values.resize(num_superpixels, std::vector<float>(num_values));
+	graph.population.resize(num_superpixels);
+	for (int superpixel = 0; superpixel < num_superpixels; superpixel += 1)
+	{
+		for (float& value : graph.values[superpixel])
+			value = value_distribution(rng);
+		graph.population[superpixel] = population_distribution(rng);
+	}
+	return graph;
+}
+
+// Sum of absolute differences, one value after the other like the old grouping code
+static float sequentialDistance(const std::vector<float>& a, const std::vector<float>& b)
+{
+	float distance = 0;
+	for (size_t value = 0; value < a.size(); value += 1)
+		distance += std::abs(a[value] - b[value]);
+	return distance;
+}
+
+// The grouping of SuperpixelSLICImpl before the forest: a list of SuperDuperPixel with a pointer and a list
+// iterator per superpixel. Histograms are a single color channel of values.size() buckets.
+static int groupWithList(const RandomGraph& graph, SuperDuperPixelMode mode, float max_distance, bool use_duper_distance,
+	std::vector<int>& superduperpixel_indexes)
+{
+	const int num_superpixels = (int) graph.neighbors.size();
+	std::list<SuperDuperPixel> superduperpixels;
+	std::vector<SuperDuperPixel*> pointers(num_superpixels, NULL);
+	std::vector<std::list<SuperDuperPixel>::iterator> iterators(num_superpixels, superduperpixels.end());
+
+	auto create = [&](int superpixel)
+	{
+		if (mode == AVERAGE)
+			superduperpixels.push_back(SuperDuperPixel(superpixel, graph.values[superpixel], graph.population[superpixel]));
+		else
+			superduperpixels.push_back(SuperDuperPixel(superpixel, std::vector< std::vector<float> >(1, graph.values[superpixel]),
+				graph.population[superpixel]));
+		pointers[superpixel] = &superduperpixels.back();
+		iterators[superpixel] = --superduperpixels.end();
+	};
+	auto add = [&](SuperDuperPixel* superduperpixel, int superpixel)
+	{
+		if (mode == AVERAGE)
+			superduperpixel->add_superpixel(superpixel, graph.values[superpixel], graph.population[superpixel]);
+		else
+			superduperpixel->add_superpixel(superpixel, std::vector< std::vector<float> >(1, graph.values[superpixel]),
+				graph.population[superpixel]);
+	};
+
+	for (int superpixel = 0; superpixel < num_superpixels; superpixel += 1)
+	{
+		for (int neighbor : graph.neighbors[superpixel])
+		{
+			if (pointers[neighbor] == pointers[superpixel] && pointers[neighbor] != NULL)
+				continue;
+
+			float distance;
+			if (mode == AVERAGE)
+			{
+				std::vector<float> colors = use_duper_distance && pointers[superpixel] != NULL ?
+					pointers[superpixel]->get_average() : graph.values[superpixel];
+				distance = use_duper_distance && pointers[neighbor] != NULL ?
+					pointers[neighbor]->distance_from(colors) : sequentialDistance(colors, graph.values[neighbor]);
+			}
+			else
+			{
+				std::vector<float> histogram = use_duper_distance && pointers[superpixel] != NULL ?
+					pointers[superpixel]->get_histogram()[0] : graph.values[superpixel];
+				distance = use_duper_distance && pointers[neighbor] != NULL ?
+					pointers[neighbor]->distance_from(std::vector< std::vector<float> >(1, graph.values[superpixel])) :
+					sequentialDistance(histogram, graph.values[neighbor]);
+			}
+			if (distance >= max_distance)
+				continue;
+
+			if (pointers[neighbor] == NULL)
+			{
+				if (pointers[superpixel] == NULL)
+					create(superpixel);
+				add(pointers[superpixel], neighbor);
+				pointers[neighbor] = pointers[superpixel];
+				iterators[neighbor] = iterators[superpixel];
+			}
+			else if (pointers[superpixel] == NULL)
+			{
+				add(pointers[neighbor], superpixel);
+				pointers[superpixel] = pointers[neighbor];
+				iterators[superpixel] = iterators[neighbor];
+			}
+			else if (pointers[superpixel] != pointers[neighbor])
+			{
+				std::list<SuperDuperPixel>::iterator merging = iterators[neighbor];
+				(*pointers[superpixel]) += pointers[neighbor];
+				for (int connected : pointers[neighbor]->get_superpixels())
+				{
+					pointers[connected] = pointers[superpixel];
+					iterators[connected] = iterators[superpixel];
+				}
+				superduperpixels.erase(merging);
+			}
+		}
+		if (pointers[superpixel] == NULL)
+			create(superpixel);
+	}
+
+	superduperpixel_indexes = std::vector<int>(num_superpixels, -1);
+	int count = 0;
+	for (const SuperDuperPixel& superduperpixel : superduperpixels)
+	{
+		for (int superpixel : superduperpixel.get_superpixels())
+			superduperpixel_indexes[superpixel] = count;
+		count += 1;
+	}
+	return count;
+}
+
+// The grouping SuperpixelSLICImpl::groupSuperpixels does now
+static int groupWithForest(const RandomGraph& graph, SuperDuperPixelMode mode, float max_distance, bool use_duper_distance,
+	std::vector<int>& superduperpixel_indexes)
+{
+	const int num_superpixels = (int) graph.neighbors.size();
+	const int num_values = (int) graph.values[0].size();
+	SuperDuperPixelForest superduperpixels(num_superpixels, num_values, mode);
+
+	for (int superpixel = 0; superpixel < num_superpixels; superpixel += 1)
+	{
+		const float* colors = graph.values[superpixel].data();
+		for (int neighbor : graph.neighbors[superpixel])
+		{
+			if (superduperpixels.same_group(neighbor, superpixel))
+				continue;
+
+			const float* duper_colors = use_duper_distance && superduperpixels.in_group(superpixel) ?
+				superduperpixels.get_values(superpixel) : colors;
+			float distance = use_duper_distance && superduperpixels.in_group(neighbor) ?
+				superduperpixels.distance_from(neighbor, mode == HISTOGRAM ? colors : duper_colors) :
+				superduperpixels.get_kernels().distance(duper_colors, graph.values[neighbor].data(), num_values);
+			if (distance >= max_distance)
+				continue;
+
+			if (!superduperpixels.in_group(neighbor))
+			{
+				if (!superduperpixels.in_group(superpixel))
+					superduperpixels.create_group(superpixel, colors, graph.population[superpixel]);
+				superduperpixels.add_superpixel(superpixel, neighbor, graph.values[neighbor].data(), graph.population[neighbor]);
+			}
+			else if (!superduperpixels.in_group(superpixel))
+				superduperpixels.add_superpixel(neighbor, superpixel, colors, graph.population[superpixel]);
+			else if (!superduperpixels.same_group(superpixel, neighbor))
+				superduperpixels.merge(superpixel, neighbor);
+		}
+		if (!superduperpixels.in_group(superpixel))
+			superduperpixels.create_group(superpixel, colors, graph.population[superpixel]);
+	}
+	return superduperpixels.index(superduperpixel_indexes);
+}
+
+// Groups random graphs both ways and expects the same super-duper-pixel of every superpixel
+// Values are 3 floats, which both sum one after the other, so the distances are bit for bit the same
+static void expectSameGrouping(SuperDuperPixelMode mode, bool use_duper_distance)
+{
+	for (unsigned int seed = 1; seed <= 20; seed += 1)
+	{
+		RandomGraph graph = makeGraph(300, 3, 600, seed);
+		for (float max_distance : { 10.0f, 30.0f, 60.0f })
+		{
+			std::vector<int> list_indexes, forest_indexes;
+			int list_count = groupWithList(graph, mode, max_distance, use_duper_distance, list_indexes);
+			int forest_count = groupWithForest(graph, mode, max_distance, use_duper_distance, forest_indexes);
+			EXPECT_EQ(forest_count, list_count) << "seed " << seed << ", max distance " << max_distance;
+			EXPECT_EQ(forest_indexes, list_indexes) << "seed " << seed << ", max distance " << max_distance;
+		}
+	}
+}
+
+//=============================================================================
+// Grouping
+//=============================================================================
+
+TEST(SuperDuperPixelForestTest, AverageMatchesListGrouping)
+{
+	expectSameGrouping(AVERAGE, true);
+}
+
+TEST(SuperDuperPixelForestTest, AverageWithoutDuperDistanceMatchesListGrouping)
+{
+	expectSameGrouping(AVERAGE, false);
+}
+
+TEST(SuperDuperPixelForestTest, HistogramMatchesListGrouping)
+{
+	expectSameGrouping(HISTOGRAM, true);
+}
+
+TEST(SuperDuperPixelForestTest, MergesSomeButNotAll)
+{
+	// The thresholds above have to actually group superpixels for the comparison to mean anything
+	RandomGraph graph = makeGraph(300, 3, 600, 1);
+	std::vector<int> indexes;
+	int count = groupWithForest(graph, AVERAGE, 30.0f, true, indexes);
+	EXPECT_GT(count, 1);
+	EXPECT_LT(count, 300);
+	EXPECT_EQ(*std::min_element(indexes.begin(), indexes.end()), 0);
+	EXPECT_EQ(*std::max_element(indexes.begin(), indexes.end()), count - 1);
+}
@@ -0,0 +1,361 @@
+#include "coco_labels.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <utility>
+#include "json.hpp"
+
+namespace fs = std::filesystem;
+using json   = nlohmann::json;
+
+// Layout (native byte order): magic, version, source size and time, the counts, then
+// nameStart, names, catStart, cats, and the category names (by id) as length and bytes
+constexpr char     LABELS_MAGIC[8] = { 'S', 'P', 'X', 'C', 'O', 'C', 'O', 'L' };
+constexpr uint32_t LABELS_VERSION  = 1;
+constexpr int32_t  MAX_CATEGORY_ID = 1 << 16;   // catNames is indexed by id
+
+// STREAMING PARSE
+
+// SAX handler keeping only what COCOLabelIndex needs. Depth 1 is the top level object, 2 the
+// images / annotations / categories arrays and 3 their elements; anything nested deeper
+// (segmentations, bounding boxes) is skipped without being stored.
+class COCOSaxHandler : public nlohmann::json_sax<json> {
+public:
+    std::vector<std::pair<int64_t, std::string>> images;       // (image id, file name)
+    std::vector<std::pair<int64_t, int32_t>>     annotations;  // (image id, category id)
+    std::vector<std::pair<int32_t, std::string>> categories;   // (category id, name)
+    std::string error;
+
+    bool null() override { return true; }
+    bool boolean(bool) override { return true; }
+    bool number_integer(number_integer_t val) override { return integer(val); }
+    bool number_unsigned(number_unsigned_t val) override { return integer((int64_t)val); }
+    bool number_float(number_float_t, const string_t&) override { return true; }
+    bool binary(binary_t&) override { return true; }
+
+    bool string(string_t& val) override {
+        if (depth == 3 && (field == "file_name" || field == "name"))
+            text = std::move(val);
+        return true;
+    }
+
+    bool start_object(std::size_t) override {
+        if (++depth == 3) {
+            id = imageId = categoryId = -1;
+            text.clear();
+        }
+        return true;
+    }
+
+    bool end_object() override {
+        if (depth-- != 3) return true;
+        switch (section) {
+            case Section::IMAGES:
+                if (id >= 0 && !text.empty()) images.emplace_back(id, std::move(text));
+                break;
+            case Section::ANNOTATIONS:
+                if (imageId >= 0 && categoryId >= 0) annotations.emplace_back(imageId, (int32_t)categoryId);
+                break;
+            case Section::CATEGORIES:
+                if (id >= 0 && !text.empty()) categories.emplace_back((int32_t)id, std::move(text));
+                break;
+            default:
+                break;
+        }
+        return true;
+    }
+
+    bool start_array(std::size_t) override { ++depth; return true; }
+    bool end_array() override { --depth; return true; }
+
+    bool key(string_t& val) override {
+        if (depth == 1) {
+            section = val == "images"      ? Section::IMAGES
+                    : val == "annotations" ? Section::ANNOTATIONS
+                    : val == "categories"  ? Section::CATEGORIES
+                    :                        Section::NONE;
+        } else if (depth == 3) {
+            field = val;
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& ex) override {
+        error = "at byte " + std::to_string(position) + ": " + ex.what();
+        return false;
+    }
+
+private:
+    enum class Section { NONE, IMAGES, ANNOTATIONS, CATEGORIES };
+
+    bool integer(int64_t val) {
+        if (depth != 3) return true;
+        if (field == "id")               id = val;
+        else if (field == "image_id")    imageId = val;
+        else if (field == "category_id") categoryId = val;
+        return true;
+    }
+
+    int depth = 0;
+    Section section = Section::NONE;
+    std::string field;
+    int64_t id = -1, imageId = -1, categoryId = -1;
+    std::string text;
+};
+
+// Appends an image, or adds to the last one if it has the same name (names come sorted)
+static void appendImage(COCOLabelIndex& index, std::string_view name,
+                        const int32_t* catsBegin, const int32_t* catsEnd) {
+    if (index.nameStart.empty()) {
+        index.nameStart.push_back(0);
+        index.catStart.push_back(0);
+    }
+    if (index.size() > 0 && index.name(index.size() - 1) == name) {
+        index.cats.insert(index.cats.end(), catsBegin, catsEnd);
+        auto first = index.cats.begin() + index.catStart[index.size() - 1];
+        std::sort(first, index.cats.end());
+        index.cats.erase(std::unique(first, index.cats.end()), index.cats.end());
+        index.catStart.back() = (uint32_t)index.cats.size();
+        return;
+    }
+    index.names.append(name);
+    index.nameStart.push_back((uint32_t)index.names.size());
+    index.cats.insert(index.cats.end(), catsBegin, catsEnd);
+    index.catStart.push_back((uint32_t)index.cats.size());
+}
+
+static COCOLabelIndex buildLabelIndex(COCOSaxHandler& parsed) {
+    auto& images = parsed.images;
+    std::sort(images.begin(), images.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    // (image, category) pairs, grouped by image
+    std::vector<std::pair<uint32_t, int32_t>> imageCats;
+    imageCats.reserve(parsed.annotations.size());
+    for (const auto& [imageId, catId] : parsed.annotations) {
+        auto it = std::lower_bound(images.begin(), images.end(), imageId,
+                                   [](const auto& img, int64_t id) { return img.first < id; });
+        if (it == images.end() || it->first != imageId) continue;
+        imageCats.emplace_back((uint32_t)(it - images.begin()), catId);
+    }
+    std::sort(imageCats.begin(), imageCats.end());
+    imageCats.erase(std::unique(imageCats.begin(), imageCats.end()), imageCats.end());
+
+    std::vector<uint32_t> first(images.size() + 1, 0);
+    for (const auto& ic : imageCats) first[ic.first + 1]++;
+    for (size_t i = 0; i < images.size(); ++i) first[i + 1] += first[i];
+    std::vector<int32_t> cats(imageCats.size());
+    for (size_t i = 0; i < imageCats.size(); ++i) cats[i] = imageCats[i].second;
+
+    // Only annotated images are kept, by name
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < images.size(); ++i)
+        if (first[i + 1] > first[i]) order.push_back(i);
+    std::sort(order.begin(), order.end(),
+              [&](uint32_t a, uint32_t b) { return images[a].second < images[b].second; });
+
+    COCOLabelIndex index;
+    for (uint32_t i : order)
+        appendImage(index, images[i].second, cats.data() + first[i], cats.data() + first[i + 1]);
+
+    for (const auto& [id, name] : parsed.categories) {
+        if (id > MAX_CATEGORY_ID) continue;
+        if ((size_t)id >= index.catNames.size()) index.catNames.resize(id + 1);
+        index.catNames[id] = name;
+    }
+    return index;
+}
+
+// LABEL INDEX
+
+std::vector<int> COCOLabelIndex::find(std::string_view fname) const {
+    size_t lo = 0, hi = size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (name(mid) < fname) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == size() || name(lo) != fname) return {};
+    return std::vector<int>(cats.begin() + catStart[lo], cats.begin() + catStart[lo + 1]);
+}
+
+void COCOLabelIndex::merge(const COCOLabelIndex& other) {
+    if (size() == 0 && catNames.empty()) {
+        *this = other;
+        return;
+    }
+
+    COCOLabelIndex merged;
+    merged.names.reserve(names.size() + other.names.size());
+    merged.cats.reserve(cats.size() + other.cats.size());
+
+    size_t a = 0, b = 0;
+    while (a < size() || b < other.size()) {
+        bool takeA = b == other.size() || (a < size() && name(a) <= other.name(b));
+        if (takeA) {
+            appendImage(merged, name(a), cats.data() + catStart[a], cats.data() + catStart[a + 1]);
+            ++a;
+        } else {
+            // A name in both is folded into the entry just appended by appendImage
+            appendImage(merged, other.name(b), other.cats.data() + other.catStart[b],
+                        other.cats.data() + other.catStart[b + 1]);
+            ++b;
+        }
+    }
+
+    merged.catNames = catNames;
+    if (other.catNames.size() > merged.catNames.size())
+        merged.catNames.resize(other.catNames.size());
+    for (size_t id = 0; id < other.catNames.size(); ++id)
+        if (!other.catNames[id].empty()) merged.catNames[id] = other.catNames[id];
+
+    *this = std::move(merged);
+}
+
+template <typename T>
+static void writeArray(std::ofstream& out, const std::vector<T>& v) {
+    out.write((const char*)v.data(), (std::streamsize)(v.size() * sizeof(T)));
+}
+
+template <typename T>
+static bool readArray(std::ifstream& in, std::vector<T>& v, uint64_t count) {
+    v.resize(count);
+    in.read((char*)v.data(), (std::streamsize)(count * sizeof(T)));
+    return (bool)in;
+}
+
+bool COCOLabelIndex::save(const std::string& path, uint64_t sourceSize, int64_t sourceTime) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) return false;
+
+    uint64_t counts[4] = { size(), names.size(), cats.size(), catNames.size() };
+    out.write(LABELS_MAGIC, sizeof(LABELS_MAGIC));
+    out.write((const char*)&LABELS_VERSION, sizeof(LABELS_VERSION));
+    out.write((const char*)&sourceSize, sizeof(sourceSize));
+    out.write((const char*)&sourceTime, sizeof(sourceTime));
+    out.write((const char*)counts, sizeof(counts));
+    if (size() > 0) {
+        writeArray(out, nameStart);
+        out.write(names.data(), (std::streamsize)names.size());
+        writeArray(out, catStart);
+        writeArray(out, cats);
+    }
+    for (const auto& n : catNames) {
+        uint32_t length = (uint32_t)n.size();
+        out.write((const char*)&length, sizeof(length));
+        out.write(n.data(), length);
+    }
+    return (bool)out;
+}
+
+bool COCOLabelIndex::load(const std::string& path, uint64_t sourceSize, int64_t sourceTime) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return false;
+
+    char magic[8];
+    uint32_t version = 0;
+    uint64_t storedSize = 0, storedTime = 0;
+    uint64_t counts[4] = {};
+    in.read(magic, sizeof(magic));
+    in.read((char*)&version, sizeof(version));
+    in.read((char*)&storedSize, sizeof(storedSize));
+    in.read((char*)&storedTime, sizeof(storedTime));
+    in.read((char*)counts, sizeof(counts));
+    if (!in || std::memcmp(magic, LABELS_MAGIC, sizeof(magic)) != 0 || version != LABELS_VERSION ||
+        storedSize != sourceSize || (int64_t)storedTime != sourceTime || counts[3] > (uint64_t)MAX_CATEGORY_ID + 1)
+        return false;
+
+    COCOLabelIndex loaded;
+    if (counts[0] > 0) {
+        loaded.names.resize(counts[1]);
+        if (!readArray(in, loaded.nameStart, counts[0] + 1)) return false;
+        in.read(&loaded.names[0], (std::streamsize)counts[1]);
+        if (!readArray(in, loaded.catStart, counts[0] + 1) ||
+            !readArray(in, loaded.cats, counts[2]))
+            return false;
+        if (loaded.nameStart.back() != counts[1] || loaded.catStart.back() != counts[2])
+            return false;
+    }
+    loaded.catNames.resize(counts[3]);
+    for (auto& n : loaded.catNames) {
+        uint32_t length = 0;
+        in.read((char*)&length, sizeof(length));
+        if (!in || length > 4096) return false;
+        n.resize(length);
+        in.read(&n[0], length);
+    }
+    if (!in) return false;
+
+    *this = std::move(loaded);
+    return true;
+}
+
+// LOADING
+
+void loadCOCOAnnotations(const std::string& annPath, COCOLabelIndex& index,
+                         const std::string& sidecarDir) {
+    std::error_code ec;
+    uint64_t sourceSize = fs::file_size(annPath, ec);
+    int64_t  sourceTime = ec ? 0 : (int64_t)fs::last_write_time(annPath, ec).time_since_epoch().count();
+    if (ec) {
+        std::cerr << "Could not open COCO annotation file: " << annPath << "\n";
+        return;
+    }
+
+    std::string sidecarPath = sidecarDir.empty()
+        ? std::string()
+        : sidecarDir + "/" + fs::path(annPath).filename().string() + ".labels";
+
+    COCOLabelIndex part;
+    if (!sidecarPath.empty() && part.load(sidecarPath, sourceSize, sourceTime)) {
+        index.merge(part);
+        std::cout << "Loaded COCO labels from: " << sidecarPath << "\n";
+        return;
+    }
+
+    std::ifstream f(annPath, std::ios::binary);
+    if (!f.is_open()) {
+        std::cerr << "Could not open COCO annotation file: " << annPath << "\n";
+        return;
+    }
+
+    COCOSaxHandler handler;
+    if (!json::sax_parse(f, &handler)) {
+        std::cerr << "Could not parse COCO annotation file " << annPath << " " << handler.error << "\n";
+        return;
+    }
+    part = buildLabelIndex(handler);
+    index.merge(part);
+    std::cout << "Loaded COCO annotations from: " << annPath << "\n";
+
+    if (!sidecarPath.empty()) {
+        fs::create_directories(sidecarDir, ec);
+        if (!part.save(sidecarPath, sourceSize, sourceTime))
+            std::cerr << "Failed to write COCO label sidecar " << sidecarPath << "\n";
+    }
+}
+
+std::vector<int> getCategoriesForImage(const COCOLabelIndex& index,
+                                       const std::string& fullPath) {
+    return index.find(fs::path(fullPath).filename().string());
+}
+
+std::string catIdsToString(const std::vector<int>& ids,
+                           const COCOLabelIndex& index) {
+    std::vector<std::string> names;
+    names.reserve(ids.size());
+    for (int id : ids) {
+        bool known = id >= 0 && (size_t)id < index.catNames.size() && !index.catNames[id].empty();
+        names.push_back(known ? index.catNames[id] : ("id_" + std::to_string(id)));
+    }
+    std::sort(names.begin(), names.end());
+    std::string out;
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (i > 0) out += "|";
+        out += names[i];
+    }
+    return out;
+}
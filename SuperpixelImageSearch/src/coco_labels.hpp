@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// DATA INDEXING FOR COCO LABELS
+
+// Category ids of every annotated image, keyed by file name, in flat arrays: the file names
+// are sorted and concatenated, so a lookup is a binary search, and the categories of the
+// i-th name are cats[catStart[i] .. catStart[i + 1]), sorted
+struct COCOLabelIndex {
+    std::string           names;       // file names, sorted, back to back
+    std::vector<uint32_t> nameStart;   // name i is names[nameStart[i] .. nameStart[i + 1])
+    std::vector<uint32_t> catStart;
+    std::vector<int32_t>  cats;
+    std::vector<std::string> catNames; // by category id, empty for unused ids
+
+    size_t size() const { return nameStart.empty() ? 0 : nameStart.size() - 1; }
+    std::string_view name(size_t i) const {
+        return std::string_view(names).substr(nameStart[i], nameStart[i + 1] - nameStart[i]);
+    }
+
+    // Categories of a file name, none if it isn't annotated
+    std::vector<int> find(std::string_view fname) const;
+
+    // Adds the images and categories of other; images in both get the union of their categories
+    void merge(const COCOLabelIndex& other);
+
+    // Compact binary sidecar. sourceSize and sourceTime identify the annotation file it was
+    // parsed from, so load() rejects a sidecar of an older version of the file.
+    bool save(const std::string& path, uint64_t sourceSize, int64_t sourceTime) const;
+    bool load(const std::string& path, uint64_t sourceSize, int64_t sourceTime);
+};
+
+// Adds the labels of a COCO instances file to index. The file is parsed as a stream, keeping
+// only image file names, annotation category ids and category names, and the result is
+// written to a sidecar in sidecarDir that later runs load instead of the JSON.
+void loadCOCOAnnotations(const std::string& annPath, COCOLabelIndex& index,
+                         const std::string& sidecarDir = "");
+
+std::vector<int> getCategoriesForImage(const COCOLabelIndex& index,
+                                       const std::string& fullPath);
+
+std::string catIdsToString(const std::vector<int>& ids,
+                           const COCOLabelIndex& index);
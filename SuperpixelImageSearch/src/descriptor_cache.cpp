@@ -0,0 +1,156 @@
+#include "descriptor_cache.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+// Layout (native byte order): magic, version, entry count, then per entry a uint32 name
+// length, the name, int32 rows, cols and type, and the rows of the matrix
+constexpr char     CACHE_MAGIC[8] = { 'S', 'P', 'X', 'C', 'A', 'C', 'H', 'E' };
+constexpr uint32_t CACHE_VERSION  = 1;
+
+bool CachedImage::get(const std::string& name, cv::Mat& m) const {
+    auto it = mats.find(name);
+    if (it == mats.end()) return false;
+    m = it->second;
+    return true;
+}
+
+void CachedImage::put(const std::string& name, const cv::Mat& m) {
+    mats[name] = m.clone();
+    modified = true;
+}
+
+DescriptorCache::DescriptorCache(const std::string& dir)
+    : dir(dir) {
+    fs::create_directories(dir);
+}
+
+std::string DescriptorCache::contentHash(const std::vector<uchar>& bytes) {
+    uint64_t h = 14695981039346656037ull;
+    for (uchar b : bytes) {
+        h ^= b;
+        h *= 1099511628211ull;
+    }
+    std::ostringstream out;
+    out << std::hex << h << "_" << bytes.size();
+    return out.str();
+}
+
+bool DescriptorCache::hashFile(const std::string& path, std::string& key, std::vector<uchar>* bytes) {
+    if (bytes) bytes->clear();
+    {
+        std::lock_guard<std::mutex> lock(hashMutex);
+        auto it = pathHashes.find(path);
+        if (it != pathHashes.end()) {
+            key = it->second;
+            return true;
+        }
+    }
+
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in.is_open()) return false;
+    std::vector<uchar> data((size_t)in.tellg());
+    in.seekg(0);
+    if (!in.read((char*)data.data(), (std::streamsize)data.size())) return false;
+
+    key = contentHash(data);
+    {
+        std::lock_guard<std::mutex> lock(hashMutex);
+        pathHashes[path] = key;
+    }
+    if (bytes) *bytes = std::move(data);
+    return true;
+}
+
+std::string DescriptorCache::entryPath(const std::string& key) const {
+    // Spread over 256 subdirectories so no directory gets huge
+    return dir + "/" + key.substr(0, 2) + "/" + key + ".cache";
+}
+
+CachedImage DescriptorCache::load(const std::string& key) const {
+    CachedImage image;
+    image.key = key;
+
+    std::ifstream in(entryPath(key), std::ios::binary);
+    if (!in.is_open()) return image;
+
+    char magic[8];
+    uint32_t version = 0, count = 0;
+    in.read(magic, sizeof(magic));
+    in.read((char*)&version, sizeof(version));
+    in.read((char*)&count, sizeof(count));
+    if (!in || std::memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 || version != CACHE_VERSION)
+        return image;
+
+    std::map<std::string, cv::Mat> mats;
+    for (uint32_t e = 0; e < count; ++e) {
+        uint32_t length = 0;
+        int32_t rows = 0, cols = 0, type = 0;
+        in.read((char*)&length, sizeof(length));
+        if (!in || length > 4096) return image;
+        std::string name(length, '\0');
+        in.read(&name[0], length);
+        in.read((char*)&rows, sizeof(rows));
+        in.read((char*)&cols, sizeof(cols));
+        in.read((char*)&type, sizeof(type));
+        if (!in || rows < 0 || cols < 0 || type < 0 || type >= CV_MAKETYPE(CV_DEPTH_MAX, CV_CN_MAX))
+            return image;
+
+        cv::Mat m(rows, cols, type);
+        for (int i = 0; i < rows; ++i)
+            in.read((char*)m.ptr(i), (std::streamsize)(cols * m.elemSize()));
+        if (!in) return image;
+        mats[name] = m;
+    }
+
+    image.mats = std::move(mats);
+    return image;
+}
+
+bool DescriptorCache::store(const CachedImage& image) const {
+    if (!image.modified) return true;
+
+    static std::atomic<unsigned> tmpCounter{0};
+    std::string path = entryPath(image.key);
+    std::string tmp  = path + ".tmp" + std::to_string(tmpCounter.fetch_add(1));
+
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) return false;
+
+        uint32_t count = (uint32_t)image.mats.size();
+        out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        out.write((const char*)&CACHE_VERSION, sizeof(CACHE_VERSION));
+        out.write((const char*)&count, sizeof(count));
+        for (const auto& [name, m] : image.mats) {
+            uint32_t length = (uint32_t)name.size();
+            int32_t rows = m.rows, cols = m.cols, type = m.type();
+            out.write((const char*)&length, sizeof(length));
+            out.write(name.data(), length);
+            out.write((const char*)&rows, sizeof(rows));
+            out.write((const char*)&cols, sizeof(cols));
+            out.write((const char*)&type, sizeof(type));
+            for (int i = 0; i < m.rows; ++i)
+                out.write((const char*)m.ptr(i), (std::streamsize)(m.cols * m.elemSize()));
+        }
+        if (!out) {
+            out.close();
+            fs::remove(tmp, ec);
+            return false;
+        }
+    }
+
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// DESCRIPTOR CACHE
+
+// Everything cached for the content of one image file (descriptors, keypoints, label maps),
+// each under a name that encodes the settings it was computed with
+struct CachedImage {
+    std::string key;                       // content hash of the file
+    std::map<std::string, cv::Mat> mats;
+    bool modified = false;                 // entries were put since it was loaded
+
+    bool get(const std::string& name, cv::Mat& m) const;
+    void put(const std::string& name, const cv::Mat& m);
+};
+
+// On-disk cache of CachedImages keyed by the content of the image files, so renamed or copied
+// images hit the same entries and edited ones miss. Every image is one file under the cache
+// directory, written whole to a temporary file and renamed over the old one, so concurrent
+// writers and interrupted runs never leave a torn entry behind. Thread safe.
+class DescriptorCache {
+public:
+    explicit DescriptorCache(const std::string& dir);
+
+    // Reads an image file and hashes its content (memoized per path for this process).
+    // bytes (if given) gets the file when it had to be read, and is left empty when the hash was
+    // known already, so callers can decode the bytes that were hashed instead of reading twice.
+    bool hashFile(const std::string& path, std::string& key, std::vector<uchar>* bytes = nullptr);
+
+    // Loads the entries cached for key (none if there's no file for it yet)
+    CachedImage load(const std::string& key) const;
+
+    // Writes image back if anything was put into it
+    bool store(const CachedImage& image) const;
+
+    // 64-bit FNV-1a of the bytes and their length, as hex
+    static std::string contentHash(const std::vector<uchar>& bytes);
+
+private:
+    std::string entryPath(const std::string& key) const;
+
+    std::string dir;
+    std::mutex hashMutex;
+    std::unordered_map<std::string, std::string> pathHashes;
+};
@@ -1,8 +1,15 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/features2d.hpp>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "descriptor_cache.hpp"
+#include "search_config.hpp"
 
 namespace fs = std::filesystem;
 
@@ -16,64 +23,259 @@ cv::Mat load_gray(const fs::path& p)
     return img;
 }
 
-cv::Mat sift_descriptor(const cv::Mat& img)
+// Name superpixel_ris caches the SIFT descriptors of a gray image of this size under
+std::string sift_cache_name(int cols, int rows)
 {
-    auto sift = cv::SIFT::create();
-    std::vector<cv::KeyPoint> kps;
-    cv::Mat desc;
-    sift->detectAndCompute(img, cv::noArray(), kps, desc);
+    return featureCacheName("SIFT", cols, rows) + DESCRIPTORS_CACHE_SUFFIX;
+}
 
+// Mean descriptor (GLOBAL-style aggregation)
+cv::Mat mean_descriptor(const cv::Mat& desc)
+{
     if (desc.empty())
         return cv::Mat::zeros(1, 128, CV_32F);
 
-    // Mean descriptor (GLOBAL-style aggregation)
+    cv::Mat desc32;
+    desc.convertTo(desc32, CV_32F);
+
     cv::Mat mean;
-    cv::reduce(desc, mean, 0, cv::REDUCE_AVG, CV_32F);
+    cv::reduce(desc32, mean, 0, cv::REDUCE_AVG, CV_32F);
     return mean;
 }
 
+// SIFT descriptors of an image, with one detector per thread
+cv::Mat sift_descriptors(const cv::Mat& img)
+{
+    thread_local cv::Ptr<cv::SIFT> sift = cv::SIFT::create();
+    std::vector<cv::KeyPoint> kps;
+    cv::Mat desc;
+    sift->detectAndCompute(img, cv::noArray(), kps, desc);
+    return desc;
+}
+
+// Full size SIFT descriptors in a cache entry: the largest image size any were cached for
+// (the superpixel descriptors cache the ones of a downsized copy as well)
+bool cached_sift(const CachedImage& image, cv::Mat& desc)
+{
+    const std::string prefix = featureCachePrefix("SIFT");
+    const std::string& suffix = DESCRIPTORS_CACHE_SUFFIX;
+    long long best_area = -1;
+    for (const auto& [name, m] : image.mats)
+    {
+        if (name.size() <= prefix.size() + suffix.size() ||
+            name.compare(0, prefix.size(), prefix) != 0 ||
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+            continue;
+
+        int cols = 0, rows = 0;
+        char x = 0;
+        std::istringstream size(name.substr(prefix.size(), name.size() - prefix.size() - suffix.size()));
+        if (!(size >> cols >> x >> rows) || x != 'x') continue;
+
+        if ((long long)cols * rows > best_area)
+        {
+            best_area = (long long)cols * rows;
+            desc = m;
+        }
+    }
+    return best_area >= 0;
+}
+
 float l2_distance(const cv::Mat& a, const cv::Mat& b)
 {
     return static_cast<float>(cv::norm(a, b, cv::NORM_L2));
 }
 
+// Splits a CSV line, keeping commas inside quoted fields
+std::vector<std::string> split_csv(const std::string& line)
+{
+    std::vector<std::string> fields(1);
+    bool quoted = false;
+    for (char c : line)
+    {
+        if (c == '"')
+            quoted = !quoted;
+        else if (c == ',' && !quoted)
+            fields.emplace_back();
+        else if (c != '\r')
+            fields.back() += c;
+    }
+    return fields;
+}
+
+// (method, match rank) -> filename of the indexed image, from the master CSV of superpixel_ris
+std::map<std::pair<std::string, int>, std::string> read_match_filenames(const fs::path& csv_path)
+{
+    std::map<std::pair<std::string, int>, std::string> filenames;
+    std::ifstream in(csv_path);
+    std::string line;
+    if (!std::getline(in, line)) return filenames;
+
+    std::vector<std::string> header = split_csv(line);
+    int method_col = -1, rank_col = -1, filename_col = -1;
+    for (int c = 0; c < (int)header.size(); ++c)
+    {
+        if (header[c] == "method") method_col = c;
+        if (header[c] == "match_rank") rank_col = c;
+        if (header[c] == "match_filename") filename_col = c;
+    }
+    if (method_col < 0 || rank_col < 0 || filename_col < 0) return filenames;
+
+    while (std::getline(in, line))
+    {
+        std::vector<std::string> fields = split_csv(line);
+        if ((int)fields.size() <= std::max(method_col, std::max(rank_col, filename_col))) continue;
+        try
+        {
+            filenames[{ fields[method_col], std::stoi(fields[rank_col]) }] = fields[filename_col];
+        }
+        catch (const std::exception&)
+        {
+            // not a data row
+        }
+    }
+    return filenames;
+}
+
+/* ---------- descriptor lookup ---------- */
+
+// One image whose mean descriptor is needed
+struct DescriptorJob
+{
+    std::string method;
+    int match_index = 0;
+    fs::path image_path;    // image written to the output directory
+    fs::path indexed_path;  // image it's a copy of in the index (empty if unknown)
+    cv::Mat mean;
+    bool cached = false;
+};
+
+// Takes the descriptors from the cache entry of the indexed image, or else of the output image itself
+bool lookup_cached(DescriptorCache& cache, DescriptorJob& job)
+{
+    std::string key;
+    cv::Mat desc;
+    if (!job.indexed_path.empty() && cache.hashFile(job.indexed_path.string(), key) &&
+        cached_sift(cache.load(key), desc))
+    {
+        job.mean = mean_descriptor(desc);
+        return true;
+    }
+    if (cache.hashFile(job.image_path.string(), key) && cached_sift(cache.load(key), desc))
+    {
+        job.mean = mean_descriptor(desc);
+        return true;
+    }
+    return false;
+}
+
+// Computes the descriptors of the output image and caches them under its content
+bool compute_and_cache(DescriptorCache& cache, DescriptorJob& job)
+{
+    cv::Mat img = load_gray(job.image_path);
+    cv::Mat desc = sift_descriptors(img);
+    job.mean = mean_descriptor(desc);
+
+    std::string key;
+    if (!cache.hashFile(job.image_path.string(), key)) return false;
+    CachedImage entry = cache.load(key);
+    entry.put(sift_cache_name(img.cols, img.rows), desc.empty() ? cv::Mat(0, 128, CV_32F) : desc);
+    return cache.store(entry);
+}
+
 /* ---------- main ---------- */
 
 int main()
 {
     try
     {
-        fs::path output_root = "SuperpixelImageSearch/output";
+        auto start = std::chrono::high_resolution_clock::now();
+
+        const fs::path output_root = OUTPUT_ROOT;
+        const fs::path index_dir   = INDEX_DIR;
         fs::path query_path  = output_root / "origin" / "query_original.jpg";
         fs::path csv_out     = output_root / "csv" / "distance_posthoc.csv";
+        DescriptorCache cache(DESCRIPTOR_CACHE_DIR);
 
-        cv::Mat query_img  = load_gray(query_path);
-        cv::Mat query_desc = sift_descriptor(query_img);
+        auto match_filenames = read_match_filenames(output_root / "csv" / "master_results.csv");
 
-        std::ofstream csv(csv_out);
-        csv << "method,match_index,distance\n";
+        // the query first, then every match of every method
+        std::vector<DescriptorJob> jobs(1);
+        jobs[0].image_path = query_path;
+        if (fs::exists(QUERY_IMG)) jobs[0].indexed_path = QUERY_IMG;
+        if (!fs::exists(query_path))
+            throw std::runtime_error("Could not load image: " + query_path.string());
 
         for (const auto& dir : fs::directory_iterator(output_root))
         {
             if (!dir.is_directory()) continue;
 
             std::string method = dir.path().filename().string();
-            if (method == "origin" || method == "csv") continue;
+            if (method == "origin" || method == "csv" || method == "cache" || method == "index") continue;
 
-            for (int i = 1; i <= 5; ++i)
+            for (int i = 1; i <= TOP_K; ++i)
             {
                 fs::path match_path = dir.path() / ("match_" + std::to_string(i) + ".jpg");
                 if (!fs::exists(match_path)) continue;
 
-                cv::Mat match_img  = load_gray(match_path);
-                cv::Mat match_desc = sift_descriptor(match_img);
+                DescriptorJob job;
+                job.method = method;
+                job.match_index = i;
+                job.image_path = match_path;
+                auto it = match_filenames.find({ method, i });
+                if (it != match_filenames.end() && fs::exists(index_dir / it->second))
+                    job.indexed_path = index_dir / it->second;
+                jobs.push_back(job);
+            }
+        }
 
-                float dist = l2_distance(query_desc, match_desc);
-                csv << method << "," << i << "," << dist << "\n";
+        // cached descriptors first, then whatever is missing, in parallel
+        int cached_count = 0;
+        std::vector<int> missing;
+        for (int j = 0; j < (int)jobs.size(); ++j)
+        {
+            if (lookup_cached(cache, jobs[j]))
+            {
+                jobs[j].cached = true;
+                cached_count++;
             }
+            else
+                missing.push_back(j);
         }
 
+        std::vector<std::string> errors(missing.size());
+        cv::parallel_for_(cv::Range(0, (int)missing.size()), [&](const cv::Range& range)
+        {
+            for (int m = range.start; m < range.end; ++m)
+            {
+                try
+                {
+                    if (!compute_and_cache(cache, jobs[missing[m]]))
+                        std::cerr << "Failed to cache descriptors of " << jobs[missing[m]].image_path << "\n";
+                }
+                catch (const std::exception& e)
+                {
+                    errors[m] = e.what();
+                }
+            }
+        });
+        for (const std::string& error : errors)
+            if (!error.empty()) throw std::runtime_error(error);
+
+        const cv::Mat& query_desc = jobs[0].mean;
+
+        std::ofstream csv(csv_out);
+        csv << "method,match_index,distance\n";
+        for (size_t j = 1; j < jobs.size(); ++j)
+        {
+            float dist = l2_distance(query_desc, jobs[j].mean);
+            csv << jobs[j].method << "," << jobs[j].match_index << "," << dist << "\n";
+        }
         csv.close();
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << "Descriptors: " << cached_count << " cached, " << missing.size() << " computed ("
+                  << ms << " ms)\n";
         std::cout << "Saved distance CSV to: " << csv_out << "\n";
     }
     catch (const std::exception& e)
@@ -0,0 +1,777 @@
+#include "image_index.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::string indexConfigToString(const IndexConfig& cfg) {
+    switch (cfg.type) {
+        case IndexType::FLAT: return "FLAT";
+        case IndexType::IVF:  return "IVF" + (cfg.ivfLists > 0 ? std::to_string(cfg.ivfLists) : std::string())
+                                     + "_P" + std::to_string(cfg.ivfProbes);
+        case IndexType::PQ:   return "PQ" + (cfg.pqSubspaces > 0 ? std::to_string(cfg.pqSubspaces) : std::string());
+        default:              return "UNKNOWN";
+    }
+}
+
+std::unique_ptr<VectorIndex> createVectorIndex(const IndexConfig& cfg) {
+    switch (cfg.type) {
+        case IndexType::IVF: return std::make_unique<IVFIndex>(cfg.ivfLists, cfg.ivfProbes);
+        case IndexType::PQ:  return std::make_unique<PQIndex>(cfg.pqSubspaces);
+        case IndexType::FLAT:
+        default:             return std::make_unique<FlatIndex>();
+    }
+}
+
+// Keeps the k closest (row, squared distance) candidates, closest first, and turns the
+// squared distances into distances
+static void keepClosest(Neighbors& res, int k) {
+    int kk = std::min(k, (int)res.size());
+    std::partial_sort(res.begin(), res.begin() + kk, res.end(),
+        [](auto& a, auto& b){ return a.second < b.second; });
+    if ((int)res.size() > kk) res.resize(kk);
+    for (auto& r : res)
+        r.second = std::sqrt(r.second);
+}
+
+std::vector<Neighbors> VectorIndex::searchBatch(const cv::Mat& queries, int k) const {
+    std::vector<Neighbors> res(queries.rows);
+    for (int q = 0; q < queries.rows; ++q)
+        res[q] = search(queries.row(q), k);
+    return res;
+}
+
+// FLAT INDEX
+
+// Queries compared at once, and bytes of rows compared against them at once (about an L2 cache)
+constexpr int FLAT_QUERY_BLOCK     = 32;
+constexpr int FLAT_ROW_BLOCK_BYTES = 1 << 20;
+
+static cv::Mat squaredRowNorms(const cv::Mat& features) {
+    cv::Mat norms(features.rows, 1, CV_32F);
+    cv::parallel_for_(cv::Range(0, features.rows), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            const float* row = features.ptr<float>(i);
+            float n = 0.0f;
+            for (int d = 0; d < features.cols; ++d)
+                n += row[d] * row[d];
+            norms.at<float>(i) = n;
+        }
+    });
+    return norms;
+}
+
+// Bounded max-heap of the k best (squared distance, row) candidates, ties broken by row so
+// the result doesn't depend on how the rows were split up
+struct TopK {
+    int k = 0;
+    std::vector<std::pair<float, int>> heap;
+
+    void push(float dist, int row) {
+        std::pair<float, int> c(dist, row);
+        if ((int)heap.size() < k) {
+            heap.push_back(c);
+            std::push_heap(heap.begin(), heap.end());
+        } else if (c < heap.front()) {
+            std::pop_heap(heap.begin(), heap.end());
+            heap.back() = c;
+            std::push_heap(heap.begin(), heap.end());
+        }
+    }
+};
+
+void FlatIndex::build(const cv::Mat& f) {
+    CV_Assert(f.empty() || f.type() == CV_32F);
+    features = f;
+    rowNorms = f.empty() ? cv::Mat() : squaredRowNorms(f);
+}
+
+void FlatIndex::build(const cv::Mat& f, const cv::Mat& norms) {
+    CV_Assert(f.empty() || (f.type() == CV_32F && norms.type() == CV_32F && norms.rows == f.rows));
+    features = f;
+    rowNorms = norms;
+}
+
+Neighbors FlatIndex::search(const cv::Mat& query, int k) const {
+    return searchBatch(query, k).front();
+}
+
+std::vector<Neighbors> FlatIndex::searchBatch(const cv::Mat& queries, int k) const {
+    return exactSearchBatch(features, rowNorms, queries, k);
+}
+
+size_t FlatIndex::memoryBytes() const {
+    return features.total() * features.elemSize() + rowNorms.total() * rowNorms.elemSize();
+}
+
+Neighbors FlatIndex::exactSearch(const cv::Mat& features, const cv::Mat& query, int k) {
+    CV_Assert(query.rows == 1);
+    if (features.empty()) return {};
+    return exactSearchBatch(features, squaredRowNorms(features), query, k).front();
+}
+
+std::vector<Neighbors> FlatIndex::exactSearchBatch(const cv::Mat& features, const cv::Mat& rowNorms,
+                                                   const cv::Mat& queriesIn, int k) {
+    std::vector<Neighbors> res(queriesIn.rows);
+    if (features.empty() || queriesIn.empty() || k <= 0) return res;
+
+    CV_Assert(features.type() == CV_32F && queriesIn.cols == features.cols);
+    CV_Assert(rowNorms.rows == features.rows);
+    cv::Mat queries = queriesIn;
+    if (queries.type() != CV_32F)
+        queriesIn.convertTo(queries, CV_32F);
+
+    const int n   = features.rows;
+    const int dim = features.cols;
+    const int nq  = queries.rows;
+    const int kk  = std::min(k, n);
+    const int rowBlock = std::max(16, std::min(4096, FLAT_ROW_BLOCK_BYTES / (dim * (int)sizeof(float))));
+    const cv::Mat queryNorms = squaredRowNorms(queries);
+
+    // Every task is one block of queries against one stripe of row blocks, with its own heaps.
+    // Rows are striped across threads too, so a single query still runs in parallel.
+    const int numQueryBlocks = (nq + FLAT_QUERY_BLOCK - 1) / FLAT_QUERY_BLOCK;
+    const int numRowBlocks   = (n + rowBlock - 1) / rowBlock;
+    const int numStripes     = std::max(1, std::min(numRowBlocks,
+                                   (cv::getNumThreads() + numQueryBlocks - 1) / numQueryBlocks));
+    std::vector<std::vector<TopK>> taskHeaps(numQueryBlocks * numStripes);
+
+    cv::parallel_for_(cv::Range(0, numQueryBlocks * numStripes), [&](const cv::Range& range) {
+        cv::Mat dots;
+        for (int task = range.start; task < range.end; ++task) {
+            int qb = task / numStripes;
+            int stripe = task % numStripes;
+            int q0 = qb * FLAT_QUERY_BLOCK;
+            int q1 = std::min(nq, q0 + FLAT_QUERY_BLOCK);
+            cv::Mat qBlock = queries.rowRange(q0, q1);
+
+            std::vector<TopK>& heaps = taskHeaps[task];
+            heaps.resize(q1 - q0);
+            for (auto& h : heaps) {
+                h.k = kk;
+                h.heap.reserve(kk);
+            }
+
+            int b0 = (int)((int64_t)numRowBlocks * stripe / numStripes);
+            int b1 = (int)((int64_t)numRowBlocks * (stripe + 1) / numStripes);
+            for (int b = b0; b < b1; ++b) {
+                int r0 = b * rowBlock;
+                int r1 = std::min(n, r0 + rowBlock);
+                cv::gemm(qBlock, features.rowRange(r0, r1), 1.0, cv::noArray(), 0.0, dots, cv::GEMM_2_T);
+
+                for (int q = 0; q < q1 - q0; ++q) {
+                    const float* dotRow = dots.ptr<float>(q);
+                    const float* norms = rowNorms.ptr<float>(r0);
+                    float qn = queryNorms.at<float>(q0 + q);
+                    TopK& heap = heaps[q];
+                    for (int r = 0; r < r1 - r0; ++r) {
+                        float d = std::max(0.0f, qn - 2.0f * dotRow[r] + norms[r]);
+                        heap.push(d, r0 + r);
+                    }
+                }
+            }
+        }
+    });
+
+    // Join the stripes of every query, then recompute the distances of its top K directly
+    for (int q = 0; q < nq; ++q) {
+        int qb = q / FLAT_QUERY_BLOCK;
+        TopK best;
+        best.k = kk;
+        for (int stripe = 0; stripe < numStripes; ++stripe)
+            for (auto& c : taskHeaps[qb * numStripes + stripe][q - qb * FLAT_QUERY_BLOCK].heap)
+                best.push(c.first, c.second);
+
+        const float* qRow = queries.ptr<float>(q);
+        Neighbors& out = res[q];
+        out.reserve(best.heap.size());
+        for (auto& c : best.heap)
+            out.emplace_back(c.second, cv::normL2Sqr<float, float>(qRow, features.ptr<float>(c.second), dim));
+        keepClosest(out, kk);
+    }
+    return res;
+}
+
+// IVF INDEX
+
+// k-means is trained on at most this many rows per list
+constexpr int IVF_TRAIN_ROWS_PER_LIST = 64;
+constexpr int IVF_KMEANS_ITERATIONS   = 20;
+
+IVFIndex::IVFIndex(int numLists, int numProbes)
+    : numLists(numLists), numProbes(numProbes) {}
+
+void IVFIndex::build(const cv::Mat& features) {
+    centroids.release();
+    listStart.assign(1, 0);
+    listRows.clear();
+    listVectors.release();
+    if (features.empty()) return;
+
+    CV_Assert(features.type() == CV_32F);
+    const int n   = features.rows;
+    const int dim = features.cols;
+    int lists = numLists > 0 ? numLists : (int)std::lround(std::sqrt((double)n));
+    lists = std::max(1, std::min(lists, n));
+
+    // Train the coarse quantizer on evenly strided rows, deterministic and cheap
+    int trainRows = std::min(n, lists * IVF_TRAIN_ROWS_PER_LIST);
+    cv::Mat train(trainRows, dim, CV_32F);
+    for (int i = 0; i < trainRows; ++i)
+        features.row((int)((int64_t)i * n / trainRows)).copyTo(train.row(i));
+
+    cv::Mat trainLabels;
+    cv::kmeans(train, lists, trainLabels,
+               cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, IVF_KMEANS_ITERATIONS, 1e-4),
+               1, cv::KMEANS_PP_CENTERS, centroids);
+
+    // Nearest centroid of every row
+    std::vector<int> assignment(n);
+    cv::parallel_for_(cv::Range(0, n), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            const float* row = features.ptr<float>(i);
+            int best = 0;
+            float bestDist = std::numeric_limits<float>::max();
+            for (int c = 0; c < lists; ++c) {
+                float d = cv::normL2Sqr<float, float>(row, centroids.ptr<float>(c), dim);
+                if (d < bestDist) {
+                    bestDist = d;
+                    best = c;
+                }
+            }
+            assignment[i] = best;
+        }
+    });
+
+    // Bucket the rows by list, keeping row order inside every list
+    listStart.assign(lists + 1, 0);
+    for (int i = 0; i < n; ++i)
+        listStart[assignment[i] + 1]++;
+    for (int c = 0; c < lists; ++c)
+        listStart[c + 1] += listStart[c];
+
+    std::vector<int> next(listStart.begin(), listStart.end() - 1);
+    listRows.resize(n);
+    listVectors.create(n, dim, CV_32F);
+    for (int i = 0; i < n; ++i) {
+        int pos = next[assignment[i]]++;
+        listRows[pos] = i;
+        features.row(i).copyTo(listVectors.row(pos));
+    }
+}
+
+Neighbors IVFIndex::search(const cv::Mat& query, int k) const {
+    Neighbors res;
+    if (listRows.empty()) return res;
+
+    CV_Assert(query.rows == 1 && query.type() == CV_32F && query.cols == listVectors.cols);
+    const int dim   = listVectors.cols;
+    const int lists = centroids.rows;
+    const float* q  = query.ptr<float>(0);
+
+    // Closest lists first
+    Neighbors probes;
+    probes.reserve(lists);
+    for (int c = 0; c < lists; ++c)
+        probes.emplace_back(c, cv::normL2Sqr<float, float>(q, centroids.ptr<float>(c), dim));
+    int np = std::max(1, std::min(numProbes, lists));
+    std::partial_sort(probes.begin(), probes.begin() + np, probes.end(),
+        [](auto& a, auto& b){ return a.second < b.second; });
+
+    for (int p = 0; p < np; ++p) {
+        int c = probes[p].first;
+        for (int pos = listStart[c]; pos < listStart[c + 1]; ++pos)
+            res.emplace_back(listRows[pos], cv::normL2Sqr<float, float>(q, listVectors.ptr<float>(pos), dim));
+    }
+
+    keepClosest(res, k);
+    return res;
+}
+
+size_t IVFIndex::memoryBytes() const {
+    return centroids.total() * centroids.elemSize() + listVectors.total() * listVectors.elemSize()
+         + (listStart.size() + listRows.size()) * sizeof(int);
+}
+
+// PQ INDEX
+
+// Dimensions per code byte when the number of subspaces isn't set
+constexpr int PQ_AUTO_SUBSPACE_DIMS = 8;
+constexpr int PQ_CENTROIDS          = 256;
+// k-means of every subspace is trained on at most this many rows
+constexpr int PQ_TRAIN_ROWS         = 64 * PQ_CENTROIDS;
+constexpr int PQ_KMEANS_ITERATIONS  = 15;
+
+PQIndex::PQIndex(int numSubspaces)
+    : numSubspaces(numSubspaces) {}
+
+void PQIndex::build(const cv::Mat& features) {
+    subspaceStart.assign(1, 0);
+    codebooks.clear();
+    codes.release();
+    if (features.empty()) return;
+
+    CV_Assert(features.type() == CV_32F);
+    const int n   = features.rows;
+    const int dim = features.cols;
+    int m = numSubspaces > 0 ? numSubspaces : (dim + PQ_AUTO_SUBSPACE_DIMS - 1) / PQ_AUTO_SUBSPACE_DIMS;
+    m = std::max(1, std::min(m, dim));
+    subspaceStart.resize(m + 1);
+    for (int s = 0; s <= m; ++s)
+        subspaceStart[s] = (int)((int64_t)dim * s / m);
+
+    const int trainRows = std::min(n, PQ_TRAIN_ROWS);
+    const int centroids = std::min(PQ_CENTROIDS, trainRows);
+    cv::Mat train(trainRows, dim, CV_32F);
+    for (int i = 0; i < trainRows; ++i)
+        features.row((int)((int64_t)i * n / trainRows)).copyTo(train.row(i));
+
+    // One codebook per subspace
+    codebooks.resize(m);
+    for (int s = 0; s < m; ++s) {
+        cv::Mat sub = train.colRange(subspaceStart[s], subspaceStart[s + 1]).clone();
+        cv::Mat labels;
+        cv::kmeans(sub, centroids, labels,
+                   cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, PQ_KMEANS_ITERATIONS, 1e-4),
+                   1, cv::KMEANS_PP_CENTERS, codebooks[s]);
+    }
+
+    // Encode every row
+    codes.create(n, m, CV_8U);
+    cv::parallel_for_(cv::Range(0, n), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            const float* row = features.ptr<float>(i);
+            uchar* code = codes.ptr<uchar>(i);
+            for (int s = 0; s < m; ++s) {
+                const int d0 = subspaceStart[s];
+                const int sd = subspaceStart[s + 1] - d0;
+                int best = 0;
+                float bestDist = std::numeric_limits<float>::max();
+                for (int c = 0; c < codebooks[s].rows; ++c) {
+                    float d = cv::normL2Sqr<float, float>(row + d0, codebooks[s].ptr<float>(c), sd);
+                    if (d < bestDist) {
+                        bestDist = d;
+                        best = c;
+                    }
+                }
+                code[s] = (uchar)best;
+            }
+        }
+    });
+}
+
+Neighbors PQIndex::search(const cv::Mat& query, int k) const {
+    if (codes.empty() || k <= 0) return {};
+
+    const int m = codes.cols;
+    CV_Assert(query.rows == 1 && query.type() == CV_32F && query.cols == subspaceStart[m]);
+    const float* q = query.ptr<float>(0);
+
+    // Squared distance of every subspace of the query to each of its centroids
+    std::vector<float> table((size_t)m * PQ_CENTROIDS, 0.0f);
+    for (int s = 0; s < m; ++s) {
+        const int d0 = subspaceStart[s];
+        const int sd = subspaceStart[s + 1] - d0;
+        for (int c = 0; c < codebooks[s].rows; ++c)
+            table[(size_t)s * PQ_CENTROIDS + c] = cv::normL2Sqr<float, float>(q + d0, codebooks[s].ptr<float>(c), sd);
+    }
+
+    // Stripes of rows are scanned in parallel, each into its own heap
+    const int n  = codes.rows;
+    const int kk = std::min(k, n);
+    const int numStripes = std::max(1, std::min(n, cv::getNumThreads()));
+    std::vector<TopK> stripeHeaps(numStripes);
+    cv::parallel_for_(cv::Range(0, numStripes), [&](const cv::Range& range) {
+        for (int stripe = range.start; stripe < range.end; ++stripe) {
+            TopK& heap = stripeHeaps[stripe];
+            heap.k = kk;
+            int r0 = (int)((int64_t)n * stripe / numStripes);
+            int r1 = (int)((int64_t)n * (stripe + 1) / numStripes);
+            for (int r = r0; r < r1; ++r) {
+                const uchar* code = codes.ptr<uchar>(r);
+                float d = 0.0f;
+                for (int s = 0; s < m; ++s)
+                    d += table[(size_t)s * PQ_CENTROIDS + code[s]];
+                heap.push(d, r);
+            }
+        }
+    });
+
+    TopK best;
+    best.k = kk;
+    for (auto& h : stripeHeaps)
+        for (auto& c : h.heap)
+            best.push(c.first, c.second);
+
+    Neighbors res;
+    res.reserve(best.heap.size());
+    for (auto& c : best.heap)
+        res.emplace_back(c.second, c.first);
+    keepClosest(res, kk);
+    return res;
+}
+
+size_t PQIndex::memoryBytes() const {
+    size_t bytes = codes.total() * codes.elemSize() + subspaceStart.size() * sizeof(int);
+    for (const auto& cb : codebooks)
+        bytes += cb.total() * cb.elemSize();
+    return bytes;
+}
+
+// IMAGE INDEX
+
+void ImageIndex::reserve(int rows, int dim) {
+    if (rows <= storage.rows && dim == storage.cols) return;
+    cv::Mat grown(rows, dim, CV_32F);
+    if (!features.empty()) {
+        CV_Assert(features.cols == dim);
+        features.copyTo(grown.rowRange(0, features.rows));
+    }
+    storage  = grown;
+    features = storage.rowRange(0, features.rows);
+}
+
+void ImageIndex::add(const std::string& fname, const cv::Mat& desc) {
+    CV_Assert(desc.rows == 1);
+    int n = (int)filenames.size();
+    if (storage.empty() || n == storage.rows)
+        reserve(std::max(16, 2 * n), desc.cols);
+    CV_Assert(desc.cols == storage.cols);
+    desc.convertTo(storage.row(n), CV_32F);
+    features = storage.rowRange(0, n + 1);
+    filenames.push_back(fname);
+}
+
+void ImageIndex::buildBackend(const IndexConfig& cfg) {
+    backend = createVectorIndex(cfg);
+    backend->build(features);
+}
+
+void ImageIndex::releaseFeatures() {
+    CV_Assert(backend);
+    features.release();
+    storage.release();
+}
+
+Neighbors ImageIndex::search(const cv::Mat& query, int k) const {
+    if (backend) return backend->search(query, k);
+    return FlatIndex::exactSearch(features, query, k);
+}
+
+std::vector<Neighbors> ImageIndex::searchBatch(const cv::Mat& queries, int k) const {
+    if (backend) return backend->searchBatch(queries, k);
+    FlatIndex flat;
+    flat.build(features);
+    return flat.searchBatch(queries, k);
+}
+
+// IMAGE INDEX BUILDER
+
+void ImageIndexBuilder::put(size_t slot, const std::string& fname, const cv::Mat& desc) {
+    CV_Assert(slot < filled.size() && desc.rows == 1);
+    std::call_once(allocated, [&]() {
+        storage.create((int)filled.size(), desc.cols, CV_32F);
+    });
+    CV_Assert(desc.cols == storage.cols);
+    desc.convertTo(storage.row((int)slot), CV_32F);
+    filenames[slot] = fname;
+    filled[slot]    = 1;
+}
+
+ImageIndex ImageIndexBuilder::finish() {
+    ImageIndex index;
+    int count = 0;
+    for (size_t slot = 0; slot < filled.size(); ++slot) {
+        if (!filled[slot]) continue;
+        if ((int)slot != count)
+            storage.row((int)slot).copyTo(storage.row(count));
+        index.filenames.push_back(std::move(filenames[slot]));
+        count++;
+    }
+    if (count > 0) {
+        index.storage  = storage;
+        index.features = storage.rowRange(0, count);
+    }
+    return index;
+}
+
+// INDEX FILE
+
+// Layout (native byte order), every array starting on a FILE_ALIGNMENT boundary:
+//   IndexFileHeader
+//   filenames: per row a uint32 length and its characters
+//   FILE_HAS_FEATURES: rows x dim float features, then rows float squared row norms
+//   FILE_HAS_PQ: int32 subspaces, subspaces + 1 int32 subspace starts, per subspace an int32
+//                centroid count and its float centroids, then rows x subspaces uint8 codes
+
+constexpr char     FILE_MAGIC[8]     = { 'S', 'P', 'X', 'I', 'N', 'D', 'E', 'X' };
+constexpr uint32_t FILE_VERSION      = 3;
+constexpr uint32_t FILE_HAS_FEATURES = 1;
+constexpr uint32_t FILE_HAS_PQ       = 2;
+constexpr size_t   FILE_ALIGNMENT    = 64;
+
+struct IndexFileHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t flags;
+    int32_t  featureType;
+    int32_t  descriptorMode;
+    int32_t  superpixelCellSize;
+    int32_t  dim;
+    int64_t  numSources;
+    int64_t  numRows;
+    uint64_t sourcesHash;
+    uint64_t settingsHash;
+};
+
+// Read-only mapping of a whole file, unmapped when the last index using it goes away
+class MappedFile {
+public:
+    static std::shared_ptr<MappedFile> open(const std::string& path) {
+        std::shared_ptr<MappedFile> file(new MappedFile());
+#ifdef _WIN32
+        file->handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file->handle == INVALID_HANDLE_VALUE) return nullptr;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file->handle, &size) || size.QuadPart == 0) return nullptr;
+        file->size = (size_t)size.QuadPart;
+        file->mapping = CreateFileMappingA(file->handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!file->mapping) return nullptr;
+        file->data = (const uchar*)MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return nullptr;
+        }
+        file->size = (size_t)st.st_size;
+        void* addr = mmap(nullptr, file->size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) return nullptr;
+        file->data = (const uchar*)addr;
+#endif
+        return file->data ? file : nullptr;
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+#else
+        if (data) munmap((void*)data, size);
+#endif
+    }
+
+    const uchar* data = nullptr;
+    size_t size = 0;
+
+private:
+    MappedFile() = default;
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+// Bounds-checked cursor over a mapped file
+struct FileReader {
+    const uchar* data;
+    size_t size;
+    size_t offset = 0;
+
+    const uchar* take(size_t bytes) {
+        if (bytes > size - offset) return nullptr;
+        const uchar* p = data + offset;
+        offset += bytes;
+        return p;
+    }
+
+    template <typename T>
+    bool read(T& value) {
+        const uchar* p = take(sizeof(T));
+        if (!p) return false;
+        std::memcpy(&value, p, sizeof(T));
+        return true;
+    }
+
+    bool align() {
+        size_t padded = (offset + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT * FILE_ALIGNMENT;
+        if (padded > size) return false;
+        offset = padded;
+        return true;
+    }
+};
+
+template <typename T>
+static void writeValue(std::ofstream& out, const T& value) {
+    out.write((const char*)&value, sizeof(T));
+}
+
+static void writeRows(std::ofstream& out, const cv::Mat& m) {
+    for (int i = 0; i < m.rows; ++i)
+        out.write((const char*)m.ptr(i), m.cols * m.elemSize());
+}
+
+static void alignOutput(std::ofstream& out) {
+    static const char zeros[FILE_ALIGNMENT] = {};
+    size_t pos = (size_t)out.tellp();
+    size_t padded = (pos + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT * FILE_ALIGNMENT;
+    out.write(zeros, padded - pos);
+}
+
+bool ImageIndex::save(const std::string& path, const IndexMetadata& meta) const {
+    const PQIndex* pq = dynamic_cast<const PQIndex*>(backend.get());
+    if (pq && pq->codes.empty()) pq = nullptr;
+    if (features.empty() && !pq) return false;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) return false;
+
+    IndexFileHeader header = {};
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version            = FILE_VERSION;
+    header.flags              = (features.empty() ? 0 : FILE_HAS_FEATURES) | (pq ? FILE_HAS_PQ : 0);
+    header.featureType        = meta.featureType;
+    header.descriptorMode     = meta.descriptorMode;
+    header.superpixelCellSize = meta.superpixelCellSize;
+    header.dim                = features.empty() ? pq->subspaceStart.back() : features.cols;
+    header.numSources         = meta.numSources;
+    header.numRows            = (int64_t)filenames.size();
+    header.sourcesHash        = meta.sourcesHash;
+    header.settingsHash       = meta.settingsHash;
+    writeValue(out, header);
+
+    for (const auto& name : filenames) {
+        writeValue(out, (uint32_t)name.size());
+        out.write(name.data(), name.size());
+    }
+
+    if (!features.empty()) {
+        const FlatIndex* flat = dynamic_cast<const FlatIndex*>(backend.get());
+        cv::Mat norms = (flat && flat->getRowNorms().rows == features.rows)
+            ? flat->getRowNorms() : squaredRowNorms(features);
+        alignOutput(out);
+        writeRows(out, features);
+        alignOutput(out);
+        writeRows(out, norms);
+    }
+
+    if (pq) {
+        alignOutput(out);
+        const int m = pq->codes.cols;
+        writeValue(out, (int32_t)m);
+        for (int start : pq->subspaceStart)
+            writeValue(out, (int32_t)start);
+        for (const auto& cb : pq->codebooks) {
+            writeValue(out, (int32_t)cb.rows);
+            writeRows(out, cb);
+        }
+        alignOutput(out);
+        writeRows(out, pq->codes);
+    }
+
+    return (bool)out;
+}
+
+bool ImageIndex::load(const std::string& path, ImageIndex& index, IndexMetadata& meta) {
+    std::shared_ptr<MappedFile> file = MappedFile::open(path);
+    if (!file) return false;
+
+    FileReader in{ file->data, file->size };
+    IndexFileHeader header;
+    if (!in.read(header) ||
+        std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 ||
+        header.version != FILE_VERSION ||
+        header.numRows < 0 || header.numRows > std::numeric_limits<int>::max() || header.dim <= 0)
+        return false;
+
+    const int rows = (int)header.numRows;
+    const int dim  = header.dim;
+
+    ImageIndex loaded;
+    loaded.filenames.reserve(rows);
+    for (int i = 0; i < rows; ++i) {
+        uint32_t length;
+        const uchar* name;
+        if (!in.read(length) || !(name = in.take(length))) return false;
+        loaded.filenames.emplace_back((const char*)name, length);
+    }
+
+    // cv::Mat headers over the read-only mapping, never written through
+    if (header.flags & FILE_HAS_FEATURES) {
+        const uchar* feats;
+        const uchar* norms;
+        if (!in.align() || !(feats = in.take((size_t)rows * dim * sizeof(float)))) return false;
+        if (!in.align() || !(norms = in.take((size_t)rows * sizeof(float)))) return false;
+        if (rows > 0) {
+            loaded.features = cv::Mat(rows, dim, CV_32F, (void*)feats);
+            loaded.storage  = loaded.features;
+            auto flat = std::make_shared<FlatIndex>();
+            flat->build(loaded.features, cv::Mat(rows, 1, CV_32F, (void*)norms));
+            loaded.backend = flat;
+        }
+    }
+
+    if (header.flags & FILE_HAS_PQ) {
+        int32_t m;
+        if (!in.align() || !in.read(m) || m <= 0 || m > dim) return false;
+        auto pq = std::make_shared<PQIndex>(m);
+        pq->subspaceStart.resize(m + 1);
+        for (int s = 0; s <= m; ++s) {
+            int32_t start;
+            if (!in.read(start) || start < 0 || start > dim) return false;
+            pq->subspaceStart[s] = start;
+        }
+        if (pq->subspaceStart.front() != 0 || pq->subspaceStart.back() != dim) return false;
+        pq->codebooks.resize(m);
+        for (int s = 0; s < m; ++s) {
+            int32_t centroids;
+            const int sd = pq->subspaceStart[s + 1] - pq->subspaceStart[s];
+            const uchar* cb;
+            if (!in.read(centroids) || centroids <= 0 || centroids > PQ_CENTROIDS || sd <= 0 ||
+                !(cb = in.take((size_t)centroids * sd * sizeof(float))))
+                return false;
+            // Small enough to copy, and the unaligned float rows are read safely that way
+            pq->codebooks[s].create(centroids, sd, CV_32F);
+            std::memcpy(pq->codebooks[s].ptr(), cb, (size_t)centroids * sd * sizeof(float));
+        }
+        const uchar* codes;
+        if (!in.align() || !(codes = in.take((size_t)rows * m))) return false;
+        // Codebooks of small indexes have fewer than PQ_CENTROIDS rows, so every code has to
+        // name a centroid of its own subspace
+        for (int64_t i = 0; i < (int64_t)rows * m; ++i)
+            if (codes[i] >= pq->codebooks[i % m].rows) return false;
+        if (rows > 0) {
+            pq->codes   = cv::Mat(rows, m, CV_8U, (void*)codes);
+            pq->mapping = file;
+            loaded.backend = pq;
+        }
+    }
+
+    meta.featureType        = header.featureType;
+    meta.descriptorMode     = header.descriptorMode;
+    meta.superpixelCellSize = header.superpixelCellSize;
+    meta.numSources         = header.numSources;
+    meta.sourcesHash        = header.sourcesHash;
+    meta.settingsHash       = header.settingsHash;
+    loaded.mapping = file;
+    index = std::move(loaded);
+    return true;
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// NEAREST-NEIGHBOR BACKENDS
+
+enum class IndexType { FLAT, IVF, PQ };
+
+struct IndexConfig {
+    IndexType type = IndexType::FLAT;
+    int ivfLists   = 0;   // IVF coarse clusters, 0 for about sqrt(N)
+    int ivfProbes  = 8;   // IVF clusters scanned per query, more for recall, fewer for speed
+    int pqSubspaces = 0;  // PQ code bytes per row, 0 for one per 8 dimensions
+};
+
+std::string indexConfigToString(const IndexConfig& cfg);
+
+// (row, L2 distance) pairs, closest first
+using Neighbors = std::vector<std::pair<int, float>>;
+
+// Nearest neighbors of a query among the rows of a CV_32F feature matrix
+class VectorIndex {
+public:
+    virtual ~VectorIndex() = default;
+
+    virtual void build(const cv::Mat& features) = 0;
+    virtual Neighbors search(const cv::Mat& query, int k) const = 0;
+
+    // Neighbors of every row of queries, one query at a time unless a backend batches them
+    virtual std::vector<Neighbors> searchBatch(const cv::Mat& queries, int k) const;
+
+    // Bytes the backend keeps for searching (features it shares with the caller included)
+    virtual size_t memoryBytes() const = 0;
+};
+
+std::unique_ptr<VectorIndex> createVectorIndex(const IndexConfig& cfg);
+
+// Exact search against every row. Squared distances are expanded into
+// ||q||^2 - 2 q.x + ||x||^2 with the row norms precomputed, so blocks of queries are compared
+// against cache-sized blocks of rows with one GEMM each, in parallel. The top K of every query
+// get their distance recomputed directly, so reported distances don't carry the expansion's
+// rounding.
+class FlatIndex : public VectorIndex {
+public:
+    void build(const cv::Mat& features) override;
+    // With row norms computed before (e.g. loaded along with the features)
+    void build(const cv::Mat& features, const cv::Mat& rowNorms);
+    Neighbors search(const cv::Mat& query, int k) const override;
+    std::vector<Neighbors> searchBatch(const cv::Mat& queries, int k) const override;
+    size_t memoryBytes() const override;
+
+    const cv::Mat& getRowNorms() const { return rowNorms; }
+
+    // Without a built index (the row norms are computed on the fly)
+    static Neighbors exactSearch(const cv::Mat& features, const cv::Mat& query, int k);
+    static std::vector<Neighbors> exactSearchBatch(const cv::Mat& features, const cv::Mat& rowNorms,
+                                                   const cv::Mat& queries, int k);
+
+private:
+    cv::Mat features;
+    cv::Mat rowNorms;   // N x 1 squared norms of the rows of features
+};
+
+// Inverted file index: rows are bucketed by their nearest k-means centroid, and a query only
+// scans the rows of the numProbes centroids closest to it
+class IVFIndex : public VectorIndex {
+public:
+    explicit IVFIndex(int numLists = 0, int numProbes = 8);
+
+    void setNumProbes(int probes) { numProbes = probes; }
+
+    void build(const cv::Mat& features) override;
+    Neighbors search(const cv::Mat& query, int k) const override;
+    size_t memoryBytes() const override;
+
+private:
+    int numLists;
+    int numProbes;
+    cv::Mat centroids;            // numLists x D
+    std::vector<int> listStart;   // rows of list l are listRows[listStart[l] .. listStart[l + 1])
+    std::vector<int> listRows;    // original row of every list entry
+    cv::Mat listVectors;          // features reordered by list, so every list is contiguous
+};
+
+// Product quantization: every row is split into numSubspaces consecutive (near equal) groups
+// of dimensions and each group is stored as the uint8 index of its nearest of 256 k-means
+// centroids. A query precomputes its squared distance to every centroid of every subspace,
+// then the (asymmetric) distance to a row is the sum of one table lookup per code byte.
+// Distances are approximations; the float features aren't kept.
+class PQIndex : public VectorIndex {
+public:
+    explicit PQIndex(int numSubspaces = 0);
+
+    void build(const cv::Mat& features) override;
+    Neighbors search(const cv::Mat& query, int k) const override;
+    size_t memoryBytes() const override;
+
+private:
+    friend struct ImageIndex;   // saves and loads the codes
+
+    int numSubspaces;
+    std::vector<int> subspaceStart;   // dimensions of subspace m are [subspaceStart[m], subspaceStart[m + 1])
+    std::vector<cv::Mat> codebooks;   // per subspace, centroids x subspace dimensions
+    cv::Mat codes;                    // N x numSubspaces CV_8U
+    std::shared_ptr<void> mapping;    // index file the codes point into, if loaded
+};
+
+// IMAGE INDEX
+
+// What an index file was built from, so a stale file can be told apart
+struct IndexMetadata {
+    int     featureType        = 0;   // FeatureType
+    int     descriptorMode     = 0;   // DescriptorMode
+    int     superpixelCellSize = 0;
+    int64_t numSources         = 0;   // images the index was built from (failed ones included)
+    uint64_t sourcesHash       = 0;   // hash of the images' sorted paths, sizes and modification times
+    uint64_t settingsHash      = 0;   // hash of the settings the descriptors were built with
+};
+
+struct ImageIndex {
+    std::vector<std::string> filenames;
+    cv::Mat features;   // first filenames.size() rows of storage
+    cv::Mat storage;    // reserved rows, grown by doubling when add() runs out
+    std::shared_ptr<VectorIndex> backend;   // exact search over features when not set
+    std::shared_ptr<void> mapping;          // index file features point into, if loaded
+
+    void reserve(int rows, int dim);
+    void add(const std::string& fname, const cv::Mat& desc);
+
+    // (Re)builds the backend over the current features
+    void buildBackend(const IndexConfig& cfg);
+
+    // Frees the float features once a backend that doesn't share them (IVF, PQ) is built,
+    // e.g. to only keep PQ codes in memory
+    void releaseFeatures();
+
+    Neighbors search(const cv::Mat& query, int k) const;
+    std::vector<Neighbors> searchBatch(const cv::Mat& queries, int k) const;
+
+    // Writes the filenames, the float features (with their row norms) if still kept, and the
+    // codes of a PQ backend to a versioned binary file
+    bool save(const std::string& path, const IndexMetadata& meta) const;
+
+    // Maps a file written by save() read-only into memory. features (and PQ codes) point
+    // straight into the mapping, so nothing is copied and processes loading the same file
+    // share its page cache. The backend is the loaded PQ index, or else a FlatIndex.
+    static bool load(const std::string& path, ImageIndex& index, IndexMetadata& meta);
+};
+
+// Fills an ImageIndex from several worker threads at once. The feature matrix is allocated
+// once for every slot (on the first descriptor, when its width is known) and each worker
+// writes its descriptor straight into its slot's row. finish() drops the slots of images that
+// failed, keeping the others in slot order.
+class ImageIndexBuilder {
+public:
+    explicit ImageIndexBuilder(size_t numSlots)
+        : filenames(numSlots), filled(numSlots, 0) {}
+
+    // Thread safe, as long as every slot is put at most once
+    void put(size_t slot, const std::string& fname, const cv::Mat& desc);
+
+    ImageIndex finish();
+
+private:
+    std::vector<std::string> filenames;
+    std::vector<char>        filled;
+    cv::Mat                  storage;
+    std::once_flag           allocated;
+};
@@ -1,4 +1,5 @@
 #include <opencv2/opencv.hpp>
+#include <opencv2/core/ocl.hpp>
 #include <filesystem>
 #include <iostream>
 #include <vector>
@@ -13,23 +14,30 @@
 #include <chrono>
 #include <cmath>
 #include <array>
-#include "json.hpp"
+#include <memory>
+#include <tuple>
+#include <functional>
 #include "sdp_slic.hpp"
+#include "image_index.hpp"
+#include "descriptor_cache.hpp"
+#include "bounded_queue.hpp"
+#include "query_server.hpp"
+#include "coco_labels.hpp"
+#include "search_config.hpp"
 
 namespace fs = std::filesystem;
-using json   = nlohmann::json;
 
-// PATH CONFIG
-const std::string DATA_ROOT = "../../SuperpixelImageSearch/data";
-const std::string INDEX_DIR = DATA_ROOT + "/coco2017/images/train2017";
-const std::string QUERY_IMG = DATA_ROOT + "/coco2017/images/val2017/000000000139.jpg";
+// PATH CONFIG (DATA_ROOT, OUTPUT_ROOT, INDEX_DIR, QUERY_IMG and DESCRIPTOR_CACHE_DIR are in search_config.hpp)
 const std::string TRAIN_ANN = DATA_ROOT + "/coco2017/annotations/annotations/instances_train2017.json";
 const std::string VAL_ANN   = DATA_ROOT + "/coco2017/annotations/annotations/instances_val2017.json";
+const std::string INDEX_CACHE_DIR = OUTPUT_ROOT + "/index/";
+const std::string COCO_LABEL_CACHE_DIR = DESCRIPTOR_CACHE_DIR + "/labels";
 
-// EXPERIMENT CONFIG
+// EXPERIMENT CONFIG (TOP_K and DESCRIPTOR_CACHE_TAG are in search_config.hpp)
 constexpr size_t MAX_IMAGES     = 2250;
 constexpr bool   USE_ALL_IMAGES = true;
-constexpr int    TOP_K          = 5;
+constexpr bool   REUSE_SAVED_INDEX = true;   // map the index saved by an earlier run instead of rebuilding it
+constexpr bool   USE_DESCRIPTOR_CACHE = true;  // cache descriptors, keypoints and SD-SLIC labels by image content
 
 // four cell sizes to test for SUPERPIXEL_SPATIAL
 constexpr int SUPERPIXEL_SIZE_1 = 8;
@@ -52,9 +60,26 @@ constexpr int   SDSLIC_REGION_SIZE        = 100;
 constexpr float SDSLIC_SMOOTHNESS         = 10.0f;
 constexpr int   SDSLIC_MIN_SIZE_PERCENT   = 4;
 constexpr int   SDSLIC_ITERATIONS         = 10;
-constexpr float SDSLIC_HIST_DISTANCE      = 2.0f;
+constexpr float SDSLIC_LABEL_CHANGE_TOLERANCE = 0.001f;  // stop iterating once < 0.1% of pixels change label
+constexpr int   SDSLIC_PYRAMID_MIN_PIXELS = 4000000;  // iterate coarse-to-fine from about 4 MP up
+constexpr int   SDSLIC_PYRAMID_LEVELS     = 2;
 constexpr int   SDSLIC_HIST_BUCKETS[3]    = {8, 64, 64};
 constexpr int   CUSTOM_FIXED_REGIONS      = 64;
+constexpr bool  SDSLIC_LOW_MEMORY         = true;   // many images are segmented at once while indexing
+constexpr bool  SDSLIC_USE_OPENCL         = false;  // iterate on the OpenCL device (labels close to, not the same as, the CPU's)
+
+// Nearest-neighbor backends every experiment is searched with, exact first
+const std::vector<IndexConfig> INDEX_BACKENDS = {
+    { IndexType::FLAT },
+    { IndexType::IVF, 0, 8 },
+    { IndexType::PQ },
+};
+
+// QUERY SERVER CONFIG (superpixel_ris --serve [experiment])
+const std::string SERVER_EXPERIMENT     = "SIFT_SUPERPIXEL_SPATIAL_32";
+const IndexConfig SERVER_BACKEND        = { IndexType::FLAT };   // IVF or PQ for large indexes
+constexpr int     SERVER_THREADS        = 0;     // query workers, 0 for one per core
+constexpr size_t  SERVER_QUEUE_CAPACITY = 256;   // queued queries before the reader blocks
 
 // BASIC TYPES
 
@@ -74,83 +99,6 @@ std::string descriptorModeToString(DescriptorMode m) {
     }
 }
 
-// DATA INDEXING FOR COCO LABELS
-
-struct COCOLabelIndex {
-    std::unordered_map<std::string, std::unordered_set<int>> imageToCats;
-    std::unordered_map<int, std::string> catIdToName;
-};
-
-void loadCOCOAnnotations(const std::string& annPath, COCOLabelIndex& index) {
-    std::ifstream f(annPath);
-    if (!f.is_open()) {
-        std::cerr << "Could not open COCO annotation file: " << annPath << "\n";
-        return;
-    }
-
-    json j;
-    f >> j;
-
-    if (j.contains("categories")) {
-        for (const auto& category : j["categories"]) {
-            int id = category.value("id", -1);
-            std::string name = category.value("name", "");
-            if (id >= 0 && !name.empty())
-                index.catIdToName[id] = name;
-        }
-    }
-
-    std::unordered_map<int, std::string> imageIdToFile;
-    if (j.contains("images")) {
-        for (const auto& img : j["images"]) {
-            int id = img.value("id", -1);
-            std::string fname = img.value("file_name", "");
-            if (id >= 0 && !fname.empty())
-                imageIdToFile[id] = fname;
-        }
-    }
-
-    if (j.contains("annotations")) {
-        for (const auto& ann : j["annotations"]) {
-            int imgId = ann.value("image_id", -1);
-            int catId = ann.value("category_id", -1);
-            if (imgId < 0 || catId < 0) continue;
-
-            auto it = imageIdToFile.find(imgId);
-            if (it == imageIdToFile.end()) continue;
-
-            index.imageToCats[it->second].insert(catId);
-        }
-    }
-
-    std::cout << "Loaded COCO annotations from: " << annPath << "\n";
-}
-
-std::vector<int> getCategoriesForImage(const COCOLabelIndex& index,
-                                       const std::string& fullPath) {
-    std::string fname = fs::path(fullPath).filename().string();
-    auto it = index.imageToCats.find(fname);
-    if (it == index.imageToCats.end()) return {};
-    return std::vector<int>(it->second.begin(), it->second.end());
-}
-
-std::string catIdsToString(const std::vector<int>& ids,
-                           const COCOLabelIndex& index) {
-    std::vector<std::string> names;
-    names.reserve(ids.size());
-    for (int id : ids) {
-        auto it = index.catIdToName.find(id);
-        names.push_back(it != index.catIdToName.end() ? it->second : ("id_" + std::to_string(id)));
-    }
-    std::sort(names.begin(), names.end());
-    std::string out;
-    for (size_t i = 0; i < names.size(); ++i) {
-        if (i > 0) out += "|";
-        out += names[i];
-    }
-    return out;
-}
-
 // GRID SUPERPIXEL GENERATION
 
 void makeGridSuperpixels(const cv::Mat& bgr,
@@ -177,6 +125,138 @@ void makeGridSuperpixels(const cv::Mat& bgr,
     numSuperpixels = gridX * gridY;
 }
 
+// SEGMENTATION RESULT
+
+// One segmentation of an image and what's derived from it, built once so the descriptor and
+// the visualizations of a query share it instead of segmenting the image again
+struct SegmentationResult {
+    cv::Size imageSize;            // size of the image that was segmented
+    cv::Mat bgr;                   // image the labels cover (downsized for grid superpixels)
+    cv::Mat labels;                // CV_32S region of every pixel of bgr
+    int numRegions = 0;
+    cv::Mat contourMask;           // CV_8U, 255 on region boundaries (like getLabelContourMask(mask, true))
+    cv::Mat meanBGR;               // numRegions x 3 CV_32F mean color of every region
+    std::vector<int> pixelCounts;  // pixels of every region
+    cv::Mat descriptor;            // descriptor built from the segmentation
+};
+
+// Fills the contour mask and region statistics of a segmentation in one pass over its labels.
+// A pixel is a contour pixel when more than 2 of its 8 neighbors have another label, not
+// counting neighbors before it that are contour pixels already, as getLabelContourMask() does.
+void summarizeRegions(SegmentationResult& seg) {
+    CV_Assert(seg.bgr.type() == CV_8UC3);
+    CV_Assert(seg.labels.type() == CV_32S && seg.labels.size() == seg.bgr.size());
+    const int h = seg.labels.rows, w = seg.labels.cols;
+
+    seg.contourMask.create(h, w, CV_8U);
+    seg.meanBGR = cv::Mat::zeros(seg.numRegions, 3, CV_32F);
+    seg.pixelCounts.assign(seg.numRegions, 0);
+
+    for (int y = 0; y < h; ++y) {
+        const int* prev = y > 0 ? seg.labels.ptr<int>(y - 1) : nullptr;
+        const int* cur  = seg.labels.ptr<int>(y);
+        const int* next = y + 1 < h ? seg.labels.ptr<int>(y + 1) : nullptr;
+        const uchar* maskPrev = y > 0 ? seg.contourMask.ptr<uchar>(y - 1) : nullptr;
+        uchar* maskCur = seg.contourMask.ptr<uchar>(y);
+        const cv::Vec3b* inRow = seg.bgr.ptr<cv::Vec3b>(y);
+
+        for (int x = 0; x < w; ++x) {
+            const int l = cur[x];
+            if (l >= 0 && l < seg.numRegions) {
+                float* mean = seg.meanBGR.ptr<float>(l);
+                mean[0] += inRow[x][0];
+                mean[1] += inRow[x][1];
+                mean[2] += inRow[x][2];
+                seg.pixelCounts[l]++;
+            }
+
+            const bool left = x > 0, right = x + 1 < w;
+            int np = 0;
+            if (left && !maskCur[x - 1] && cur[x - 1] != l) np++;
+            if (right && cur[x + 1] != l) np++;
+            if (prev) {
+                if (left && !maskPrev[x - 1] && prev[x - 1] != l) np++;
+                if (!maskPrev[x] && prev[x] != l) np++;
+                if (right && !maskPrev[x + 1] && prev[x + 1] != l) np++;
+            }
+            if (next) {
+                if (left && next[x - 1] != l) np++;
+                if (next[x] != l) np++;
+                if (right && next[x + 1] != l) np++;
+            }
+            maskCur[x] = np > 2 ? 255 : 0;
+        }
+    }
+
+    for (int r = 0; r < seg.numRegions; ++r) {
+        if (seg.pixelCounts[r] > 0) {
+            float* mean = seg.meanBGR.ptr<float>(r);
+            mean[0] /= seg.pixelCounts[r];
+            mean[1] /= seg.pixelCounts[r];
+            mean[2] /= seg.pixelCounts[r];
+        }
+    }
+}
+
+// DESCRIPTOR CACHE CONTEXT
+
+// Cache entry of the image whose descriptors are being built on this thread, if any, so
+// keypoints and label maps computed for one config are reused by the others
+static thread_local CachedImage* currentCachedImage = nullptr;
+
+struct CachedImageScope {
+    explicit CachedImageScope(CachedImage* image) : previous(currentCachedImage) { currentCachedImage = image; }
+    ~CachedImageScope() { currentCachedImage = previous; }
+    CachedImage* previous;
+};
+
+cv::Mat keypointsToMat(const std::vector<cv::KeyPoint>& keypoints) {
+    cv::Mat m((int)keypoints.size(), 7, CV_32F);
+    for (int i = 0; i < m.rows; ++i) {
+        const cv::KeyPoint& k = keypoints[i];
+        float* row = m.ptr<float>(i);
+        row[0] = k.pt.x;     row[1] = k.pt.y;     row[2] = k.size; row[3] = k.angle;
+        row[4] = k.response; row[5] = (float)k.octave; row[6] = (float)k.class_id;
+    }
+    return m;
+}
+
+std::vector<cv::KeyPoint> matToKeypoints(const cv::Mat& m) {
+    std::vector<cv::KeyPoint> keypoints(m.rows);
+    for (int i = 0; i < m.rows; ++i) {
+        const float* row = m.ptr<float>(i);
+        keypoints[i] = cv::KeyPoint(row[0], row[1], row[2], row[3], row[4], (int)row[5], (int)row[6]);
+    }
+    return keypoints;
+}
+
+// SIFT and ORB descriptors are whole numbers in [0, 255], so they're cached losslessly as bytes
+cv::Mat compactDescriptors(const cv::Mat& desc) {
+    if (desc.empty()) return desc;
+    cv::Mat bytes, back;
+    desc.convertTo(bytes, CV_8U);
+    bytes.convertTo(back, CV_32F);
+    return cv::norm(back, desc, cv::NORM_INF) == 0.0 ? bytes : desc;
+}
+
+// Label maps are cached as 16-bit PNGs, a small fraction of their int size
+cv::Mat encodeLabels(const cv::Mat& labels, int numLabels) {
+    if (numLabels > 65536) return labels;
+    cv::Mat labels16;
+    labels.convertTo(labels16, CV_16U);
+    std::vector<uchar> png;
+    if (!cv::imencode(".png", labels16, png)) return labels;
+    return cv::Mat(1, (int)png.size(), CV_8U, png.data()).clone();
+}
+
+cv::Mat decodeLabels(const cv::Mat& cached) {
+    if (cached.type() == CV_32S) return cached;
+    cv::Mat labels16 = cv::imdecode(cached, cv::IMREAD_UNCHANGED);
+    cv::Mat labels;
+    labels16.convertTo(labels, CV_32S);
+    return labels;
+}
+
 // FEATURE EXTRACTION
 
 void computeFeatures(const cv::Mat& gray,
@@ -184,6 +264,19 @@ void computeFeatures(const cv::Mat& gray,
                      std::vector<cv::KeyPoint>& keypoints,
                      cv::Mat& descriptors,
                      int& descDim) {
+    // Keypoints depend on the image size as well, e.g. full size vs SUPERPIXEL_RESIZE
+    const std::string cacheName = featureCacheName(featureTypeToString(type), gray.cols, gray.rows);
+    cv::Mat cachedKeypoints;
+    if (currentCachedImage &&
+        currentCachedImage->get(cacheName + KEYPOINTS_CACHE_SUFFIX, cachedKeypoints) &&
+        currentCachedImage->get(cacheName + DESCRIPTORS_CACHE_SUFFIX, descriptors)) {
+        keypoints = matToKeypoints(cachedKeypoints);
+        descDim   = descriptors.cols;
+        if (descriptors.type() != CV_32F)
+            descriptors.convertTo(descriptors, CV_32F);
+        return;
+    }
+
     if (type == FeatureType::SIFT) {
         auto sift = cv::SIFT::create();
         sift->detectAndCompute(gray, cv::noArray(), keypoints, descriptors);
@@ -199,6 +292,11 @@ void computeFeatures(const cv::Mat& gray,
     } else if (descriptors.type() != CV_32F) {
         descriptors.convertTo(descriptors, CV_32F);
     }
+
+    if (currentCachedImage) {
+        currentCachedImage->put(cacheName + KEYPOINTS_CACHE_SUFFIX, keypointsToMat(keypoints));
+        currentCachedImage->put(cacheName + DESCRIPTORS_CACHE_SUFFIX, compactDescriptors(descriptors));
+    }
 }
 
 cv::Mat globalDescriptorMean(const cv::Mat& desc, int dim) {
@@ -210,16 +308,21 @@ cv::Mat globalDescriptorMean(const cv::Mat& desc, int dim) {
     return mean;
 }
 
+// numRegions is one more than the largest label, looked up in the labels when not given
 std::vector<std::vector<int>> assignKeypointsToSuperpixels(
     const std::vector<cv::KeyPoint>& keypoints,
-    const cv::Mat& labels) {
+    const cv::Mat& labels,
+    int numRegions = -1) {
 
     CV_Assert(labels.type() == CV_32S);
     int h = labels.rows, w = labels.cols;
 
-    double minVal, maxVal;
-    cv::minMaxLoc(labels, &minVal, &maxVal);
-    int numSp = static_cast<int>(maxVal) + 1;
+    int numSp = numRegions;
+    if (numSp < 0) {
+        double minVal, maxVal;
+        cv::minMaxLoc(labels, &minVal, &maxVal);
+        numSp = static_cast<int>(maxVal) + 1;
+    }
 
     std::vector<std::vector<int>> spToIndices(numSp);
     for (int i = 0; i < (int)keypoints.size(); ++i) {
@@ -227,7 +330,7 @@ std::vector<std::vector<int>> assignKeypointsToSuperpixels(
         int y = static_cast<int>(std::round(keypoints[i].pt.y));
         if (x >= 0 && x < w && y >= 0 && y < h) {
             int sp = labels.at<int>(y, x);
-            spToIndices[sp].push_back(i);
+            if (sp >= 0 && sp < numSp) spToIndices[sp].push_back(i);
         }
     }
     return spToIndices;
@@ -294,7 +397,7 @@ cv::Mat buildRegionDescriptor(const cv::Mat& bgr,
     labMean.at<float>(0, 1) = (float)labMeanScalar[1];
     labMean.at<float>(0, 2) = (float)labMeanScalar[2];
 
-    auto spToIdx = assignKeypointsToSuperpixels(keypoints, labels);
+    auto spToIdx = assignKeypointsToSuperpixels(keypoints, labels, numRegions);
 
     int finalRegions = (fixedNumRegions > 0 ? fixedNumRegions : numRegions);
     cv::Mat regionMeans = cv::Mat::zeros(finalRegions, descDim, CV_32F);
@@ -325,197 +428,182 @@ cv::Mat buildRegionDescriptor(const cv::Mat& bgr,
 
 // SUPERPIXEL-SPATIAL DESCRIPTOR
 
-cv::Mat buildSuperpixelDescriptor(const cv::Mat& bgr,
-                                  FeatureType type,
-                                  int cellSize) {
+// Grid superpixels of the image downsized to SUPERPIXEL_RESIZE
+SegmentationResult segmentGrid(const cv::Mat& bgr, int cellSize) {
     CV_Assert(bgr.type() == CV_8UC3);
     CV_Assert(cellSize > 0);
 
-    cv::Mat bgrSmall;
-    cv::resize(bgr, bgrSmall,
+    SegmentationResult seg;
+    seg.imageSize = bgr.size();
+    cv::resize(bgr, seg.bgr,
                cv::Size(SUPERPIXEL_RESIZE_WIDTH, SUPERPIXEL_RESIZE_HEIGHT));
+    makeGridSuperpixels(seg.bgr, seg.labels, seg.numRegions, cellSize);
+    return seg;
+}
 
-    cv::Mat labels;
-    int numSp = 0;
-    makeGridSuperpixels(bgrSmall, labels, numSp, cellSize);
-
-    return buildRegionDescriptor(bgrSmall, labels, numSp, type, numSp);
+// segmentation, if given, gets the grid with its contours, region statistics and the descriptor
+cv::Mat buildSuperpixelDescriptor(const cv::Mat& bgr,
+                                  FeatureType type,
+                                  int cellSize,
+                                  SegmentationResult* segmentation = nullptr) {
+    SegmentationResult seg = segmentGrid(bgr, cellSize);
+    seg.descriptor = buildRegionDescriptor(seg.bgr, seg.labels, seg.numRegions, type, seg.numRegions);
+
+    if (segmentation) {
+        summarizeRegions(seg);
+        *segmentation = seg;
+    }
+    return seg.descriptor;
 }
 
 // CUSTOM DESCRIPTOR (SD-SLIC, fixed 64 regions)
 
-cv::Mat buildCustomDescriptor(const cv::Mat& bgr, FeatureType type) {
+// Every parameter segmentSDSLIC() passes to the SLIC object, so changing any of them misses the
+// cached label maps and CUSTOM descriptors
+std::string sdslicSettingsName() {
+    return "sdslic_" + std::to_string(SDSLIC_REGION_SIZE) + "_" + std::to_string(SDSLIC_SMOOTHNESS) + "_" +
+           std::to_string(SDSLIC_MIN_SIZE_PERCENT) + "_" + std::to_string(SDSLIC_ITERATIONS) + "_" +
+           std::to_string(SDSLIC_LABEL_CHANGE_TOLERANCE) + "_" +
+           std::to_string(SDSLIC_PYRAMID_MIN_PIXELS) + "_" + std::to_string(SDSLIC_PYRAMID_LEVELS) + "_" +
+           std::to_string(SDSLIC_HIST_BUCKETS[0]) + "x" + std::to_string(SDSLIC_HIST_BUCKETS[1]) + "x" +
+           std::to_string(SDSLIC_HIST_BUCKETS[2]) + "_" +
+           (SDSLIC_LOW_MEMORY ? "lowmem" : "fullmem") + "_" + (SDSLIC_USE_OPENCL ? "ocl" : "cpu") + "_" +
+           std::to_string(CUSTOM_FIXED_REGIONS);
+}
+
+std::string sdslicCacheName(const cv::Mat& bgr) {
+    return DESCRIPTOR_CACHE_TAG + "_" + sdslicSettingsName() + "_" +
+           std::to_string(bgr.cols) + "x" + std::to_string(bgr.rows);
+}
+
+// SD-SLIC super-duper-pixels of the image, CUSTOM_FIXED_REGIONS of them
+SegmentationResult segmentSDSLIC(const cv::Mat& bgr) {
     CV_Assert(bgr.type() == CV_8UC3);
 
+    SegmentationResult seg;
+    seg.imageSize = bgr.size();
+    seg.bgr = bgr;
+
+    // The SD-SLIC label map doesn't depend on the feature type
+    const std::string cacheName = sdslicCacheName(bgr);
+    cv::Mat cachedLabels, cachedCount;
+    if (currentCachedImage &&
+        currentCachedImage->get(cacheName, cachedLabels) &&
+        currentCachedImage->get(cacheName + "_count", cachedCount)) {
+        seg.labels = decodeLabels(cachedLabels);
+        seg.numRegions = cachedCount.at<int>(0);
+        return seg;
+    }
+
     cv::Mat lab;
     cv::cvtColor(bgr, lab, cv::COLOR_BGR2Lab);
 
-    cv::Ptr<SuperpixelSLIC> slic =
-        createSuperpixelSLIC(lab, SLIC, SDSLIC_REGION_SIZE, SDSLIC_SMOOTHNESS);
-
+    // Same-sized images segmented on a thread reuse the buffers of the last one
+    static thread_local cv::Ptr<SegmentationWorkspace> workspace = cv::makePtr<SegmentationWorkspace>();
+    // Iterates on the GPU only when asked to and OpenCL is available
+    cv::Ptr<SuperpixelSLIC> slic = SDSLIC_USE_OPENCL && cv::ocl::useOpenCL()
+        ? createSuperpixelSLIC(lab.getUMat(cv::ACCESS_READ), workspace, SLIC, SDSLIC_REGION_SIZE, SDSLIC_SMOOTHNESS)
+        : createSuperpixelSLIC(lab, workspace, SLIC, SDSLIC_REGION_SIZE, SDSLIC_SMOOTHNESS);
+
+    slic->setConvergenceCriterion(SLIC_CONVERGENCE_LABEL_CHANGE, SDSLIC_LABEL_CHANGE_TOLERANCE);
+    // Many images are segmented at once while indexing, so keep each one small
+    slic->setLowMemory(SDSLIC_LOW_MEMORY);
+    if (static_cast<int>(bgr.total()) >= SDSLIC_PYRAMID_MIN_PIXELS)
+        slic->setPyramid(SDSLIC_PYRAMID_LEVELS);
     slic->iterate(SDSLIC_ITERATIONS);
     slic->enforceLabelConnectivity(SDSLIC_MIN_SIZE_PERCENT);
-    slic->duperizeWithHistogram(SDSLIC_HIST_BUCKETS, SDSLIC_HIST_DISTANCE);
+    // Merge closest regions first until exactly CUSTOM_FIXED_REGIONS are left
+    slic->duperizeBestFirstWithHistogram(SDSLIC_HIST_BUCKETS, std::numeric_limits<float>::max(),
+                                         CUSTOM_FIXED_REGIONS);
 
-    cv::Mat labels;
-    slic->getLabels(labels);
-    int numRegions = slic->getNumberOfSuperpixels();
-
-    cv::Mat labelsClamped = labels;
-    if (numRegions > CUSTOM_FIXED_REGIONS) {
-        labelsClamped = cv::Mat(labels.size(), CV_32S);
-        for (int y = 0; y < labels.rows; ++y) {
-            const int* inRow  = labels.ptr<int>(y);
-            int*       outRow = labelsClamped.ptr<int>(y);
-            for (int x = 0; x < labels.cols; ++x) {
-                int sp = inRow[x];
-                if (sp >= CUSTOM_FIXED_REGIONS) sp = CUSTOM_FIXED_REGIONS - 1;
-                outRow[x] = sp;
-            }
-        }
-        numRegions = CUSTOM_FIXED_REGIONS;
-    }
+    slic->getLabels(seg.labels);
+    seg.numRegions = slic->getNumberOfSuperpixels();
 
-    return buildRegionDescriptor(bgr, labelsClamped, numRegions, type, CUSTOM_FIXED_REGIONS);
+    if (currentCachedImage) {
+        currentCachedImage->put(cacheName, encodeLabels(seg.labels, seg.numRegions));
+        currentCachedImage->put(cacheName + "_count", cv::Mat(1, 1, CV_32S, cv::Scalar(seg.numRegions)));
+    }
+    return seg;
 }
 
-// VISUALS
-
-cv::Mat visualizeGridSuperpixels(const cv::Mat& bgr, int cellSize) {
-    CV_Assert(bgr.type() == CV_8UC3);
-    CV_Assert(cellSize > 0);
-
-    cv::Mat bgrSmall;
-    cv::resize(bgr, bgrSmall,
-               cv::Size(SUPERPIXEL_RESIZE_WIDTH, SUPERPIXEL_RESIZE_HEIGHT));
-
-    cv::Mat labels;
-    int numSp = 0;
-    makeGridSuperpixels(bgrSmall, labels, numSp, cellSize);
-
-    int h = bgrSmall.rows, w = bgrSmall.cols;
-
-    cv::Mat meanBGR = cv::Mat::zeros(numSp, 3, CV_32F);
-    std::vector<int> counts(numSp, 0);
+// segmentation, if given, gets the super-duper-pixels with their contours, region statistics and the descriptor
+cv::Mat buildCustomDescriptor(const cv::Mat& bgr, FeatureType type, SegmentationResult* segmentation = nullptr) {
+    SegmentationResult seg = segmentSDSLIC(bgr);
+    seg.descriptor = buildRegionDescriptor(seg.bgr, seg.labels, seg.numRegions, type, CUSTOM_FIXED_REGIONS);
 
-    for (int y = 0; y < h; ++y) {
-        const int* lblRow      = labels.ptr<int>(y);
-        const cv::Vec3b* inRow = bgrSmall.ptr<cv::Vec3b>(y);
-        for (int x = 0; x < w; ++x) {
-            int sp = lblRow[x];
-            const cv::Vec3b& pix = inRow[x];
-            meanBGR.at<float>(sp, 0) += pix[0];
-            meanBGR.at<float>(sp, 1) += pix[1];
-            meanBGR.at<float>(sp, 2) += pix[2];
-            counts[sp]++;
-        }
+    if (segmentation) {
+        summarizeRegions(seg);
+        *segmentation = seg;
     }
+    return seg.descriptor;
+}
 
-    for (int sp = 0; sp < numSp; ++sp) {
-        if (counts[sp] > 0) {
-            meanBGR.at<float>(sp, 0) /= counts[sp];
-            meanBGR.at<float>(sp, 1) /= counts[sp];
-            meanBGR.at<float>(sp, 2) /= counts[sp];
-        }
-    }
+// VISUALS
+
+// Mosaic of the mean color of every grid cell, at the size of the segmented image
+cv::Mat visualizeGridSuperpixels(const SegmentationResult& seg) {
+    CV_Assert(seg.numRegions > 0 && seg.meanBGR.rows == seg.numRegions);
+    int h = seg.bgr.rows, w = seg.bgr.cols;
 
     cv::Mat mosaic(h, w, CV_8UC3);
     for (int y = 0; y < h; ++y) {
-        const int* lblRow = labels.ptr<int>(y);
+        const int* lblRow = seg.labels.ptr<int>(y);
         cv::Vec3b* outRow = mosaic.ptr<cv::Vec3b>(y);
         for (int x = 0; x < w; ++x) {
-            int sp = lblRow[x];
+            const float* mean = seg.meanBGR.ptr<float>(lblRow[x]);
             cv::Vec3b c;
-            c[0] = static_cast<uchar>(std::clamp(meanBGR.at<float>(sp, 0), 0.0f, 255.0f));
-            c[1] = static_cast<uchar>(std::clamp(meanBGR.at<float>(sp, 1), 0.0f, 255.0f));
-            c[2] = static_cast<uchar>(std::clamp(meanBGR.at<float>(sp, 2), 0.0f, 255.0f));
+            c[0] = static_cast<uchar>(std::clamp(mean[0], 0.0f, 255.0f));
+            c[1] = static_cast<uchar>(std::clamp(mean[1], 0.0f, 255.0f));
+            c[2] = static_cast<uchar>(std::clamp(mean[2], 0.0f, 255.0f));
             outRow[x] = c;
         }
     }
 
     cv::Mat mosaicFull;
-    cv::resize(mosaic, mosaicFull, bgr.size(), 0, 0, cv::INTER_NEAREST);
+    cv::resize(mosaic, mosaicFull, seg.imageSize, 0, 0, cv::INTER_NEAREST);
     return mosaicFull;
 }
 
-cv::Mat visualizeSDSLICSuperpixels(const cv::Mat& bgr) {
-    CV_Assert(bgr.type() == CV_8UC3);
-
-    cv::Mat lab;
-    cv::cvtColor(bgr, lab, cv::COLOR_BGR2Lab);
-
-    cv::Ptr<SuperpixelSLIC> slic =
-        createSuperpixelSLIC(lab, SLIC, SDSLIC_REGION_SIZE, SDSLIC_SMOOTHNESS);
-
-    slic->iterate(SDSLIC_ITERATIONS);
-    slic->enforceLabelConnectivity(SDSLIC_MIN_SIZE_PERCENT);
-    slic->duperizeWithHistogram(SDSLIC_HIST_BUCKETS, SDSLIC_HIST_DISTANCE);
+cv::Mat visualizeGridSuperpixels(const cv::Mat& bgr, int cellSize) {
+    SegmentationResult seg = segmentGrid(bgr, cellSize);
+    summarizeRegions(seg);
+    return visualizeGridSuperpixels(seg);
+}
 
-    cv::Mat contourMask;
-    slic->getLabelContourMask(contourMask, true);
+// Region contours drawn in red over the segmented image
+cv::Mat visualizeSDSLICSuperpixels(const SegmentationResult& seg) {
+    CV_Assert(!seg.contourMask.empty());
 
-    cv::Mat vis = bgr.clone();
-    vis.setTo(cv::Scalar(0, 0, 255), contourMask);
+    cv::Mat vis = seg.bgr.clone();
+    vis.setTo(cv::Scalar(0, 0, 255), seg.contourMask);
     return vis;
 }
 
+cv::Mat visualizeSDSLICSuperpixels(const cv::Mat& bgr) {
+    SegmentationResult seg = segmentSDSLIC(bgr);
+    summarizeRegions(seg);
+    return visualizeSDSLICSuperpixels(seg);
+}
+
 // DESCRIPTOR BUILDER
 
+// segmentation, if given, gets the segmentation the descriptor was built from (nothing for GLOBAL)
 cv::Mat buildDescriptor(const cv::Mat& bgr,
                         FeatureType type,
                         DescriptorMode mode,
-                        int superpixelCellSize) {
+                        int superpixelCellSize,
+                        SegmentationResult* segmentation = nullptr) {
     switch (mode) {
     case DescriptorMode::GLOBAL:
         return buildGlobalDescriptor(bgr, type);
     case DescriptorMode::SUPERPIXEL_SPATIAL:
-        return buildSuperpixelDescriptor(bgr, type, superpixelCellSize);
+        return buildSuperpixelDescriptor(bgr, type, superpixelCellSize, segmentation);
     case DescriptorMode::CUSTOM:
-        return buildCustomDescriptor(bgr, type);
+        return buildCustomDescriptor(bgr, type, segmentation);
     }
     return buildGlobalDescriptor(bgr, type);
 }
 
-// IMAGE INDEX
-
-struct ImageIndex {
-    std::vector<std::string> filenames;
-    cv::Mat features;
-
-    void add(const std::string& fname, const cv::Mat& desc) {
-        if (features.empty()) {
-            features = desc.clone();
-        } else {
-            cv::vconcat(features, desc, features);
-        }
-        filenames.push_back(fname);
-    }
-
-    std::vector<std::pair<int, float>> search(const cv::Mat& query, int k) const {
-        std::vector<std::pair<int, float>> res;
-        if (features.empty()) return res;
-
-        CV_Assert(query.rows == 1);
-        cv::Mat qRepeat;
-        cv::repeat(query, features.rows, 1, qRepeat);
-
-        cv::Mat diff, dists;
-        cv::pow(features - qRepeat, 2, diff);
-        cv::reduce(diff, dists, 1, cv::REDUCE_SUM);
-        cv::sqrt(dists, dists);
-
-        res.reserve(features.rows);
-        for (int i = 0; i < features.rows; ++i)
-            res.emplace_back(i, dists.at<float>(i, 0));
-
-        int kk = std::min(k, (int)res.size());
-        std::partial_sort(res.begin(), res.begin() + kk, res.end(),
-            [](auto& a, auto& b){ return a.second < b.second; });
-        if ((int)res.size() > kk) res.resize(kk);
-        return res;
-    }
-};
-
 // OTHER UTILITIES
 
 bool isImageFile(const fs::path& p) {
@@ -525,32 +613,187 @@ bool isImageFile(const fs::path& p) {
     return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp";
 }
 
-struct ImageJobResult {
+// Name of a descriptor in the cache, covering every setting it depends on
+std::string descriptorCacheName(FeatureType type, DescriptorMode mode, int superpixelCellSize) {
+    std::string name = DESCRIPTOR_CACHE_TAG + "_desc_" + featureTypeToString(type) + "_" + descriptorModeToString(mode);
+    if (mode == DescriptorMode::SUPERPIXEL_SPATIAL)
+        name += "_" + std::to_string(superpixelCellSize) + "_" +
+                std::to_string(SUPERPIXEL_RESIZE_WIDTH) + "x" + std::to_string(SUPERPIXEL_RESIZE_HEIGHT);
+    else if (mode == DescriptorMode::CUSTOM)
+        name += "_" + sdslicSettingsName();
+    return name;
+}
+
+// INGESTION PIPELINE
+
+// (feature, descriptor mode, superpixel cell size) of a descriptor to build
+using DescriptorKind = std::tuple<FeatureType, DescriptorMode, int>;
+
+// One image on its way through the ingestion pipeline
+struct ImageJob {
+    size_t index = 0;
     std::string path;
-    cv::Mat desc;
-    bool ok = false;
+    cv::Mat image;                         // decoded, unless every descriptor was cached
+    std::shared_ptr<CachedImage> cached;   // cache entry, when caching
+    std::vector<cv::Mat> descs;            // per kind, empty until built (or if that failed)
 };
 
-ImageJobResult processImageJob(const std::string& path,
-                               FeatureType type,
-                               DescriptorMode mode,
-                               int superpixelCellSize) {
-    ImageJobResult r;
-    r.path = path;
+// Throughput of a pipeline stage; busy time leaves out waiting on its queues
+struct StageCounter {
+    const char*          name;
+    int                  threads = 0;
+    std::atomic<size_t>  items{0};
+    std::atomic<int64_t> busyNs{0};
+
+    explicit StageCounter(const char* name) : name(name) {}
 
-    cv::Mat img = cv::imread(path, cv::IMREAD_COLOR);
-    if (img.empty()) {
-        std::cerr << "Could not read " << path << std::endl;
-        return r;
+    void add(std::chrono::steady_clock::time_point start) {
+        items++;
+        busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
     }
 
-    try {
-        r.desc = buildDescriptor(img, type, mode, superpixelCellSize);
-        r.ok   = true;
-    } catch (const std::exception& e) {
-        std::cerr << "Error processing " << path << ": " << e.what() << std::endl;
+    void print() const {
+        double busyS = busyNs.load() * 1e-9;
+        std::cout << "  " << name << ": " << threads << " threads, " << items.load() << " images, "
+                  << busyS << " s busy";
+        if (busyS > 0.0)
+            std::cout << ", " << items.load() * threads / busyS << " images/s";
+        std::cout << "\n";
+    }
+};
+
+// Streams images through three stages connected by bounded lock-free queues:
+//   decode:  reads and hashes the file, takes the descriptors that are cached, and decodes the
+//            image only if some are still missing
+//   extract: builds the missing descriptors (segmentation, feature extraction) and caches them
+//   sink:    a single thread handing every finished image to sink, in arrival order
+// Decoding and extraction get their own threads instead of competing inside every worker. Full
+// queues hold earlier stages back, so only a few queues' worth of decoded images are ever in
+// memory, whatever the number of images.
+void runIngestPipeline(const std::vector<std::string>& paths,
+                       const std::vector<DescriptorKind>& kinds,
+                       DescriptorCache* cache,
+                       const std::function<void(ImageJob&)>& sink) {
+    int numThreads = (int)std::thread::hardware_concurrency();
+    if (!numThreads) numThreads = 4;
+
+    StageCounter decodeStage("decode"), extractStage("extract"), sinkStage("insert");
+    decodeStage.threads  = std::max(1, numThreads / 4);
+    extractStage.threads = std::max(1, numThreads - decodeStage.threads);
+    sinkStage.threads    = 1;
+
+    BoundedQueue<ImageJob> decoded(2 * extractStage.threads);
+    BoundedQueue<ImageJob> finished(std::max(16, 4 * extractStage.threads));
+
+    std::atomic<size_t> nextIndex{0};
+    std::atomic<int> liveDecoders{decodeStage.threads};
+    std::atomic<int> liveProducers{decodeStage.threads + extractStage.threads};
+    auto producerDone = [&]() {
+        if (--liveProducers == 0) finished.close();
+    };
+
+    auto decodeWorker = [&]() {
+        while (true) {
+            size_t idx = nextIndex.fetch_add(1);
+            if (idx >= paths.size()) break;
+            auto start = std::chrono::steady_clock::now();
+
+            ImageJob job;
+            job.index = idx;
+            job.path  = paths[idx];
+            job.descs.resize(kinds.size());
+
+            std::string key;
+            std::vector<uchar> bytes;
+            if (cache) {
+                bool complete = false;
+                if (cache->hashFile(job.path, key, &bytes)) {
+                    job.cached = std::make_shared<CachedImage>(cache->load(key));
+                    complete = true;
+                    for (size_t i = 0; i < kinds.size(); ++i) {
+                        auto [type, mode, cell] = kinds[i];
+                        if (!job.cached->get(descriptorCacheName(type, mode, cell), job.descs[i]))
+                            complete = false;
+                    }
+                }
+                if (complete) {
+                    // Every descriptor is cached, nothing to decode or extract
+                    decodeStage.add(start);
+                    finished.push(std::move(job));
+                    continue;
+                }
+                // Decode the bytes that were just hashed, unless the hash was memoized and
+                // nothing was read
+                if (!bytes.empty())
+                    job.image = cv::imdecode(bytes, cv::IMREAD_COLOR);
+                else if (!key.empty())
+                    job.image = cv::imread(job.path, cv::IMREAD_COLOR);
+            } else {
+                job.image = cv::imread(job.path, cv::IMREAD_COLOR);
+            }
+            decodeStage.add(start);
+
+            if (job.image.empty()) {
+                std::cerr << "Could not read " << job.path << std::endl;
+                finished.push(std::move(job));
+            } else {
+                decoded.push(std::move(job));
+            }
+        }
+        if (--liveDecoders == 0) decoded.close();
+        producerDone();
+    };
+
+    auto extractWorker = [&]() {
+        ImageJob job;
+        while (decoded.pop(job)) {
+            auto start = std::chrono::steady_clock::now();
+            {
+                // Keypoints and label maps are shared between the kinds of this image
+                CachedImageScope scope(job.cached.get());
+                for (size_t i = 0; i < kinds.size(); ++i) {
+                    if (!job.descs[i].empty()) continue;
+                    auto [type, mode, cell] = kinds[i];
+                    try {
+                        job.descs[i] = buildDescriptor(job.image, type, mode, cell);
+                        if (job.cached)
+                            job.cached->put(descriptorCacheName(type, mode, cell), job.descs[i]);
+                    } catch (const std::exception& e) {
+                        std::cerr << "Error processing " << job.path << ": " << e.what() << std::endl;
+                    }
+                }
+            }
+            if (job.cached && !cache->store(*job.cached))
+                std::cerr << "Failed to cache descriptors of " << job.path << std::endl;
+            job.image.release();
+            job.cached.reset();
+            extractStage.add(start);
+            finished.push(std::move(job));
+        }
+        producerDone();
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(decodeStage.threads + extractStage.threads);
+    for (int i = 0; i < decodeStage.threads; ++i)
+        threads.emplace_back(decodeWorker);
+    for (int i = 0; i < extractStage.threads; ++i)
+        threads.emplace_back(extractWorker);
+
+    // This thread is the sink
+    ImageJob job;
+    while (finished.pop(job)) {
+        auto start = std::chrono::steady_clock::now();
+        sink(job);
+        sinkStage.add(start);
     }
-    return r;
+    for (auto& t : threads) t.join();
+
+    std::cout << "Ingestion stages:\n";
+    decodeStage.print();
+    extractStage.print();
+    sinkStage.print();
 }
 
 // CONFIGURATION AND STATS
@@ -560,6 +803,7 @@ struct ExperimentConfig {
     DescriptorMode mode;
     int            superpixelCellSize;
     std::string    name;
+    std::vector<IndexConfig> backends = INDEX_BACKENDS;
 };
 
 struct ExperimentStats {
@@ -570,101 +814,162 @@ struct ExperimentStats {
     int         gridX = 0;
     int         gridY = 0;
     size_t      numIndexed = 0;
-    double      indexTimeMs = 0.0;
+    double      indexTimeMs = 0.0;   // extracting descriptors into a new index (0 if a saved one was mapped)
+    double      loadTimeMs = 0.0;    // mapping a saved index (0 if it was built)
     double      queryTimeMs = 0.0;
     double      precisionAtK = 0.0;
     std::string maxStr;
+    std::string indexName = "FLAT";
+    double      buildTimeMs = 0.0;
+    double      recallAtK = 1.0;    // share of the exact top K the backend found
+    size_t      indexBytes = 0;     // memory the backend searches
+    double      compression = 1.0;  // float features' bytes per backend byte
 };
 
-// EXPERIMENT RUNNER
+// DESCRIPTOR PRECOMPUTATION
+
+// Fills the descriptor cache for every experiment at once, decoding each image a single time.
+// Later runExperiment() calls then only read the cache, and a rerun after changing a single
+// config only computes that config.
+void precomputeDescriptors(const std::vector<ExperimentConfig>& experiments,
+                           const std::vector<std::string>& imagePaths,
+                           DescriptorCache& cache) {
+    std::vector<DescriptorKind> kinds;
+    for (const auto& cfg : experiments) {
+        auto kind = std::make_tuple(cfg.feature, cfg.mode,
+                                    cfg.mode == DescriptorMode::SUPERPIXEL_SPATIAL ? cfg.superpixelCellSize : 0);
+        if (std::find(kinds.begin(), kinds.end(), kind) == kinds.end())
+            kinds.push_back(kind);
+    }
 
-ExperimentStats runExperiment(const ExperimentConfig& cfg,
-                              const std::vector<std::string>& imagePaths,
-                              const COCOLabelIndex& cocoIndex,
-                              const cv::Mat& queryImg,
-                              const std::vector<int>& queryCats,
-                              const std::string& queryCatStr,
-                              const std::unordered_set<int>& queryCatSet,
-                              std::ofstream& fout,
-                              const std::string& maxStr) {
+    std::cout << "\nPrecomputing " << kinds.size() << " descriptor kinds for "
+              << imagePaths.size() << " images...\n";
 
-    ExperimentStats stats;
-    stats.featureName        = featureTypeToString(cfg.feature);
-    stats.modeName           = descriptorModeToString(cfg.mode);
-    stats.superpixelCellSize = cfg.superpixelCellSize;
-    stats.maxStr             = maxStr;
-    stats.methodName         = cfg.name + "_" + maxStr;
+    size_t numProcessed = 0;
+    runIngestPipeline(imagePaths, kinds, &cache, [&](ImageJob&) {
+        if (++numProcessed % 50 == 0)
+            std::cout << "Precomputed " << numProcessed << " images...\n";
+    });
+}
 
-    std::cout << "\nExperiment: "    << cfg.name  << "\n";
-    std::cout << "Feature type: "  << stats.featureName << "\n";
-    std::cout << "Descriptor:  "   << stats.modeName    << "\n";
+// INDEX CONSTRUCTION
 
-    if (cfg.mode == DescriptorMode::SUPERPIXEL_SPATIAL)
-        std::cout << "Superpixel cell size: " << cfg.superpixelCellSize << "\n";
-
-    if (cfg.mode == DescriptorMode::SUPERPIXEL_SPATIAL) {
-        stats.gridX = (SUPERPIXEL_RESIZE_WIDTH  + cfg.superpixelCellSize - 1) / cfg.superpixelCellSize;
-        stats.gridY = (SUPERPIXEL_RESIZE_HEIGHT + cfg.superpixelCellSize - 1) / cfg.superpixelCellSize;
+// 64-bit FNV-1a of size bytes, continuing from the hash h of the bytes before them
+uint64_t fnv1a(const void* data, size_t size, uint64_t h = 14695981039346656037ull) {
+    const uchar* bytes = (const uchar*)data;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 1099511628211ull;
     }
+    return h;
+}
 
-    auto t0 = std::chrono::steady_clock::now();
-
-    std::vector<ImageJobResult> results(imagePaths.size());
-    std::atomic<size_t> nextIndex{0};
-
-    unsigned int numThreads = std::thread::hardware_concurrency();
-    if (!numThreads) numThreads = 4;
+// Hash of the sorted image paths with the size and modification time of each file, so a saved
+// index over another image set (even one of the same size) doesn't match
+uint64_t sourceListHash(const std::vector<std::string>& imagePaths) {
+    std::vector<std::string> sorted = imagePaths;
+    std::sort(sorted.begin(), sorted.end());
+
+    uint64_t h = fnv1a(nullptr, 0);
+    for (const auto& path : sorted) {
+        std::error_code ec;
+        const uint64_t size = (uint64_t)fs::file_size(path, ec);
+        const int64_t modified = (int64_t)fs::last_write_time(path, ec).time_since_epoch().count();
+        h = fnv1a(path.c_str(), path.size() + 1, h);   // with its terminator, so names can't run into each other
+        h = fnv1a(&size, sizeof(size), h);
+        h = fnv1a(&modified, sizeof(modified), h);
+    }
+    return h;
+}
 
-    auto worker = [&]() {
-        while (true) {
-            size_t idx = nextIndex.fetch_add(1);
-            if (idx >= imagePaths.size()) break;
-            results[idx] = processImageJob(imagePaths[idx],
-                                           cfg.feature,
-                                           cfg.mode,
-                                           cfg.superpixelCellSize);
-        }
-    };
+// Hash of the descriptor settings of cfg (cache tag, resize, SD-SLIC parameters), so a saved
+// index built with other settings doesn't match
+uint64_t descriptorSettingsHash(const ExperimentConfig& cfg) {
+    const std::string name = descriptorCacheName(cfg.feature, cfg.mode, cfg.superpixelCellSize);
+    return fnv1a(name.data(), name.size());
+}
 
-    std::vector<std::thread> threads;
-    threads.reserve(numThreads);
-    for (unsigned int i = 0; i < numThreads; ++i)
-        threads.emplace_back(worker);
-    for (auto& t : threads) t.join();
+// Maps the index saved by an earlier run over the same images and settings, or else extracts
+// the descriptors of every image into a new index and saves it for the next run. mapped (if
+// given) tells which of the two happened.
+ImageIndex loadOrBuildIndex(const ExperimentConfig& cfg,
+                            const std::vector<std::string>& imagePaths,
+                            const std::string& maxStr,
+                            DescriptorCache* cache = nullptr,
+                            bool* mapped = nullptr) {
+    std::string indexPath = INDEX_CACHE_DIR + cfg.name + "_" + maxStr + ".spix";
+    IndexMetadata meta;
+    meta.featureType        = (int)cfg.feature;
+    meta.descriptorMode     = (int)cfg.mode;
+    meta.superpixelCellSize = cfg.superpixelCellSize;
+    meta.numSources         = (int64_t)imagePaths.size();
+    meta.sourcesHash        = sourceListHash(imagePaths);
+    meta.settingsHash       = descriptorSettingsHash(cfg);
 
     ImageIndex index;
-    size_t count = 0;
-    for (const auto& r : results) {
-        if (!r.ok) continue;
-        index.add(r.path, r.desc);
-        if (++count % 50 == 0)
-            std::cout << "Indexed " << count << " images...\n";
-    }
-
-    auto t1 = std::chrono::steady_clock::now();
-    stats.indexTimeMs =
-        std::chrono::duration<double, std::milli>(t1 - t0).count();
-    stats.numIndexed = index.filenames.size();
-
-    std::cout << "Total indexed images: " << stats.numIndexed << "\n";
-    if (stats.numIndexed == 0) {
-        std::cerr << "No images indexed for " << cfg.name << "\n";
-        return stats;
+    IndexMetadata savedMeta;
+    bool loaded = REUSE_SAVED_INDEX &&
+                  ImageIndex::load(indexPath, index, savedMeta) &&
+                  savedMeta.featureType        == meta.featureType &&
+                  savedMeta.descriptorMode     == meta.descriptorMode &&
+                  savedMeta.superpixelCellSize == meta.superpixelCellSize &&
+                  savedMeta.numSources         == meta.numSources &&
+                  savedMeta.sourcesHash        == meta.sourcesHash &&
+                  savedMeta.settingsHash       == meta.settingsHash &&
+                  !index.features.empty();
+
+    if (loaded) {
+        std::cout << "Mapped saved index: " << indexPath << "\n";
+    } else {
+        // Descriptors are written straight into the index's preallocated rows as they come out
+        // of the pipeline
+        ImageIndexBuilder builder(imagePaths.size());
+        size_t numProcessed = 0;
+        runIngestPipeline(imagePaths, { { cfg.feature, cfg.mode, cfg.superpixelCellSize } }, cache,
+                          [&](ImageJob& job) {
+            if (!job.descs.front().empty())
+                builder.put(job.index, job.path, job.descs.front());
+            if (++numProcessed % 50 == 0)
+                std::cout << "Processed " << numProcessed << " images...\n";
+        });
+
+        index = builder.finish();
+
+        if (!index.features.empty()) {
+            fs::create_directories(INDEX_CACHE_DIR);
+            if (!index.save(indexPath, meta))
+                std::cerr << "Failed to save index to " << indexPath << "\n";
+        }
     }
 
-    auto tq0 = std::chrono::steady_clock::now();
-    cv::Mat queryDesc = buildDescriptor(queryImg, cfg.feature,
-                                        cfg.mode, cfg.superpixelCellSize);
-    auto matches = index.search(queryDesc, TOP_K);
-    auto tq1 = std::chrono::steady_clock::now();
-    stats.queryTimeMs =
-        std::chrono::duration<double, std::milli>(tq1 - tq0).count();
+    if (mapped) *mapped = loaded;
+    return index;
+}
 
-    std::cout << "\nTop " << TOP_K << " matches (" << cfg.name << "):\n";
-    for (auto& [idx, dist] : matches)
-        std::cout << "  " << index.filenames[idx] << "  (dist=" << dist << ")\n";
+// EXPERIMENT RUNNER
 
-    std::string outDir = "../SuperpixelImageSearch/output/" + cfg.name + "_" + maxStr;
+// Header of the per-match CSV writeMatches() writes rows of (superpixel_ris and pipeline_demo)
+const std::string MATCHES_CSV_HEADER =
+    "method,feature,descriptor_mode,superpixel_cell_size,grid_x,grid_y,"
+    "max_images,num_indexed,"
+    "query_filename,query_categories,"
+    "match_rank,match_filename,match_categories,shares_label,distance,"
+    "index_time_ms,index_load_ms,query_time_ms,"
+    "index_backend,index_build_ms,recall_at_k,index_bytes,compression\n";
+
+// Saves the matches of one backend (and the query visualizations, drawn from the segmentation
+// the query descriptor was built from), writes them to the master CSV and returns their precision@K
+double writeMatches(const ExperimentConfig& cfg,
+                    const ExperimentStats& stats,
+                    const ImageIndex& index,
+                    const std::vector<std::pair<int, float>>& matches,
+                    const cv::Mat& queryImg,
+                    const SegmentationResult& querySeg,
+                    const COCOLabelIndex& cocoIndex,
+                    const std::string& queryCatStr,
+                    const std::unordered_set<int>& queryCatSet,
+                    std::ofstream& fout) {
+    std::string outDir = OUTPUT_ROOT + "/" + stats.methodName;
     fs::create_directories(outDir);
 
     try {
@@ -691,7 +996,7 @@ ExperimentStats runExperiment(const ExperimentConfig& cfg,
             if (!cv::imwrite(origPath, queryImg))
                 std::cerr << "Failed to write " << origPath << "\n";
 
-            cv::Mat spVis = visualizeGridSuperpixels(queryImg, cfg.superpixelCellSize);
+            cv::Mat spVis = visualizeGridSuperpixels(querySeg);
             std::string spPath =
                 outDir + "/query_superpixels_cell" +
                 std::to_string(cfg.superpixelCellSize) + ".jpg";
@@ -710,7 +1015,7 @@ ExperimentStats runExperiment(const ExperimentConfig& cfg,
             if (!cv::imwrite(origPath, queryImg))
                 std::cerr << "Failed to write " << origPath << "\n";
 
-            cv::Mat sdslicVis = visualizeSDSLICSuperpixels(queryImg);
+            cv::Mat sdslicVis = visualizeSDSLICSuperpixels(querySeg);
             std::string sdPath = outDir + "/query_sdslic_hist.jpg";
             if (!cv::imwrite(sdPath, sdslicVis))
                 std::cerr << "Failed to write " << sdPath << "\n";
@@ -748,7 +1053,7 @@ ExperimentStats runExperiment(const ExperimentConfig& cfg,
              << cfg.superpixelCellSize << ","
              << stats.gridX << ","
              << stats.gridY << ","
-             << maxStr << ","
+             << stats.maxStr << ","
              << stats.numIndexed << ","
              << queryFname << ","
              << "\"" << queryCatStr << "\","
@@ -758,22 +1063,242 @@ ExperimentStats runExperiment(const ExperimentConfig& cfg,
              << (shareLabel ? 1 : 0) << ","
              << dist << ","
              << stats.indexTimeMs << ","
-             << stats.queryTimeMs << "\n";
+             << stats.loadTimeMs << ","
+             << stats.queryTimeMs << ","
+             << stats.indexName << ","
+             << stats.buildTimeMs << ","
+             << stats.recallAtK << ","
+             << stats.indexBytes << ","
+             << stats.compression << "\n";
 
         rank++;
     }
 
-    stats.precisionAtK = (double)correct / (double)TOP_K;
-    std::cout << "Precision@" << TOP_K << " (COCO category match, " << cfg.name
-              << ") = " << stats.precisionAtK << "\n";
+    return (double)correct / (double)TOP_K;
+}
+
+// Indexes every image once, then searches with (and reports) each backend of cfg
+std::vector<ExperimentStats> runExperiment(const ExperimentConfig& cfg,
+                                           const std::vector<std::string>& imagePaths,
+                                           const COCOLabelIndex& cocoIndex,
+                                           const cv::Mat& queryImg,
+                                           const std::vector<int>& queryCats,
+                                           const std::string& queryCatStr,
+                                           const std::unordered_set<int>& queryCatSet,
+                                           std::ofstream& fout,
+                                           const std::string& maxStr,
+                                           DescriptorCache* cache = nullptr) {
+
+    ExperimentStats stats;
+    stats.featureName        = featureTypeToString(cfg.feature);
+    stats.modeName           = descriptorModeToString(cfg.mode);
+    stats.superpixelCellSize = cfg.superpixelCellSize;
+    stats.maxStr             = maxStr;
+    stats.methodName         = cfg.name + "_" + maxStr;
+
+    std::cout << "\nExperiment: "    << cfg.name  << "\n";
+    std::cout << "Feature type: "  << stats.featureName << "\n";
+    std::cout << "Descriptor:  "   << stats.modeName    << "\n";
+
+    if (cfg.mode == DescriptorMode::SUPERPIXEL_SPATIAL)
+        std::cout << "Superpixel cell size: " << cfg.superpixelCellSize << "\n";
+
+    if (cfg.mode == DescriptorMode::SUPERPIXEL_SPATIAL) {
+        stats.gridX = (SUPERPIXEL_RESIZE_WIDTH  + cfg.superpixelCellSize - 1) / cfg.superpixelCellSize;
+        stats.gridY = (SUPERPIXEL_RESIZE_HEIGHT + cfg.superpixelCellSize - 1) / cfg.superpixelCellSize;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    bool mapped = false;
+    ImageIndex index = loadOrBuildIndex(cfg, imagePaths, maxStr, cache, &mapped);
+
+    auto t1 = std::chrono::steady_clock::now();
+    (mapped ? stats.loadTimeMs : stats.indexTimeMs) =
+        std::chrono::duration<double, std::milli>(t1 - t0).count();
+    stats.numIndexed = index.filenames.size();
+
+    std::cout << "Total indexed images: " << stats.numIndexed << "\n";
+    if (stats.numIndexed == 0) {
+        std::cerr << "No images indexed for " << cfg.name << "\n";
+        return { stats };
+    }
+
+    // Query descriptor once, searched by every backend (its segmentation is visualized too)
+    auto tq0 = std::chrono::steady_clock::now();
+    SegmentationResult querySeg;
+    cv::Mat queryDesc = buildDescriptor(queryImg, cfg.feature,
+                                        cfg.mode, cfg.superpixelCellSize, &querySeg);
+    auto tq1 = std::chrono::steady_clock::now();
+    double queryDescMs =
+        std::chrono::duration<double, std::milli>(tq1 - tq0).count();
+
+    // Ground truth for the recall of approximate backends
+    auto exactMatches = FlatIndex::exactSearch(index.features, queryDesc, TOP_K);
+
+    // Size of the float features, which are released once the last backend is PQ
+    const size_t featureBytes = index.features.total() * index.features.elemSize();
+
+    std::vector<ExperimentStats> allStats;
+    for (const auto& backendCfg : cfg.backends) {
+        ExperimentStats bstats = stats;
+        bstats.indexName = indexConfigToString(backendCfg);
+        if (backendCfg.type != IndexType::FLAT)
+            bstats.methodName = cfg.name + "_" + bstats.indexName + "_" + maxStr;
+
+        auto tb0 = std::chrono::steady_clock::now();
+        index.buildBackend(backendCfg);
+        auto tb1 = std::chrono::steady_clock::now();
+        bstats.buildTimeMs =
+            std::chrono::duration<double, std::milli>(tb1 - tb0).count();
+        bstats.indexBytes  = index.backend->memoryBytes();
+        bstats.compression = bstats.indexBytes > 0
+            ? (double)featureBytes / (double)bstats.indexBytes
+            : 1.0;
+        // recall uses exactMatches, so only the PQ codes need to stay in memory after the last backend
+        if (backendCfg.type == IndexType::PQ && &backendCfg == &cfg.backends.back())
+            index.releaseFeatures();
+
+        auto ts0 = std::chrono::steady_clock::now();
+        auto matches = index.search(queryDesc, TOP_K);
+        auto ts1 = std::chrono::steady_clock::now();
+        bstats.queryTimeMs = queryDescMs +
+            std::chrono::duration<double, std::milli>(ts1 - ts0).count();
+
+        int found = 0;
+        for (auto& m : matches)
+            for (auto& e : exactMatches)
+                if (m.first == e.first) { found++; break; }
+        bstats.recallAtK = exactMatches.empty() ? 1.0 : (double)found / (double)exactMatches.size();
+
+        std::cout << "\nTop " << TOP_K << " matches (" << cfg.name << ", " << bstats.indexName << "):\n";
+        for (auto& [idx, dist] : matches)
+            std::cout << "  " << index.filenames[idx] << "  (dist=" << dist << ")\n";
+
+        bstats.precisionAtK = writeMatches(cfg, bstats, index, matches, queryImg, querySeg, cocoIndex,
+                                           queryCatStr, queryCatSet, fout);
+        std::cout << "Precision@" << TOP_K << " (COCO category match, " << cfg.name << ", "
+                  << bstats.indexName << ") = " << bstats.precisionAtK
+                  << ", recall@" << TOP_K << " vs FLAT = " << bstats.recallAtK
+                  << ", " << bstats.indexBytes / 1024 << " KiB (" << bstats.compression
+                  << "x smaller than the float features)\n";
+
+        allStats.push_back(bstats);
+    }
+
+    return allStats;
+}
+
+// EXPERIMENTS
+
+std::vector<ExperimentConfig> defaultExperiments() {
+    std::vector<ExperimentConfig> experiments;
+    experiments.push_back({ FeatureType::SIFT, DescriptorMode::GLOBAL, 0, "SIFT_GLOBAL" });
+    experiments.push_back({ FeatureType::ORB,  DescriptorMode::GLOBAL, 0, "ORB_GLOBAL" });
+
+    for (int cell : SUPERPIXEL_SIZES) {
+        experiments.push_back({
+            FeatureType::SIFT,
+            DescriptorMode::SUPERPIXEL_SPATIAL,
+            cell,
+            "SIFT_SUPERPIXEL_SPATIAL_" + std::to_string(cell)
+        });
+        experiments.push_back({
+            FeatureType::ORB,
+            DescriptorMode::SUPERPIXEL_SPATIAL,
+            cell,
+            "ORB_SUPERPIXEL_SPATIAL_" + std::to_string(cell)
+        });
+    }
+
+    // NOTE: CUSTOM_SDSLIC_SIFT moved to pipeline_demo.cpp
+    // experiments.push_back({
+    //     FeatureType::SIFT,
+    //     DescriptorMode::CUSTOM,
+    //     0,
+    //     "CUSTOM_SDSLIC_SIFT"
+    // });
+
+    return experiments;
+}
+
+std::vector<std::string> listIndexImages(size_t maxImages) {
+    std::vector<std::string> imagePaths;
+    for (const auto& entry : fs::directory_iterator(INDEX_DIR)) {
+        if (!entry.is_regular_file()) continue;
+        if (!isImageFile(entry.path())) continue;
+        imagePaths.push_back(entry.path().string());
+        if (imagePaths.size() >= maxImages) break;
+    }
+    return imagePaths;
+}
+
+// QUERY SERVER MODE
+
+// Points a stream at another buffer until it goes out of scope (exceptions included)
+struct StreamRedirect {
+    StreamRedirect(std::ostream& stream, std::streambuf* buf) : stream(stream), saved(stream.rdbuf(buf)) {}
+    ~StreamRedirect() { stream.rdbuf(saved); }
+    StreamRedirect(const StreamRedirect&) = delete;
+    StreamRedirect& operator=(const StreamRedirect&) = delete;
+
+    std::ostream& stream;
+    std::streambuf* saved;
+};
+
+// Loads (or builds) the index of one experiment once and answers queries on stdin/stdout
+// until stdin closes, see QueryServer for the protocol
+int runQueryServer(const std::string& experimentName) {
+    // stdout carries the protocol, so everything else is logged to stderr
+    std::ostream protocol(std::cout.rdbuf());
+    StreamRedirect logToStderr(std::cout, std::cerr.rdbuf());
+
+    auto experiments = defaultExperiments();
+    auto cfg = std::find_if(experiments.begin(), experiments.end(),
+                            [&](const ExperimentConfig& e) { return e.name == experimentName; });
+    if (cfg == experiments.end()) {
+        std::cerr << "Unknown experiment: " << experimentName << "\n";
+        return 1;
+    }
+
+    size_t maxImages = USE_ALL_IMAGES ? std::numeric_limits<size_t>::max() : MAX_IMAGES;
+    std::string maxStr = USE_ALL_IMAGES ? "all" : std::to_string(maxImages);
+    std::vector<std::string> imagePaths = listIndexImages(maxImages);
+
+    std::unique_ptr<DescriptorCache> descriptorCache;
+    if (USE_DESCRIPTOR_CACHE)
+        descriptorCache = std::make_unique<DescriptorCache>(DESCRIPTOR_CACHE_DIR);
+
+    ImageIndex index = loadOrBuildIndex(*cfg, imagePaths, maxStr, descriptorCache.get());
+    if (index.filenames.empty()) {
+        std::cerr << "No images indexed for " << cfg->name << "\n";
+        return 1;
+    }
+    index.buildBackend(SERVER_BACKEND);
+    if (SERVER_BACKEND.type == IndexType::PQ)
+        index.releaseFeatures();
+
+    std::cerr << "Serving " << cfg->name << " (" << indexConfigToString(SERVER_BACKEND) << ", "
+              << index.filenames.size() << " images) on stdin\n";
+
+    QueryServer server(index,
+                       [cfg](const cv::Mat& bgr) {
+                           return buildDescriptor(bgr, cfg->feature, cfg->mode, cfg->superpixelCellSize);
+                       },
+                       TOP_K, SERVER_THREADS, SERVER_QUEUE_CAPACITY);
+    server.run(std::cin, protocol);
 
-    return stats;
+    std::cerr << "Final stats: " << server.statsJson() << "\n";
+    return 0;
 }
 
 // MAIN
 
-int main(int, char**) {
+int main(int argc, char** argv) {
     try {
+        if (argc > 1 && std::string(argv[1]) == "--serve")
+            return runQueryServer(argc > 2 ? argv[2] : SERVER_EXPERIMENT);
+
         std::cout << "Program started.\n";
         std::cout << "Index dir: " << INDEX_DIR << "\n";
         std::cout << "Query img: " << QUERY_IMG << "\n";
@@ -790,19 +1315,12 @@ int main(int, char**) {
 
         COCOLabelIndex cocoIndex;
         std::cout << "Loading train annotations...\n";
-        loadCOCOAnnotations(TRAIN_ANN, cocoIndex);
+        loadCOCOAnnotations(TRAIN_ANN, cocoIndex, COCO_LABEL_CACHE_DIR);
         std::cout << "Loading val annotations...\n";
-        loadCOCOAnnotations(VAL_ANN,   cocoIndex);
+        loadCOCOAnnotations(VAL_ANN,   cocoIndex, COCO_LABEL_CACHE_DIR);
         std::cout << "Finished loading annotations.\n";
 
-        std::vector<std::string> imagePaths;
-        for (const auto& entry : fs::directory_iterator(INDEX_DIR)) {
-            if (!entry.is_regular_file()) continue;
-            if (!isImageFile(entry.path())) continue;
-            imagePaths.push_back(entry.path().string());
-            if (imagePaths.size() >= maxImages) break;
-        }
-
+        std::vector<std::string> imagePaths = listIndexImages(maxImages);
         std::cout << "Found " << imagePaths.size() << " images to index.\n";
         if (imagePaths.empty()) {
             std::cerr << "No images found in INDEX_DIR.\n";
@@ -817,7 +1335,7 @@ int main(int, char**) {
 
         // origin visualizations
         try {
-            std::string originDir = "../SuperpixelImageSearch/output/origin/";
+            std::string originDir = OUTPUT_ROOT + "/origin/";
             fs::create_directories(originDir);
 
             std::string origPath = originDir + "query_original.jpg";
@@ -852,7 +1370,7 @@ int main(int, char**) {
             std::cout << "Query COCO categories: " << queryCatStr << "\n";
 
         // CSV output
-        std::string csvDir  = "../SuperpixelImageSearch/output/csv/";
+        std::string csvDir  = OUTPUT_ROOT + "/csv/";
         fs::create_directories(csvDir);
         std::string csvFile = csvDir + "master_results.csv";
 
@@ -862,39 +1380,15 @@ int main(int, char**) {
             return 1;
         }
 
-        fout << "method,feature,descriptor_mode,superpixel_cell_size,grid_x,grid_y,"
-             << "max_images,num_indexed,"
-             << "query_filename,query_categories,"
-             << "match_rank,match_filename,match_categories,shares_label,distance,"
-             << "index_time_ms,query_time_ms\n";
-
-        // experiment configs
-        std::vector<ExperimentConfig> experiments;
-        experiments.push_back({ FeatureType::SIFT, DescriptorMode::GLOBAL, 0, "SIFT_GLOBAL" });
-        experiments.push_back({ FeatureType::ORB,  DescriptorMode::GLOBAL, 0, "ORB_GLOBAL" });
-
-        for (int cell : SUPERPIXEL_SIZES) {
-            experiments.push_back({
-                FeatureType::SIFT,
-                DescriptorMode::SUPERPIXEL_SPATIAL,
-                cell,
-                "SIFT_SUPERPIXEL_SPATIAL_" + std::to_string(cell)
-            });
-            experiments.push_back({
-                FeatureType::ORB,
-                DescriptorMode::SUPERPIXEL_SPATIAL,
-                cell,
-                "ORB_SUPERPIXEL_SPATIAL_" + std::to_string(cell)
-            });
-        }
+        fout << MATCHES_CSV_HEADER;
 
-        // NOTE: CUSTOM_SDSLIC_SIFT moved to pipeline_demo.cpp
-        // experiments.push_back({
-        //     FeatureType::SIFT,
-        //     DescriptorMode::CUSTOM,
-        //     0,
-        //     "CUSTOM_SDSLIC_SIFT"
-        // });
+        std::vector<ExperimentConfig> experiments = defaultExperiments();
+
+        std::unique_ptr<DescriptorCache> descriptorCache;
+        if (USE_DESCRIPTOR_CACHE) {
+            descriptorCache = std::make_unique<DescriptorCache>(DESCRIPTOR_CACHE_DIR);
+            precomputeDescriptors(experiments, imagePaths, *descriptorCache);
+        }
 
         std::vector<ExperimentStats> allStats;
         allStats.reserve(experiments.size());
@@ -908,8 +1402,9 @@ int main(int, char**) {
                                       queryCatStr,
                                       queryCatSet,
                                       fout,
-                                      maxStr);
-            allStats.push_back(stats);
+                                      maxStr,
+                                      descriptorCache.get());
+            allStats.insert(allStats.end(), stats.begin(), stats.end());
         }
 
         fout.close();
@@ -923,8 +1418,9 @@ int main(int, char**) {
         } else {
             fsumm << "method,feature,descriptor_mode,superpixel_cell_size,grid_x,grid_y,"
                   << "max_images,num_indexed,precision_at_k,"
-                  << "index_time_ms,query_time_ms,"
-                  << "index_time_per_image_ms,query_time_per_image_ms\n";
+                  << "index_time_ms,index_load_ms,query_time_ms,"
+                  << "index_time_per_image_ms,query_time_per_image_ms,"
+                  << "index_backend,index_build_ms,recall_at_k,index_bytes,compression\n";
 
             for (const auto& s : allStats) {
                 double idxPerImg = (s.numIndexed > 0)
@@ -944,9 +1440,15 @@ int main(int, char**) {
                       << s.numIndexed << ","
                       << s.precisionAtK << ","
                       << s.indexTimeMs << ","
+                      << s.loadTimeMs << ","
                       << s.queryTimeMs << ","
                       << idxPerImg << ","
-                      << qryPerImg << "\n";
+                      << qryPerImg << ","
+                      << s.indexName << ","
+                      << s.buildTimeMs << ","
+                      << s.recallAtK << ","
+                      << s.indexBytes << ","
+                      << s.compression << "\n";
             }
 
             fsumm.close();
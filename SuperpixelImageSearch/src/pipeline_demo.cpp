@@ -45,9 +45,9 @@ int main(int, char**)
         // --------------------------------------------------------------------
         COCOLabelIndex cocoIndex;
         std::cout << "Loading train annotations...\n";
-        loadCOCOAnnotations(TRAIN_ANN, cocoIndex);
+        loadCOCOAnnotations(TRAIN_ANN, cocoIndex, COCO_LABEL_CACHE_DIR);
         std::cout << "Loading val annotations...\n";
-        loadCOCOAnnotations(VAL_ANN,   cocoIndex);
+        loadCOCOAnnotations(VAL_ANN,   cocoIndex, COCO_LABEL_CACHE_DIR);
         std::cout << "Finished loading annotations.\n\n";
 
         // --------------------------------------------------------------------
@@ -134,11 +134,7 @@ int main(int, char**)
             return 1;
         }
 
-        fout << "method,feature,descriptor_mode,superpixel_cell_size,grid_x,grid_y,"
-             << "max_images,num_indexed,"
-             << "query_filename,query_categories,"
-             << "match_rank,match_filename,match_categories,shares_label,distance,"
-             << "index_time_ms,query_time_ms\n";
+        fout << MATCHES_CSV_HEADER;
 
         // --------------------------------------------------------------------
         // 8) CUSTOM pipeline config: CUSTOM_SDSLIC_SIFT ONLY
@@ -154,7 +150,7 @@ int main(int, char**)
         std::cout << "Running CUSTOM_SDSLIC_SIFT pipeline...\n";
         std::cout << "==========================================\n\n";
 
-        ExperimentStats stats = runExperiment(
+        std::vector<ExperimentStats> stats = runExperiment(
             customCfg,
             imagePaths,
             cocoIndex,
@@ -171,8 +167,9 @@ int main(int, char**)
         std::cout << "\nPipeline demo finished.\n";
         std::cout << "Images written under ../SuperpixelImageSearch/output/\n";
         std::cout << "Pipeline CSV: " << csvFile << "\n";
-        std::cout << "Precision@" << TOP_K << " = "
-                  << stats.precisionAtK << "\n";
+        for (const auto& s : stats)
+            std::cout << "Precision@" << TOP_K << " (" << s.indexName << ") = "
+                      << s.precisionAtK << "\n";
 
         return 0;
     }
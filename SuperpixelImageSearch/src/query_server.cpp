@@ -0,0 +1,176 @@
+#include "query_server.hpp"
+
+#include <opencv2/imgcodecs.hpp>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+// LATENCY TRACKING
+
+void LatencyTracker::record(double latencyMs, std::chrono::steady_clock::time_point done) {
+    std::lock_guard<std::mutex> lock(mutex);
+    samples[next] = { latencyMs, done };
+    next = (next + 1) % samples.size();
+    count = std::min(count + 1, samples.size());
+}
+
+LatencyTracker::Snapshot LatencyTracker::snapshot() const {
+    std::vector<double> latencies;
+    std::chrono::steady_clock::time_point oldest = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        latencies.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            const Sample& s = samples[(next + samples.size() - 1 - i) % samples.size()];
+            latencies.push_back(s.latencyMs);
+            oldest = std::min(oldest, s.done);
+        }
+    }
+
+    Snapshot snap;
+    snap.count = latencies.size();
+    if (latencies.empty()) return snap;
+
+    auto percentile = [&](double p) {
+        size_t i = std::min(latencies.size() - 1, (size_t)(p * (double)latencies.size()));
+        std::nth_element(latencies.begin(), latencies.begin() + i, latencies.end());
+        return latencies[i];
+    };
+    snap.p50Ms = percentile(0.50);
+    snap.p99Ms = percentile(0.99);
+
+    double spanS = std::chrono::duration<double>(std::chrono::steady_clock::now() - oldest).count();
+    snap.qps = spanS > 0.0 ? (double)latencies.size() / spanS : 0.0;
+    return snap;
+}
+
+// QUERY SERVER
+
+QueryServer::QueryServer(const ImageIndex& index,
+                         Extractor extract,
+                         int defaultK,
+                         int numThreads,
+                         size_t queueCapacity)
+    : index(index), extract(std::move(extract)), defaultK(defaultK),
+      numThreads(numThreads > 0 ? numThreads : std::max(1, (int)std::thread::hardware_concurrency())),
+      queue(queueCapacity) {}
+
+bool QueryServer::answer(const Request& req, std::string& line) {
+    json res;
+    res["id"] = req.id;
+    try {
+        cv::Mat img = cv::imread(req.path, cv::IMREAD_COLOR);
+        if (img.empty()) {
+            res["ok"]    = false;
+            res["error"] = "could not read image";
+            line = res.dump();
+            return false;
+        }
+
+        cv::Mat desc = extract(img);
+        if (desc.empty()) {
+            res["ok"]    = false;
+            res["error"] = "no descriptor";
+            line = res.dump();
+            return false;
+        }
+
+        auto matches = index.search(desc, req.k > 0 ? req.k : defaultK);
+
+        json results = json::array();
+        for (auto& [row, dist] : matches)
+            results.push_back({ { "file", index.filenames[row] }, { "distance", dist } });
+
+        res["ok"]         = true;
+        res["latency_ms"] = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - req.received).count();
+        res["results"]    = std::move(results);
+    } catch (const std::exception& e) {
+        res["ok"]    = false;
+        res["error"] = e.what();
+        line = res.dump();
+        return false;
+    }
+    line = res.dump();
+    return true;
+}
+
+std::string QueryServer::statsJson() const {
+    LatencyTracker::Snapshot snap = latency.snapshot();
+    json res;
+    res["served"]      = served.load();
+    res["failed"]      = failed.load();
+    res["qps"]         = snap.qps;
+    res["p50_ms"]      = snap.p50Ms;
+    res["p99_ms"]      = snap.p99Ms;
+    res["queue_depth"] = queued.load();
+    res["in_flight"]   = inFlight.load();
+    return res.dump();
+}
+
+void QueryServer::write(std::ostream& out, const std::string& line) {
+    std::lock_guard<std::mutex> lock(outMutex);
+    out << line << "\n";
+    out.flush();
+}
+
+void QueryServer::run(std::istream& in, std::ostream& out) {
+    auto worker = [&]() {
+        Request req;
+        while (queue.pop(req)) {
+            queued--;
+            inFlight++;
+            std::string line;
+            bool ok = answer(req, line);
+            write(out, line);
+            inFlight--;
+
+            auto done = std::chrono::steady_clock::now();
+            latency.record(std::chrono::duration<double, std::milli>(done - req.received).count(), done);
+            if (ok)
+                served++;
+            else
+                failed++;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads);
+    for (int i = 0; i < numThreads; ++i)
+        threads.emplace_back(worker);
+
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream words(line);
+        std::string command;
+        if (!(words >> command)) continue;
+
+        if (command == "quit") {
+            break;
+        } else if (command == "stats") {
+            write(out, statsJson());
+        } else if (command == "query") {
+            Request req;
+            req.received = std::chrono::steady_clock::now();
+            words >> req.id >> req.k >> std::ws;
+            std::getline(words, req.path);   // the rest of the line, so paths may hold spaces
+            if (!req.path.empty() && req.path.back() == '\r')
+                req.path.pop_back();
+            if (!words || req.id.empty() || req.path.empty()) {
+                write(out, json({ { "id", req.id }, { "ok", false },
+                                  { "error", "expected: query <id> <k> <path>" } }).dump());
+                continue;
+            }
+            queued++;
+            queue.push(std::move(req));
+        } else {
+            write(out, json({ { "ok", false }, { "error", "unknown command: " + command } }).dump());
+        }
+    }
+
+    queue.close();
+    for (auto& t : threads) t.join();
+}
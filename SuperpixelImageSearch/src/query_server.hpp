@@ -0,0 +1,103 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "bounded_queue.hpp"
+#include "image_index.hpp"
+
+// LATENCY TRACKING
+
+// Latencies and completion times of the most recent queries, for percentiles and QPS
+class LatencyTracker {
+public:
+    explicit LatencyTracker(size_t window = 1024) : samples(window) {}
+
+    void record(double latencyMs, std::chrono::steady_clock::time_point done);
+
+    struct Snapshot {
+        size_t count = 0;    // samples in the window
+        double p50Ms = 0.0;
+        double p99Ms = 0.0;
+        double qps   = 0.0;  // completions per second over the window
+    };
+    Snapshot snapshot() const;
+
+private:
+    struct Sample {
+        double latencyMs = 0.0;
+        std::chrono::steady_clock::time_point done;
+    };
+
+    mutable std::mutex mutex;
+    std::vector<Sample> samples;   // ring, next is overwritten next
+    size_t next  = 0;
+    size_t count = 0;
+};
+
+// QUERY SERVER
+
+// Answers image queries against an index that stays loaded, with descriptor extraction and
+// search for concurrent queries running on a thread pool. Line protocol, one request per line:
+//
+//   query <id> <k> <path>   top k matches of the image at path (k = 0 for the default)
+//   stats                   latency percentiles, QPS, queue depth and counters
+//   quit                    finish the queued queries and stop (as does end of input)
+//
+// Every request is answered with one line of JSON. Query responses carry the client's id,
+// since concurrent queries are answered as they finish, not in request order:
+//
+//   {"id":"7","ok":true,"latency_ms":41.2,"results":[{"file":"a.jpg","distance":0.31},...]}
+//   {"id":"8","ok":false,"error":"could not read image"}
+//   {"served":120,"failed":1,"qps":35.1,"p50_ms":38.0,"p99_ms":95.4,"queue_depth":3,"in_flight":8}
+//
+// Latency is measured from reading the request to writing its response, queueing included.
+// When the queue is full the reader stops reading, so clients see backpressure as latency.
+class QueryServer {
+public:
+    // Descriptor of a BGR image, comparable with the rows of the index
+    using Extractor = std::function<cv::Mat(const cv::Mat& bgr)>;
+
+    QueryServer(const ImageIndex& index,
+                Extractor extract,
+                int defaultK,
+                int numThreads = 0,           // 0 for one per core
+                size_t queueCapacity = 256);
+
+    // Serves requests from in until "quit" or end of input, answering on out
+    void run(std::istream& in, std::ostream& out);
+
+    std::string statsJson() const;
+
+private:
+    struct Request {
+        std::string id;
+        std::string path;
+        int k = 0;
+        std::chrono::steady_clock::time_point received;
+    };
+
+    // Runs a query; line gets its response
+    bool answer(const Request& req, std::string& line);
+    void write(std::ostream& out, const std::string& line);
+
+    const ImageIndex& index;
+    Extractor extract;
+    int defaultK;
+    int numThreads;
+
+    BlockingQueue<Request> queue;   // workers sleep while no queries come in
+    std::mutex outMutex;
+    LatencyTracker latency;
+
+    std::atomic<size_t> queued{0};
+    std::atomic<size_t> inFlight{0};
+    std::atomic<size_t> served{0};
+    std::atomic<size_t> failed{0};
+};
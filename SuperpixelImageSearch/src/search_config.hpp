@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+// SHARED CONFIG
+
+// Settings superpixel_ris (main.cpp) and distance_calculation both depend on. Paths are relative
+// to the directory the programs run from, which has to be the same for both so that
+// distance_calculation finds the matches, CSVs and cached descriptors superpixel_ris wrote.
+
+// PATH CONFIG
+inline const std::string DATA_ROOT            = "../../SuperpixelImageSearch/data";
+inline const std::string OUTPUT_ROOT          = "../SuperpixelImageSearch/output";
+inline const std::string INDEX_DIR            = DATA_ROOT + "/coco2017/images/train2017";
+inline const std::string QUERY_IMG            = DATA_ROOT + "/coco2017/images/val2017/000000000139.jpg";
+inline const std::string DESCRIPTOR_CACHE_DIR = OUTPUT_ROOT + "/cache";
+
+// EXPERIMENT CONFIG
+constexpr int TOP_K = 5;
+inline const std::string DESCRIPTOR_CACHE_TAG = "v1";  // bump when descriptors change, so cached ones miss
+
+// DESCRIPTOR CACHE NAMES
+
+// Start of the cache names of every image size's features of a type (e.g. "SIFT")
+inline std::string featureCachePrefix(const std::string& featureName) {
+    return DESCRIPTOR_CACHE_TAG + "_features_" + featureName + "_";
+}
+
+// Cache name of the features of a gray image of this size, followed by
+// KEYPOINTS_CACHE_SUFFIX or DESCRIPTORS_CACHE_SUFFIX
+inline std::string featureCacheName(const std::string& featureName, int cols, int rows) {
+    return featureCachePrefix(featureName) + std::to_string(cols) + "x" + std::to_string(rows);
+}
+
+inline const std::string KEYPOINTS_CACHE_SUFFIX   = "_kp";
+inline const std::string DESCRIPTORS_CACHE_SUFFIX = "_desc";
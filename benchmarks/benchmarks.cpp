@@ -0,0 +1,418 @@
+// benchmarks.cpp
+// Times the hot paths of every module (SD-SLIC segmentation and duperizing, LTriDP preprocessing and
+// feature extraction, the superpixel metrics, the SLIC hash table and the image index) on synthetic
+// images across image sizes, region sizes and thread counts, and writes the timings to JSON so
+// releases can be compared.
+//
+// Usage: benchmarks [--quick] [--out FILE] [--warmup N] [--reps N] [--threads 1,4,8] [--filter TEXT]
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sdp_slic.hpp"
+#include "preprocessing.hpp"
+#include "feature_extraction.hpp"
+#include "evaluator.hpp"
+#include "SLICHashTable.hpp"
+#include "image_index.hpp"
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+#ifndef BENCHMARK_GIT_REVISION
+#define BENCHMARK_GIT_REVISION "unknown"
+#endif
+
+// HARNESS
+
+struct BenchmarkOptions {
+    bool             quick  = false;
+    int              warmup = 2;
+    int              reps   = 5;
+    std::vector<int> threads;          // thread counts to run with, empty for 1 and all cores
+    std::string      filter;           // only benchmarks whose name contains it
+    std::string      outPath = "benchmark_results.json";
+};
+
+class BenchmarkRunner {
+public:
+    explicit BenchmarkRunner(const BenchmarkOptions& options) : options(options) {}
+
+    bool enabled(const std::string& name) const {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    // Runs setup (untimed) and then op (timed) warmup + reps times, and records the op's timings
+    void run(const std::string& name,
+             const json& params,
+             const std::function<void()>& setup,
+             const std::function<void()>& op) {
+        if (!enabled(name)) return;
+
+        for (int i = 0; i < options.warmup; ++i) {
+            setup();
+            op();
+        }
+
+        std::vector<double> samples;
+        samples.reserve(options.reps);
+        for (int i = 0; i < options.reps; ++i) {
+            setup();
+            auto t0 = std::chrono::steady_clock::now();
+            op();
+            auto t1 = std::chrono::steady_clock::now();
+            samples.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+        }
+
+        std::vector<double> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        double mean = 0.0;
+        for (double s : samples) mean += s;
+        mean /= (double)samples.size();
+        double var = 0.0;
+        for (double s : samples) var += (s - mean) * (s - mean);
+        double median = sorted.size() % 2
+            ? sorted[sorted.size() / 2]
+            : 0.5 * (sorted[sorted.size() / 2 - 1] + sorted[sorted.size() / 2]);
+
+        json result;
+        result["name"]      = name;
+        result["params"]    = params;
+        result["warmup"]    = options.warmup;
+        result["reps"]      = options.reps;
+        result["mean_ms"]   = mean;
+        result["median_ms"] = median;
+        result["min_ms"]    = sorted.front();
+        result["max_ms"]    = sorted.back();
+        result["stddev_ms"] = samples.size() > 1 ? std::sqrt(var / (double)(samples.size() - 1)) : 0.0;
+        result["samples_ms"] = samples;
+        results.push_back(result);
+
+        std::cout << std::left << std::setw(36) << name << " " << std::setw(60) << params.dump()
+                  << " median " << std::fixed << std::setprecision(3) << median << " ms\n";
+        std::cout.unsetf(std::ios::floatfield);
+    }
+
+    bool write(const std::string& path) const {
+        std::time_t now = std::time(nullptr);
+        char timestamp[32];
+        std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+        json out;
+        out["meta"] = {
+            { "timestamp",        timestamp },
+            { "git_revision",     BENCHMARK_GIT_REVISION },
+            { "opencv_version",   CV_VERSION },
+            { "hardware_threads", (int)std::thread::hardware_concurrency() },
+            { "warmup",           options.warmup },
+            { "reps",             options.reps },
+            { "quick",            options.quick },
+        };
+        out["results"] = results;
+
+        std::ofstream f(path);
+        if (!f.is_open()) return false;
+        f << out.dump(2) << "\n";
+        return (bool)f;
+    }
+
+private:
+    const BenchmarkOptions& options;
+    json results = json::array();
+};
+
+// SYNTHETIC INPUTS
+
+// Piecewise smooth color image (gradient, overlapping shapes, a little noise), the same for a
+// given size and seed on every run
+cv::Mat makeTestImage(int width, int height, uint64_t seed = 12345) {
+    cv::RNG rng(seed);
+    cv::Mat img(height, width, CV_8UC3);
+    for (int y = 0; y < height; ++y) {
+        cv::Vec3b* row = img.ptr<cv::Vec3b>(y);
+        for (int x = 0; x < width; ++x)
+            row[x] = cv::Vec3b((uchar)(255 * x / width), (uchar)(255 * y / height), 128);
+    }
+
+    int numShapes = 12 + (width * height) / (128 * 128);
+    for (int i = 0; i < numShapes; ++i) {
+        cv::Scalar color(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+        cv::Point center(rng.uniform(0, width), rng.uniform(0, height));
+        int radius = rng.uniform(std::max(4, width / 64), std::max(8, width / 6));
+        if (i % 2)
+            cv::circle(img, center, radius, color, cv::FILLED);
+        else
+            cv::rectangle(img, cv::Rect(center.x - radius, center.y - radius / 2, 2 * radius, radius),
+                          color, cv::FILLED);
+    }
+
+    cv::Mat noisy, noise(img.size(), CV_16SC3);
+    rng.fill(noise, cv::RNG::NORMAL, 0, 6);
+    img.convertTo(noisy, CV_16SC3);
+    cv::add(noisy, noise, noisy);
+    noisy.convertTo(img, CV_8UC3);
+    return img;
+}
+
+cv::Mat makeFeatures(int rows, int dim, uint64_t seed = 777) {
+    cv::RNG rng(seed);
+    cv::Mat features(rows, dim, CV_32F);
+    rng.fill(features, cv::RNG::UNIFORM, 0.0f, 1.0f);
+    return features;
+}
+
+// BENCHMARKS
+
+constexpr int   SLIC_ITERATIONS      = 10;
+constexpr float SLIC_RULER           = 10.0f;
+constexpr int   MIN_ELEMENT_SIZE     = 4;
+constexpr float DUPER_DISTANCE       = 25.0f;
+constexpr int   HISTOGRAM_BUCKETS[3] = { 8, 64, 64 };
+constexpr int   HASH_BATCH_IMAGES    = 8;
+constexpr int   INDEX_QUERIES        = 64;
+constexpr int   INDEX_TOP_K          = 5;
+
+void benchmarkSegmentation(BenchmarkRunner& runner, const std::vector<int>& sizes,
+                           const std::vector<int>& regionSizes, const std::vector<int>& threadCounts) {
+    for (int size : sizes) {
+        cv::Mat lab;
+        cv::cvtColor(makeTestImage(size, size), lab, cv::COLOR_BGR2Lab);
+
+        for (int region : regionSizes) {
+            for (int threads : threadCounts) {
+                cv::setNumThreads(threads);
+                json params = { { "width", size }, { "height", size }, { "region_size", region }, { "threads", threads } };
+                cv::Ptr<SuperpixelSLIC> slic;
+
+                auto create = [&]() { slic = createSuperpixelSLIC(lab, SLIC, region, SLIC_RULER); };
+                auto iterated = [&]() { create(); slic->iterate(SLIC_ITERATIONS); };
+                auto connected = [&]() { iterated(); slic->enforceLabelConnectivity(MIN_ELEMENT_SIZE); };
+
+                runner.run("slic.iterate", params, create, [&]() { slic->iterate(SLIC_ITERATIONS); });
+                runner.run("slic.enforceLabelConnectivity", params, iterated,
+                           [&]() { slic->enforceLabelConnectivity(MIN_ELEMENT_SIZE); });
+                runner.run("slic.duperizeWithAverage", params, connected,
+                           [&]() { slic->duperizeWithAverage(DUPER_DISTANCE); });
+                runner.run("slic.duperizeWithHistogram", params, connected,
+                           [&]() { slic->duperizeWithHistogram(HISTOGRAM_BUCKETS, DUPER_DISTANCE); });
+            }
+        }
+    }
+}
+
+void benchmarkLTriDP(BenchmarkRunner& runner, const std::vector<int>& sizes, const std::vector<int>& threadCounts) {
+    using namespace ltridp_slic_improved;
+
+    for (int size : sizes) {
+        cv::Mat gray;
+        cv::cvtColor(makeTestImage(size, size), gray, cv::COLOR_BGR2GRAY);
+
+        for (int threads : threadCounts) {
+            cv::setNumThreads(threads);
+            json params = { { "width", size }, { "height", size }, { "threads", threads } };
+
+            Preprocessor preprocessor;
+            FeatureExtractor extractor;
+            cv::Mat enhanced, features;
+            preprocessor.enhance(gray, enhanced);
+
+            runner.run("ltridp.Preprocessor.enhance", params, []() {},
+                       [&]() { cv::Mat out; preprocessor.enhance(gray, out); });
+            runner.run("ltridp.FeatureExtractor.extract", params, []() {},
+                       [&]() { extractor.extract(enhanced, features); });
+        }
+    }
+}
+
+void benchmarkMetrics(BenchmarkRunner& runner, const std::vector<int>& sizes,
+                      const std::vector<int>& regionSizes, const std::vector<int>& threadCounts) {
+    cv::setNumThreads(1);
+    for (int size : sizes) {
+        cv::Mat bgr = makeTestImage(size, size), lab, gray;
+        cv::cvtColor(bgr, lab, cv::COLOR_BGR2Lab);
+        cv::cvtColor(bgr, gray, cv::COLOR_BGR2GRAY);
+
+        for (int region : regionSizes) {
+            // A coarser segmentation stands in for the ground truth
+            cv::Mat labels, groundTruth;
+            auto slic = createSuperpixelSLIC(lab, SLIC, region, SLIC_RULER);
+            slic->iterate(SLIC_ITERATIONS);
+            slic->enforceLabelConnectivity(MIN_ELEMENT_SIZE);
+            slic->getLabels(labels);
+            auto coarse = createSuperpixelSLIC(lab, SLIC, region * 4, SLIC_RULER);
+            coarse->iterate(SLIC_ITERATIONS);
+            coarse->getLabels(groundTruth);
+
+            json params = { { "width", size }, { "height", size }, { "region_size", region } };
+            runner.run("metrics.computeAverageCompactness", params, []() {},
+                       [&]() { SuperpixelEvaluator::computeAverageCompactness(labels); });
+            runner.run("metrics.computeUnderSegmentationError", params, []() {},
+                       [&]() { SuperpixelEvaluator::computeUnderSegmentationError(labels, groundTruth); });
+            runner.run("metrics.computeBoundaryRecall", params, []() {},
+                       [&]() { SuperpixelEvaluator::computeBoundaryRecall(labels, groundTruth); });
+            runner.run("metrics.computeEdgeAlignmentScore", params, []() {},
+                       [&]() { SuperpixelEvaluator::computeEdgeAlignmentScore(labels, gray); });
+
+            for (int threads : threadCounts) {
+                cv::setNumThreads(threads);
+                json threadParams = params;
+                threadParams["threads"] = threads;
+                runner.run("metrics.evaluateAll", threadParams, []() {},
+                           [&]() { SuperpixelEvaluator::evaluateAll(labels, groundTruth, gray); });
+            }
+            cv::setNumThreads(1);
+        }
+    }
+}
+
+void benchmarkHashTable(BenchmarkRunner& runner, const std::vector<int>& sizes,
+                        const std::vector<int>& regionSizes, const std::vector<int>& threadCounts) {
+    cv::setNumThreads(1);
+    for (int size : sizes) {
+        for (int region : regionSizes) {
+            std::vector<cv::Mat> images(HASH_BATCH_IMAGES), labels(HASH_BATCH_IMAGES);
+            std::vector<int> counts(HASH_BATCH_IMAGES);
+            for (int i = 0; i < HASH_BATCH_IMAGES; ++i) {
+                cv::cvtColor(makeTestImage(size, size, 1000 + i), images[i], cv::COLOR_BGR2Lab);
+                auto slic = createSuperpixelSLIC(images[i], SLIC, region, SLIC_RULER);
+                slic->iterate(SLIC_ITERATIONS);
+                slic->enforceLabelConnectivity(MIN_ELEMENT_SIZE);
+                slic->getLabels(labels[i]);
+                counts[i] = slic->getNumberOfSuperpixels();
+            }
+
+            json params = { { "width", size }, { "height", size }, { "region_size", region } };
+            std::unique_ptr<SLICHashTable> table;
+            auto fresh = [&]() { table = std::make_unique<SLICHashTable>(); };
+            runner.run("hashtable.Hash", params, fresh, [&]() {
+                table->Hash(images[0], labels[0], counts[0], 0);
+                table->build();
+            });
+
+            for (int threads : threadCounts) {
+                json batchParams = params;
+                batchParams["images"]  = HASH_BATCH_IMAGES;
+                batchParams["threads"] = threads;
+                runner.run("hashtable.HashAll", batchParams, fresh, [&]() {
+                    table->HashAll(images, labels, counts, threads);
+                    table->build();
+                });
+            }
+
+            fresh();
+            table->HashAll(images, labels, counts);
+            table->build();
+            runner.run("hashtable.Query", params, []() {},
+                       [&]() { table->Query(images[1], labels[1], counts[1]); });
+        }
+    }
+}
+
+void benchmarkImageIndex(BenchmarkRunner& runner, bool quick, const std::vector<int>& threadCounts) {
+    std::vector<std::pair<int, int>> shapes = quick
+        ? std::vector<std::pair<int, int>>{ { 10000, 128 } }
+        : std::vector<std::pair<int, int>>{ { 10000, 128 }, { 100000, 128 }, { 10000, 1024 } };
+    const std::vector<IndexConfig> backends = {
+        { IndexType::FLAT },
+        { IndexType::IVF, 0, 8 },
+        { IndexType::PQ },
+    };
+
+    for (auto [rows, dim] : shapes) {
+        ImageIndex index;
+        index.features = makeFeatures(rows, dim);
+        index.filenames.resize(rows);
+        cv::Mat queries = makeFeatures(INDEX_QUERIES, dim, 4242);
+
+        for (const auto& cfg : backends) {
+            index.buildBackend(cfg);
+            for (int threads : threadCounts) {
+                cv::setNumThreads(threads);
+                json params = { { "rows", rows }, { "dim", dim }, { "backend", indexConfigToString(cfg) },
+                                { "threads", threads }, { "queries", INDEX_QUERIES }, { "k", INDEX_TOP_K } };
+                runner.run("index.search", params, []() {}, [&]() {
+                    for (int q = 0; q < queries.rows; ++q)
+                        index.search(queries.row(q), INDEX_TOP_K);
+                });
+                runner.run("index.searchBatch", params, []() {},
+                           [&]() { index.searchBatch(queries, INDEX_TOP_K); });
+            }
+        }
+    }
+}
+
+// MAIN
+
+bool parseOptions(int argc, char** argv, BenchmarkOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--quick") {
+            options.quick = true;
+        } else if (arg == "--out" && hasValue) {
+            options.outPath = argv[++i];
+        } else if (arg == "--warmup" && hasValue) {
+            options.warmup = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--reps" && hasValue) {
+            options.reps = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--filter" && hasValue) {
+            options.filter = argv[++i];
+        } else if (arg == "--threads" && hasValue) {
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ','))
+                if (std::atoi(item.c_str()) > 0) options.threads.push_back(std::atoi(item.c_str()));
+        } else {
+            std::cerr << "Usage: benchmarks [--quick] [--out FILE] [--warmup N] [--reps N] "
+                      << "[--threads 1,4,8] [--filter TEXT]\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchmarkOptions options;
+    if (!parseOptions(argc, argv, options)) return 1;
+
+    std::vector<int> threadCounts = options.threads;
+    if (threadCounts.empty()) {
+        int cores = std::max(1, (int)std::thread::hardware_concurrency());
+        threadCounts = { 1 };
+        if (cores > 1) threadCounts.push_back(cores);
+    }
+    std::vector<int> sizes       = options.quick ? std::vector<int>{ 256, 512 } : std::vector<int>{ 256, 512, 1024, 2048 };
+    std::vector<int> regionSizes = options.quick ? std::vector<int>{ 16 }       : std::vector<int>{ 16, 32, 64 };
+
+    BenchmarkRunner runner(options);
+    try {
+        benchmarkSegmentation(runner, sizes, regionSizes, threadCounts);
+        benchmarkLTriDP(runner, sizes, threadCounts);
+        benchmarkMetrics(runner, sizes, regionSizes, threadCounts);
+        benchmarkHashTable(runner, sizes, regionSizes, threadCounts);
+        benchmarkImageIndex(runner, options.quick, threadCounts);
+    } catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << "\n";
+        return 1;
+    }
+
+    if (!runner.write(options.outPath)) {
+        std::cerr << "Failed to write " << options.outPath << "\n";
+        return 1;
+    }
+    std::cout << "Results written to: " << options.outPath << "\n";
+    return 0;
+}
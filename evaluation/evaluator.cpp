@@ -8,10 +8,73 @@
 
 #include "evaluator.hpp"
 #include <opencv2/imgproc.hpp>
+#include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 #include <cmath>
 
+namespace {
+
+// Largest superpixel x ground truth overlap table kept as a dense array (per stripe of rows)
+constexpr long long DENSE_OVERLAP_CELLS = 1 << 18;
+
+/**
+ * Gives every label an index in [0, count): labels are shifted down to start at 0
+ * when their range is no larger than the number of pixels, and renumbered in sorted
+ * order otherwise. Returns count.
+ */
+int compactLabels(const cv::Mat& labels, cv::Mat& compact) {
+    if (labels.empty()) {
+        compact = labels;
+        return 0;
+    }
+    double minLabel = 0.0, maxLabel = 0.0;
+    cv::minMaxLoc(labels, &minLabel, &maxLabel);
+    const long long range = static_cast<long long>(maxLabel) - static_cast<long long>(minLabel) + 1;
+    if (range <= static_cast<long long>(labels.total())) {
+        if (minLabel == 0.0) compact = labels;
+        else labels.convertTo(compact, CV_32S, 1.0, -minLabel);
+        return static_cast<int>(range);
+    }
+
+    std::vector<int> sorted;
+    sorted.reserve(labels.total());
+    for (int row = 0; row < labels.rows; ++row) {
+        sorted.insert(sorted.end(), labels.ptr<int>(row), labels.ptr<int>(row) + labels.cols);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    compact.create(labels.size(), CV_32S);
+    cv::parallel_for_(cv::Range(0, labels.rows), [&](const cv::Range& rows) {
+        for (int row = rows.start; row < rows.end; ++row) {
+            const int* in = labels.ptr<int>(row);
+            int* out = compact.ptr<int>(row);
+            for (int col = 0; col < labels.cols; ++col) {
+                out[col] = static_cast<int>(std::lower_bound(sorted.begin(), sorted.end(), in[col]) - sorted.begin());
+            }
+        }
+    });
+    return static_cast<int>(sorted.size());
+}
+
+/**
+ * What one stripe of rows contributes to evaluateAll().
+ */
+struct MetricsPartial {
+    std::vector<int> area;                               // Pixels of each superpixel
+    std::vector<int> perimeter;                          // Boundary pixels of each superpixel
+    std::vector<int> overlap;                            // Dense overlap table, superpixel-major
+    std::vector<std::pair<long long, int>> overlapRuns;  // (superpixel * numRegions + region, pixels) otherwise
+    long long gtBoundaryPixels = 0;
+    long long matchedGtBoundaryPixels = 0;
+    long long boundaryPixels = 0;
+    long long alignedBoundaryPixels = 0;
+};
+
+} // namespace
+
 
 double SuperpixelEvaluator::computeAverageCompactness(const cv::Mat& superpixelLabels) {
     CV_Assert(superpixelLabels.type() == CV_32S);
@@ -124,43 +187,35 @@ cv::Mat SuperpixelEvaluator::computeLabelBoundaryMask(const cv::Mat& labelImage)
     CV_Assert(labelImage.type() == CV_32S);
     const int numRows = labelImage.rows;
     const int numCols = labelImage.cols;
-    cv::Mat boundaryMask = cv::Mat::zeros(numRows, numCols, CV_8U);
-
-    // Check all 8 neighbors
-    const int dx[] = {-1, 0, 1, -1, 1, -1, 0, 1};
-    const int dy[] = {-1, -1, -1, 0, 0, 1, 1, 1};
-
-    for (int row = 0; row < numRows; ++row) {
-        const int* labelRowPtr = labelImage.ptr<int>(row);
-        uchar* boundaryRowPtr = boundaryMask.ptr<uchar>(row);
-
-        for (int col = 0; col < numCols; ++col) {
-            const int currentLabel = labelRowPtr[col];
-            bool pixelIsBoundary   = false;
-
-            // Check all 8 neighbors
-            for (int k = 0; k < 8; ++k) {
-                const int neighborRow = row + dy[k];
-                const int neighborCol = col + dx[k];
-
-                // Boundary check
-                if (neighborRow < 0 || neighborRow >= numRows ||
-                    neighborCol < 0 || neighborCol >= numCols) {
-                    continue;
+    cv::Mat boundaryMask(numRows, numCols, CV_8U);
+
+    cv::parallel_for_(cv::Range(0, numRows), [&](const cv::Range& rows) {
+        for (int row = rows.start; row < rows.end; ++row) {
+            const int* labelRowPtr = labelImage.ptr<int>(row);
+            const int* aboveRowPtr = row > 0 ? labelImage.ptr<int>(row - 1) : nullptr;
+            const int* belowRowPtr = row + 1 < numRows ? labelImage.ptr<int>(row + 1) : nullptr;
+            uchar* boundaryRowPtr = boundaryMask.ptr<uchar>(row);
+
+            for (int col = 0; col < numCols; ++col) {
+                const int currentLabel = labelRowPtr[col];
+                // Neighbors outside the image are clamped onto pixels already compared
+                const int left  = col > 0 ? col - 1 : col;
+                const int right = col + 1 < numCols ? col + 1 : col;
+
+                // Check all 8 neighbors, different label = boundary
+                bool pixelIsBoundary = labelRowPtr[left] != currentLabel || labelRowPtr[right] != currentLabel;
+                if (!pixelIsBoundary && aboveRowPtr != nullptr) {
+                    pixelIsBoundary = aboveRowPtr[left] != currentLabel || aboveRowPtr[col] != currentLabel ||
+                                      aboveRowPtr[right] != currentLabel;
                 }
-
-                // Different label = boundary
-                if (labelImage.ptr<int>(neighborRow)[neighborCol] != currentLabel) {
-                    pixelIsBoundary = true;
-                    break;
+                if (!pixelIsBoundary && belowRowPtr != nullptr) {
+                    pixelIsBoundary = belowRowPtr[left] != currentLabel || belowRowPtr[col] != currentLabel ||
+                                      belowRowPtr[right] != currentLabel;
                 }
-            }
-
-            if (pixelIsBoundary) {
-                boundaryRowPtr[col] = 255;
+                boundaryRowPtr[col] = pixelIsBoundary ? 255 : 0;
             }
         }
-    }
+    });
 
     return boundaryMask;
 }
@@ -251,3 +306,183 @@ double SuperpixelEvaluator::computeEdgeAlignmentScore(const cv::Mat& superpixelL
 
     return alignedBoundaryPixelCount / totalBoundaryPixelCount;
 }
+
+SuperpixelMetrics SuperpixelEvaluator::evaluateAll(const cv::Mat& superpixelLabels, const cv::Mat& groundTruthLabels, const cv::Mat& intensityImage, double overlapFractionThreshold, int boundaryToleranceInPixels, int edgeToleranceInPixels) {
+    CV_Assert(superpixelLabels.type() == CV_32S);
+    CV_Assert(groundTruthLabels.empty() ||
+              (groundTruthLabels.type() == CV_32S && groundTruthLabels.size() == superpixelLabels.size()));
+    CV_Assert(intensityImage.empty() ||
+              (intensityImage.type() == CV_8UC1 && intensityImage.size() == superpixelLabels.size()));
+    CV_Assert(overlapFractionThreshold >= 0.0 && overlapFractionThreshold <= 1.0);
+    CV_Assert(boundaryToleranceInPixels >= 0 && edgeToleranceInPixels >= 0);
+
+    SuperpixelMetrics metrics;
+    metrics.hasGroundTruth = !groundTruthLabels.empty();
+    metrics.hasIntensity   = !intensityImage.empty();
+
+    const int numRows   = superpixelLabels.rows;
+    const int numCols   = superpixelLabels.cols;
+    const int numPixels = numRows * numCols;
+    if (numPixels == 0) {
+        return metrics;
+    }
+
+    // Each mask and distance transform is computed once and shared by the metrics that need it
+    cv::Mat superpixels, regions;
+    const int numSuperpixels = compactLabels(superpixelLabels, superpixels);
+    const int numRegions = metrics.hasGroundTruth ? compactLabels(groundTruthLabels, regions) : 0;
+
+    cv::Mat superpixelBoundaryMask = computeLabelBoundaryMask(superpixelLabels);
+    cv::Mat gtBoundaryMask, distanceToSuperpixelBoundary;
+    if (metrics.hasGroundTruth) {
+        gtBoundaryMask = computeLabelBoundaryMask(groundTruthLabels);
+        cv::Mat superpixelNonBoundaryMask;
+        cv::bitwise_not(superpixelBoundaryMask, superpixelNonBoundaryMask);
+        cv::distanceTransform(superpixelNonBoundaryMask, distanceToSuperpixelBoundary, cv::DIST_L2, cv::DIST_MASK_3);
+    }
+    cv::Mat distanceToEdge;
+    if (metrics.hasIntensity) {
+        cv::Mat edges, nonEdgeMask;
+        cv::Canny(intensityImage, edges, 50, 150);
+        cv::bitwise_not(edges, nonEdgeMask);
+        cv::distanceTransform(nonEdgeMask, distanceToEdge, cv::DIST_L2, cv::DIST_MASK_3);
+    }
+
+    // One pass over the rows, a stripe of rows per thread
+    const bool denseOverlap = static_cast<long long>(numSuperpixels) * numRegions <= DENSE_OVERLAP_CELLS;
+    const int numStripes = std::max(1, std::min(numRows, cv::getNumThreads()));
+    std::vector<MetricsPartial> partials(numStripes);
+    const float boundaryTolerance = static_cast<float>(boundaryToleranceInPixels);
+    const float edgeTolerance = static_cast<float>(edgeToleranceInPixels);
+
+    cv::parallel_for_(cv::Range(0, numStripes), [&](const cv::Range& stripes) {
+        for (int stripe = stripes.start; stripe < stripes.end; ++stripe) {
+            MetricsPartial& partial = partials[stripe];
+            partial.area.assign(numSuperpixels, 0);
+            partial.perimeter.assign(numSuperpixels, 0);
+            if (metrics.hasGroundTruth && denseOverlap) {
+                partial.overlap.assign(static_cast<size_t>(numSuperpixels) * numRegions, 0);
+            }
+
+            const int firstRow = static_cast<int>(static_cast<long long>(stripe) * numRows / numStripes);
+            const int lastRow  = static_cast<int>(static_cast<long long>(stripe + 1) * numRows / numStripes);
+            for (int row = firstRow; row < lastRow; ++row) {
+                const int* spRow = superpixels.ptr<int>(row);
+                const uchar* boundaryRow = superpixelBoundaryMask.ptr<uchar>(row);
+                for (int col = 0; col < numCols; ++col) {
+                    partial.area[spRow[col]]++;
+                    if (boundaryRow[col] != 0) {
+                        partial.perimeter[spRow[col]]++;
+                    }
+                }
+
+                if (metrics.hasGroundTruth) {
+                    const int* gtRow = regions.ptr<int>(row);
+                    if (denseOverlap) {
+                        for (int col = 0; col < numCols; ++col) {
+                            partial.overlap[static_cast<size_t>(spRow[col]) * numRegions + gtRow[col]]++;
+                        }
+                    } else {
+                        // Runs of pixels with the same (superpixel, region) pair count once
+                        for (int col = 0; col < numCols;) {
+                            int end = col + 1;
+                            while (end < numCols && spRow[end] == spRow[col] && gtRow[end] == gtRow[col]) ++end;
+                            partial.overlapRuns.emplace_back(static_cast<long long>(spRow[col]) * numRegions + gtRow[col], end - col);
+                            col = end;
+                        }
+                    }
+
+                    const uchar* gtBoundaryRow = gtBoundaryMask.ptr<uchar>(row);
+                    const float* distanceRow = distanceToSuperpixelBoundary.ptr<float>(row);
+                    for (int col = 0; col < numCols; ++col) {
+                        if (gtBoundaryRow[col] == 0) continue;
+                        partial.gtBoundaryPixels++;
+                        if (distanceRow[col] <= boundaryTolerance) partial.matchedGtBoundaryPixels++;
+                    }
+                }
+
+                if (metrics.hasIntensity) {
+                    const float* distanceRow = distanceToEdge.ptr<float>(row);
+                    for (int col = 0; col < numCols; ++col) {
+                        if (boundaryRow[col] == 0) continue;
+                        partial.boundaryPixels++;
+                        if (distanceRow[col] <= edgeTolerance) partial.alignedBoundaryPixels++;
+                    }
+                }
+            }
+        }
+    });
+
+    // Join the stripes
+    MetricsPartial total = std::move(partials[0]);
+    for (int stripe = 1; stripe < numStripes; ++stripe) {
+        MetricsPartial& partial = partials[stripe];
+        for (int sp = 0; sp < numSuperpixels; ++sp) {
+            total.area[sp] += partial.area[sp];
+            total.perimeter[sp] += partial.perimeter[sp];
+        }
+        for (size_t cell = 0; cell < partial.overlap.size(); ++cell) {
+            total.overlap[cell] += partial.overlap[cell];
+        }
+        total.overlapRuns.insert(total.overlapRuns.end(), partial.overlapRuns.begin(), partial.overlapRuns.end());
+        total.gtBoundaryPixels += partial.gtBoundaryPixels;
+        total.matchedGtBoundaryPixels += partial.matchedGtBoundaryPixels;
+        total.boundaryPixels += partial.boundaryPixels;
+        total.alignedBoundaryPixels += partial.alignedBoundaryPixels;
+        std::vector<std::pair<long long, int>>().swap(partial.overlapRuns);
+    }
+
+    // Compactness P^2 / (4*pi*A) averaged over the superpixels with a boundary
+    double sumCompactness = 0.0;
+    int compactnessCount = 0;
+    for (int sp = 0; sp < numSuperpixels; ++sp) {
+        const double area = total.area[sp];
+        const double perimeter = total.perimeter[sp];
+        if (area > 0 && perimeter > 0) {
+            sumCompactness += (perimeter * perimeter) / (4.0 * M_PI * area);
+            compactnessCount++;
+        }
+    }
+    metrics.averageCompactness = compactnessCount == 0 ? 0.0 : sumCompactness / compactnessCount;
+
+    if (metrics.hasGroundTruth) {
+        // Sum_i  Sum_{[S_k | |S_k ∩ G_i| > B]} |S_k|
+        double summedAreaOverGt = 0.0;
+        auto addOverlap = [&](int superpixelId, int intersectionSize) {
+            const int superpixelPixelCount = total.area[superpixelId];
+            if (intersectionSize > overlapFractionThreshold * static_cast<double>(superpixelPixelCount)) {
+                summedAreaOverGt += static_cast<double>(superpixelPixelCount);
+            }
+        };
+        if (denseOverlap) {
+            for (int sp = 0; sp < numSuperpixels; ++sp) {
+                const int* overlapRow = &total.overlap[static_cast<size_t>(sp) * numRegions];
+                for (int region = 0; region < numRegions; ++region) {
+                    if (overlapRow[region] > 0) addOverlap(sp, overlapRow[region]);
+                }
+            }
+        } else {
+            std::vector<std::pair<long long, int>>& runs = total.overlapRuns;
+            std::sort(runs.begin(), runs.end());
+            for (size_t run = 0; run < runs.size();) {
+                size_t end = run;
+                int intersectionSize = 0;
+                while (end < runs.size() && runs[end].first == runs[run].first) intersectionSize += runs[end++].second;
+                addOverlap(static_cast<int>(runs[run].first / numRegions), intersectionSize);
+                run = end;
+            }
+        }
+        metrics.underSegmentationError = std::max(0.0,
+            (summedAreaOverGt - static_cast<double>(numPixels)) / static_cast<double>(numPixels));
+
+        metrics.boundaryRecall = total.gtBoundaryPixels == 0 ? 1.0
+            : static_cast<double>(total.matchedGtBoundaryPixels) / static_cast<double>(total.gtBoundaryPixels);
+    }
+
+    if (metrics.hasIntensity) {
+        metrics.edgeAlignmentScore = total.boundaryPixels == 0 ? 0.0
+            : static_cast<double>(total.alignedBoundaryPixels) / static_cast<double>(total.boundaryPixels);
+    }
+
+    return metrics;
+}
@@ -31,30 +31,59 @@ bool FeatureExtractor::extract(const cv::Mat& inputImage, cv::Mat& featureMap) {
     if (inputImage.channels() == 3) {
         cv::cvtColor(inputImage, grayImage, cv::COLOR_BGR2GRAY);
     } else {
-        grayImage = inputImage.clone();
+        grayImage = inputImage;
     }
     
-    cv::Mat floatImage;
-    grayImage.convertTo(floatImage, CV_32F);
-    featureMap = cv::Mat::zeros(floatImage.size(), CV_8U);
-    int rows = floatImage.rows;
-    int cols = floatImage.cols;
+    const int rows = grayImage.rows;
+    const int cols = grayImage.cols;
+    featureMap = cv::Mat::zeros(grayImage.size(), CV_8U);
     
-    for (int row = 1; row < rows - 1; ++row) {
-        for (int col = 1; col < cols - 1; ++col) {
-            // get 3x3 neighborhood
-            float neighbors[9];
-            extractNeighborhood(floatImage, row, col, neighbors);
-
-            // compute and store LTriDP code
-            unsigned char code = computeLTriDPCode(neighbors);
-            featureMap.at<unsigned char>(row, col) = code;
+    // Rows only read the image and write their own codes, so bands of rows run in parallel
+    // (the 1-pixel border stays 0)
+    cv::parallel_for_(cv::Range(1, rows - 1), [&](const cv::Range& range) {
+        for (int row = range.start; row < range.end; ++row) {
+            computeLTriDPRow(grayImage.ptr<uchar>(row - 1),
+                             grayImage.ptr<uchar>(row),
+                             grayImage.ptr<uchar>(row + 1),
+                             featureMap.ptr<uchar>(row),
+                             cols);
         }
-    }
+    });
     
     return true;
 }
 
+void FeatureExtractor::computeLTriDPRow(const uchar* above,
+                                        const uchar* center,
+                                        const uchar* below,
+                                        uchar* codes,
+                                        int cols) const {
+    /**
+     * M1 >= M2 compares squared magnitudes (sqrt keeps the order of the
+     * exactly representable integer sums). With p = g(i-1), n = g(i+1):
+     *   (p-gc)² + (n-gc)² - (p-gi)² - (n-gi)² = 2 (gi-gc)(p+n-gc-gi)
+     * so bit i is set when a = gi-gc and b = p+n-gc-gi don't have opposite
+     * signs, which only needs int16 range.
+     */
+    for (int col = 1; col < cols - 1; ++col) {
+        const int gc = center[col];
+        // g1..g8 clockwise from right (see extractNeighborhood)
+        const int g[8] = {
+            center[col + 1], below[col + 1], below[col], below[col - 1],
+            center[col - 1], above[col - 1], above[col], above[col + 1]
+        };
+        
+        int code = 0;
+        for (int i = 0; i < 8; ++i) {
+            const int a = g[i] - gc;
+            const int b = g[(i + 7) % 8] + g[(i + 1) % 8] - gc - g[i];
+            const int bit = ((a ^ b) >= 0) | (a == 0) | (b == 0);
+            code |= bit << i;
+        }
+        codes[col] = static_cast<uchar>(code);
+    }
+}
+
 void FeatureExtractor::extractNeighborhood(const cv::Mat& image, int row, int col, float neighbors[9]) const {
     /**
      * gc is the center pixel at (x,y)
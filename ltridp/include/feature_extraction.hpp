@@ -20,6 +20,8 @@
 
 namespace ltridp_slic_improved {
 
+class StreamingPipeline;
+
 /**
  * @class FeatureExtractor
  * @brief Extracts Local Tri-Directional Pattern (LTriDP) texture features
@@ -72,6 +74,32 @@ public:
 private:
     unsigned char computeLTriDPCode(const float neighbors[9]) const;
 
+    /**
+     * @brief Compute the LTriDP codes of one image row straight from 8-bit data
+     * 
+     * Gives the same codes as computeLTriDPCode. With integer gray values
+     * M1 >= M2 is the same as (gi - gc) * (g(i-1) + g(i+1) - gc - gi) >= 0,
+     * so no square roots (or floats) are needed and the loop vectorizes.
+     * 
+     * Parameters:
+     * @param above Row above (row - 1)
+     * @param center Row to compute the codes of
+     * @param below Row below (row + 1)
+     * @param codes Output codes, only columns [1, cols - 2] are written
+     * @param cols Number of columns in the rows
+     * 
+     * Pre-conditions:
+     * @pre cols >= 3
+     */
+    void computeLTriDPRow(const uchar* above,
+                          const uchar* center,
+                          const uchar* below,
+                          uchar* codes,
+                          int cols) const;
+
+    // Runs computeLTriDPRow tile by tile
+    friend class StreamingPipeline;
+
     /**
      * @brief Extract 3×3 neighborhood gray values around a pixel
      * 
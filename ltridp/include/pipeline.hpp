@@ -0,0 +1,98 @@
+/**
+ * @file pipeline.hpp
+ * @brief Tile-streaming preprocessing and feature extraction pipeline
+ * 
+ * Chains 3D histogram reconstruction, gamma transformation and LTriDP
+ * feature extraction over bands of rows, so the intermediate images only
+ * exist one small tile at a time instead of as full-image passes.
+ * 
+ * @author Ketsia Mbaku
+ * 
+ * Reference:
+ *         Y. Wang, Q. Qi, and X. Shen, "Image Segmentation of Brain MRI Based on
+ *         LTriDP and Superpixels of Improved SLIC," Brain Sciences, vol. 10, no. 2,
+ *         p. 116, 2020.
+ */
+
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "preprocessing.hpp"
+#include "feature_extraction.hpp"
+#include <opencv2/opencv.hpp>
+
+namespace ltridp_slic_improved {
+
+/**
+ * @class StreamingPipeline
+ * @brief Produces the enhanced image and LTriDP feature map the SLIC
+ * segmenters take, in one pass over the input
+ * 
+ * Each tile is a band of rows plus a 1-row halo of enhanced rows on both
+ * sides (the reconstruction itself reads 1 more row of input), so tiles
+ * don't depend on each other and run in parallel. The results are the
+ * same as Preprocessor::enhance followed by FeatureExtractor::extract.
+ */
+class StreamingPipeline {
+public:
+    /**
+     * @brief StreamingPipeline instantiates a new StreamingPipeline object
+     * 
+     * Parameters:
+     * @param gamma Gamma correction parameter (default: 0.5 per paper Section 3.2)
+     * @param tileRows Rows per tile, 0 picks enough rows to fill about 256 KB
+     * 
+     * Post-conditions:
+     * @post StreamingPipeline is ready to process images
+     */
+    explicit StreamingPipeline(double gamma = 0.5, int tileRows = 0);
+    
+    /**
+     * @brief Enhances an image and extracts its LTriDP features tile by tile
+     * 
+     * Parameters:
+     * @param inputImage Input MRI image (grayscale or color)
+     * @param enhancedImage Enhanced grayscale image (CV_8UC1)
+     * @param featureMap LTriDP texture feature map (CV_8UC1, border pixels are 0)
+     * 
+     * Return value:
+     * @return true if successful, false otherwise
+     * 
+     * Pre-conditions:
+     * @pre inputImage must be non-empty CV_8U with at least 3×3 pixels
+     * @pre gamma > 0
+     * 
+     * Post-conditions:
+     * @post enhancedImage matches Preprocessor::enhance (converted to gray for color input)
+     * @post featureMap matches FeatureExtractor::extract on enhancedImage
+     */
+    bool process(const cv::Mat& inputImage, cv::Mat& enhancedImage, cv::Mat& featureMap);
+    
+private:
+    double m_gamma;
+    int m_tileRows;
+    Preprocessor m_preprocessor;
+    FeatureExtractor m_featureExtractor;
+    
+    /**
+     * @brief Process rows [rowBegin, rowEnd) of one tile
+     * 
+     * Parameters:
+     * gray Grayscale input image
+     * gammaTable Gamma lookup table
+     * rowBegin First row of the tile
+     * rowEnd One past the last row of the tile
+     * enhancedImage Output enhanced image (rows of the tile are written)
+     * featureMap Output feature map (rows of the tile are written)
+     */
+    void processTile(const cv::Mat& gray,
+                     const cv::Mat& gammaTable,
+                     int rowBegin,
+                     int rowEnd,
+                     cv::Mat& enhancedImage,
+                     cv::Mat& featureMap) const;
+};
+
+} // namespace ltridp_slic_improved
+
+#endif // PIPELINE_HPP
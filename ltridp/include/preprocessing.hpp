@@ -21,6 +21,8 @@
 
 namespace ltridp_slic_improved {
 
+class StreamingPipeline;
+
 /**
  * @class Preprocessor
  * @brief Handles MRI image preprocessing and enhancement
@@ -110,6 +112,17 @@ private:
      * @post output has same dimensions and channels as input
      */
     void apply3DHistogramReconstruction(const cv::Mat& input, cv::Mat& output);
+
+    /**
+     * @brief Reconstruct one row of an image (apply3DHistogramReconstruction
+     * runs rows in parallel, StreamingPipeline runs them a tile at a time)
+     * 
+     * Parameters:
+     * image CV_8UC1 grayscale image
+     * y Row to reconstruct
+     * out Reconstructed values of the row (image.cols floats, before rounding to 8 bits)
+     */
+    void reconstructRow(const cv::Mat& image, int y, float* out) const;
     
     /**
      * applyGammaTransformation Apply gamma transformation (paper Section 3.2)
@@ -131,6 +144,15 @@ private:
      * output contains gamma-corrected intensities
      */
     void applyGammaTransformation(const cv::Mat& input, cv::Mat& output, double gamma);
+
+    /**
+     * createGammaLookupTable Build the 256 entry CV_8U lookup table
+     * applyGammaTransformation applies with cv::LUT
+     */
+    static cv::Mat createGammaLookupTable(double gamma);
+
+    // Runs reconstructRow and the gamma lookup table tile by tile
+    friend class StreamingPipeline;
 };
 
 }
@@ -0,0 +1,146 @@
+/**
+ * @file volume.hpp
+ * @brief Batch segmentation of whole MRI stacks
+ * 
+ * Runs the streaming preprocessing pipeline and LTriDP SLIC on every slice
+ * of a study in parallel and collects the labels into one label volume.
+ * 
+ * @author Ketsia Mbaku
+ * 
+ * Reference:
+ *         Y. Wang, Q. Qi, and X. Shen, "Image Segmentation of Brain MRI Based on
+ *         LTriDP and Superpixels of Improved SLIC," Brain Sciences, vol. 10, no. 2,
+ *         p. 116, 2020.
+ */
+
+#ifndef VOLUME_HPP
+#define VOLUME_HPP
+
+#include "pipeline.hpp"
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+namespace ltridp_slic_improved {
+
+/**
+ * @struct VolumeSegmentation
+ * @brief Labels and statistics of a segmented stack
+ */
+struct VolumeSegmentation {
+    // Label volume, slices × rows × cols CV_16U (labels restart at 0 on every slice)
+    cv::Mat labels;
+    // Number of superpixels of each slice (0 for slices that failed)
+    std::vector<int> numSuperpixels;
+    // Source of each slice (file path, or empty for a 3D Mat)
+    std::vector<std::string> sources;
+    int slicesProcessed = 0;
+    int slicesFailed = 0;
+    // Wall-clock time of the whole batch
+    double seconds = 0.0;
+    double slicesPerSecond = 0.0;
+};
+
+/**
+ * @class VolumeSegmenter
+ * @brief Preprocesses and segments all slices of an MRI stack in parallel
+ * 
+ * Every worker thread keeps one workspace (pipeline and slice buffers) and
+ * takes the next unprocessed slice until none are left, so buffers are
+ * reused across slices and slow slices don't hold up a whole band. For
+ * directories each worker decodes its own slices, so decoding overlaps
+ * with the other workers' preprocessing and segmentation.
+ */
+class VolumeSegmenter {
+public:
+    /**
+     * @brief VolumeSegmenter instantiates a new VolumeSegmenter object
+     * 
+     * Parameters:
+     * @param regionSize Approximate superpixel size S
+     * @param ruler Compactness parameter m
+     * @param iterations Number of SLIC iterations per slice
+     * @param minElementSize Minimum superpixel size as percentage (enforceLabelConnectivity)
+     * @param gamma Gamma correction parameter
+     */
+    VolumeSegmenter(int regionSize = 20,
+                    float ruler = 10.0f,
+                    int iterations = 10,
+                    int minElementSize = 25,
+                    double gamma = 0.5);
+    
+    /**
+     * @brief Segments every image file in a directory (sorted by file name)
+     * 
+     * Parameters:
+     * @param directory Directory of slices, all with the size of the first readable one
+     * @param result Labels and statistics
+     * 
+     * Return value:
+     * @return true if at least one slice was segmented
+     * 
+     * Post-conditions:
+     * @post Files that can't be read, have another size or fail to segment count as failed slices
+     */
+    bool processDirectory(const std::string& directory, VolumeSegmentation& result);
+    
+    /**
+     * @brief Segments every slice of a 3D volume
+     * 
+     * Parameters:
+     * @param volume slices × rows × cols CV_8U volume
+     * @param result Labels and statistics
+     * 
+     * Return value:
+     * @return true if at least one slice was segmented
+     */
+    bool processVolume(const cv::Mat& volume, VolumeSegmentation& result);
+    
+    /**
+     * @brief Writes a label volume as raw binary
+     * 
+     * Writes the slice, row and column counts as 32-bit integers followed
+     * by the 16-bit labels in slice, row, column order.
+     * 
+     * Return value:
+     * @return true if the file was written
+     */
+    static bool writeLabelVolume(const std::string& path, const cv::Mat& labels);
+    
+private:
+    int m_regionSize;
+    float m_ruler;
+    int m_iterations;
+    int m_minElementSize;
+    double m_gamma;
+    
+    /**
+     * @brief Buffers a worker reuses from slice to slice
+     */
+    struct Workspace {
+        explicit Workspace(double gamma) : pipeline(gamma) {}
+        StreamingPipeline pipeline;
+        cv::Mat enhanced;
+        cv::Mat features;
+        cv::Mat labels;
+    };
+    
+    /**
+     * @brief Runs all slices through workers, getSlice loads slice i into a Mat
+     * (empty when it can't be loaded)
+     */
+    template <typename GetSlice>
+    void processSlices(int numSlices, GetSlice getSlice, VolumeSegmentation& result);
+    
+    /**
+     * @brief Preprocesses and segments one slice into its plane of the label volume
+     * 
+     * Return value:
+     * @return number of superpixels, or 0 if the slice failed
+     */
+    int segmentSlice(const cv::Mat& slice, Workspace& workspace, cv::Mat& labelPlane) const;
+};
+
+} // namespace ltridp_slic_improved
+
+#endif // VOLUME_HPP
@@ -0,0 +1,111 @@
+/**
+ * @file pipeline.cpp
+ * @brief Implementation of the tile-streaming preprocessing pipeline
+ *
+ * @author Ketsia Mbaku
+ * 
+ * Reference:
+ *         Y. Wang, Q. Qi, and X. Shen, "Image Segmentation of Brain MRI Based on
+ *         LTriDP and Superpixels of Improved SLIC," Brain Sciences, vol. 10, no. 2,
+ *         p. 116, 2020.
+ */
+
+#include "pipeline.hpp"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace ltridp_slic_improved {
+
+namespace {
+
+// Bytes of intermediate rows a tile aims for (about the size of an L2 cache)
+constexpr int kTileBytes = 256 * 1024;
+
+}  // namespace
+
+StreamingPipeline::StreamingPipeline(double gamma, int tileRows)
+    : m_gamma(gamma), m_tileRows(tileRows) {
+}
+
+bool StreamingPipeline::process(const cv::Mat& inputImage, cv::Mat& enhancedImage, cv::Mat& featureMap) {
+    // Input validation (same as enhance and extract)
+    if (inputImage.empty()) return false;
+    if (inputImage.depth() != CV_8U) return false;
+    if (inputImage.rows < 3 || inputImage.cols < 3) return false;
+    if (m_gamma <= 0.0 || std::isnan(m_gamma)) return false;
+    
+    // Convert to grayscale if image is in color
+    cv::Mat grayImage;
+    if (inputImage.channels() == 3) {
+        cv::cvtColor(inputImage, grayImage, cv::COLOR_BGR2GRAY);
+    } else {
+        grayImage = inputImage;
+    }
+    
+    const int rows = grayImage.rows;
+    const int cols = grayImage.cols;
+    
+    // A tile touches about 4 bytes per pixel (input, enhanced tile, enhanced and feature output)
+    const int tileRows = m_tileRows > 0 ? m_tileRows : std::max(8, kTileBytes / (cols * 4));
+    const int numTiles = (rows + tileRows - 1) / tileRows;
+    
+    const cv::Mat gammaTable = Preprocessor::createGammaLookupTable(m_gamma);
+    // Tiles still read the input after others wrote their rows, so never write over it
+    if (enhancedImage.data == grayImage.data) {
+        enhancedImage.release();
+    }
+    enhancedImage.create(rows, cols, CV_8U);
+    featureMap = cv::Mat::zeros(rows, cols, CV_8U);
+    
+    // Tiles recompute their halo rows instead of sharing them, so they run in parallel
+    cv::parallel_for_(cv::Range(0, numTiles), [&](const cv::Range& range) {
+        for (int tile = range.start; tile < range.end; ++tile) {
+            processTile(grayImage, gammaTable, tile * tileRows, std::min((tile + 1) * tileRows, rows),
+                        enhancedImage, featureMap);
+        }
+    });
+    
+    return true;
+}
+
+void StreamingPipeline::processTile(const cv::Mat& gray,
+                                    const cv::Mat& gammaTable,
+                                    int rowBegin,
+                                    int rowEnd,
+                                    cv::Mat& enhancedImage,
+                                    cv::Mat& featureMap) const {
+    const int rows = gray.rows;
+    const int cols = gray.cols;
+    
+    // Enhanced rows of the tile plus the rows right above and below it
+    const int haloBegin = std::max(rowBegin - 1, 0);
+    const int haloEnd = std::min(rowEnd + 1, rows);
+    cv::Mat enhancedTile(haloEnd - haloBegin, cols, CV_8U);
+    cv::Mat reconstructedRow(1, cols, CV_32F);
+    cv::Mat roundedRow(1, cols, CV_8U);
+    
+    // Same steps as enhance, a row at a time
+    for (int y = haloBegin; y < haloEnd; ++y) {
+        m_preprocessor.reconstructRow(gray, y, reconstructedRow.ptr<float>());
+        reconstructedRow.convertTo(roundedRow, CV_8U);
+        cv::Mat enhancedRow = enhancedTile.row(y - haloBegin);
+        cv::LUT(roundedRow, gammaTable, enhancedRow);
+    }
+    
+    for (int y = rowBegin; y < rowEnd; ++y) {
+        std::memcpy(enhancedImage.ptr<uchar>(y), enhancedTile.ptr<uchar>(y - haloBegin), cols);
+    }
+    
+    // Same codes as extract (the 1-pixel border stays 0)
+    for (int y = std::max(rowBegin, 1); y < std::min(rowEnd, rows - 1); ++y) {
+        m_featureExtractor.computeLTriDPRow(enhancedTile.ptr<uchar>(y - 1 - haloBegin),
+                                            enhancedTile.ptr<uchar>(y - haloBegin),
+                                            enhancedTile.ptr<uchar>(y + 1 - haloBegin),
+                                            featureMap.ptr<uchar>(y),
+                                            cols);
+    }
+}
+
+} // namespace ltridp_slic_improved
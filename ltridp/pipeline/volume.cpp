@@ -0,0 +1,157 @@
+/**
+ * @file volume.cpp
+ * @brief Implementation of batch MRI stack segmentation
+ *
+ * @author Ketsia Mbaku
+ * 
+ * Reference:
+ *         Y. Wang, Q. Qi, and X. Shen, "Image Segmentation of Brain MRI Based on
+ *         LTriDP and Superpixels of Improved SLIC," Brain Sciences, vol. 10, no. 2,
+ *         p. 116, 2020.
+ */
+
+#include "volume.hpp"
+#include "slic.hpp"
+#include <opencv2/imgcodecs.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+
+namespace fs = std::filesystem;
+
+namespace ltridp_slic_improved {
+
+VolumeSegmenter::VolumeSegmenter(int regionSize, float ruler, int iterations, int minElementSize, double gamma)
+    : m_regionSize(regionSize), m_ruler(ruler), m_iterations(iterations),
+      m_minElementSize(minElementSize), m_gamma(gamma) {
+}
+
+bool VolumeSegmenter::processDirectory(const std::string& directory, VolumeSegmentation& result) {
+    result = VolumeSegmentation();
+    if (!fs::is_directory(directory)) return false;
+    
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::directory_iterator(directory)) {
+        if (entry.is_regular_file()) {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    
+    // The first readable slice sets the size of the volume
+    cv::Mat first;
+    size_t firstIndex = 0;
+    while (firstIndex < files.size() && first.empty()) {
+        first = cv::imread(files[firstIndex].string(), cv::IMREAD_GRAYSCALE);
+        ++firstIndex;
+    }
+    if (first.empty()) return false;
+    
+    const int sizes[3] = {static_cast<int>(files.size()), first.rows, first.cols};
+    result.labels.create(3, sizes, CV_16U);
+    for (const auto& file : files) {
+        result.sources.push_back(file.string());
+    }
+    
+    --firstIndex;
+    processSlices(static_cast<int>(files.size()), [&](int i) {
+        if (static_cast<size_t>(i) == firstIndex) return first;
+        cv::Mat slice = cv::imread(files[i].string(), cv::IMREAD_GRAYSCALE);
+        return slice.size() == first.size() ? slice : cv::Mat();
+    }, result);
+    
+    return result.slicesProcessed > 0;
+}
+
+bool VolumeSegmenter::processVolume(const cv::Mat& volume, VolumeSegmentation& result) {
+    result = VolumeSegmentation();
+    if (volume.empty() || volume.dims != 3 || volume.type() != CV_8UC1) return false;
+    
+    const int numSlices = volume.size[0];
+    const int rows = volume.size[1];
+    const int cols = volume.size[2];
+    const int sizes[3] = {numSlices, rows, cols};
+    result.labels.create(3, sizes, CV_16U);
+    result.sources.assign(numSlices, std::string());
+    
+    processSlices(numSlices, [&](int i) {
+        // 2D header over the slice, no copy
+        return cv::Mat(rows, cols, CV_8U, const_cast<uchar*>(volume.ptr<uchar>(i)), volume.step[1]);
+    }, result);
+    
+    return result.slicesProcessed > 0;
+}
+
+template <typename GetSlice>
+void VolumeSegmenter::processSlices(int numSlices, GetSlice getSlice, VolumeSegmentation& result) {
+    const int rows = result.labels.size[1];
+    const int cols = result.labels.size[2];
+    result.numSuperpixels.assign(numSlices, 0);
+    
+    const int64 start = cv::getTickCount();
+    
+    // Workers pull slices off a shared counter, each with its own workspace
+    std::atomic<int> nextSlice(0);
+    const int numWorkers = std::max(1, std::min(cv::getNumThreads(), numSlices));
+    cv::parallel_for_(cv::Range(0, numWorkers), [&](const cv::Range& range) {
+        for (int worker = range.start; worker < range.end; ++worker) {
+            Workspace workspace(m_gamma);
+            for (int i = nextSlice++; i < numSlices; i = nextSlice++) {
+                cv::Mat labelPlane(rows, cols, CV_16U, result.labels.ptr<uint16_t>(i));
+                const cv::Mat slice = getSlice(i);
+                result.numSuperpixels[i] = slice.empty() ? 0 : segmentSlice(slice, workspace, labelPlane);
+                if (result.numSuperpixels[i] == 0) {
+                    labelPlane.setTo(0);
+                }
+            }
+        }
+    }, numWorkers);
+    
+    result.seconds = static_cast<double>(cv::getTickCount() - start) / cv::getTickFrequency();
+    for (int count : result.numSuperpixels) {
+        if (count > 0) {
+            ++result.slicesProcessed;
+        } else {
+            ++result.slicesFailed;
+        }
+    }
+    result.slicesPerSecond = result.seconds > 0.0 ? result.slicesProcessed / result.seconds : 0.0;
+}
+
+int VolumeSegmenter::segmentSlice(const cv::Mat& slice, Workspace& workspace, cv::Mat& labelPlane) const {
+    if (!workspace.pipeline.process(slice, workspace.enhanced, workspace.features)) return 0;
+    
+    try {
+        ltridp::LTriDPSuperpixelSLIC slic(workspace.enhanced, workspace.features, m_regionSize, m_ruler);
+        slic.iterate(m_iterations);
+        slic.enforceLabelConnectivity(m_minElementSize);
+        
+        // Labels are stored in 16 bits
+        const int numSuperpixels = slic.getNumberOfSuperpixels();
+        if (numSuperpixels <= 0 || numSuperpixels > std::numeric_limits<uint16_t>::max() + 1) return 0;
+        
+        slic.getLabels(workspace.labels);
+        workspace.labels.convertTo(labelPlane, CV_16U);
+        return numSuperpixels;
+    } catch (const std::exception&) {
+        return 0;
+    }
+}
+
+bool VolumeSegmenter::writeLabelVolume(const std::string& path, const cv::Mat& labels) {
+    if (labels.empty() || labels.dims != 3 || labels.type() != CV_16UC1 || !labels.isContinuous()) return false;
+    
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+    
+    const int32_t sizes[3] = {labels.size[0], labels.size[1], labels.size[2]};
+    file.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+    file.write(reinterpret_cast<const char*>(labels.data), static_cast<std::streamsize>(labels.total() * labels.elemSize()));
+    return static_cast<bool>(file);
+}
+
+} // namespace ltridp_slic_improved
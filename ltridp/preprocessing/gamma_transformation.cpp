@@ -21,6 +21,10 @@ using namespace cv;
 namespace ltridp_slic_improved {
 
 void Preprocessor::applyGammaTransformation(const Mat& input, Mat& output, double gamma) {
+    LUT(input, createGammaLookupTable(gamma), output);
+}
+
+Mat Preprocessor::createGammaLookupTable(double gamma) {
     /*
      * I'(x,y) = 255 * (I(x,y)/255)^γ 
      * with γ = 0.5.
@@ -33,7 +37,7 @@ void Preprocessor::applyGammaTransformation(const Mat& input, Mat& output, doubl
         lutPtr[intensity] = saturate_cast<uchar>(corrected * 255.0);
     }
 
-    LUT(input, lookupTable, output);
+    return lookupTable;
 }
 
 }  // namespace ltridp_slic_improved
@@ -12,10 +12,41 @@
 
 #include "preprocessing.hpp"
 #include <opencv2/imgproc.hpp>
+#include <algorithm>
 #include <cmath>
 
 namespace ltridp_slic_improved {
 
+namespace {
+
+/**
+ * @brief Sorts a and b so that a <= b (without branching)
+ */
+inline void sortPair(float& a, float& b) {
+    const float low = std::min(a, b);
+    b = std::max(a, b);
+    a = low;
+}
+
+/**
+ * @brief Median of 9 values using a 19 compare-exchange sorting network
+ * 
+ * Gives the same value as sorting all 9 and taking the middle one.
+ */
+inline float median9(float p0, float p1, float p2, float p3, float p4,
+                     float p5, float p6, float p7, float p8) {
+    sortPair(p1, p2); sortPair(p4, p5); sortPair(p7, p8);
+    sortPair(p0, p1); sortPair(p3, p4); sortPair(p6, p7);
+    sortPair(p1, p2); sortPair(p4, p5); sortPair(p7, p8);
+    sortPair(p0, p3); sortPair(p5, p8); sortPair(p4, p7);
+    sortPair(p3, p6); sortPair(p1, p4); sortPair(p2, p5);
+    sortPair(p4, p7); sortPair(p4, p2); sortPair(p6, p4);
+    sortPair(p4, p2);
+    return p4;
+}
+
+}  // namespace
+
 Preprocessor::RegionGroup Preprocessor::classifyRegionGroup(float grayValue,
                                                             float localMean,
                                                             float localMedian,
@@ -42,6 +73,87 @@ Preprocessor::RegionGroup Preprocessor::classifyRegionGroup(float grayValue,
     return RegionGroup::GROUP_0_1;  // all relatively close
 }
 
+void Preprocessor::reconstructRow(const cv::Mat& image, int y, float* out) const {
+    const int rows = image.rows;
+    const int cols = image.cols;
+    constexpr float kTieTolerance = 0.0f;  // can increase later to allow more ties
+    
+    // Corrects (f, g, h) by its region group and returns (f* + g* + h*)/3
+    auto reconstruct = [this](float f, float g, float h) {
+        float f_star = f;
+        float g_star = g;
+        float h_star = h;
+        
+        switch (classifyRegionGroup(f, g, h, kTieTolerance)) {
+            case RegionGroup::GROUP_0_1:
+                // no correction
+                break;
+            case RegionGroup::GROUP_2_3:
+                f_star = (g + h) / 2.0f;
+                break;
+            case RegionGroup::GROUP_4_5:
+                g_star = (f + h) / 2.0f;
+                break;
+            case RegionGroup::GROUP_6_7:
+                f_star = h;
+                g_star = h;
+                break;
+        }
+        
+        return (f_star + g_star + h_star) / 3.0f;
+    };
+    
+    // Pixels with part of their 3×3 neighborhood outside the image: mean and median of the
+    // pixels that are inside (median is the upper middle value when there's an even count)
+    auto reconstructBorder = [&](int y, int x) {
+        float neighborhood[9];
+        int count = 0;
+        float sum = 0.0f;
+        for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, rows - 1); ++ny) {
+            const uchar* row = image.ptr<uchar>(ny);
+            for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, cols - 1); ++nx) {
+                sum += row[nx];
+                // Insertion sort, at most 9 values
+                int i = count++;
+                while (i > 0 && neighborhood[i - 1] > row[nx]) {
+                    neighborhood[i] = neighborhood[i - 1];
+                    --i;
+                }
+                neighborhood[i] = row[nx];
+            }
+        }
+        const float g = sum / count;
+        const float h = neighborhood[count / 2];
+        return reconstruct(image.at<uchar>(y, x), g, h);
+    };
+    
+    if (y == 0 || y == rows - 1 || cols < 3) {
+        for (int x = 0; x < cols; ++x) {
+            out[x] = reconstructBorder(y, x);
+        }
+        return;
+    }
+    
+    const uchar* above = image.ptr<uchar>(y - 1);
+    const uchar* row = image.ptr<uchar>(y);
+    const uchar* below = image.ptr<uchar>(y + 1);
+    
+    out[0] = reconstructBorder(y, 0);
+    for (int x = 1; x < cols - 1; ++x) {
+        // Summed in the same order as the neighborhood is scanned, so the mean matches exactly
+        float sum = 0.0f;
+        sum += above[x - 1]; sum += above[x]; sum += above[x + 1];
+        sum += row[x - 1];   sum += row[x];   sum += row[x + 1];
+        sum += below[x - 1]; sum += below[x]; sum += below[x + 1];
+        const float g = sum / 9;
+        const float h = median9(above[x - 1], above[x], above[x + 1],
+                                row[x - 1], row[x], row[x + 1],
+                                below[x - 1], below[x], below[x + 1]);
+        out[x] = reconstruct(row[x], g, h);
+    }
+    out[cols - 1] = reconstructBorder(y, cols - 1);
+}
+
 void Preprocessor::apply3DHistogramReconstruction(const cv::Mat& input, cv::Mat& output) {
     /**
      * Algorithm:
@@ -63,77 +175,16 @@ void Preprocessor::apply3DHistogramReconstruction(const cv::Mat& input, cv::Mat&
         grayImage = input.clone();
     }
     
-    // Convert to float for precision
-    cv::Mat floatImage;
-    grayImage.convertTo(floatImage, CV_32F);
-    
-    cv::Mat reconstructed = cv::Mat::zeros(floatImage.size(), CV_32F);
-    
-    int rows = floatImage.rows;
-    int cols = floatImage.cols;
+    // Computed in float for precision (the 8-bit gray values convert to float exactly,
+    // so there's no need for a float copy of the image)
+    cv::Mat reconstructed(grayImage.size(), CV_32F);
     
-    // Process each pixel
-    for (int y = 0; y < rows; ++y) {
-        for (int x = 0; x < cols; ++x) {
-            float f = floatImage.at<float>(y, x);
-            
-            // Compute mean g(x,y) of 3×3 neighborhood
-            float sum = 0.0f;
-            int count = 0;
-            for (int dy = -1; dy <= 1; ++dy) {
-                for (int dx = -1; dx <= 1; ++dx) {
-                    int ny = y + dy;
-                    int nx = x + dx;
-                    if (ny >= 0 && ny < rows && nx >= 0 && nx < cols) {
-                        sum += floatImage.at<float>(ny, nx);
-                        count++;
-                    }
-                }
-            }
-            float g = sum / count;
-            
-            // Compute median h(x,y) of 3×3 neighborhood
-            std::vector<float> neighborhood;
-            for (int dy = -1; dy <= 1; ++dy) {
-                for (int dx = -1; dx <= 1; ++dx) {
-                    int ny = y + dy;
-                    int nx = x + dx;
-                    if (ny >= 0 && ny < rows && nx >= 0 && nx < cols) {
-                        neighborhood.push_back(floatImage.at<float>(ny, nx));
-                    }
-                }
-            }
-            std::sort(neighborhood.begin(), neighborhood.end());
-            float h = neighborhood[neighborhood.size() / 2];
-            
-            float f_star = f;
-            float g_star = g;
-            float h_star = h;
-
-            constexpr float kTieTolerance = 0.0f;  // can increase later to allow more ties
-            const RegionGroup group = classifyRegionGroup(f, g, h, kTieTolerance);
-
-            switch (group) {
-                case RegionGroup::GROUP_0_1:
-                    // no correction
-                    break;
-                case RegionGroup::GROUP_2_3:
-                    f_star = (g + h) / 2.0f;
-                    break;
-                case RegionGroup::GROUP_4_5:
-                    g_star = (f + h) / 2.0f;
-                    break;
-                case RegionGroup::GROUP_6_7:
-                    f_star = h;
-                    g_star = h;
-                    break;
-            }
-            
-            // Compute final reconstructed value
-            float reconstructedValue = (f_star + g_star + h_star) / 3.0f;
-            reconstructed.at<float>(y, x) = reconstructedValue;
+    // Rows only read the image and write their own output row, so bands can run in parallel
+    cv::parallel_for_(cv::Range(0, grayImage.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            reconstructRow(grayImage, y, reconstructed.ptr<float>(y));
         }
-    }
+    });
     
     // Convert back to original format
     if (input.channels() == 3) {
@@ -54,7 +54,9 @@
 
 #include "slic.hpp"
 #include <opencv2/imgproc.hpp>
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <stdexcept>
 
@@ -225,6 +227,200 @@ void LTriDPSuperpixelSLIC::iterate(int num_iterations)
     performLTriDPSLIC(num_iterations);
 }
 
+namespace {
+
+/**
+ * @brief Assigns the pixels of a band of rows to their nearest cluster center
+ *
+ * Runs through cv::parallel_for_ over image rows. Every band visits the cluster centers in the
+ * same order as a serial sweep would, so each pixel sees the exact same sequence of distance
+ * comparisons and the labels don't depend on how the rows were split up.
+ */
+struct LTriDPAssignInvoker : public cv::ParallelLoopBody {
+    LTriDPAssignInvoker(const cv::Mat& image, const cv::Mat& texture, cv::Mat& distvec, cv::Mat& klabels,
+                        const std::vector<float>& kseedsx, const std::vector<float>& kseedsy,
+                        const std::vector<float>& kseeds_gray, const std::vector<float>& kseeds_tex,
+                        int num_seeds, int region_size, float inv_gray_variance, float inv_texture_variance,
+                        float texture_weight, float feature_scale, float spatial_weight)
+        : image(image), texture(texture), distvec(distvec), klabels(klabels),
+          kseedsx(kseedsx), kseedsy(kseedsy), kseeds_gray(kseeds_gray), kseeds_tex(kseeds_tex),
+          num_seeds(num_seeds), region_size(region_size), inv_gray_variance(inv_gray_variance),
+          inv_texture_variance(inv_texture_variance), texture_weight(texture_weight),
+          feature_scale(feature_scale), spatial_weight(spatial_weight) {}
+
+    void operator()(const cv::Range& rows) const override {
+        const int width = image.cols;
+
+        for (int k = 0; k < num_seeds; ++k) {
+            // Define 2S × 2S search window around cluster center (clipped to this band)
+            int cy = static_cast<int>(kseedsy[k]);
+            int cx = static_cast<int>(kseedsx[k]);
+
+            int y1 = std::max(rows.start, cy - region_size);
+            int y2 = std::min(rows.end, cy + region_size);
+            int x1 = std::max(0, cx - region_size);
+            int x2 = std::min(width, cx + region_size);
+
+            // Get cluster center values
+            float center_gray = kseeds_gray[k];
+            float center_tex = kseeds_tex[k];
+            float center_x = kseedsx[k];
+            float center_y = kseedsy[k];
+
+            // Search neighborhood
+            for (int y = y1; y < y2; ++y) {
+                const uchar* image_row = image.ptr<uchar>(y);
+                const uchar* texture_row = texture.ptr<uchar>(y);
+                float* dist_row = distvec.ptr<float>(y);
+                int* label_row = klabels.ptr<int>(y);
+
+                for (int x = x1; x < x2; ++x) {
+                    // Get pixel values
+                    float pixel_gray = static_cast<float>(image_row[x]);
+                    float pixel_tex = static_cast<float>(texture_row[x]);
+
+                    // Gray distance component (normalized by global variance)
+                    float gray_diff = pixel_gray - center_gray;
+                    float dc = gray_diff * gray_diff * inv_gray_variance;
+
+                    // Texture distance component
+                    float texture_diff = pixel_tex - center_tex;
+                    float dt = texture_diff * texture_diff * inv_texture_variance;
+
+                    // Spatial distance component
+                    float dx_diff = static_cast<float>(x) - center_x;
+                    float dy_diff = static_cast<float>(y) - center_y;
+                    float ds = dx_diff * dx_diff + dy_diff * dy_diff;
+
+                    // Combined distance metric: follow Achanta-style weighting
+                    // where spatial term is scaled by (m / S)^2.
+                    float dist = feature_scale * (dc + texture_weight * dt) + spatial_weight * ds;
+
+                    // Assign to nearest cluster
+                    if (dist < dist_row[x]) {
+                        dist_row[x] = dist;
+                        label_row[x] = k;
+                    }
+                }
+            }
+        }
+    }
+
+    const cv::Mat& image;
+    const cv::Mat& texture;
+    cv::Mat& distvec;
+    cv::Mat& klabels;
+    const std::vector<float>& kseedsx;
+    const std::vector<float>& kseedsy;
+    const std::vector<float>& kseeds_gray;
+    const std::vector<float>& kseeds_tex;
+    int num_seeds;
+    int region_size;
+    float inv_gray_variance;
+    float inv_texture_variance;
+    float texture_weight;
+    float feature_scale;
+    float spatial_weight;
+};
+
+/**
+ * @brief Per-cluster sums of the pixels that pass the gray threshold in a stripe of rows
+ *
+ * Coordinates, gray and texture values are all integers, so they're summed in 64 bits: the
+ * sums are exact whatever the cluster size, and the same for any number of stripes.
+ *
+ * This is not the original serial float accumulation. Once a cluster's float sums passed 2^24
+ * they rounded, so on large clusters (or large coordinates) the centers, and the labels after
+ * them, can differ from the original implementation even on one thread. Runs are only
+ * bit-identical to the serial run of this code, not to that baseline.
+ */
+struct LTriDPCenterSums {
+    std::vector<int64_t> sigma_x;
+    std::vector<int64_t> sigma_y;
+    std::vector<int64_t> sigma_gray;
+    std::vector<int64_t> sigma_tex;
+    std::vector<int> cluster_size;
+
+    explicit LTriDPCenterSums(int num_labels)
+        : sigma_x(num_labels, 0), sigma_y(num_labels, 0), sigma_gray(num_labels, 0),
+          sigma_tex(num_labels, 0), cluster_size(num_labels, 0) {}
+
+    void join(const LTriDPCenterSums& other) {
+        for (size_t k = 0; k < cluster_size.size(); ++k) {
+            sigma_x[k] += other.sigma_x[k];
+            sigma_y[k] += other.sigma_y[k];
+            sigma_gray[k] += other.sigma_gray[k];
+            sigma_tex[k] += other.sigma_tex[k];
+            cluster_size[k] += other.cluster_size[k];
+        }
+    }
+};
+
+/**
+ * @brief Accumulates the gray-threshold filtered cluster sums of each stripe of rows
+ *
+ * Stripe s covers rows [height * s / n, height * (s + 1) / n) and accumulates into its own
+ * LTriDPCenterSums, which are joined afterwards. The sums being exact, the centers don't
+ * depend on the number of stripes (or threads).
+ */
+struct LTriDPCenterSumsInvoker : public cv::ParallelLoopBody {
+    LTriDPCenterSumsInvoker(const cv::Mat& image, const cv::Mat& texture, const cv::Mat& klabels,
+                            const std::vector<float>& kseeds_gray, float gray_threshold,
+                            std::vector<LTriDPCenterSums>& stripe_sums)
+        : image(image), texture(texture), klabels(klabels), kseeds_gray(kseeds_gray),
+          gray_threshold(gray_threshold), stripe_sums(stripe_sums) {}
+
+    void operator()(const cv::Range& stripes) const override {
+        const int height = klabels.rows;
+        const int width = klabels.cols;
+        const int num_stripes = static_cast<int>(stripe_sums.size());
+
+        for (int s = stripes.start; s < stripes.end; ++s) {
+            LTriDPCenterSums& sums = stripe_sums[s];
+            int y_begin = static_cast<int>(static_cast<int64_t>(height) * s / num_stripes);
+            int y_end = static_cast<int>(static_cast<int64_t>(height) * (s + 1) / num_stripes);
+
+            for (int y = y_begin; y < y_end; ++y) {
+                const int* label_row = klabels.ptr<int>(y);
+                const uchar* image_row = image.ptr<uchar>(y);
+                const uchar* texture_row = texture.ptr<uchar>(y);
+
+                for (int x = 0; x < width; ++x) {
+                    int label = label_row[x];
+
+                    // Get pixel gray value
+                    float pixel_gray = static_cast<float>(image_row[x]);
+
+                    // Get cluster center gray value
+                    float center_gray = kseeds_gray[label];
+
+                    // Key modification: Only include pixels within gray threshold
+                    // |gray_center - gray_pixel| < α
+                    float gray_diff = std::abs(center_gray - pixel_gray);
+
+                    if (gray_diff < gray_threshold) {
+                        // Pixel passes threshold - include in center update
+                        sums.sigma_x[label] += x;
+                        sums.sigma_y[label] += y;
+                        sums.sigma_gray[label] += image_row[x];
+                        sums.sigma_tex[label] += texture_row[x];
+                        sums.cluster_size[label]++;
+                    }
+                }
+            }
+        }
+    }
+
+    const cv::Mat& image;
+    const cv::Mat& texture;
+    const cv::Mat& klabels;
+    const std::vector<float>& kseeds_gray;
+    float gray_threshold;
+    std::vector<LTriDPCenterSums>& stripe_sums;
+};
+
+} // namespace
+
 void LTriDPSuperpixelSLIC::performLTriDPSLIC(int num_iterations)
 {
     // Distance tracking matrix
@@ -260,54 +456,12 @@ void LTriDPSuperpixelSLIC::performLTriDPSLIC(int num_iterations)
         distvec.setTo(std::numeric_limits<float>::max());
         
         // Step 1: Assign pixels to nearest cluster center
-        for (int k = 0; k < m_numlabels; ++k) {
-            // Define 2S × 2S search window around cluster center
-            int cy = static_cast<int>(m_kseedsy[k]);
-            int cx = static_cast<int>(m_kseedsx[k]);
-            
-            int y1 = std::max(0, cy - m_region_size);
-            int y2 = std::min(m_height, cy + m_region_size);
-            int x1 = std::max(0, cx - m_region_size);
-            int x2 = std::min(m_width, cx + m_region_size);
-            
-            // Get cluster center values
-            float center_gray = m_kseeds_gray[k];
-            float center_tex = m_kseeds_tex[k];
-            float center_x = m_kseedsx[k];
-            float center_y = m_kseedsy[k];
-            
-            // Search neighborhood
-            for (int y = y1; y < y2; ++y) {
-                for (int x = x1; x < x2; ++x) {
-                    // Get pixel values
-                    float pixel_gray = static_cast<float>(m_image.at<uchar>(y, x));
-                    float pixel_tex = static_cast<float>(m_texture.at<uchar>(y, x));  // ADDED: texture pixel value
-                    
-                    // Gray distance component (normalized by global variance)
-                    float gray_diff = pixel_gray - center_gray;
-                    float dc = gray_diff * gray_diff * inv_gray_variance;
-                    
-                    // Texture distance component
-                    float texture_diff = pixel_tex - center_tex;
-                    float dt = texture_diff * texture_diff * inv_texture_variance;
-                    
-                    // Spatial distance component
-                    float dx_diff = static_cast<float>(x) - center_x;
-                    float dy_diff = static_cast<float>(y) - center_y;
-                    float ds = dx_diff * dx_diff + dy_diff * dy_diff;
-                    
-                    // Combined distance metric: follow Achanta-style weighting
-                    // where spatial term is scaled by (m / S)^2.
-                    float dist = feature_scale * (dc + texture_weight * dt) + spatial_weight * ds;
-                    
-                    // Assign to nearest cluster
-                    if (dist < distvec.at<float>(y, x)) {
-                        distvec.at<float>(y, x) = dist;
-                        m_klabels.at<int>(y, x) = k;
-                    }
-                }
-            }
-        }
+        // Bands of rows are assigned in parallel, each one against every cluster center's window
+        LTriDPAssignInvoker assign(m_image, m_texture, distvec, m_klabels,
+                                   m_kseedsx, m_kseedsy, m_kseeds_gray, m_kseeds_tex,
+                                   m_numlabels, m_region_size, inv_gray_variance, inv_texture_variance,
+                                   texture_weight, feature_scale, spatial_weight);
+        cv::parallel_for_(cv::Range(0, m_height), assign, cv::getNumThreads() * 4);
         
         // Step 2: Update cluster centers with gray-threshold filtering
         updateCenters();
@@ -319,50 +473,34 @@ void LTriDPSuperpixelSLIC::updateCenters()
     // Calculate gray threshold α (standard deviation of image)
     const float gray_threshold = calculateGrayThreshold();
     
-    // Accumulation arrays for each cluster
-    std::vector<float> sigma_x(m_numlabels, 0.0f);
-    std::vector<float> sigma_y(m_numlabels, 0.0f);
-    std::vector<float> sigma_gray(m_numlabels, 0.0f);
-    std::vector<float> sigma_tex(m_numlabels, 0.0f);                        // ADDED: texture accumulator
-    std::vector<int> cluster_size(m_numlabels, 0);
-    
     // Accumulate pixel values with gray-threshold filtering                // MODIFIED: gray filtering
     // (Paper modification #2)                                              // MODIFIED: new filtering logic
-    for (int y = 0; y < m_height; ++y) {
-        for (int x = 0; x < m_width; ++x) {
-            int label = m_klabels.at<int>(y, x);
-            
-            // Get pixel gray value
-            float pixel_gray = static_cast<float>(m_image.at<uchar>(y, x));
-            
-            // Get cluster center gray value
-            float center_gray = m_kseeds_gray[label];
-            
-
-            // Key modification: Only include pixels within gray threshold  // MODIFIED: conditional inclusion
-            // |gray_center - gray_pixel| < α                               // MODIFIED: threshold comparison
-            float gray_diff = std::abs(center_gray - pixel_gray);           // ADDED: compute gray difference
-            
-            if (gray_diff < gray_threshold) {                               // ADDED: threshold filter
-                // Pixel passes threshold - include in center update
-                sigma_x[label] += static_cast<float>(x);
-                sigma_y[label] += static_cast<float>(y);
-                sigma_gray[label] += pixel_gray;
-                sigma_tex[label] += static_cast<float>(m_texture.at<uchar>(y, x));  // ADDED: accumulate texture
-                cluster_size[label]++;
-            }
-        }
+    // Each stripe of rows is accumulated in parallel, then the stripes are joined in order
+    const int num_stripes = std::max(1, std::min(cv::getNumThreads(), m_height));
+    std::vector<LTriDPCenterSums> stripe_sums(num_stripes, LTriDPCenterSums(m_numlabels));
+    cv::parallel_for_(cv::Range(0, num_stripes),
+                      LTriDPCenterSumsInvoker(m_image, m_texture, m_klabels, m_kseeds_gray,
+                                              gray_threshold, stripe_sums));
+    for (int s = 1; s < num_stripes; ++s) {
+        stripe_sums[0].join(stripe_sums[s]);
     }
+
+    // Accumulation arrays for each cluster
+    const std::vector<int64_t>& sigma_x = stripe_sums[0].sigma_x;
+    const std::vector<int64_t>& sigma_y = stripe_sums[0].sigma_y;
+    const std::vector<int64_t>& sigma_gray = stripe_sums[0].sigma_gray;
+    const std::vector<int64_t>& sigma_tex = stripe_sums[0].sigma_tex;     // ADDED: texture accumulator
+    const std::vector<int>& cluster_size = stripe_sums[0].cluster_size;
     
     // Compute new cluster centers from filtered pixels
     for (int k = 0; k < m_numlabels; ++k) {
         if (cluster_size[k] > 0) {
             // Average filtered pixels to get new center
-            float count = static_cast<float>(cluster_size[k]);
-            m_kseedsx[k] = sigma_x[k] / count;
-            m_kseedsy[k] = sigma_y[k] / count;
-            m_kseeds_gray[k] = sigma_gray[k] / count;
-            m_kseeds_tex[k] = sigma_tex[k] / count;                      // ADDED: update texture center
+            double count = static_cast<double>(cluster_size[k]);
+            m_kseedsx[k] = static_cast<float>(sigma_x[k] / count);
+            m_kseedsy[k] = static_cast<float>(sigma_y[k] / count);
+            m_kseeds_gray[k] = static_cast<float>(sigma_gray[k] / count);
+            m_kseeds_tex[k] = static_cast<float>(sigma_tex[k] / count);  // ADDED: update texture center
         }
     }
 }
@@ -25,6 +25,7 @@
 
 #include "preprocessing.hpp"
 #include "feature_extraction.hpp"
+#include "pipeline.hpp"
 #include "slic.hpp"
 #include "../../evaluation/evaluator.hpp"
 #include <opencv2/core.hpp>
@@ -111,15 +112,11 @@ bool processImage(const fs::path& input_path, const fs::path& output_dir, std::v
     
     std::cout << "✓ Loaded image: " << original.cols << "×" << original.rows << " pixels\n";
     
-    std::cout << "\nStep 1: Preprocessing...\n";
-    ltridp_slic_improved::Preprocessor preprocessor;
+    std::cout << "\nStep 1-3: Preprocessing + Feature Extraction (LTriDP), streamed over tiles...\n";
+    ltridp_slic_improved::StreamingPipeline pipeline(0.5);
     cv::Mat enhanced;
-    preprocessor.enhance(original, enhanced, 0.5f);
-    std::cout << "  ✓ Complete\n";
-    std::cout << "\nStep 3: Feature Extraction (LTriDP)...\n";
-    ltridp_slic_improved::FeatureExtractor feature_extractor;
     cv::Mat features;
-    feature_extractor.extract(enhanced, features);
+    pipeline.process(original, enhanced, features);
     std::cout << "  ✓ Complete\n";
     
     std::cout << "\nStep 4: Superpixel Segmentation (LTriDP SLIC)...\n";
@@ -0,0 +1,109 @@
+/**
+ * @file test_evaluator.cpp
+ * @brief Checks SuperpixelEvaluator::evaluateAll against the four separate metric methods
+ *
+ * The label maps are fixed synthetic ones: wavy blocks of superpixels over
+ * ground truth blocks with a disc on top, and an intensity image whose
+ * edges follow the ground truth.
+ */
+
+#include <gtest/gtest.h>
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#include "evaluator.hpp"
+
+namespace {
+
+constexpr double kTolerance = 1e-9;
+
+struct Segmentation {
+    cv::Mat superpixels;
+    cv::Mat groundTruth;
+    cv::Mat intensity;
+};
+
+// Superpixels are blockSize blocks with wavy borders, ground truth regions are regionSize blocks
+Segmentation makeSegmentation(int rows, int cols, int blockSize, int regionSize) {
+    Segmentation segmentation;
+    segmentation.superpixels.create(rows, cols, CV_32S);
+    segmentation.groundTruth.create(rows, cols, CV_32S);
+    const int blocksPerRow = (cols + blockSize) / blockSize + 1;
+    const int regionsPerRow = (cols + regionSize - 1) / regionSize;
+    for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < cols; ++x) {
+            const int wavyX = x + static_cast<int>(2.0 * std::sin(y * 0.3));
+            const int wavyY = y + static_cast<int>(2.0 * std::cos(x * 0.2));
+            segmentation.superpixels.at<int>(y, x) =
+                (std::max(wavyY, 0) / blockSize) * blocksPerRow + std::max(wavyX, 0) / blockSize;
+            segmentation.groundTruth.at<int>(y, x) = (y / regionSize) * regionsPerRow + x / regionSize;
+        }
+    }
+    const int disc = regionsPerRow * ((rows + regionSize - 1) / regionSize);
+    cv::circle(segmentation.groundTruth, cv::Point(cols / 2, rows / 2), std::min(rows, cols) / 4,
+               cv::Scalar(disc), cv::FILLED);
+
+    // Gray level of each ground truth region, plus a little noise
+    segmentation.intensity.create(rows, cols, CV_8UC1);
+    cv::RNG rng(34);
+    for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < cols; ++x) {
+            const int region = segmentation.groundTruth.at<int>(y, x);
+            segmentation.intensity.at<uchar>(y, x) =
+                cv::saturate_cast<uchar>(region * 53 % 200 + rng.uniform(0, 8));
+        }
+    }
+    return segmentation;
+}
+
+void expectMatchesSeparateMetrics(const Segmentation& s, double overlapFractionThreshold,
+                                  int boundaryTolerance, int edgeTolerance) {
+    const SuperpixelMetrics metrics = SuperpixelEvaluator::evaluateAll(
+        s.superpixels, s.groundTruth, s.intensity,
+        overlapFractionThreshold, boundaryTolerance, edgeTolerance);
+
+    ASSERT_TRUE(metrics.hasGroundTruth);
+    ASSERT_TRUE(metrics.hasIntensity);
+    EXPECT_NEAR(metrics.averageCompactness,
+                SuperpixelEvaluator::computeAverageCompactness(s.superpixels), kTolerance);
+    EXPECT_NEAR(metrics.underSegmentationError,
+                SuperpixelEvaluator::computeUnderSegmentationError(s.superpixels, s.groundTruth,
+                                                                   overlapFractionThreshold), kTolerance);
+    EXPECT_NEAR(metrics.boundaryRecall,
+                SuperpixelEvaluator::computeBoundaryRecall(s.superpixels, s.groundTruth,
+                                                           boundaryTolerance), kTolerance);
+    EXPECT_NEAR(metrics.edgeAlignmentScore,
+                SuperpixelEvaluator::computeEdgeAlignmentScore(s.superpixels, s.intensity,
+                                                               edgeTolerance), kTolerance);
+}
+
+}  // namespace
+
+//=============================================================================
+// Equivalence Tests
+//=============================================================================
+
+TEST(EvaluatorTest, EvaluateAllMatchesSeparateMetrics) {
+    const Segmentation segmentation = makeSegmentation(150, 200, 12, 40);
+    expectMatchesSeparateMetrics(segmentation, 0.05, 2, 2);
+    expectMatchesSeparateMetrics(segmentation, 0.2, 0, 3);
+}
+
+TEST(EvaluatorTest, EvaluateAllMatchesSeparateMetricsWithSparseOverlapTable) {
+    // 3x3 superpixels and 30x30 regions on 240x240 give more than 2^18 overlap cells
+    const Segmentation segmentation = makeSegmentation(240, 240, 3, 30);
+    expectMatchesSeparateMetrics(segmentation, 0.05, 2, 2);
+}
+
+TEST(EvaluatorTest, EvaluateAllSkipsMissingInputs) {
+    const Segmentation segmentation = makeSegmentation(150, 200, 12, 40);
+    const SuperpixelMetrics metrics =
+        SuperpixelEvaluator::evaluateAll(segmentation.superpixels, cv::Mat(), cv::Mat());
+
+    EXPECT_FALSE(metrics.hasGroundTruth);
+    EXPECT_FALSE(metrics.hasIntensity);
+    EXPECT_NEAR(metrics.averageCompactness,
+                SuperpixelEvaluator::computeAverageCompactness(segmentation.superpixels), kTolerance);
+    EXPECT_EQ(metrics.underSegmentationError, 0.0);
+    EXPECT_EQ(metrics.boundaryRecall, 0.0);
+    EXPECT_EQ(metrics.edgeAlignmentScore, 0.0);
+}
@@ -0,0 +1,89 @@
+/**
+ * @file test_feature_extraction.cpp
+ * @brief Checks the 8-bit LTriDP row kernel against the magnitude definition
+ *
+ * The reference below computes every code as the paper defines it: bit i is
+ * set when M1 = sqrt((g(i-1) - gc)² + (g(i+1) - gc)²) is at least
+ * M2 = sqrt((g(i-1) - gi)² + (g(i+1) - gi)²), in float.
+ */
+
+#include <gtest/gtest.h>
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#include "feature_extraction.hpp"
+
+using namespace ltridp_slic_improved;
+
+namespace {
+
+cv::Mat referenceCodes(const cv::Mat& gray) {
+    cv::Mat codes = cv::Mat::zeros(gray.size(), CV_8U);
+    for (int row = 1; row < gray.rows - 1; ++row) {
+        for (int col = 1; col < gray.cols - 1; ++col) {
+            const float gc = gray.at<uchar>(row, col);
+            // g1..g8 clockwise from right
+            const float g[8] = {
+                static_cast<float>(gray.at<uchar>(row, col + 1)),
+                static_cast<float>(gray.at<uchar>(row + 1, col + 1)),
+                static_cast<float>(gray.at<uchar>(row + 1, col)),
+                static_cast<float>(gray.at<uchar>(row + 1, col - 1)),
+                static_cast<float>(gray.at<uchar>(row, col - 1)),
+                static_cast<float>(gray.at<uchar>(row - 1, col - 1)),
+                static_cast<float>(gray.at<uchar>(row - 1, col)),
+                static_cast<float>(gray.at<uchar>(row - 1, col + 1))
+            };
+
+            unsigned char code = 0;
+            for (int i = 0; i < 8; ++i) {
+                const float previous = g[(i + 7) % 8];
+                const float next = g[(i + 1) % 8];
+                const float M1 = std::sqrt((previous - gc) * (previous - gc) + (next - gc) * (next - gc));
+                const float M2 = std::sqrt((previous - g[i]) * (previous - g[i]) + (next - g[i]) * (next - g[i]));
+                if (M1 >= M2) {
+                    code |= (1 << i);
+                }
+            }
+            codes.at<uchar>(row, col) = code;
+        }
+    }
+    return codes;
+}
+
+void expectMatchesReference(const cv::Mat& image) {
+    FeatureExtractor extractor;
+    cv::Mat featureMap;
+    ASSERT_TRUE(extractor.extract(image, featureMap));
+    const cv::Mat expected = referenceCodes(image);
+    ASSERT_EQ(featureMap.size(), expected.size());
+    EXPECT_EQ(cv::countNonZero(featureMap != expected), 0);
+}
+
+}  // namespace
+
+//=============================================================================
+// Equivalence Tests
+//=============================================================================
+
+TEST(FeatureExtractionTest, MatchesReferenceOnRandomImage) {
+    cv::Mat image(120, 157, CV_8UC1);
+    cv::RNG rng(2020);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+    expectMatchesReference(image);
+}
+
+TEST(FeatureExtractionTest, MatchesReferenceWithTies) {
+    // Only 3 gray levels, so most neighborhoods have equal magnitudes or zero gradients
+    cv::Mat image(120, 157, CV_8UC1);
+    cv::RNG rng(7);
+    rng.fill(image, cv::RNG::UNIFORM, 100, 103);
+    expectMatchesReference(image);
+}
+
+TEST(FeatureExtractionTest, MatchesReferenceAtExtremes) {
+    // Only black and white, the largest differences the int kernel sees
+    cv::Mat image(64, 64, CV_8UC1);
+    cv::RNG rng(11);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 2);
+    image.convertTo(image, CV_8U, 255.0);
+    expectMatchesReference(image);
+}
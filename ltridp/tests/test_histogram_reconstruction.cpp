@@ -0,0 +1,112 @@
+/**
+ * @file test_histogram_reconstruction.cpp
+ * @brief Checks the banded 3D histogram reconstruction against the plain per-pixel loop
+ *
+ * The reference below is the straightforward implementation (vector of the 3×3
+ * neighborhood, std::sort for the median). Preprocessor::enhance with gamma 1
+ * leaves the reconstruction untouched, so both must give the same image.
+ */
+
+#include <gtest/gtest.h>
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "preprocessing.hpp"
+
+using namespace ltridp_slic_improved;
+
+namespace {
+
+float referenceCorrection(float f, float g, float h) {
+    const float distanceFG = std::abs(f - g);
+    const float distanceFH = std::abs(f - h);
+    const float distanceGH = std::abs(g - h);
+
+    float f_star = f;
+    float g_star = g;
+    if (distanceFG > distanceGH && distanceFH > distanceGH) {
+        f_star = (g + h) / 2.0f;
+    } else if (distanceFG > distanceFH && distanceGH > distanceFH) {
+        g_star = (f + h) / 2.0f;
+    } else if (distanceFH > distanceFG && distanceGH > distanceFG) {
+        f_star = h;
+        g_star = h;
+    }
+    return (f_star + g_star + h) / 3.0f;
+}
+
+cv::Mat referenceReconstruction(const cv::Mat& gray) {
+    cv::Mat floatImage;
+    gray.convertTo(floatImage, CV_32F);
+    cv::Mat reconstructed(gray.size(), CV_32F);
+
+    const int rows = floatImage.rows;
+    const int cols = floatImage.cols;
+    for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < cols; ++x) {
+            float sum = 0.0f;
+            std::vector<float> neighborhood;
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    const int ny = y + dy;
+                    const int nx = x + dx;
+                    if (ny >= 0 && ny < rows && nx >= 0 && nx < cols) {
+                        sum += floatImage.at<float>(ny, nx);
+                        neighborhood.push_back(floatImage.at<float>(ny, nx));
+                    }
+                }
+            }
+            const float g = sum / neighborhood.size();
+            std::sort(neighborhood.begin(), neighborhood.end());
+            const float h = neighborhood[neighborhood.size() / 2];
+            reconstructed.at<float>(y, x) = referenceCorrection(floatImage.at<float>(y, x), g, h);
+        }
+    }
+
+    cv::Mat output;
+    reconstructed.convertTo(output, CV_8U);
+    return output;
+}
+
+// Noisy blocks (few distinct values, so plenty of ties) on top of random pixels
+cv::Mat makeImage(int rows, int cols) {
+    cv::Mat image(rows, cols, CV_8UC1);
+    cv::RNG rng(2020);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+    for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < cols; ++x) {
+            if (((x / 16) + (y / 16)) % 2 == 0) {
+                image.at<uchar>(y, x) = static_cast<uchar>(100 + rng.uniform(0, 3));
+            }
+        }
+    }
+    return image;
+}
+
+void expectMatchesReference(const cv::Mat& image) {
+    Preprocessor preprocessor;
+    cv::Mat output;
+    ASSERT_TRUE(preprocessor.enhance(image, output, 1.0));
+    const cv::Mat expected = referenceReconstruction(image);
+    ASSERT_EQ(output.size(), expected.size());
+    EXPECT_EQ(cv::countNonZero(output != expected), 0)
+        << image.rows << "x" << image.cols << " image";
+}
+
+}  // namespace
+
+//=============================================================================
+// Equivalence Tests
+//=============================================================================
+
+TEST(HistogramReconstructionTest, MatchesReferenceLoop) {
+    expectMatchesReference(makeImage(97, 131));
+}
+
+TEST(HistogramReconstructionTest, MatchesReferenceLoopOnThinImages) {
+    expectMatchesReference(makeImage(1, 40));
+    expectMatchesReference(makeImage(40, 1));
+    expectMatchesReference(makeImage(2, 2));
+    expectMatchesReference(makeImage(3, 3));
+}
@@ -0,0 +1,101 @@
+/**
+ * @file test_pipeline.cpp
+ * @brief Checks StreamingPipeline against Preprocessor::enhance followed by FeatureExtractor::extract
+ *
+ * The input is a fixed synthetic volume: slices of a bright ellipse on a dark
+ * background with noise, growing from slice to slice like a head in an MRI
+ * stack. Every tile height from a single row up is compared, so rows at tile
+ * seams (which the pipeline recomputes as halo rows) are covered.
+ */
+
+#include <gtest/gtest.h>
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "pipeline.hpp"
+
+using namespace ltridp_slic_improved;
+
+namespace {
+
+constexpr int kSlices = 5;
+
+std::vector<cv::Mat> makeVolume(int rows, int cols) {
+    std::vector<cv::Mat> slices;
+    cv::RNG rng(13);
+    for (int slice = 0; slice < kSlices; ++slice) {
+        cv::Mat image(rows, cols, CV_8UC1, cv::Scalar(20));
+        const cv::Size axes(cols / 4 + slice * 3, rows / 3 + slice * 2);
+        cv::ellipse(image, cv::Point(cols / 2, rows / 2), axes, 0.0, 0.0, 360.0, cv::Scalar(170), cv::FILLED);
+        cv::circle(image, cv::Point(cols / 2 + slice, rows / 2), rows / 8, cv::Scalar(90), cv::FILLED);
+        cv::Mat noise(rows, cols, CV_8UC1);
+        rng.fill(noise, cv::RNG::UNIFORM, 0, 30);
+        slices.push_back(image + noise);
+    }
+    return slices;
+}
+
+// enhance followed by extract, the two passes the pipeline streams over tiles
+void referenceOutputs(const cv::Mat& gray, double gamma, cv::Mat& enhanced, cv::Mat& features) {
+    Preprocessor preprocessor;
+    FeatureExtractor extractor;
+    ASSERT_TRUE(preprocessor.enhance(gray, enhanced, gamma));
+    ASSERT_TRUE(extractor.extract(enhanced, features));
+}
+
+void expectMatchesReference(const cv::Mat& input, const cv::Mat& gray, double gamma, int tileRows) {
+    cv::Mat expectedEnhanced, expectedFeatures;
+    referenceOutputs(gray, gamma, expectedEnhanced, expectedFeatures);
+
+    StreamingPipeline pipeline(gamma, tileRows);
+    cv::Mat enhanced, features;
+    ASSERT_TRUE(pipeline.process(input, enhanced, features));
+    ASSERT_EQ(enhanced.size(), expectedEnhanced.size());
+    ASSERT_EQ(features.size(), expectedFeatures.size());
+    EXPECT_EQ(cv::countNonZero(enhanced != expectedEnhanced), 0) << "tile rows " << tileRows;
+    EXPECT_EQ(cv::countNonZero(features != expectedFeatures), 0) << "tile rows " << tileRows;
+}
+
+}  // namespace
+
+//=============================================================================
+// Equivalence Tests
+//=============================================================================
+
+TEST(StreamingPipelineTest, MatchesEnhanceThenExtractOnVolume) {
+    const std::vector<cv::Mat> volume = makeVolume(61, 83);
+    for (const cv::Mat& slice : volume) {
+        for (int tileRows : {1, 2, 3, 7, 0}) {
+            expectMatchesReference(slice, slice, 0.5, tileRows);
+        }
+    }
+}
+
+TEST(StreamingPipelineTest, MatchesEnhanceThenExtractWithOtherGamma) {
+    const std::vector<cv::Mat> volume = makeVolume(61, 83);
+    expectMatchesReference(volume[2], volume[2], 1.0, 4);
+    expectMatchesReference(volume[2], volume[2], 2.2, 4);
+}
+
+TEST(StreamingPipelineTest, MatchesEnhanceThenExtractOnColorInput) {
+    const std::vector<cv::Mat> volume = makeVolume(61, 83);
+    cv::Mat color;
+    cv::merge(std::vector<cv::Mat>{volume[0], volume[1], volume[2]}, color);
+    cv::Mat gray;
+    cv::cvtColor(color, gray, cv::COLOR_BGR2GRAY);
+    expectMatchesReference(color, gray, 0.5, 5);
+}
+
+TEST(StreamingPipelineTest, MatchesEnhanceThenExtractOnSmallestImage) {
+    cv::Mat image(3, 3, CV_8UC1);
+    cv::RNG rng(3);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+    expectMatchesReference(image, image, 0.5, 1);
+}
+
+TEST(StreamingPipelineTest, RejectsInvalidInput) {
+    StreamingPipeline pipeline;
+    cv::Mat enhanced, features;
+    EXPECT_FALSE(pipeline.process(cv::Mat(), enhanced, features));
+    EXPECT_FALSE(pipeline.process(cv::Mat(2, 10, CV_8UC1, cv::Scalar(0)), enhanced, features));
+    EXPECT_FALSE(pipeline.process(cv::Mat(10, 10, CV_32FC1, cv::Scalar(0)), enhanced, features));
+}
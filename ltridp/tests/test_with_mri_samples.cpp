@@ -19,6 +19,7 @@
 #include <filesystem>
 #include <vector>
 #include "preprocessing.hpp"
+#include "volume.hpp"
 
 namespace fs = std::filesystem;
 using namespace ltridp_slic_improved;
@@ -104,5 +105,26 @@ int main(int argc, char** argv) {
         std::cout << "  Failed: " << failCount << " images" << std::endl;
     }
     std::cout << "  Output directory: " << outputDir << std::endl;    
+    
+    // Segment the whole stack at once with the batch API
+    std::cout << std::endl << "Segmenting stack (batch volume mode)..." << std::endl;
+    VolumeSegmenter segmenter;
+    VolumeSegmentation volume;
+    if (segmenter.processDirectory(inputDir, volume)) {
+        std::cout << "  Segmented: " << volume.slicesProcessed << " slices";
+        if (volume.slicesFailed > 0) {
+            std::cout << " (" << volume.slicesFailed << " failed)";
+        }
+        std::cout << " in " << volume.seconds << " s, "
+                  << volume.slicesPerSecond << " slices/second" << std::endl;
+        
+        std::string volumePath = outputDir + "/labels.vol";
+        if (VolumeSegmenter::writeLabelVolume(volumePath, volume.labels)) {
+            std::cout << "  Label volume: " << volumePath << std::endl;
+        }
+    } else {
+        std::cerr << "  Error: Batch segmentation failed" << std::endl;
+    }
+    
     return (failCount > 0) ? 1 : 0;
 }